@@ -22,6 +22,9 @@
 #include <net/cloud.h>
 #include <net/socket.h>
 #include <net/nrf_cloud.h>
+#if defined(CONFIG_CLOUD_QUEUE)
+#include <net/cloud_queue.h>
+#endif
 #if defined(CONFIG_NRF_CLOUD_AGPS)
 #include <net/nrf_cloud_agps.h>
 #endif
@@ -1209,20 +1212,42 @@ static void sensor_data_send(struct cloud_channel_data *data)
 			.endpoint.type = CLOUD_EP_TOPIC_MSG
 		};
 
-	if (!data_send_enabled() || gps_control_is_active()) {
+	if (gps_control_is_active()) {
+		return;
+	}
+
+	if (!data_send_enabled() && !IS_ENABLED(CONFIG_CLOUD_QUEUE)) {
 		return;
 	}
 
 	err = cloud_encode_data(data, CLOUD_CMD_GROUP_DATA, &msg);
 	if (err) {
 		LOG_ERR("Unable to encode cloud data: %d", err);
+		return;
+	}
+
+#if defined(CONFIG_CLOUD_QUEUE)
+	/* Stored for replay if it cannot be sent now. While the queued
+	 * messages are replayed, new ones wait behind them.
+	 */
+	if (data_send_enabled()) {
+		err = cloud_queue_send(cloud_backend, &msg);
 	} else {
-		err = cloud_send(cloud_backend, &msg);
-		cloud_release_data(&msg);
-		if (err) {
-			LOG_ERR("%s failed: %d", __func__, err);
-			cloud_error_handler(err);
-		}
+		err = cloud_queue_put(&msg);
+	}
+
+	if (err) {
+		LOG_WRN("Message not queued, error: %d", err);
+	}
+#else
+	err = cloud_send(cloud_backend, &msg);
+#endif /* defined(CONFIG_CLOUD_QUEUE) */
+
+	cloud_release_data(&msg);
+
+	if (err && data_send_enabled()) {
+		LOG_ERR("%s failed: %d", __func__, err);
+		cloud_error_handler(err);
 	}
 }
 
@@ -1345,6 +1370,9 @@ void cloud_event_handler(const struct cloud_backend *const backend,
 #endif
 		atomic_set(&cloud_association, CLOUD_ASSOCIATION_STATE_READY);
 		sensors_start();
+#if defined(CONFIG_CLOUD_QUEUE)
+		cloud_queue_replay_start(backend);
+#endif
 		break;
 	case CLOUD_EVT_ERROR:
 		LOG_INF("CLOUD_EVT_ERROR");
@@ -1423,6 +1451,9 @@ void connection_evt_handler(const struct cloud_event *const evt)
 
 		LOG_INF("CLOUD_EVT_DISCONNECTED: %d", evt->data.err);
 		ui_led_set_pattern(UI_LTE_CONNECTED);
+#if defined(CONFIG_CLOUD_QUEUE)
+		cloud_queue_replay_stop();
+#endif
 
 		switch (evt->data.err) {
 		case CLOUD_DISCONNECT_INVALID_REQUEST:
@@ -1555,6 +1586,15 @@ static void cloud_api_init(void)
 			ret);
 		cloud_error_handler(ret);
 	}
+
+#if defined(CONFIG_CLOUD_QUEUE)
+	ret = cloud_queue_init();
+	if (ret) {
+		/* Messages produced while offline are dropped. */
+		LOG_ERR("Cloud queue could not be initialized, error: %d",
+			ret);
+	}
+#endif
 }
 
 /**@brief Configures modem to provide LTE link. Blocks until link is
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "uart_ctrl_event.h"
+
+static int log_uart_ctrl_event(const struct event_header *eh, char *buf,
+				  size_t buf_len)
+{
+	const struct uart_ctrl_event *event = cast_uart_ctrl_event(eh);
+
+	return snprintf(
+		buf,
+		buf_len,
+		"dev_idx:%d cmd:%d",
+		event->dev_idx,
+		event->cmd);
+}
+
+EVENT_TYPE_DEFINE(uart_ctrl_event,
+		  IS_ENABLED(CONFIG_BRIDGE_LOG_UART_CTRL_EVENT),
+		  log_uart_ctrl_event,
+		  NULL);
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef _UART_CTRL_EVENT_H_
+#define _UART_CTRL_EVENT_H_
+
+/**
+ * @brief UART Control Event
+ * @defgroup uart_ctrl_event UART Control Event
+ * @{
+ */
+
+#include <string.h>
+#include <toolchain/common.h>
+
+#include "event_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum uart_ctrl_cmd {
+	/* The consumer of the UART data can not keep up: stop receiving */
+	UART_CTRL_RX_PAUSE,
+	/* The consumer of the UART data is ready for more */
+	UART_CTRL_RX_RESUME
+};
+
+/** UART control event. */
+struct uart_ctrl_event {
+	struct event_header header;
+
+	u8_t dev_idx;
+	enum uart_ctrl_cmd cmd;
+};
+
+EVENT_TYPE_DECLARE(uart_ctrl_event);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _UART_CTRL_EVENT_H_ */
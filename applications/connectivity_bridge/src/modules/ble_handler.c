@@ -20,6 +20,7 @@
 #include "ble_ctrl_event.h"
 #include "ble_data_event.h"
 #include "uart_data_event.h"
+#include "uart_ctrl_event.h"
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(MODULE, CONFIG_BRIDGE_BLE_LOG_LEVEL);
@@ -29,21 +30,35 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_BRIDGE_BLE_LOG_LEVEL);
 #define BLE_SLAB_ALIGNMENT 4
 
 #define BLE_TX_BUF_SIZE (CONFIG_BRIDGE_BUF_SIZE * 2)
+#define BLE_TX_BLOCK_SIZE (CONFIG_BT_L2CAP_TX_MTU - 3)
+
+/* UART RX is paused above the high level and resumed below the low level.
+ * Up to two UART RX buffers can still arrive after the pause.
+ */
+#define BLE_TX_PAUSE_LEVEL (BLE_TX_BUF_SIZE / 2)
+#define BLE_TX_RESUME_LEVEL (BLE_TX_BUF_SIZE / 4)
 
 #define ATT_MIN_PAYLOAD 20 /* Minimum L2CAP MTU minus ATT header */
 
+/* Delay before sending again when the stack is out of buffers */
+#define BLE_TX_RETRY_DELAY_MS 10
+
 static void bt_send_work_handler(struct k_work *work);
+static void ble_tx_flow_update(void);
 
 K_MEM_SLAB_DEFINE(ble_rx_slab, BLE_RX_BLOCK_SIZE, BLE_RX_BUF_COUNT, BLE_SLAB_ALIGNMENT);
 RING_BUF_DECLARE(ble_tx_ring_buf, BLE_TX_BUF_SIZE);
 
-static K_SEM_DEFINE(ble_tx_sem, 0, 1);
-
-static K_WORK_DEFINE(bt_send_work, bt_send_work_handler);
+static struct k_delayed_work bt_send_work;
 
 static struct bt_conn *current_conn;
 static struct bt_gatt_exchange_params exchange_params;
 static u32_t nus_max_send_len;
+/* Buffer to pack data wrapping around the end of the ring buffer */
+static u8_t ble_tx_block[BLE_TX_BLOCK_SIZE];
+/* Notifications that can be queued before the previous ones are sent */
+static atomic_t tx_credits;
+static atomic_t tx_paused;
 static atomic_t ready;
 static atomic_t active;
 
@@ -85,6 +100,7 @@ static void connected(struct bt_conn *conn, u8_t err)
 	}
 
 	ring_buf_reset(&ble_tx_ring_buf);
+	atomic_set(&tx_credits, CONFIG_BRIDGE_BLE_TX_CREDITS);
 
 	struct peer_conn_event *event = new_peer_conn_event();
 
@@ -107,6 +123,10 @@ static void disconnected(struct bt_conn *conn, u8_t reason)
 		current_conn = NULL;
 	}
 
+	/* Drop the data that was not sent and resume UART RX */
+	ring_buf_reset(&ble_tx_ring_buf);
+	ble_tx_flow_update();
+
 	struct peer_conn_event *event = new_peer_conn_event();
 
 	event->peer_id = PEER_ID_BLE;
@@ -121,22 +141,102 @@ static struct bt_conn_cb conn_callbacks = {
 	.disconnected = disconnected,
 };
 
+static u32_t ble_tx_buf_used(void)
+{
+	return ring_buf_capacity_get(&ble_tx_ring_buf) -
+	       ring_buf_space_get(&ble_tx_ring_buf);
+}
+
+static void uart_ctrl_send(enum uart_ctrl_cmd cmd)
+{
+	struct uart_ctrl_event *event = new_uart_ctrl_event();
+
+	/* Only one BLE Service instance, mapped to UART_0 */
+	event->dev_idx = 0;
+	event->cmd = cmd;
+	EVENT_SUBMIT(event);
+}
+
+static void ble_tx_flow_update(void)
+{
+	u32_t used = ble_tx_buf_used();
+
+	if (used >= BLE_TX_PAUSE_LEVEL) {
+		if (!atomic_set(&tx_paused, true)) {
+			uart_ctrl_send(UART_CTRL_RX_PAUSE);
+		}
+	} else if (used <= BLE_TX_RESUME_LEVEL) {
+		if (atomic_set(&tx_paused, false)) {
+			uart_ctrl_send(UART_CTRL_RX_RESUME);
+		}
+	}
+}
+
+/* Claims up to size bytes from the ring buffer. Data wrapping around the
+ * end of the ring buffer is copied to a single block.
+ */
+static u32_t ble_tx_claim(u8_t **data, u32_t size)
+{
+	u32_t len;
+	u32_t wrap_len;
+	u8_t *wrap_data;
+
+	len = ring_buf_get_claim(&ble_tx_ring_buf, data, size);
+	if (len == size) {
+		return len;
+	}
+
+	wrap_len = ring_buf_get_claim(&ble_tx_ring_buf, &wrap_data,
+				      size - len);
+	if (wrap_len == 0) {
+		return len;
+	}
+
+	memcpy(ble_tx_block, *data, len);
+	memcpy(&ble_tx_block[len], wrap_data, wrap_len);
+	*data = ble_tx_block;
+
+	return len + wrap_len;
+}
+
 static void bt_send_work_handler(struct k_work *work)
 {
-	u16_t len;
+	u32_t max_len = MIN(nus_max_send_len, BLE_TX_BLOCK_SIZE);
+	bool notif_disabled = false;
+	bool retry = false;
+	u32_t len;
 	u8_t *buf;
 	int err;
-	bool notif_disabled = false;
 
-	do {
-		len = ring_buf_get_claim(&ble_tx_ring_buf, &buf, nus_max_send_len);
+	while (current_conn && (atomic_get(&tx_credits) > 0)) {
+		u32_t used = ble_tx_buf_used();
+
+		if (used == 0) {
+			break;
+		}
+
+		/* Hold back a short notification while others are in
+		 * flight: more data can arrive until they are sent.
+		 */
+		if ((used < max_len) &&
+		    (atomic_get(&tx_credits) < CONFIG_BRIDGE_BLE_TX_CREDITS)) {
+			break;
+		}
+
+		len = ble_tx_claim(&buf, max_len);
 
+		atomic_dec(&tx_credits);
 		err = bt_gatt_nus_send(current_conn, buf, len);
-		if (err == -EINVAL) {
-			notif_disabled = true;
-			len = 0;
-		} else if (err) {
+		if (err) {
+			atomic_inc(&tx_credits);
 			len = 0;
+
+			if (err == -EINVAL) {
+				notif_disabled = true;
+			} else {
+				LOG_WRN("bt_gatt_nus_send: %d", err);
+				retry = true;
+			}
 		}
 
 		err = ring_buf_get_finish(&ble_tx_ring_buf, len);
@@ -144,12 +244,22 @@ static void bt_send_work_handler(struct k_work *work)
 			LOG_ERR("ring_buf_get_finish: %d", err);
 			break;
 		}
-	} while (len != 0 && !ring_buf_is_empty(&ble_tx_ring_buf));
+
+		if (len == 0) {
+			break;
+		}
+	}
 
 	if (notif_disabled) {
 		/* Peer has not enabled notifications: don't accumulate data */
 		ring_buf_reset(&ble_tx_ring_buf);
+	} else if (retry) {
+		/* The data is kept, send it again later */
+		k_delayed_work_submit(&bt_send_work,
+				      K_MSEC(BLE_TX_RETRY_DELAY_MS));
 	}
+
+	ble_tx_flow_update();
 }
 
 static void bt_receive_cb(struct bt_conn *conn, const u8_t *const data,
@@ -185,11 +295,24 @@ static void bt_receive_cb(struct bt_conn *conn, const u8_t *const data,
 
 static void bt_sent_cb(struct bt_conn *conn)
 {
-	if (ring_buf_is_empty(&ble_tx_ring_buf)) {
+	atomic_val_t credits;
+
+	if (conn != current_conn) {
+		/* Notification sent over a previous connection */
 		return;
 	}
 
-	k_work_submit(&bt_send_work);
+	do {
+		credits = atomic_get(&tx_credits);
+		if (credits >= CONFIG_BRIDGE_BLE_TX_CREDITS) {
+			/* Credits were reset while the notification was
+			 * in flight.
+			 */
+			return;
+		}
+	} while (!atomic_cas(&tx_credits, credits, credits + 1));
+
+	k_delayed_work_submit(&bt_send_work, K_NO_WAIT);
 }
 
 static struct bt_gatt_nus_cb nus_cb = {
@@ -279,15 +402,10 @@ static bool event_handler(const struct event_header *eh)
 			LOG_WRN("UART_%d -> BLE overflow", event->dev_idx);
 		}
 
-		u32_t buf_utilization =
-			(ring_buf_capacity_get(&ble_tx_ring_buf) -
-			ring_buf_space_get(&ble_tx_ring_buf));
+		ble_tx_flow_update();
 
-		/* Simple check to start transmission. */
-		/* If bt_send_work is already running, this has no effect */
-		if (buf_utilization == written) {
-			k_work_submit(&bt_send_work);
-		}
+		/* Also cuts short a pending retry */
+		k_delayed_work_submit(&bt_send_work, K_NO_WAIT);
 
 		return false;
 	}
@@ -336,6 +454,8 @@ static bool event_handler(const struct event_header *eh)
 			atomic_set(&active, false);
 
 			nus_max_send_len = ATT_MIN_PAYLOAD;
+			k_delayed_work_init(&bt_send_work,
+					    bt_send_work_handler);
 
 			err = bt_enable(bt_ready);
 			if (err) {
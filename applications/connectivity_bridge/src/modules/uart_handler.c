@@ -14,6 +14,7 @@
 #include "ble_data_event.h"
 #include "cdc_data_event.h"
 #include "uart_data_event.h"
+#include "uart_ctrl_event.h"
 
 #include <logging/log.h>
 LOG_MODULE_REGISTER(MODULE, CONFIG_BRIDGE_UART_LOG_LEVEL);
@@ -75,6 +76,10 @@ static u32_t uart_default_baudrate[UART_DEVICE_COUNT];
 /* UART RX only enabled when there is one or more subscribers (power saving) */
 static int subscriber_count[UART_DEVICE_COUNT];
 static bool enable_rx_retry[UART_DEVICE_COUNT];
+/* RX paused on request of the data consumer (flow control) */
+static atomic_t rx_paused[UART_DEVICE_COUNT];
+static atomic_t rx_buf_refused[UART_DEVICE_COUNT];
+static atomic_t rx_stopped[UART_DEVICE_COUNT];
 static atomic_t uart_tx_started[UART_DEVICE_COUNT];
 
 static bool framing_error_msg_sent[UART_DEVICE_COUNT];
@@ -169,6 +174,12 @@ static void uart_callback(struct uart_event *evt, void *user_data)
 		}
 		break;
 	case UART_RX_BUF_REQUEST:
+		if (atomic_get(&rx_paused[dev_idx])) {
+			/* RX stops when the current buffer is full */
+			atomic_set(&rx_buf_refused[dev_idx], true);
+			break;
+		}
+
 		buf = uart_rx_buf_alloc();
 		if (buf == NULL) {
 			LOG_WRN("UART_%d RX overflow", dev_idx);
@@ -185,6 +196,14 @@ static void uart_callback(struct uart_event *evt, void *user_data)
 		if (enable_rx_retry[dev_idx]) {
 			enable_uart_rx(dev_idx);
 			enable_rx_retry[dev_idx] = false;
+		} else if (atomic_set(&rx_buf_refused[dev_idx], false) &&
+			   (subscriber_count[dev_idx] > 0)) {
+			if (atomic_get(&rx_paused[dev_idx])) {
+				/* Restarted when RX is resumed */
+				atomic_set(&rx_stopped[dev_idx], true);
+			} else {
+				enable_uart_rx(dev_idx);
+			}
 		} else if (UART_SET_PM_STATE) {
 			set_uart_power_state(dev_idx, false);
 		}
@@ -301,6 +320,8 @@ static void enable_uart_rx(u8_t dev_idx)
 	int err;
 	struct uart_rx_buf *buf;
 
+	atomic_set(&rx_stopped[dev_idx], false);
+
 	err = uart_callback_set(dev, uart_callback, (void *) (int) dev_idx);
 	if (err) {
 		LOG_ERR("uart_callback_set: %d", err);
@@ -451,6 +472,39 @@ static bool event_handler(const struct event_header *eh)
 		return false;
 	}
 
+	if (is_uart_ctrl_event(eh)) {
+		const struct uart_ctrl_event *event =
+			cast_uart_ctrl_event(eh);
+
+		if (event->dev_idx >= UART_DEVICE_COUNT) {
+			return false;
+		}
+
+		if (!devices[event->dev_idx]) {
+			return false;
+		}
+
+		switch (event->cmd) {
+		case UART_CTRL_RX_PAUSE:
+			atomic_set(&rx_paused[event->dev_idx], true);
+			break;
+		case UART_CTRL_RX_RESUME:
+			atomic_set(&rx_paused[event->dev_idx], false);
+
+			if (atomic_set(&rx_stopped[event->dev_idx], false) &&
+			    (subscriber_count[event->dev_idx] > 0)) {
+				enable_uart_rx(event->dev_idx);
+			}
+			break;
+		default:
+			/* Unhandled control message */
+			__ASSERT_NO_MSG(false);
+			break;
+		}
+
+		return false;
+	}
+
 	if (is_peer_conn_event(eh)) {
 		const struct peer_conn_event *event =
 			cast_peer_conn_event(eh);
@@ -517,6 +571,9 @@ static bool event_handler(const struct event_header *eh)
 				uart_default_baudrate[i] = cfg.baudrate;
 				subscriber_count[i] = 0;
 				enable_rx_retry[i] = false;
+				atomic_set(&rx_paused[i], false);
+				atomic_set(&rx_buf_refused[i], false);
+				atomic_set(&rx_stopped[i], false);
 
 				atomic_set(&uart_tx_started[i], false);
 
@@ -544,4 +601,5 @@ EVENT_SUBSCRIBE(MODULE, module_state_event);
 EVENT_SUBSCRIBE(MODULE, peer_conn_event);
 EVENT_SUBSCRIBE(MODULE, ble_data_event);
 EVENT_SUBSCRIBE(MODULE, cdc_data_event);
+EVENT_SUBSCRIBE(MODULE, uart_ctrl_event);
 EVENT_SUBSCRIBE_FINAL(MODULE, uart_data_event);
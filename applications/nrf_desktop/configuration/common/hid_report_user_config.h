@@ -11,7 +11,11 @@
 extern "C" {
 #endif
 
+#ifdef CONFIG_DESKTOP_CONFIG_CHANNEL_REPORT_SIZE
+#define REPORT_SIZE_USER_CONFIG CONFIG_DESKTOP_CONFIG_CHANNEL_REPORT_SIZE
+#else
 #define REPORT_SIZE_USER_CONFIG                29 /* bytes */
+#endif
 
 
 #define REPORT_MAP_USER_CONFIG(report_id)				\
@@ -107,6 +107,22 @@ struct ble_peer_conn_params_event {
 };
 EVENT_TYPE_DECLARE(ble_peer_conn_params_event);
 
+/** @brief Prefix of connection intervals in Low Latency Packet Mode. */
+#define REG_CONN_INTERVAL_LLPM_MASK	0x0d00
+
+/** @brief Check if a connection interval is an LLPM interval.
+ *
+ * @param interval	Connection interval, as reported by
+ *			ble_peer_conn_params_event or bt_conn_get_info.
+ *
+ * @return True if the interval is given in LLPM units.
+ */
+static inline bool ble_conn_interval_is_llpm(u16_t interval)
+{
+	return (interval & REG_CONN_INTERVAL_LLPM_MASK) ==
+	       REG_CONN_INTERVAL_LLPM_MASK;
+}
+
 /** @brief BLE peer search event. */
 struct ble_peer_search_event {
 	struct event_header header;
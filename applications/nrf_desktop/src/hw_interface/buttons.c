@@ -15,6 +15,7 @@
 #include "key_id.h"
 #include "gpio_pins.h"
 #include "buttons_def.h"
+#include "key_matrix.h"
 
 #include "event_manager.h"
 #include "button_event.h"
@@ -31,6 +32,10 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_BUTTONS_LOG_LEVEL);
 /* For directly connected GPIO, scan rows once. */
 #define COLUMNS MAX(ARRAY_SIZE(col), 1)
 
+#define GPIO_PORT_PIN_COUNT	32
+
+BUILD_ASSERT(ARRAY_SIZE(row) <= 32, "Row state must fit in u32_t");
+
 enum state {
 	STATE_IDLE,
 	STATE_ACTIVE,
@@ -40,6 +45,8 @@ enum state {
 
 static struct device *gpio_devs[ARRAY_SIZE(port_map)];
 static struct gpio_callback gpio_cb[ARRAY_SIZE(port_map)];
+static u32_t row_pin_mask[ARRAY_SIZE(port_map)];
+static u8_t row_idx[ARRAY_SIZE(port_map)][GPIO_PORT_PIN_COUNT];
 static struct k_delayed_work matrix_scan;
 static struct k_delayed_work button_pressed;
 static enum state state;
@@ -48,52 +55,93 @@ static enum state state;
 static void scan_fn(struct k_work *work);
 
 
-static int set_cols(u32_t mask)
+static int set_col(size_t i, bool output, bool val)
 {
-	for (size_t i = 0; i < ARRAY_SIZE(col); i++) {
-		u32_t val = (mask & BIT(i)) ? (1) : (0);
-		int err;
+	gpio_flags_t flags = GPIO_INPUT;
 
-		if (val || !mask) {
-			if (IS_ENABLED(CONFIG_DESKTOP_BUTTONS_POLARITY_INVERSED)) {
-				val = !val;
-			}
-
-			err = gpio_pin_configure(gpio_devs[col[i].port],
-						 col[i].pin, GPIO_OUTPUT);
-			if (!err) {
-				err = gpio_pin_set_raw(gpio_devs[col[i].port],
-						       col[i].pin, val);
-			}
-		} else {
-			err = gpio_pin_configure(gpio_devs[col[i].port],
-						 col[i].pin, GPIO_INPUT);
+	if (output) {
+		if (IS_ENABLED(CONFIG_DESKTOP_BUTTONS_POLARITY_INVERSED)) {
+			val = !val;
 		}
 
+		/* Configure and set the pin in a single call. */
+		flags = (val) ? (GPIO_OUTPUT_HIGH) : (GPIO_OUTPUT_LOW);
+	}
+
+	int err = gpio_pin_configure(gpio_devs[col[i].port], col[i].pin,
+				     flags);
+
+	if (err) {
+		LOG_ERR("Cannot set pin");
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+static int set_cols(u32_t mask)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(col); i++) {
+		bool val = (mask & BIT(i)) != 0;
+		int err = set_col(i, (val || !mask), val);
+
 		if (err) {
-			LOG_ERR("Cannot set pin");
-			return -EFAULT;
+			return err;
 		}
 	}
 
 	return 0;
 }
 
+static int select_col(size_t i)
+{
+	if (ARRAY_SIZE(col) == 0) {
+		return 0;
+	}
+
+	/* Only the previously selected column needs to be released. */
+	if (i == 0) {
+		return set_cols(BIT(0));
+	}
+
+	int err = set_col(i - 1, false, false);
+
+	if (!err) {
+		err = set_col(i, true, true);
+	}
+
+	return err;
+}
+
 static int get_rows(u32_t *mask)
 {
-	for (size_t i = 0; i < ARRAY_SIZE(row); i++) {
-		int val = gpio_pin_get_raw(gpio_devs[row[i].port], row[i].pin);
+	for (size_t i = 0; i < ARRAY_SIZE(port_map); i++) {
+		gpio_port_value_t val;
 
-		if (val < 0) {
+		if (!row_pin_mask[i]) {
+			continue;
+		}
+
+		/* Read all row pins of the port in a single access. */
+		int err = gpio_port_get_raw(gpio_devs[i], &val);
+
+		if (err) {
 			LOG_ERR("Cannot get pin");
 			return -EFAULT;
 		}
 
 		if (IS_ENABLED(CONFIG_DESKTOP_BUTTONS_POLARITY_INVERSED)) {
-			val = !val;
+			val = ~val;
 		}
 
-		*mask |= (val << i);
+		val &= row_pin_mask[i];
+
+		while (val) {
+			u32_t pin = __builtin_ctz(val);
+
+			val &= val - 1;
+			*mask |= BIT(row_idx[i][pin]);
+		}
 	}
 
 	return 0;
@@ -225,7 +273,7 @@ static void scan_fn(struct k_work *work)
 	memset(raw_state, 0, sizeof(raw_state));
 
 	for (size_t i = 0; i < COLUMNS; i++) {
-		int err = set_cols(BIT(i));
+		int err = select_col(i);
 
 		if (!err) {
 			err = get_rows(&raw_state[i]);
@@ -247,54 +295,35 @@ static void scan_fn(struct k_work *work)
 
 	/* Prevent bouncing */
 	static u32_t prev_state[COLUMNS];
-	for (size_t i = 0; i < COLUMNS; i++) {
-		u32_t bounce_mask = prev_state[i] ^ raw_state[i];
-		prev_state[i] = raw_state[i];
-		raw_state[i] &= ~bounce_mask;
-		raw_state[i] |= settled_state[i] & bounce_mask;
-	}
+	key_matrix_debounce(raw_state, prev_state, settled_state, COLUMNS);
 
 	/* Prevent ghosting */
 	u32_t cur_state[COLUMNS];
-	for (size_t i = 0; i < COLUMNS; i++) {
-		u32_t blocking_mask = 0;
-		for (size_t j = 0; j < COLUMNS; j++) {
-			if (i == j) {
-				continue;
-			}
-			blocking_mask |= raw_state[j];
-		}
-		blocking_mask ^= raw_state[i];
-		cur_state[i] = raw_state[i];
-		if (!is_power_of_two(raw_state[i])) {
-			/* Power of two means only one bit is set */
-			cur_state[i] &= blocking_mask;
-		}
-	}
+	key_matrix_ghost_filter(raw_state, cur_state, COLUMNS);
 
 	/* Emit event for any key state change */
 	bool any_pressed = false;
 	size_t evt_limit = 0;
 
 	for (size_t i = 0; i < COLUMNS; i++) {
-		for (size_t j = 0; j < ARRAY_SIZE(row); j++) {
-			bool is_raw_pressed = raw_state[i] & BIT(j);
-			bool is_pressed = cur_state[i] & BIT(j);
-			bool was_pressed = settled_state[i] & BIT(j);
+		u32_t changed = key_matrix_changed(raw_state[i], cur_state[i],
+						   settled_state[i]);
 
-			if ((is_pressed != was_pressed) &&
-			    (is_pressed == is_raw_pressed) &&
-			    (evt_limit < CONFIG_DESKTOP_BUTTONS_EVENT_LIMIT)) {
-				struct button_event *event = new_button_event();
+		while (changed &&
+		       (evt_limit < CONFIG_DESKTOP_BUTTONS_EVENT_LIMIT)) {
+			u32_t j = __builtin_ctz(changed);
+			bool is_pressed = (cur_state[i] & BIT(j)) != 0;
+			struct button_event *event = new_button_event();
 
-				event->key_id = KEY_ID(i, j);
-				event->pressed = is_pressed;
-				EVENT_SUBMIT(event);
+			changed &= changed - 1;
 
-				evt_limit++;
+			event->key_id = KEY_ID(i, j);
+			event->pressed = is_pressed;
+			EVENT_SUBMIT(event);
 
-				WRITE_BIT(settled_state[i], j, is_pressed);
-			}
+			evt_limit++;
+
+			WRITE_BIT(settled_state[i], j, is_pressed);
 		}
 
 		any_pressed = any_pressed ||
@@ -456,8 +485,12 @@ static void init_fn(void)
 		goto error;
 	}
 
-	u32_t pin_mask[ARRAY_SIZE(port_map)] = {0};
 	for (size_t i = 0; i < ARRAY_SIZE(row); i++) {
+		__ASSERT_NO_MSG(row[i].pin < GPIO_PORT_PIN_COUNT);
+
+		row_pin_mask[row[i].port] |= BIT(row[i].pin);
+		row_idx[row[i].port][row[i].pin] = i;
+
 		/* Module starts in scanning mode and will switch to
 		 * callback mode if no button is pressed.
 		 */
@@ -468,8 +501,6 @@ static void init_fn(void)
 			LOG_ERR("Cannot configure rows");
 			goto error;
 		}
-
-		pin_mask[row[i].port] |= BIT(row[i].pin);
 	}
 
 	for (size_t i = 0; i < ARRAY_SIZE(port_map); i++) {
@@ -477,7 +508,8 @@ static void init_fn(void)
 			/* Skip non-existing ports */
 			continue;
 		}
-		gpio_init_callback(&gpio_cb[i], button_pressed_isr, pin_mask[i]);
+		gpio_init_callback(&gpio_cb[i], button_pressed_isr,
+				   row_pin_mask[i]);
 		err = gpio_add_callback(gpio_devs[i], &gpio_cb[i]);
 		if (err) {
 			LOG_ERR("Cannot add callback");
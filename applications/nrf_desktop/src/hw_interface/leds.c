@@ -6,7 +6,13 @@
 
 #include <zephyr.h>
 #include <assert.h>
+
+#ifdef CONFIG_DESKTOP_LED_PLAYBACK_PWM_SEQUENCE
+#include <nrfx_pwm.h>
+#include "led_seq.h"
+#else
 #include <drivers/pwm.h>
+#endif
 
 #include "power_event.h"
 #include "led_event.h"
@@ -22,18 +28,270 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_LED_LOG_LEVEL);
 #define LED_ID(led) ((led) - &leds[0])
 
 struct led {
+#ifdef CONFIG_DESKTOP_LED_PLAYBACK_PWM_SEQUENCE
+	const nrfx_pwm_t *pwm;
+	struct led_seq seq;
+	struct led_seq_entry seq_buf[CONFIG_DESKTOP_LED_SEQUENCE_SIZE];
+#else
 	struct device *pwm_dev;
+	u16_t effect_step;
+	u16_t effect_substep;
+#endif
 
 	struct led_color color;
 	const struct led_effect *effect;
-	u16_t effect_step;
-	u16_t effect_substep;
 
 	struct k_delayed_work work;
 };
 
 static struct led leds[CONFIG_DESKTOP_LED_COUNT];
 
+#ifdef CONFIG_DESKTOP_LED_PLAYBACK_PWM_SEQUENCE
+/* First edge within the PWM period is falling, so that the pulse width
+ * equals the compare value.
+ */
+#define PWM_CH_VALUE_NORMAL BIT(15)
+
+static const nrfx_pwm_t pwm_instances[] = {
+#if CONFIG_NRFX_PWM0
+	NRFX_PWM_INSTANCE(0),
+#endif
+#if CONFIG_NRFX_PWM1
+	NRFX_PWM_INSTANCE(1),
+#endif
+#if CONFIG_NRFX_PWM2
+	NRFX_PWM_INSTANCE(2),
+#endif
+#if CONFIG_NRFX_PWM3
+	NRFX_PWM_INSTANCE(3),
+#endif
+};
+
+
+static void led_ready(struct led *led)
+{
+	struct led_ready_event *ready_event = new_led_ready_event();
+
+	ready_event->led_id = LED_ID(led);
+	ready_event->led_effect = led->effect;
+
+	EVENT_SUBMIT(ready_event);
+}
+
+static u32_t sequence_repeats(const struct led *led)
+{
+	/* Every entry is played for a tick, that is for a number of PWM
+	 * periods. The period is CONFIG_DESKTOP_LED_BRIGHTNESS_MAX us long.
+	 */
+	u32_t periods = (led_seq_tick_get(&led->seq) * USEC_PER_MSEC) /
+			CONFIG_DESKTOP_LED_BRIGHTNESS_MAX;
+
+	return MIN(MAX(periods, 1) - 1, PWM_SEQ_REFRESH_CNT_Msk);
+}
+
+static bool sequence_play(struct led *led)
+{
+	size_t len = led_seq_fill(&led->seq, led->seq_buf,
+				  ARRAY_SIZE(led->seq_buf));
+
+	if (len == 0) {
+		return false;
+	}
+
+	led_seq_color_get(&led->seq, &led->color);
+
+	for (size_t i = 0; i < len; i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(led->seq_buf[i].c); j++) {
+			led->seq_buf[i].c[j] |= PWM_CH_VALUE_NORMAL;
+		}
+	}
+
+	nrf_pwm_sequence_t sequence = {
+		.values.p_individual =
+			(nrf_pwm_values_individual_t *)led->seq_buf,
+		.length = len * LED_SEQ_CHANNEL_COUNT,
+		.repeats = sequence_repeats(led),
+		.end_delay = 0,
+	};
+
+	u32_t flags = 0;
+
+	/* Pass of a looped effect that fits in the buffer is played by the
+	 * PWM peripheral on its own. The first pass starts from the previous
+	 * LED color, so it is played once before the loop. Otherwise, the CPU
+	 * is woken up when the buffer is played to refill it.
+	 */
+	if (led_seq_is_pass_loop(&led->seq)) {
+		flags = NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_NO_EVT_FINISHED;
+	}
+
+	nrfx_pwm_simple_playback(led->pwm, &sequence, 1, flags);
+
+	return true;
+}
+
+static void work_handler(struct k_work *work)
+{
+	struct led *led = CONTAINER_OF(work, struct led, work);
+
+	if (!sequence_play(led)) {
+		led_ready(led);
+	}
+}
+
+static void pwm_handler(size_t led_id, nrfx_pwm_evt_type_t event_type)
+{
+	if ((led_id < ARRAY_SIZE(leds)) &&
+	    (event_type == NRFX_PWM_EVT_FINISHED)) {
+		k_delayed_work_submit(&leds[led_id].work, K_NO_WAIT);
+	}
+}
+
+#define PWM_HANDLER_DEFINE(idx)						\
+	static void pwm_handler_##idx(nrfx_pwm_evt_type_t event_type)	\
+	{								\
+		pwm_handler(idx, event_type);				\
+	}
+
+PWM_HANDLER_DEFINE(0)
+PWM_HANDLER_DEFINE(1)
+PWM_HANDLER_DEFINE(2)
+PWM_HANDLER_DEFINE(3)
+
+static const nrfx_pwm_handler_t pwm_handlers[] = {
+	pwm_handler_0,
+	pwm_handler_1,
+	pwm_handler_2,
+	pwm_handler_3,
+};
+
+static void pwm_irq_connect(void)
+{
+#if CONFIG_NRFX_PWM0
+	IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_PWM0),
+		    NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+		    nrfx_isr, nrfx_pwm_0_irq_handler, 0);
+#endif
+#if CONFIG_NRFX_PWM1
+	IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_PWM1),
+		    NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+		    nrfx_isr, nrfx_pwm_1_irq_handler, 0);
+#endif
+#if CONFIG_NRFX_PWM2
+	IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_PWM2),
+		    NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+		    nrfx_isr, nrfx_pwm_2_irq_handler, 0);
+#endif
+#if CONFIG_NRFX_PWM3
+	IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_PWM3),
+		    NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+		    nrfx_isr, nrfx_pwm_3_irq_handler, 0);
+#endif
+}
+
+static int pwm_init(struct led *led)
+{
+	nrfx_pwm_config_t config = {
+		.output_pins = {
+			NRFX_PWM_PIN_NOT_USED,
+			NRFX_PWM_PIN_NOT_USED,
+			NRFX_PWM_PIN_NOT_USED,
+			NRFX_PWM_PIN_NOT_USED,
+		},
+		.irq_priority = NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+		.base_clock = NRF_PWM_CLK_1MHz,
+		.count_mode = NRF_PWM_MODE_UP,
+		.top_value = CONFIG_DESKTOP_LED_BRIGHTNESS_MAX,
+		.load_mode = NRF_PWM_LOAD_INDIVIDUAL,
+		.step_mode = NRF_PWM_STEP_AUTO,
+	};
+
+	BUILD_ASSERT(sizeof(struct led_seq_entry) ==
+		     sizeof(nrf_pwm_values_individual_t));
+	BUILD_ASSERT(ARRAY_SIZE(config.output_pins) == LED_SEQ_CHANNEL_COUNT);
+
+	for (size_t i = 0; i < CONFIG_DESKTOP_LED_COLOR_COUNT; i++) {
+		config.output_pins[i] = led_pins[LED_ID(led)][i];
+	}
+
+	nrfx_err_t err = nrfx_pwm_init(led->pwm, &config,
+				       pwm_handlers[LED_ID(led)]);
+
+	if (err != NRFX_SUCCESS) {
+		LOG_ERR("Cannot initialize PWM (err: %d)", err);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void led_update(struct led *led)
+{
+	(void)nrfx_pwm_stop(led->pwm, true);
+	k_delayed_work_cancel(&led->work);
+
+	if (!led->effect) {
+		LOG_WRN("No effect set");
+		return;
+	}
+
+	__ASSERT_NO_MSG(led->effect->steps);
+
+	if (led->effect->step_count > 0) {
+		led_seq_init(&led->seq, led->effect, &led->color);
+		sequence_play(led);
+	} else {
+		LOG_WRN("LED effect with no effect");
+	}
+}
+
+static int leds_init(void)
+{
+	int err = 0;
+
+	BUILD_ASSERT(ARRAY_SIZE(leds) <= ARRAY_SIZE(pwm_instances),
+			 "not enough PWMs");
+	BUILD_ASSERT(ARRAY_SIZE(leds) <= ARRAY_SIZE(pwm_handlers),
+			 "not enough PWM handlers");
+
+	pwm_irq_connect();
+
+	for (size_t i = 0; (i < ARRAY_SIZE(leds)) && !err; i++) {
+		leds[i].pwm = &pwm_instances[i];
+		k_delayed_work_init(&leds[i].work, work_handler);
+
+		err = pwm_init(&leds[i]);
+		if (!err) {
+			led_update(&leds[i]);
+		}
+	}
+
+	return err;
+}
+
+static void leds_start(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(leds); i++) {
+		int err = pwm_init(&leds[i]);
+
+		if (!err) {
+			led_update(&leds[i]);
+		}
+	}
+}
+
+static void leds_stop(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(leds); i++) {
+		/* Stopped PWM sets the pins to the idle level (LED off). */
+		(void)nrfx_pwm_stop(leds[i].pwm, true);
+		k_delayed_work_cancel(&leds[i].work);
+
+		nrfx_pwm_uninit(leds[i].pwm);
+	}
+}
+
+#else
 
 static void pwm_out(struct led *led, struct led_color *color)
 {
@@ -195,6 +453,8 @@ static void leds_stop(void)
 	}
 }
 
+#endif /* CONFIG_DESKTOP_LED_PLAYBACK_PWM_SEQUENCE */
+
 static bool event_handler(const struct event_header *eh)
 {
 	static bool initialized;
@@ -21,6 +21,7 @@
 #include "hid_event.h"
 #include "config_event.h"
 #include "usb_event.h"
+#include "ble_event.h"
 
 #define MODULE motion
 #include "module_state_event.h"
@@ -36,6 +37,27 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_MOTION_LOG_LEVEL);
 
 #define MAX_KEY_LEN 20
 
+#define CONN_INTERVAL_LLPM_US		1000
+#define CONN_INTERVAL_UNIT_US		1250
+
+#ifdef CONFIG_DESKTOP_MOTION_SENSOR_SAMPLE_LEAD_US
+#define SAMPLE_LEAD_US		CONFIG_DESKTOP_MOTION_SENSOR_SAMPLE_LEAD_US
+#else
+#define SAMPLE_LEAD_US		0
+#endif
+
+#ifdef CONFIG_USB_HID_POLL_INTERVAL_MS
+#define USB_POLL_INTERVAL_US	(CONFIG_USB_HID_POLL_INTERVAL_MS * 1000)
+#else
+#define USB_POLL_INTERVAL_US	0
+#endif
+
+#ifdef CONFIG_DESKTOP_MOTION_SENSOR_LATENCY_STATS_COUNT
+#define LATENCY_STATS_COUNT	CONFIG_DESKTOP_MOTION_SENSOR_LATENCY_STATS_COUNT
+#else
+#define LATENCY_STATS_COUNT	0
+#endif
+
 enum state {
 	STATE_DISABLED,
 	STATE_DISABLED_SUSPENDED,
@@ -54,6 +76,20 @@ struct sensor_state {
 	u8_t peer_count;
 	u32_t option[MOTION_SENSOR_OPTION_COUNT];
 	u32_t option_mask;
+	u32_t sample_cyc;
+	bool sample_pending;
+};
+
+struct report_slot {
+	u32_t ble_interval_us;
+	bool usb_active;
+};
+
+struct latency_stats {
+	u32_t min;
+	u32_t max;
+	u64_t sum;
+	u16_t count;
 };
 
 enum sensor_opt {
@@ -73,6 +109,8 @@ static struct k_thread thread;
 static struct device *sensor_dev;
 
 static struct sensor_state state;
+static struct report_slot report_slot;
+static struct latency_stats latency_stats;
 
 static const char * const opt_descr[] = {
 	[SENSOR_OPT_TYPE] = OPT_DESCR_MODULE_TYPE,
@@ -155,6 +193,9 @@ SETTINGS_STATIC_HANDLER_DEFINE(motion_sensor, MODULE_NAME, NULL, settings_set,
 			       NULL, NULL);
 
 static void data_ready_handler(struct device *dev, struct sensor_trigger *trig);
+static void sample_timer_handler(struct k_timer *timer);
+
+static K_TIMER_DEFINE(sample_timer, sample_timer_handler, NULL);
 
 
 static int enable_trigger(void)
@@ -223,6 +264,7 @@ static int motion_read(bool send_event)
 {
 	struct sensor_value value_x;
 	struct sensor_value value_y;
+	u32_t sample_cyc = k_cycle_get_32();
 
 	int err = sensor_sample_fetch(sensor_dev);
 
@@ -256,11 +298,96 @@ static int motion_read(bool send_event)
 
 	event->dx = value_x.val1;
 	event->dy = value_y.val1;
+
+	if (IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_LATENCY_STATS)) {
+		k_spinlock_key_t key = k_spin_lock(&state.lock);
+		state.sample_cyc = sample_cyc;
+		state.sample_pending = true;
+		k_spin_unlock(&state.lock, key);
+	}
+
 	EVENT_SUBMIT(event);
 
 	return err;
 }
 
+static void sample_timer_handler(struct k_timer *timer)
+{
+	k_spinlock_key_t key = k_spin_lock(&state.lock);
+
+	if (state.state == STATE_FETCHING) {
+		state.sample = true;
+		k_sem_give(&sem);
+	}
+
+	k_spin_unlock(&state.lock, key);
+}
+
+static u32_t report_interval_get(void)
+{
+	/* USB subscriber takes precedence over BLE in HID state. */
+	if (report_slot.usb_active) {
+		return USB_POLL_INTERVAL_US;
+	}
+
+	return report_slot.ble_interval_us;
+}
+
+static void sample_schedule(void)
+{
+	/* Report was just sent, so the next report slot is expected after
+	 * one report interval. Sample the sensor right before the slot
+	 * to send the freshest motion data.
+	 */
+	u32_t interval_us = report_interval_get();
+
+	if (IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SYNC_SAMPLING) &&
+	    (interval_us > SAMPLE_LEAD_US)) {
+		u32_t delay_us = interval_us - SAMPLE_LEAD_US;
+
+		k_timer_start(&sample_timer, K_USEC(delay_us), K_NO_WAIT);
+	} else {
+		state.sample = true;
+		k_sem_give(&sem);
+	}
+}
+
+static void latency_stats_update(void)
+{
+	u32_t latency_us;
+
+	k_spinlock_key_t key = k_spin_lock(&state.lock);
+
+	if (!state.sample_pending) {
+		k_spin_unlock(&state.lock, key);
+		return;
+	}
+
+	latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - state.sample_cyc);
+	state.sample_pending = false;
+
+	k_spin_unlock(&state.lock, key);
+
+	if (latency_stats.count == 0) {
+		latency_stats.min = latency_us;
+		latency_stats.max = latency_us;
+		latency_stats.sum = 0;
+	}
+
+	latency_stats.min = MIN(latency_stats.min, latency_us);
+	latency_stats.max = MAX(latency_stats.max, latency_us);
+	latency_stats.sum += latency_us;
+	latency_stats.count++;
+
+	if (latency_stats.count >= LATENCY_STATS_COUNT) {
+		LOG_INF("Sensor-to-air latency [us]: min %u avg %u max %u "
+			"(interval %u)", latency_stats.min,
+			(u32_t)(latency_stats.sum / latency_stats.count),
+			latency_stats.max, report_interval_get());
+		latency_stats.count = 0;
+	}
+}
+
 static void set_sampling_time_in_sleep3(bool connected)
 {
 	if (CONFIG_DESKTOP_MOTION_SENSOR_SLEEP3_SAMPLE_TIME_DEFAULT ==
@@ -512,22 +639,89 @@ static void motion_thread_fn(void)
 
 static bool handle_usb_state_event(const struct usb_state_event *event)
 {
+	bool sleep_disable =
+		IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SLEEP_DISABLE_ON_USB);
+
 	switch (event->state) {
 	case USB_STATE_POWERED:
-		set_option(MOTION_SENSOR_OPTION_SLEEP_ENABLE, false);
+		if (sleep_disable) {
+			set_option(MOTION_SENSOR_OPTION_SLEEP_ENABLE, false);
+		}
+		report_slot.usb_active = false;
+		break;
+
+	case USB_STATE_ACTIVE:
+		report_slot.usb_active = true;
 		break;
 
 	case USB_STATE_DISCONNECTED:
-		set_option(MOTION_SENSOR_OPTION_SLEEP_ENABLE, true);
+		if (sleep_disable) {
+			set_option(MOTION_SENSOR_OPTION_SLEEP_ENABLE, true);
+		}
+		report_slot.usb_active = false;
+		break;
+
+	default:
+		report_slot.usb_active = false;
+		break;
+	}
+
+	return false;
+}
+
+static void ble_interval_set(u16_t interval)
+{
+	if (ble_conn_interval_is_llpm(interval)) {
+		report_slot.ble_interval_us = CONN_INTERVAL_LLPM_US;
+	} else {
+		report_slot.ble_interval_us = interval * CONN_INTERVAL_UNIT_US;
+	}
+}
+
+static bool handle_ble_peer_event(const struct ble_peer_event *event)
+{
+	struct bt_conn_info info;
+	int err;
+
+	switch (event->state) {
+	case PEER_STATE_CONNECTED:
+		/* No update event is received if the central keeps the initial
+		 * connection parameters.
+		 */
+		err = bt_conn_get_info(event->id, &info);
+		if (err) {
+			LOG_WRN("Cannot get conn info (%d)", err);
+			break;
+		}
+		ble_interval_set(info.le.interval);
+		break;
+
+	case PEER_STATE_DISCONNECTED:
+		/* Report slot is unknown until the next connection. */
+		report_slot.ble_interval_us = 0;
 		break;
 
 	default:
+		/* Ignore. */
 		break;
 	}
 
 	return false;
 }
 
+static bool handle_ble_peer_conn_params_event(
+		const struct ble_peer_conn_params_event *event)
+{
+	if (!event->updated) {
+		/* Ignore the connection parameters update request. */
+		return false;
+	}
+
+	ble_interval_set(event->interval_min);
+
+	return false;
+}
+
 static bool event_handler(const struct event_header *eh)
 {
 	if (is_hid_report_sent_event(eh)) {
@@ -535,10 +729,15 @@ static bool event_handler(const struct event_header *eh)
 			cast_hid_report_sent_event(eh);
 
 		if (event->report_id == REPORT_ID_MOUSE) {
+			if (IS_ENABLED(
+				CONFIG_DESKTOP_MOTION_SENSOR_LATENCY_STATS) &&
+			    !event->error) {
+				latency_stats_update();
+			}
+
 			k_spinlock_key_t key = k_spin_lock(&state.lock);
 			if (state.state == STATE_FETCHING) {
-				state.sample = true;
-				k_sem_give(&sem);
+				sample_schedule();
 			}
 			k_spin_unlock(&state.lock, key);
 		}
@@ -690,11 +889,24 @@ static bool event_handler(const struct event_header *eh)
 		return false;
 	}
 
-	if (IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SLEEP_DISABLE_ON_USB) &&
+	if ((IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SLEEP_DISABLE_ON_USB) ||
+	     IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SYNC_SAMPLING)) &&
+	    IS_ENABLED(CONFIG_DESKTOP_USB_ENABLE) &&
 	    is_usb_state_event(eh)) {
 		return handle_usb_state_event(cast_usb_state_event(eh));
 	}
 
+	if (IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SYNC_SAMPLING) &&
+	    is_ble_peer_event(eh)) {
+		return handle_ble_peer_event(cast_ble_peer_event(eh));
+	}
+
+	if (IS_ENABLED(CONFIG_DESKTOP_MOTION_SENSOR_SYNC_SAMPLING) &&
+	    is_ble_peer_conn_params_event(eh)) {
+		return handle_ble_peer_conn_params_event(
+			cast_ble_peer_conn_params_event(eh));
+	}
+
 	GEN_CONFIG_EVENT_HANDLERS("sensor", opt_descr, update_config,
 				  fetch_config, false);
 
@@ -712,7 +924,13 @@ EVENT_SUBSCRIBE(MODULE, hid_report_subscription_event);
 EVENT_SUBSCRIBE(MODULE, config_event);
 EVENT_SUBSCRIBE(MODULE, config_fetch_request_event);
 #endif
-#if CONFIG_DESKTOP_MOTION_SENSOR_SLEEP_DISABLE_ON_USB
+#if CONFIG_DESKTOP_USB_ENABLE && \
+	(CONFIG_DESKTOP_MOTION_SENSOR_SLEEP_DISABLE_ON_USB || \
+	 CONFIG_DESKTOP_MOTION_SENSOR_SYNC_SAMPLING)
 EVENT_SUBSCRIBE(MODULE, usb_state_event);
 #endif
+#if CONFIG_DESKTOP_MOTION_SENSOR_SYNC_SAMPLING
+EVENT_SUBSCRIBE(MODULE, ble_peer_event);
+EVENT_SUBSCRIBE(MODULE, ble_peer_conn_params_event);
+#endif
 EVENT_SUBSCRIBE_EARLY(MODULE, power_down_event);
@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 #include <bluetooth/bluetooth.h>
+#include <bluetooth/gatt_dm.h>
 #include <shell/shell.h>
 #include <settings/settings.h>
 
@@ -208,6 +209,27 @@ static int store_bt_stack_id_lut(void)
 	return 0;
 }
 
+static void discovery_cache_delete(const struct bt_bond_info *info,
+				   void *user_data)
+{
+	int err = bt_gatt_dm_cache_delete(&info->addr, NULL);
+
+	if (err) {
+		LOG_WRN("Cannot delete discovery cache (err %d)", err);
+	}
+}
+
+static int unpair(u8_t id, const bt_addr_le_t *addr)
+{
+	/* Discovery results are stored for bonded peers only. */
+	if (IS_ENABLED(CONFIG_BT_GATT_DM_CACHE)) {
+		__ASSERT_NO_MSG(!addr || !bt_addr_le_cmp(addr, BT_ADDR_LE_ANY));
+		bt_foreach_bond(id, discovery_cache_delete, NULL);
+	}
+
+	return bt_unpair(id, addr);
+}
+
 static void swap_bt_stack_peer_id(void)
 {
 	__ASSERT_NO_MSG(state == STATE_ERASE_ADV);
@@ -215,7 +237,7 @@ static void swap_bt_stack_peer_id(void)
 	if (IS_ENABLED(CONFIG_DESKTOP_BLE_USE_DEFAULT_ID)) {
 		if ((bt_stack_id_lut[0] == BT_ID_DEFAULT) &&
 		    (cur_peer_id == 0)) {
-			int err = bt_unpair(BT_ID_DEFAULT, NULL);
+			int err = unpair(BT_ID_DEFAULT, NULL);
 
 			if (err) {
 				LOG_ERR("Cannot unpair for default id");
@@ -242,7 +264,7 @@ static int remove_peers(u8_t identity)
 {
 	LOG_INF("Remove peers on identity %u", identity);
 
-	int err = bt_unpair(get_bt_stack_peer_id(identity), BT_ADDR_LE_ANY);
+	int err = unpair(get_bt_stack_peer_id(identity), BT_ADDR_LE_ANY);
 	if (err) {
 		LOG_ERR("Failed to remove");
 	}
@@ -645,7 +667,7 @@ static void storage_data_overwrite(void)
 		return;
 	}
 
-	err = bt_unpair(BT_ID_DEFAULT, NULL);
+	err = unpair(BT_ID_DEFAULT, NULL);
 
 	if (err) {
 		LOG_ERR("Cannot unpair for default ID");
@@ -655,6 +677,11 @@ static void storage_data_overwrite(void)
 
 	/* Reset Bluetooth local identities. */
 	for (size_t i = 1; i < CONFIG_BT_ID_MAX; i++) {
+		/* Resetting the identity removes its bonds. */
+		if (IS_ENABLED(CONFIG_BT_GATT_DM_CACHE)) {
+			bt_foreach_bond(i, discovery_cache_delete, NULL);
+		}
+
 		err = bt_id_reset(i, NULL, NULL);
 
 		if (err < 0) {
@@ -21,7 +21,6 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_BLE_LATENCY_LOG_LEVEL);
 	K_SECONDS(CONFIG_DESKTOP_BLE_SECURITY_FAIL_TIMEOUT_S)
 #define LOW_LATENCY_CHECK_PERIOD_MS	5000
 #define DEFAULT_LATENCY			CONFIG_BT_PERIPHERAL_PREF_SLAVE_LATENCY
-#define REG_CONN_INTERVAL_LLPM_MASK	0x0d00
 #define REG_CONN_INTERVAL_BLE_DEFAULT	0x0006
 
 static struct bt_conn *active_conn;
@@ -82,7 +81,7 @@ static void set_conn_latency(bool low_latency)
 	/* Request with connection interval set to a LLPM value is rejected
 	 * by Zephyr Bluetooth API.
 	 */
-	u16_t interval = (info.le.interval & REG_CONN_INTERVAL_LLPM_MASK) ?
+	u16_t interval = ble_conn_interval_is_llpm(info.le.interval) ?
 			  REG_CONN_INTERVAL_BLE_DEFAULT : info.le.interval;
 	const struct bt_le_conn_param param = {
 		.interval_min = interval,
@@ -149,7 +148,7 @@ static void conn_params_updated(const struct ble_peer_conn_params_event *event)
 
 	__ASSERT_NO_MSG(event->interval_min == event->interval_max);
 
-	if (event->interval_min & REG_CONN_INTERVAL_LLPM_MASK) {
+	if (ble_conn_interval_is_llpm(event->interval_min)) {
 		latency_state |= CONN_IS_LLPM;
 	} else {
 		latency_state &= ~CONN_IS_LLPM;
@@ -90,15 +90,26 @@ struct params_blacklist {
 	u16_t wifi_chn_bitmask;
 } __packed;
 
+struct chn_stats {
+	u16_t crc_ok;
+	u8_t crc_error;
+};
+
 static u8_t chmap_instance_buf[CHMAP_FILTER_INST_SIZE];
 static struct chmap_instance *chmap_inst;
+static const u8_t default_chmap[CHMAP_BLE_BITMASK_SIZE] =
+	CHMAP_BLE_BITMASK_DEFAULT;
 static u8_t current_chmap[CHMAP_BLE_BITMASK_SIZE] = CHMAP_BLE_BITMASK_DEFAULT;
-static atomic_t processing;
 static atomic_t new_blacklist;
 static atomic_t params_updated;
 static struct chmap_filter_params filter_params;
 static struct k_mutex data_access_mutex;
 
+/* CRC statistics collected since the last processing */
+static struct chn_stats chn_stats[CHMAP_BLE_CHANNEL_COUNT];
+static struct k_spinlock chn_stats_lock;
+static K_SEM_DEFINE(process_sem, 0, 1);
+
 BUILD_ASSERT(sizeof(struct bt_hci_cp_le_set_host_chan_classif) ==
 	     sizeof(struct params_chmap));
 BUILD_ASSERT(sizeof(current_chmap) == sizeof(struct params_chmap));
@@ -129,6 +140,7 @@ static const char * const opt_descr[] = {
 static void update_blacklist(const u8_t *blacklist)
 {
 	atomic_set(&new_blacklist, sys_get_le16(blacklist));
+	k_sem_give(&process_sem);
 }
 
 static void update_parameters(const u8_t *qos_ble_params,
@@ -194,6 +206,8 @@ static void update_parameters(const u8_t *qos_ble_params,
 
 	atomic_set(&params_updated, true);
 	k_mutex_unlock(&data_access_mutex);
+
+	k_sem_give(&process_sem);
 }
 
 static int settings_set(const char *key, size_t len_rd,
@@ -405,6 +419,50 @@ static void hid_pkt_stats_print(u32_t ble_recv)
 	send_uart_data(cdc_dev, str, str_len);
 }
 
+static bool chn_stats_update(u8_t chn_idx, u16_t crc_ok, u8_t crc_error)
+{
+	struct chn_stats *stats = &chn_stats[chn_idx];
+	k_spinlock_key_t key = k_spin_lock(&chn_stats_lock);
+
+	/* Halving keeps the CRC error rate of the channel. */
+	while ((stats->crc_ok > UINT16_MAX - crc_ok) ||
+	       (stats->crc_error > UINT8_MAX - crc_error)) {
+		stats->crc_ok /= 2;
+		stats->crc_error /= 2;
+	}
+
+	stats->crc_ok += crc_ok;
+	stats->crc_error += crc_error;
+
+	u32_t count = stats->crc_ok + stats->crc_error;
+	bool degraded =
+		(count >= CONFIG_DESKTOP_BLE_QOS_DEGRADATION_SAMPLE_COUNT) &&
+		(stats->crc_error * 100 >=
+		 CONFIG_DESKTOP_BLE_QOS_DEGRADATION_THRESHOLD * count);
+
+	k_spin_unlock(&chn_stats_lock, key);
+
+	return degraded;
+}
+
+static void chn_stats_feed(void)
+{
+	for (u8_t i = 0; i < CHMAP_BLE_CHANNEL_COUNT; i++) {
+		k_spinlock_key_t key = k_spin_lock(&chn_stats_lock);
+		struct chn_stats stats = chn_stats[i];
+
+		chn_stats[i].crc_ok = 0;
+		chn_stats[i].crc_error = 0;
+
+		k_spin_unlock(&chn_stats_lock, key);
+
+		if ((stats.crc_ok > 0) || (stats.crc_error > 0)) {
+			chmap_filter_crc_update(chmap_inst, i, stats.crc_ok,
+						stats.crc_error);
+		}
+	}
+}
+
 static bool on_vs_evt(struct net_buf_simple *buf)
 {
 	u8_t *subevent_code;
@@ -416,19 +474,17 @@ static bool on_vs_evt(struct net_buf_simple *buf)
 
 	switch (*subevent_code) {
 	case HCI_VS_SUBEVENT_CODE_QOS_CONN_EVENT_REPORT:
-		if (atomic_get(&processing)) {
-			/* Cheaper to skip this update */
-			/* instead of using locks */
+		evt = (void *)buf->data;
+
+		if (evt->channel_index >= CHMAP_BLE_CHANNEL_COUNT) {
 			return true;
 		}
 
-		evt = (void *)buf->data;
-
-		chmap_filter_crc_update(
-			chmap_inst,
-			evt->channel_index,
-			evt->crc_ok_count,
-			evt->crc_error_count);
+		/* Channel map is processed only if the link degrades. */
+		if (chn_stats_update(evt->channel_index, evt->crc_ok_count,
+				     evt->crc_error_count)) {
+			k_sem_give(&process_sem);
+		}
 		return true;
 	default:
 		return false;
@@ -740,11 +796,17 @@ static void apply_new_params(void)
 
 static void ble_qos_thread_fn(void)
 {
+	bool periodic = false;
+
 	while (true) {
 		bool update_channel_map;
 		int err;
 
-		k_sleep(K_MSEC(CONFIG_DESKTOP_BLE_QOS_INTERVAL));
+		/* Blocked channels are evaluated by the periodic processing.
+		 * With the full channel map, the thread waits until the link
+		 * degrades or the configuration changes.
+		 */
+		k_sem_take(&process_sem, periodic ? K_NO_WAIT : K_FOREVER);
 
 		/* Check and apply new parameters received via config channel */
 		if (atomic_get(&params_updated)) {
@@ -765,32 +827,40 @@ static void ble_qos_thread_fn(void)
 		}
 
 		/* Run processing function. */
-		/* Atomic variable is used as data busy flag */
-		/* (this thread runs at the lowest priority) */
-		atomic_set(&processing, true);
+		chn_stats_feed();
 		update_channel_map = chmap_filter_process(chmap_inst);
-		atomic_set(&processing, false);
 
 		ble_chn_stats_print(update_channel_map);
 
-		if (!update_channel_map) {
-			continue;
-		}
+		/* Failed channel map update is retried periodically. */
+		periodic = update_channel_map;
 
-		u8_t *chmap;
+		if (update_channel_map) {
+			u8_t *chmap;
 
-		chmap = chmap_filter_suggested_map_get(chmap_inst);
-		err = bt_le_set_chan_map(chmap);
-		if (err) {
-			LOG_WRN("bt_le_set_chan_map: %d", err);
-		} else {
-			LOG_DBG("Channel map update");
-			chmap_filter_suggested_map_confirm(chmap_inst);
+			chmap = chmap_filter_suggested_map_get(chmap_inst);
+			err = bt_le_set_chan_map(chmap);
+			if (err) {
+				LOG_WRN("bt_le_set_chan_map: %d", err);
+			} else {
+				LOG_DBG("Channel map update");
+				chmap_filter_suggested_map_confirm(chmap_inst);
+				periodic = false;
+
+				k_mutex_lock(&data_access_mutex, K_FOREVER);
+				memcpy(current_chmap, chmap,
+				       sizeof(current_chmap));
+				k_mutex_unlock(&data_access_mutex);
+			}
+		}
 
-			k_mutex_lock(&data_access_mutex, K_FOREVER);
-			memcpy(current_chmap, chmap, sizeof(current_chmap));
-			k_mutex_unlock(&data_access_mutex);
+		if (memcmp(current_chmap, default_chmap,
+			   sizeof(current_chmap))) {
+			periodic = true;
 		}
+
+		/* Statistics are collected for at least the interval. */
+		k_sleep(K_MSEC(CONFIG_DESKTOP_BLE_QOS_INTERVAL));
 	}
 }
 
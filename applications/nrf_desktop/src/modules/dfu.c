@@ -5,9 +5,11 @@
  */
 
 #include <inttypes.h>
+#include <string.h>
 
 #include <zephyr/types.h>
 #include <sys/byteorder.h>
+#include <sys/crc.h>
 #include <storage/flash_map.h>
 #include <pm_config.h>
 #include <fw_info.h>
@@ -29,20 +31,49 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_CONFIG_CHANNEL_DFU_LOG_LEVEL);
 #define FLASH_PAGE_ID(off)	((off) >> FLASH_PAGE_SIZE_LOG2)
 #define FLASH_CLEAN_VAL		UINT32_MAX
 #define FLASH_READ_CHUNK_SIZE	(FLASH_PAGE_SIZE / 8)
+#define FLASH_WRITE_ALIGN	sizeof(u32_t)
+#define FLASH_VERIFY_CHUNK_SIZE	64
+
+#define WRITE_BUF_SIZE CONFIG_DESKTOP_CONFIG_CHANNEL_DFU_WRITE_BUFFER_SIZE
+
+/* Initial value of the image checksum computed by the host tool */
+#define IMG_CSUM_INIT		1
+
+BUILD_ASSERT((WRITE_BUF_SIZE & (WRITE_BUF_SIZE - 1)) == 0,
+	     "Write buffer size must be a power of two");
 
 #define DFU_TIMEOUT			K_SECONDS(2)
 #define REBOOT_REQUEST_TIMEOUT		K_MSEC(250)
 #define BACKGROUND_FLASH_ERASE_TIMEOUT	K_SECONDS(15)
 
+struct write_buf {
+	u8_t data[WRITE_BUF_SIZE] __aligned(FLASH_WRITE_ALIGN);
+	u32_t offset;
+	size_t len;
+};
+
+struct flash_stats {
+	u32_t write_cnt;
+	u32_t stall_max;
+};
+
 static struct k_delayed_work dfu_timeout;
 static struct k_delayed_work reboot_request;
 static struct k_delayed_work background_erase;
+static struct k_work flash_write;
 
 static const struct flash_area *flash_area;
 static u32_t cur_offset;
 static u32_t img_csum;
 static u32_t img_length;
 
+/* Image data is collected in one buffer while the other one is written. */
+static struct write_buf write_bufs[2];
+static struct write_buf *fill_buf = &write_bufs[0];
+static struct write_buf *flush_buf;
+static u32_t written_csum;
+static struct flash_stats flash_stats;
+
 static bool device_in_use;
 static bool is_flash_area_clean;
 
@@ -52,6 +83,7 @@ enum dfu_opt {
 	DFU_OPT_SYNC,
 	DFU_OPT_REBOOT,
 	DFU_OPT_FWINFO,
+	DFU_OPT_FLASH_STATS,
 
 	DFU_OPT_COUNT
 };
@@ -61,7 +93,8 @@ const static char * const opt_descr[] = {
 	[DFU_OPT_DATA] = "data",
 	[DFU_OPT_SYNC] = "sync",
 	[DFU_OPT_REBOOT] = "reboot",
-	[DFU_OPT_FWINFO] = "fwinfo"
+	[DFU_OPT_FWINFO] = "fwinfo",
+	[DFU_OPT_FLASH_STATS] = "flash_stats"
 };
 
 static u8_t dfu_slot_id(void)
@@ -103,13 +136,185 @@ static bool is_page_clean(const struct flash_area *fa, off_t off, size_t len)
 	return true;
 }
 
+static void write_buf_reset(u32_t offset)
+{
+	fill_buf->offset = offset;
+	fill_buf->len = 0;
+	flush_buf = NULL;
+}
+
+static u32_t written_offset_get(void)
+{
+	return (flush_buf) ? flush_buf->offset : fill_buf->offset;
+}
+
+static void dfu_stop(void)
+{
+	flash_area_close(flash_area);
+	flash_area = NULL;
+	k_delayed_work_cancel(&dfu_timeout);
+
+	/* Data that is not written is dropped, the DFU can be restarted from
+	 * the reported offset.
+	 */
+	cur_offset = written_offset_get();
+	write_buf_reset(cur_offset);
+}
+
+static void image_written(void)
+{
+	LOG_INF("DFU image written, %" PRIu32 " flash writes, "
+		"worst stall %" PRIu32 " us", flash_stats.write_cnt,
+		k_cyc_to_us_ceil32(flash_stats.stall_max));
+
+	dfu_stop();
+
+	if (written_csum != img_csum) {
+		LOG_ERR("Invalid image checksum 0x%" PRIx32, written_csum);
+
+		/* Host sees the offset reset and the image is erased. */
+		is_flash_area_clean = false;
+		cur_offset = 0;
+		img_length = 0;
+		img_csum = 0;
+		write_buf_reset(cur_offset);
+
+		k_delayed_work_submit(&background_erase, 0);
+	}
+}
+
+static int written_verify(u32_t offset, size_t len)
+{
+	u8_t buf[FLASH_VERIFY_CHUNK_SIZE];
+
+	/* Checksum is computed over the data read back from flash. */
+	for (size_t pos = 0; pos < len; pos += sizeof(buf)) {
+		size_t chunk_len = MIN(sizeof(buf), len - pos);
+		int err = flash_area_read(flash_area, offset + pos, buf,
+					  chunk_len);
+
+		if (err) {
+			LOG_ERR("Cannot read flash (%d)", err);
+			return err;
+		}
+
+		written_csum = crc32_ieee_update(written_csum, buf, chunk_len);
+	}
+
+	return 0;
+}
+
+static int buf_write(struct write_buf *buf, size_t len)
+{
+	__ASSERT_NO_MSG(len <= buf->len);
+
+	/* Only the last write of the image can end unaligned. The buffer is
+	 * padded with the value of the erased flash.
+	 */
+	size_t write_len = ROUND_UP(len, FLASH_WRITE_ALIGN);
+
+	__ASSERT_NO_MSG(write_len <= sizeof(buf->data));
+	memset(&buf->data[len], (u8_t)FLASH_CLEAN_VAL, write_len - len);
+
+	u32_t start = k_cycle_get_32();
+	int err = flash_area_write(flash_area, buf->offset, buf->data,
+				   write_len);
+	u32_t stall = k_cycle_get_32() - start;
+
+	flash_stats.write_cnt++;
+	flash_stats.stall_max = MAX(flash_stats.stall_max, stall);
+
+	if (err) {
+		LOG_ERR("Cannot write data (%d)", err);
+		return err;
+	}
+
+	err = written_verify(buf->offset, len);
+	if (err) {
+		return err;
+	}
+
+	buf->offset += len;
+	buf->len -= len;
+	memmove(buf->data, &buf->data[len], buf->len);
+
+	return 0;
+}
+
+static int flush_buf_write(void)
+{
+	if (!flush_buf) {
+		return 0;
+	}
+
+	int err = buf_write(flush_buf, flush_buf->len);
+
+	if (err) {
+		return err;
+	}
+
+	u32_t written_offset = flush_buf->offset;
+
+	flush_buf = NULL;
+
+	if (written_offset == img_length) {
+		image_written();
+	}
+
+	return 0;
+}
+
+static int fill_buf_write(void)
+{
+	int err = flush_buf_write();
+
+	if (err || !flash_area) {
+		return err;
+	}
+
+	/* Partially filled buffer is written up to the last full word. */
+	size_t len = (cur_offset == img_length) ? fill_buf->len :
+		     ROUND_DOWN(fill_buf->len, FLASH_WRITE_ALIGN);
+
+	if (len == 0) {
+		return 0;
+	}
+
+	err = buf_write(fill_buf, len);
+
+	if (!err && (fill_buf->offset == img_length)) {
+		image_written();
+	}
+
+	return err;
+}
+
+static void flash_write_handler(struct k_work *work)
+{
+	/* The write is deferred out of the config event processing. With the
+	 * Bluetooth controller enabled, the flash driver performs it in
+	 * timeslots between the radio events.
+	 */
+	if (!flash_area) {
+		return;
+	}
+
+	if (flush_buf_write()) {
+		dfu_stop();
+	}
+}
+
 static void dfu_timeout_handler(struct k_work *work)
 {
 	LOG_WRN("DFU timed out");
 
 	if (flash_area) {
-		flash_area_close(flash_area);
-		flash_area = NULL;
+		/* Store the received data, the DFU can be restarted. */
+		fill_buf_write();
+
+		if (flash_area) {
+			dfu_stop();
+		}
 	}
 }
 
@@ -180,10 +385,8 @@ static void background_erase_handler(struct k_work *work)
 	}
 }
 
-static void handle_dfu_data(const u8_t *data, const size_t size)
+static void handle_dfu_data(const u8_t *data, size_t size)
 {
-	int err;
-
 	if (!is_flash_area_clean) {
 		LOG_WRN("Flash is not clean");
 		return;
@@ -196,35 +399,51 @@ static void handle_dfu_data(const u8_t *data, const size_t size)
 
 	LOG_DBG("DFU data received cur_offset:%" PRIu32, cur_offset);
 
-	if (size == 0) {
+	if ((size == 0) || (size > img_length - cur_offset)) {
 		LOG_WRN("Invalid DFU data header");
-		goto dfu_finish;
-	}
-
-	err = flash_area_write(flash_area, cur_offset, data, size);
-	if (err) {
-		LOG_ERR("Cannot write data (%d)", err);
-		goto dfu_finish;
+		dfu_stop();
+		return;
 	}
 
-	cur_offset += size;
+	while (size > 0) {
+		/* Buffer is written once the data reaches the buffer boundary.
+		 * The buffer size divides the flash page, so a single write
+		 * never spans two pages.
+		 */
+		size_t len = MIN(size, WRITE_BUF_SIZE -
+				       (cur_offset % WRITE_BUF_SIZE));
+
+		memcpy(&fill_buf->data[fill_buf->len], data, len);
+		fill_buf->len += len;
+		cur_offset += len;
+		data += len;
+		size -= len;
+
+		if ((cur_offset % WRITE_BUF_SIZE != 0) &&
+		    (cur_offset != img_length)) {
+			continue;
+		}
 
-	LOG_DBG("DFU chunk written");
+		/* Previous buffer is still waiting for the write. */
+		if (flush_buf_write()) {
+			dfu_stop();
+			return;
+		}
 
-	if (img_length == cur_offset) {
-		LOG_INF("DFU image written");
+		flush_buf = fill_buf;
+		fill_buf = (fill_buf == &write_bufs[0]) ? &write_bufs[1] :
+							  &write_bufs[0];
+		fill_buf->offset = cur_offset;
+		fill_buf->len = 0;
 
-		goto dfu_finish;
-	} else {
-		k_delayed_work_submit(&dfu_timeout, DFU_TIMEOUT);
+		k_work_submit(&flash_write);
 	}
 
-	return;
+	LOG_DBG("DFU chunk received");
 
-dfu_finish:
-	flash_area_close(flash_area);
-	flash_area = NULL;
-	k_delayed_work_cancel(&dfu_timeout);
+	if (flash_area && (cur_offset != img_length)) {
+		k_delayed_work_submit(&dfu_timeout, DFU_TIMEOUT);
+	}
 }
 
 static void handle_dfu_start(const u8_t *data, const size_t size)
@@ -291,6 +510,7 @@ static void handle_dfu_start(const u8_t *data, const size_t size)
 			cur_offset = 0;
 			img_length = 0;
 			img_csum = 0;
+			write_buf_reset(cur_offset);
 
 			return;
 		} else {
@@ -299,6 +519,13 @@ static void handle_dfu_start(const u8_t *data, const size_t size)
 		}
 	}
 
+	if (offset == 0) {
+		written_csum = IMG_CSUM_INIT;
+		memset(&flash_stats, 0, sizeof(flash_stats));
+	}
+
+	write_buf_reset(cur_offset);
+
 	__ASSERT_NO_MSG(flash_area == NULL);
 	int err = flash_area_open(dfu_slot_id(), &flash_area);
 
@@ -322,10 +549,19 @@ static void handle_dfu_sync(u8_t *data, size_t *size)
 {
 	LOG_INF("DFU sync requested");
 
+	/* Reported offset must be stored in flash. */
+	if (flash_area && fill_buf_write()) {
+		dfu_stop();
+	}
+
+	/* Data short of a full flash word stays in the buffer and is not
+	 * included in the reported offset.
+	 */
+	u32_t offset = written_offset_get();
 	u8_t dfu_active = (flash_area != NULL) ? 0x01 : 0x00;
 
 	size_t data_size = sizeof(dfu_active) + sizeof(img_length) +
-			   sizeof(img_csum) + sizeof(cur_offset);
+			   sizeof(img_csum) + sizeof(offset);
 
 	*size = data_size;
 
@@ -340,8 +576,8 @@ static void handle_dfu_sync(u8_t *data, size_t *size)
 	sys_put_le32(img_csum, &data[pos]);
 	pos += sizeof(img_csum);
 
-	sys_put_le32(cur_offset, &data[pos]);
-	pos += sizeof(cur_offset);
+	sys_put_le32(offset, &data[pos]);
+	pos += sizeof(offset);
 }
 
 static void handle_reboot_request(u8_t *data, size_t *size)
@@ -354,6 +590,20 @@ static void handle_reboot_request(u8_t *data, size_t *size)
 	k_delayed_work_submit(&reboot_request, REBOOT_REQUEST_TIMEOUT);
 }
 
+static void handle_flash_stats_request(u8_t *data, size_t *size)
+{
+	u32_t stall_max_us = k_cyc_to_us_ceil32(flash_stats.stall_max);
+	size_t pos = 0;
+
+	sys_put_le32(flash_stats.write_cnt, &data[pos]);
+	pos += sizeof(flash_stats.write_cnt);
+
+	sys_put_le32(stall_max_us, &data[pos]);
+	pos += sizeof(stall_max_us);
+
+	*size = pos;
+}
+
 static void handle_image_info_request(u8_t *data, size_t *size)
 {
 	const struct fw_info *info;
@@ -444,6 +694,10 @@ static void fetch_config(const u8_t opt_id, u8_t *data, size_t *size)
 		handle_dfu_sync(data, size);
 		break;
 
+	case DFU_OPT_FLASH_STATS:
+		handle_flash_stats_request(data, size);
+		break;
+
 	default:
 		/* Ignore unknown event. */
 		LOG_WRN("Unknown DFU event");
@@ -476,6 +730,7 @@ static bool event_handler(const struct event_header *eh)
 			k_delayed_work_init(&dfu_timeout, dfu_timeout_handler);
 			k_delayed_work_init(&reboot_request, reboot_request_handler);
 			k_delayed_work_init(&background_erase, background_erase_handler);
+			k_work_init(&flash_write, flash_write_handler);
 
 			k_delayed_work_submit(&background_erase, 0);
 		}
@@ -5,7 +5,6 @@
  */
 
 #include <zephyr/types.h>
-#include <sys/slist.h>
 
 #include <bluetooth/services/hids_c.h>
 #include <sys/byteorder.h>
@@ -24,16 +23,42 @@
 #include <logging/log.h>
 LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_HID_FORWARD_LOG_LEVEL);
 
-#define MAX_ENQUEUED_ITEMS	5
+#define QUEUE_SIZE		CONFIG_DESKTOP_HID_FORWARD_QUEUE_SIZE
 
-struct enqueued_event_item {
-	sys_snode_t node;
-	struct hid_report_event *event;
+#define REPORT_SIZE_MAX		MAX(MAX(REPORT_SIZE_MOUSE,		\
+					REPORT_SIZE_KEYBOARD_KEYS),	\
+				    MAX(REPORT_SIZE_SYSTEM_CTRL,	\
+					REPORT_SIZE_CONSUMER_CTRL))
+
+#ifdef CONFIG_DESKTOP_HID_FORWARD_STATS_COUNT
+#define STATS_COUNT		CONFIG_DESKTOP_HID_FORWARD_STATS_COUNT
+#else
+#define STATS_COUNT		0
+#endif
+
+struct report_buf {
+	u8_t size;
+	u8_t data[sizeof(u8_t) + REPORT_SIZE_MAX]; /* Report ID on the front. */
 };
 
 struct hids_subscriber {
 	struct bt_gatt_hids_c hidc;
 	u16_t pid;
+
+	/* Reports waiting for USB, kept also after peer disconnects so
+	 * that key releases are forwarded.
+	 */
+	struct report_buf queue[QUEUE_SIZE];
+	u8_t head;
+	u8_t len;
+};
+
+struct forward_stats {
+	u32_t forwarded;
+	u32_t enqueued;
+	u32_t coalesced;
+	u32_t dropped;
+	u8_t max_depth;
 };
 
 static struct hids_subscriber subscribers[CONFIG_BT_MAX_CONN];
@@ -43,62 +68,176 @@ static bool usb_busy;
 static bool forward_pending;
 static void *channel_id;
 
-static sys_slist_t enqueued_event_list;
-static size_t enqueued_event_count;
+static size_t next_subscriber_idx;
+static struct forward_stats stats;
 
 static struct k_spinlock lock;
 
 
-static void enqueue_hid_event(struct hid_report_event *event)
+static struct report_buf *queue_at(struct hids_subscriber *subscriber,
+				   size_t pos)
 {
-	struct enqueued_event_item *item;
+	return &subscriber->queue[(subscriber->head + pos) % QUEUE_SIZE];
+}
 
-	if (enqueued_event_count < MAX_ENQUEUED_ITEMS) {
-		item = k_malloc(sizeof(*item));
-		enqueued_event_count++;
-	} else {
-		LOG_WRN("Enqueue dropped the oldest event");
-		item = CONTAINER_OF(sys_slist_get(&enqueued_event_list),
-				    __typeof__(*item),
-				    node);
-		k_free(item->event);
+static s16_t mouse_xy_get(u16_t val)
+{
+	/* Sign extend 12-bit value. */
+	return (s16_t)(val << 4) >> 4;
+}
+
+static bool mouse_report_coalesce(u8_t *queued, const u8_t *data)
+{
+	/* Mouse report starts with buttons bitmask followed by 8-bit wheel
+	 * and 12-bit X and Y axes (see hid_report_mouse.h).
+	 */
+	if (queued[0] != data[0]) {
+		/* Keep button state changes. */
+		return false;
 	}
 
-	if (!item) {
-		LOG_ERR("OOM error");
-		module_set_state(MODULE_STATE_ERROR);
-	} else {
-		item->event = event;
-		sys_slist_append(&enqueued_event_list, &item->node);
+	s16_t wheel = (s8_t)queued[1] + (s8_t)data[1];
+	s16_t dx = mouse_xy_get(queued[2] | ((queued[3] & 0x0f) << 8)) +
+		   mouse_xy_get(data[2] | ((data[3] & 0x0f) << 8));
+	s16_t dy = mouse_xy_get((queued[3] >> 4) | (queued[4] << 4)) +
+		   mouse_xy_get((data[3] >> 4) | (data[4] << 4));
+
+	if ((wheel < MOUSE_REPORT_WHEEL_MIN) ||
+	    (wheel > MOUSE_REPORT_WHEEL_MAX) ||
+	    (dx < MOUSE_REPORT_XY_MIN) || (dx > MOUSE_REPORT_XY_MAX) ||
+	    (dy < MOUSE_REPORT_XY_MIN) || (dy > MOUSE_REPORT_XY_MAX)) {
+		return false;
 	}
+
+	queued[1] = wheel;
+	queued[2] = dx & 0xff;
+	queued[3] = ((dy & 0x0f) << 4) | ((dx >> 8) & 0x0f);
+	queued[4] = (dy >> 4) & 0xff;
+
+	return true;
 }
 
-static void forward_hid_report(u8_t report_id, const u8_t *data, size_t size)
+static void stats_update(void)
 {
-	struct hid_report_event *event = new_hid_report_event(size + sizeof(report_id));
+	if (!IS_ENABLED(CONFIG_DESKTOP_HID_FORWARD_STATS)) {
+		return;
+	}
 
-	k_spinlock_key_t key = k_spin_lock(&lock);
+	stats.forwarded++;
 
-	if (!usb_ready) {
-		k_spin_unlock(&lock, key);
-		k_free(event);
+	if (stats.forwarded >= STATS_COUNT) {
+		LOG_INF("Forwarded %u reports: %u enqueued, %u coalesced, "
+			"%u dropped, max queue depth %u", stats.forwarded,
+			stats.enqueued, stats.coalesced, stats.dropped,
+			stats.max_depth);
+		memset(&stats, 0, sizeof(stats));
+	}
+}
+
+static void enqueue_hid_report(struct hids_subscriber *subscriber,
+			       u8_t report_id, const u8_t *data, size_t size)
+{
+	if (size >= sizeof(subscriber->queue[0].data)) {
+		LOG_WRN("Report too big to be enqueued");
+		stats.dropped++;
 		return;
 	}
 
-	event->subscriber = usb_id;
+	if (IS_ENABLED(CONFIG_DESKTOP_HID_FORWARD_MOUSE_COALESCE) &&
+	    (report_id == REPORT_ID_MOUSE) && (size == REPORT_SIZE_MOUSE) &&
+	    (subscriber->len > 0)) {
+		struct report_buf *last = queue_at(subscriber,
+						   subscriber->len - 1);
+
+		if ((last->data[0] == report_id) &&
+		    mouse_report_coalesce(&last->data[1], data)) {
+			stats.coalesced++;
+			return;
+		}
+	}
+
+	if (subscriber->len == QUEUE_SIZE) {
+		LOG_WRN("Enqueue dropped the oldest report");
+		subscriber->head = (subscriber->head + 1) % QUEUE_SIZE;
+		subscriber->len--;
+		stats.dropped++;
+	}
+
+	struct report_buf *buf = queue_at(subscriber, subscriber->len);
+
+	/* Store report as is adding report id on the front. */
+	buf->data[0] = report_id;
+	memcpy(&buf->data[1], data, size);
+	buf->size = size + sizeof(report_id);
+
+	subscriber->len++;
+	stats.enqueued++;
+	stats.max_depth = MAX(stats.max_depth, subscriber->len);
+}
+
+static bool dequeue_hid_report(struct report_buf *buf)
+{
+	/* Serve peripherals in turns so that none of them is starved. */
+	for (size_t i = 0; i < ARRAY_SIZE(subscribers); i++) {
+		size_t idx = (next_subscriber_idx + i) % ARRAY_SIZE(subscribers);
+		struct hids_subscriber *subscriber = &subscribers[idx];
+
+		if (subscriber->len > 0) {
+			*buf = *queue_at(subscriber, 0);
+			subscriber->head = (subscriber->head + 1) % QUEUE_SIZE;
+			subscriber->len--;
+
+			next_subscriber_idx = (idx + 1) %
+					      ARRAY_SIZE(subscribers);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void submit_hid_report(const void *subscriber_id, u8_t report_id,
+			      const u8_t *data, size_t size)
+{
+	struct hid_report_event *event =
+		new_hid_report_event(size + sizeof(report_id));
+
+	event->subscriber = subscriber_id;
 
 	/* Forward report as is adding report id on the front. */
 	event->dyndata.data[0] = report_id;
 	memcpy(&event->dyndata.data[1], data, size);
 
-	if (!usb_busy) {
-		EVENT_SUBMIT(event);
-		usb_busy = true;
-	} else {
-		enqueue_hid_event(event);
+	EVENT_SUBMIT(event);
+}
+
+static void forward_hid_report(struct hids_subscriber *subscriber,
+			       u8_t report_id, const u8_t *data, size_t size)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (!usb_ready) {
+		k_spin_unlock(&lock, key);
+		return;
 	}
 
+	if (usb_busy) {
+		enqueue_hid_report(subscriber, report_id, data, size);
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	const void *subscriber_id = usb_id;
+
+	usb_busy = true;
+	stats_update();
+
 	k_spin_unlock(&lock, key);
+
+	/* USB is free, report is copied from the notification directly to
+	 * the event. The event is allocated only if it is submitted.
+	 */
+	submit_hid_report(subscriber_id, report_id, data, size);
 }
 
 static u8_t hidc_read(struct bt_gatt_hids_c *hids_c,
@@ -114,13 +253,15 @@ static u8_t hidc_read(struct bt_gatt_hids_c *hids_c,
 		return BT_GATT_ITER_CONTINUE;
 	}
 
+	struct hids_subscriber *subscriber =
+		CONTAINER_OF(hids_c, struct hids_subscriber, hidc);
 	u8_t report_id = bt_gatt_hids_c_rep_id(rep);
 	size_t size = bt_gatt_hids_c_rep_size(rep);
 
 	__ASSERT_NO_MSG((report_id != REPORT_ID_RESERVED) &&
 			(report_id < REPORT_ID_COUNT));
 
-	forward_hid_report(report_id, data, size);
+	forward_hid_report(subscriber, report_id, data, size);
 
 	return BT_GATT_ITER_CONTINUE;
 }
@@ -170,7 +311,6 @@ static void init(void)
 	for (size_t i = 0; i < ARRAY_SIZE(subscribers); i++) {
 		bt_gatt_hids_c_init(&subscribers[i].hidc, &params);
 	}
-	sys_slist_init(&enqueued_event_list);
 }
 
 static int register_subscriber(struct bt_gatt_dm *dm, u16_t pid)
@@ -413,7 +553,8 @@ static void disconnect_subscriber(struct hids_subscriber *subscriber)
 
 			memset(empty_data, 0, sizeof(empty_data));
 
-			forward_hid_report(report_id, empty_data, size);
+			forward_hid_report(subscriber, report_id, empty_data,
+					   size);
 		}
 	}
 
@@ -430,50 +571,40 @@ static void clear_state(void)
 	usb_busy = false;
 
 	/* Clear all the reports. */
-	while (!sys_slist_is_empty(&enqueued_event_list)) {
-		struct enqueued_event_item *item;;
-
-		item = CONTAINER_OF(sys_slist_get(&enqueued_event_list),
-				     __typeof__(*item),
-				    node);
-		enqueued_event_count--;
-
-		k_spin_unlock(&lock, key);
-
-		k_free(item->event);
-		k_free(item);
-
-		key = k_spin_lock(&lock);
+	for (size_t i = 0; i < ARRAY_SIZE(subscribers); i++) {
+		subscribers[i].head = 0;
+		subscribers[i].len = 0;
 	}
 
-	__ASSERT_NO_MSG(enqueued_event_count == 0);
-
 	k_spin_unlock(&lock, key);
 }
 
 static bool event_handler(const struct event_header *eh)
 {
 	if (is_hid_report_sent_event(eh)) {
+		struct report_buf buf;
+		const void *subscriber_id;
+		bool dequeued;
+
 		k_spinlock_key_t key = k_spin_lock(&lock);
 
 		__ASSERT_NO_MSG(usb_ready);
 
-		struct enqueued_event_item *item = NULL;
-
-		if (!sys_slist_is_empty(&enqueued_event_list)) {
-			item = CONTAINER_OF(sys_slist_get(&enqueued_event_list),
-					    __typeof__(*item),
-					    node);
-			enqueued_event_count--;
-
-			EVENT_SUBMIT(item->event);
+		subscriber_id = usb_id;
+		dequeued = dequeue_hid_report(&buf);
+		if (dequeued) {
+			stats_update();
 		} else {
 			usb_busy = false;
 		}
 
 		k_spin_unlock(&lock, key);
 
-		k_free(item);
+		if (dequeued) {
+			submit_hid_report(subscriber_id, buf.data[0],
+					  &buf.data[1],
+					  buf.size - sizeof(buf.data[0]));
+		}
 
 		return false;
 	}
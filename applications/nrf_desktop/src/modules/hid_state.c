@@ -14,7 +14,6 @@
 #include <sys/types.h>
 
 #include <zephyr/types.h>
-#include <sys/slist.h>
 #include <sys/util.h>
 #include <sys/byteorder.h>
 
@@ -28,6 +27,7 @@
 #include "hid_keymap.h"
 #include "hid_keymap_def.h"
 #include "hid_report_desc.h"
+#include "hid_eventq.h"
 
 #define MODULE hid_state
 #include "module_state_event.h"
@@ -35,6 +35,11 @@
 #include <logging/log.h>
 LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_HID_STATE_LOG_LEVEL);
 
+#ifdef CONFIG_DESKTOP_USB_REPORT_QUEUE_SIZE
+#define USB_PIPELINE_DEPTH	CONFIG_DESKTOP_USB_REPORT_QUEUE_SIZE
+#else
+#define USB_PIPELINE_DEPTH	1
+#endif
 
 /**@brief Module state. */
 enum state {
@@ -79,19 +84,6 @@ struct items {
 	struct item item[ITEM_COUNT]; /**< Items set. Browse from the end. */
 };
 
-/**@brief Enqueued HID state item. */
-struct item_event {
-	sys_snode_t node; /**< Event queue linked list node. */
-	struct item item; /**< HID state item which has been enqueued. */
-	u32_t timestamp; /**< HID event timestamp. */
-};
-
-/**@brief Event queue. */
-struct eventq {
-	sys_slist_t root;
-	size_t len;
-};
-
 /**@brief Axis data. */
 struct axis_data {
 	s16_t axis[AXIS_COUNT]; /**< Array of axes. */
@@ -100,7 +92,7 @@ struct axis_data {
 
 struct report_data {
 	struct items items;
-	struct eventq eventq;
+	struct hid_eventq eventq;
 	struct axis_data axes;
 	bool update_needed;
 	struct report_state *linked_rs;
@@ -131,6 +123,8 @@ struct hid_state {
 static u8_t report_data_index[REPORT_ID_COUNT];
 static u8_t report_state_index[REPORT_ID_COUNT];
 static struct hid_state state;
+static struct hid_eventq_event eventq_buf[INPUT_REPORT_DATA_COUNT]
+					 [CONFIG_DESKTOP_HID_EVENT_QUEUE_SIZE];
 
 
 static void report_send(struct report_data *rd, bool check_state, bool send_always);
@@ -207,181 +201,10 @@ static int usage_id_compare(const void *a, const void *b)
 	return (p_a->usage_id - p_b->usage_id);
 }
 
-static void eventq_reset(struct eventq *eventq)
-{
-	struct item_event *event;
-	struct item_event *tmp;
-
-	SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&eventq->root, event, tmp, node) {
-		sys_slist_remove(&eventq->root, NULL, &event->node);
-
-		k_free(event);
-	}
-
-	sys_slist_init(&eventq->root);
-	eventq->len = 0;
-}
-
-static bool eventq_is_full(const struct eventq *eventq)
-{
-	return (eventq->len >= CONFIG_DESKTOP_HID_EVENT_QUEUE_SIZE);
-}
-
-
-static bool eventq_is_empty(struct eventq *eventq)
-{
-	bool empty = sys_slist_is_empty(&eventq->root);
-
-	__ASSERT_NO_MSG(!empty == (eventq->len != 0));
-
-	return empty;
-}
-
-static struct item_event *eventq_get(struct eventq *eventq)
-{
-	sys_snode_t *node = sys_slist_get(&eventq->root);
-
-	if (!node) {
-		return NULL;
-	}
-
-	eventq->len--;
-
-	return CONTAINER_OF(node, struct item_event, node);
-}
-
-static void eventq_append(struct eventq *eventq, u16_t usage_id, s16_t value)
-{
-	struct item_event *hid_event = k_malloc(sizeof(*hid_event));
-
-	if (!hid_event) {
-		LOG_WRN("Failed to allocate HID event");
-		return;
-	}
-
-	hid_event->item.usage_id = usage_id;
-	hid_event->item.value = value;
-	hid_event->timestamp = K_MSEC(k_uptime_get());
-
-	/* Add a new event to the queue. */
-	sys_slist_append(&eventq->root, &hid_event->node);
-
-	eventq->len++;
-}
-
-static void eventq_region_purge(struct eventq *eventq,
-				sys_snode_t *last_to_purge)
+static void eventq_cleanup(struct hid_eventq *eventq, u32_t timestamp)
 {
-	sys_snode_t *tmp;
-	sys_snode_t *tmp_safe;
-	size_t cnt = 0;
-
-	SYS_SLIST_FOR_EACH_NODE_SAFE(&eventq->root, tmp, tmp_safe) {
-		sys_slist_remove(&eventq->root, NULL, tmp);
-
-		k_free(CONTAINER_OF(tmp, struct item_event, node));
-		cnt++;
-
-		if (tmp == last_to_purge) {
-			break;
-		}
-	}
-
-	eventq->len -= cnt;
-
-	LOG_WRN("%u stale events removed from the queue!", cnt);
-}
-
-
-static void eventq_cleanup(struct eventq *eventq, u32_t timestamp)
-{
-	/* Find timed out events. */
-
-	sys_snode_t *first_valid;
-
-	SYS_SLIST_FOR_EACH_NODE(&eventq->root, first_valid) {
-		u32_t diff = timestamp - CONTAINER_OF(
-			first_valid, struct item_event, node)->timestamp;
-
-		if (diff < CONFIG_DESKTOP_HID_REPORT_EXPIRATION) {
-			break;
-		}
-	}
-
-	/* Remove events but only if key up was generated for each removed
-	 * key down.
-	 */
-
-	sys_snode_t *maxfound = sys_slist_peek_head(&eventq->root);
-	size_t maxfound_pos = 0;
-
-	sys_snode_t *cur;
-	size_t cur_pos = 0;
-
-	sys_snode_t *tmp_safe;
-
-	SYS_SLIST_FOR_EACH_NODE_SAFE(&eventq->root, cur, tmp_safe) {
-		const struct item cur_item =
-			CONTAINER_OF(cur, struct item_event, node)->item;
-
-		if (cur_item.value > 0) {
-			/* Every key down must be paired with key up.
-			 * Set hit count to value as we just detected
-			 * first key down for this usage.
-			 */
-
-			unsigned int hit_count = cur_item.value;
-			sys_snode_t *j = cur;
-			size_t j_pos = cur_pos;
-
-			SYS_SLIST_ITERATE_FROM_NODE(&eventq->root, j) {
-				j_pos++;
-				if (j == first_valid) {
-					break;
-				}
-
-				const struct item item =
-					CONTAINER_OF(j,
-						     struct item_event,
-						     node)->item;
-
-				if (cur_item.usage_id == item.usage_id) {
-					hit_count += item.value;
-
-					if (hit_count == 0) {
-						/* All events with this usage
-						 * are paired.
-						 */
-						break;
-					}
-				}
-			}
-
-			if (j == first_valid) {
-				/* Pair not found. */
-				break;
-			}
-
-			if (j_pos > maxfound_pos) {
-				maxfound = j;
-				maxfound_pos = j_pos;
-			}
-		}
-
-
-		if (cur == first_valid) {
-			break;
-		}
-
-		if (cur == maxfound) {
-			/* All events up to this point have pairs and can
-			 * be deleted.
-			 */
-			eventq_region_purge(eventq, maxfound);
-		}
-
-		cur_pos++;
-	}
+	hid_eventq_cleanup(eventq, timestamp,
+			   CONFIG_DESKTOP_HID_REPORT_EXPIRATION);
 }
 
 static void sort_by_usage_id(struct item items[], size_t array_size)
@@ -420,7 +243,7 @@ static void clear_report_data(struct report_data *rd)
 
 	clear_axes(&rd->axes);
 	clear_items(&rd->items);
-	eventq_reset(&rd->eventq);
+	hid_eventq_reset(&rd->eventq);
 
 	rd->update_needed = false;
 }
@@ -874,21 +697,16 @@ static bool update_report(struct report_data *rd)
 {
 	bool update_needed = false;
 
-	while (!update_needed && !eventq_is_empty(&rd->eventq)) {
-		/* There are enqueued events to handle. */
-		struct item_event *event = eventq_get(&rd->eventq);
-
-		__ASSERT_NO_MSG(event);
+	struct hid_eventq_event event;
 
+	while (!update_needed && hid_eventq_get(&rd->eventq, &event)) {
+		/* There are enqueued events to handle. */
 		update_needed = key_value_set(&rd->items,
-					      event->item.usage_id,
-					      event->item.value);
+					      event.usage_id,
+					      event.value);
 
 		rd->update_needed = rd->update_needed || update_needed;
 
-
-		k_free(event);
-
 		/* If no item was changed, try next event. */
 	}
 
@@ -913,10 +731,11 @@ static void report_send(struct report_data *rd, bool check_state, bool send_alwa
 	if (!check_state || (rs->state != STATE_DISCONNECTED)) {
 		unsigned int pipeline_depth;
 
-		if ((rs->subscriber->is_usb) ||
-		    (rs->report_id == REPORT_ID_CONSUMER_CTRL) ||
+		if ((rs->report_id == REPORT_ID_CONSUMER_CTRL) ||
 		    (rs->report_id == REPORT_ID_SYSTEM_CTRL))  {
 			pipeline_depth = 1;
+		} else if (rs->subscriber->is_usb) {
+			pipeline_depth = USB_PIPELINE_DEPTH;
 		} else {
 			pipeline_depth = 2;
 		}
@@ -1059,7 +878,7 @@ static void connect(const void *subscriber_id, u8_t report_id)
 		}
 		rd->linked_rs = rs;
 
-		if (!eventq_is_empty(&rd->eventq)) {
+		if (!hid_eventq_is_empty(&rd->eventq)) {
 			/* Remove all stale events from the queue. */
 			eventq_cleanup(&rd->eventq, K_MSEC(k_uptime_get()));
 		}
@@ -1100,48 +919,24 @@ static void disconnect(const void *subscriber_id, u8_t report_id)
 static void enqueue(struct report_data *rd, u16_t usage_id, s16_t value,
 		    bool connected)
 {
-	eventq_cleanup(&rd->eventq, K_MSEC(k_uptime_get()));
-
-	if (eventq_is_full(&rd->eventq)) {
-		if (!connected) {
-			/* In disconnected state no items are recorded yet.
-			 * Try to remove queued items starting from the
-			 * oldest one.
-			 */
-			sys_snode_t *i;
-
-			SYS_SLIST_FOR_EACH_NODE(&rd->eventq.root, i) {
-				/* Initial cleanup was done above. Queue will
-				 * not contain events with expired timestamp.
-				 */
-				u32_t timestamp =
-					CONTAINER_OF(i,
-						     struct item_event,
-						     node)->timestamp +
-					CONFIG_DESKTOP_HID_REPORT_EXPIRATION;
-
-				eventq_cleanup(&rd->eventq, timestamp);
-
-				if (!eventq_is_full(&rd->eventq)) {
-					/* At least one element was removed
-					 * from the queue. Do not continue
-					 * list traverse, content was modified!
-					 */
-					break;
-				}
-			}
-		}
-
-		if (eventq_is_full(&rd->eventq)) {
-			/* To maintain the sanity of HID state, clear
-			 * all recorded events and items.
-			 */
-			LOG_WRN("Queue is full, all events are dropped!");
-			clear_report_data(rd);
-		}
+	/* In disconnected state no items are recorded yet, so also the
+	 * events that did not expire can be removed.
+	 */
+	if (!hid_eventq_make_room(&rd->eventq, K_MSEC(k_uptime_get()),
+				  CONFIG_DESKTOP_HID_REPORT_EXPIRATION,
+				  !connected)) {
+		/* To maintain the sanity of HID state, clear
+		 * all recorded events and items.
+		 */
+		LOG_WRN("Queue is full, all events are dropped!");
+		clear_report_data(rd);
 	}
 
-	eventq_append(&rd->eventq, usage_id, value);
+	int err = hid_eventq_append(&rd->eventq, usage_id, value,
+				    K_MSEC(k_uptime_get()));
+
+	__ASSERT_NO_MSG(!err);
+	ARG_UNUSED(err);
 }
 
 /**@brief Function for updating the value linked to the HID usage. */
@@ -1159,7 +954,7 @@ static void update_key(const struct hid_keymap *map, s16_t value)
 		connected = (rs->state != STATE_DISCONNECTED);
 	}
 
-	if (!connected || !eventq_is_empty(&rd->eventq)) {
+	if (!connected || !hid_eventq_is_empty(&rd->eventq)) {
 		/* Report cannot be sent yet - enqueue this HID event. */
 		enqueue(rd, map->usage_id, value, connected);
 	} else {
@@ -1187,6 +982,11 @@ static void init(void)
 		}
 	}
 
+	for (size_t i = 0; i < ARRAY_SIZE(state.report_data); i++) {
+		hid_eventq_init(&state.report_data[i].eventq, eventq_buf[i],
+				ARRAY_SIZE(eventq_buf[i]));
+	}
+
 	/* Mark unused report IDs. */
 	for (size_t i = 0; i < ARRAY_SIZE(report_data_index); i++) {
 		report_data_index[i] = INPUT_REPORT_DATA_COUNT;
@@ -7,6 +7,7 @@
 #include <zephyr.h>
 #include <sys/byteorder.h>
 
+#include "hid_report_desc.h"
 #include "config_event.h"
 
 #define MODULE info
@@ -19,12 +20,16 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_INFO_LOG_LEVEL);
 
 enum config_info_opt {
 	INFO_OPT_BOARD_NAME,
+	INFO_OPT_WINDOW_SIZE,
+	INFO_OPT_REPORT_SIZE,
 
 	INFO_OPT_COUNT
 };
 
 const static char *opt_descr[] = {
-	"board_name"
+	"board_name",
+	"window_size",
+	"report_size"
 };
 
 static void fetch_config(const u8_t opt_id, u8_t *data, size_t *size)
@@ -45,6 +50,18 @@ static void fetch_config(const u8_t opt_id, u8_t *data, size_t *size)
 		*size = name_len;
 		break;
 	}
+	case INFO_OPT_WINDOW_SIZE:
+		/* Windowed transfer is supported by the configuration channel
+		 * of this device.
+		 */
+		data[0] = CONFIG_DESKTOP_CONFIG_CHANNEL_WINDOW_SIZE;
+		*size = sizeof(u8_t);
+		break;
+	case INFO_OPT_REPORT_SIZE:
+		/* Feature report size without the report ID. */
+		data[0] = REPORT_SIZE_USER_CONFIG;
+		*size = sizeof(u8_t);
+		break;
 	default:
 		LOG_WRN("Unknown config fetch option ID %" PRIu8, opt_id);
 		break;
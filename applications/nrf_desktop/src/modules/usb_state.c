@@ -5,6 +5,7 @@
  */
 
 #include <zephyr/types.h>
+#include <spinlock.h>
 #include <sys/byteorder.h>
 #include <sys/util.h>
 
@@ -25,21 +26,67 @@ LOG_MODULE_REGISTER(MODULE, CONFIG_DESKTOP_USB_STATE_LOG_LEVEL);
 #include "hid_event.h"
 #include "usb_event.h"
 #include "config_event.h"
+#include "button_event.h"
 
 #define REPORT_TYPE_INPUT	0x01
 #define REPORT_TYPE_OUTPUT	0x02
 #define REPORT_TYPE_FEATURE	0x03
 
+#define REPORT_QUEUE_SIZE	CONFIG_DESKTOP_USB_REPORT_QUEUE_SIZE
+#define REPORT_SIZE_MAX		MAX(MAX(REPORT_SIZE_MOUSE,		\
+					REPORT_SIZE_KEYBOARD_KEYS),	\
+				    MAX(REPORT_SIZE_SYSTEM_CTRL,	\
+					REPORT_SIZE_CONSUMER_CTRL))
+
+#ifdef CONFIG_DESKTOP_USB_LATENCY_STATS_COUNT
+#define LATENCY_STATS_COUNT	CONFIG_DESKTOP_USB_LATENCY_STATS_COUNT
+#else
+#define LATENCY_STATS_COUNT	0
+#endif
+
 
 #ifndef CONFIG_USB_HID_PROTOCOL_CODE
 #define CONFIG_USB_HID_PROTOCOL_CODE -1
 #endif
 
+struct report_item {
+	u8_t data[sizeof(u8_t) + REPORT_SIZE_MAX]; /* Report ID on the front. */
+	u8_t size;
+	bool boot;
+	u32_t seq;
+	u32_t button_cyc;
+	bool button_pending;
+};
+
+struct report_queue {
+	struct report_item item[REPORT_QUEUE_SIZE];
+	u8_t head;
+	u8_t len;
+};
+
+struct latency_stats {
+	u32_t min;
+	u32_t max;
+	u64_t sum;
+	u16_t count;
+};
+
 static enum usb_state state;
 static u8_t hid_protocol = HID_PROTOCOL_REPORT;
 static struct device *usb_dev;
 static u8_t sent_report_id = REPORT_ID_COUNT;
 
+/* Reports waiting for the endpoint, one queue per report ID. */
+static struct report_queue report_queue[REPORT_ID_COUNT];
+static u32_t report_seq;
+static struct k_spinlock lock;
+
+static u32_t button_cyc;
+static bool button_pending;
+static bool sent_button_pending;
+static u32_t sent_button_cyc;
+static struct latency_stats latency_stats;
+
 static struct config_channel_state cfg_chan;
 
 static int get_report(struct usb_setup_packet *setup, s32_t *len, u8_t **data)
@@ -139,22 +186,155 @@ static int set_report(struct usb_setup_packet *setup, s32_t *len, u8_t **data)
 	return 0;
 }
 
-static void report_sent(bool error)
+static void report_sent(u8_t report_id, bool error)
 {
 	struct hid_report_sent_event *event = new_hid_report_sent_event();
 
-	event->report_id = sent_report_id;
+	event->report_id = report_id;
 	event->subscriber = &state;
 	event->error = error;
 	EVENT_SUBMIT(event);
+}
+
+static void latency_stats_update(u32_t cyc)
+{
+	u32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - cyc);
+
+	if (latency_stats.count == 0) {
+		latency_stats.min = latency_us;
+		latency_stats.max = latency_us;
+		latency_stats.sum = 0;
+	}
+
+	latency_stats.min = MIN(latency_stats.min, latency_us);
+	latency_stats.max = MAX(latency_stats.max, latency_us);
+	latency_stats.sum += latency_us;
+	latency_stats.count++;
+
+	if (latency_stats.count >= LATENCY_STATS_COUNT) {
+		LOG_INF("Button-to-USB latency [us]: min %u avg %u max %u",
+			latency_stats.min,
+			(u32_t)(latency_stats.sum / latency_stats.count),
+			latency_stats.max);
+		latency_stats.count = 0;
+	}
+}
+
+static struct report_item *report_queue_oldest(void)
+{
+	struct report_item *oldest = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(report_queue); i++) {
+		struct report_queue *queue = &report_queue[i];
+
+		if (queue->len == 0) {
+			continue;
+		}
+
+		struct report_item *item = &queue->item[queue->head];
+
+		if (!oldest || ((s32_t)(item->seq - oldest->seq) < 0)) {
+			oldest = item;
+		}
+	}
+
+	return oldest;
+}
+
+static void report_queue_clear(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(report_queue); i++) {
+		report_queue[i].head = 0;
+		report_queue[i].len = 0;
+	}
+}
+
+static int report_write(const u8_t *data, size_t size, bool boot)
+{
+	if (boot) {
+		/* For boot protocol omit the first byte. */
+		data++;
+		size--;
+		__ASSERT_NO_MSG(size > 0);
+	}
+
+	int err = hid_int_ep_write(usb_dev, data, size, NULL);
+
+	if (err) {
+		LOG_ERR("Cannot send report (%d)", err);
+	}
+
+	return err;
+}
+
+/* Writes the oldest queued report. A report that cannot be written is
+ * dropped and the next one is tried. The endpoint is released only once
+ * the queue is empty.
+ */
+static void report_queue_write(void)
+{
+	struct report_item item;
+
+	while (true) {
+		k_spinlock_key_t key = k_spin_lock(&lock);
+		struct report_item *oldest = report_queue_oldest();
+
+		if (!oldest) {
+			/* Used to assert if previous report was sent before
+			 * sending new one.
+			 */
+			sent_report_id = REPORT_ID_COUNT;
+			sent_button_pending = false;
+			k_spin_unlock(&lock, key);
+			return;
+		}
 
-	/* Used to assert if previous report was sent before sending new one. */
-	sent_report_id = REPORT_ID_COUNT;
+		struct report_queue *queue = &report_queue[oldest->data[0]];
+
+		item = *oldest;
+		queue->head = (queue->head + 1) % REPORT_QUEUE_SIZE;
+		queue->len--;
+
+		sent_report_id = item.data[0];
+		sent_button_pending = item.button_pending;
+		sent_button_cyc = item.button_cyc;
+
+		k_spin_unlock(&lock, key);
+
+		if (!report_write(item.data, item.size, item.boot)) {
+			return;
+		}
+
+		report_sent(item.data[0], true);
+	}
 }
 
 static void report_sent_cb(void)
 {
-	report_sent(false);
+	u8_t report_id;
+	bool button_sent;
+	u32_t cyc;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	report_id = sent_report_id;
+	button_sent = sent_button_pending;
+	cyc = sent_button_cyc;
+
+	k_spin_unlock(&lock, key);
+
+	/* Write the next report right away, so that it can be sent in the
+	 * next USB frame without a round trip through the event manager.
+	 */
+	report_queue_write();
+
+	if (IS_ENABLED(CONFIG_DESKTOP_USB_LATENCY_STATS) && button_sent) {
+		latency_stats_update(cyc);
+	}
+
+	if (report_id != REPORT_ID_COUNT) {
+		report_sent(report_id, false);
+	}
 }
 
 static void send_hid_report(const struct hid_report_event *event)
@@ -171,37 +351,90 @@ static void send_hid_report(const struct hid_report_event *event)
 
 	const u8_t *report_buffer = event->dyndata.data;
 	size_t report_size = event->dyndata.size;
+	u8_t report_id = report_buffer[0];
+	bool boot = false;
 
 	__ASSERT_NO_MSG(report_size > 0);
-	__ASSERT_NO_MSG(sent_report_id == REPORT_ID_COUNT);
+	__ASSERT_NO_MSG(report_id < REPORT_ID_COUNT);
 
 	if (hid_protocol != HID_PROTOCOL_REPORT) {
 		if ((IS_ENABLED(CONFIG_DESKTOP_HID_BOOT_INTERFACE_MOUSE) &&
-		     (report_buffer[0] == REPORT_ID_BOOT_MOUSE)) ||
+		     (report_id == REPORT_ID_BOOT_MOUSE)) ||
 		    (IS_ENABLED(CONFIG_DESKTOP_HID_BOOT_INTERFACE_KEYBOARD) &&
-		     (report_buffer[0] == REPORT_ID_BOOT_KEYBOARD))) {
-			sent_report_id = event->dyndata.data[0];
-			/* For boot protocol omit the first byte. */
-			report_buffer++;
-			report_size--;
-			__ASSERT_NO_MSG(report_size > 0);
+		     (report_id == REPORT_ID_BOOT_KEYBOARD))) {
+			boot = true;
 		} else {
 			/* Boot protocol is not supported or this is not a
 			 * boot report.
 			 */
 			return;
 		}
-	} else {
-		sent_report_id = event->dyndata.data[0];
 	}
 
-	int err = hid_int_ep_write(usb_dev, event->dyndata.data,
-				   event->dyndata.size, NULL);
+	k_spinlock_key_t key = k_spin_lock(&lock);
 
-	if (err) {
-		LOG_ERR("Cannot send report (%d)", err);
-		report_sent(true);
+	/* The first report after a button event carries its latency mark. */
+	bool button_mark = button_pending;
+	u32_t cyc = button_cyc;
+
+	button_pending = false;
+
+	if (sent_report_id == REPORT_ID_COUNT) {
+		/* Endpoint is free, write the report directly from the
+		 * event.
+		 */
+		sent_report_id = report_id;
+		sent_button_pending = button_mark;
+		sent_button_cyc = cyc;
+
+		k_spin_unlock(&lock, key);
+
+		if (report_write(report_buffer, report_size, boot)) {
+			/* Reports queued in the meantime are written next. */
+			report_queue_write();
+
+			report_sent(report_id, true);
+		}
+
+		return;
+	}
+
+	struct report_queue *queue = &report_queue[report_id];
+
+	if ((queue->len == REPORT_QUEUE_SIZE) ||
+	    (report_size > sizeof(queue->item[0].data))) {
+		k_spin_unlock(&lock, key);
+
+		LOG_WRN("Cannot enqueue report %" PRIu8, report_id);
+		report_sent(report_id, true);
+		return;
+	}
+
+	struct report_item *item =
+		&queue->item[(queue->head + queue->len) % REPORT_QUEUE_SIZE];
+
+	memcpy(item->data, report_buffer, report_size);
+	item->size = report_size;
+	item->boot = boot;
+	item->seq = report_seq++;
+	item->button_pending = button_mark;
+	item->button_cyc = cyc;
+	queue->len++;
+
+	k_spin_unlock(&lock, key);
+}
+
+static void handle_button_event(const struct button_event *event)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	/* Measure latency from the oldest button event not reported yet. */
+	if (!button_pending && (state == USB_STATE_ACTIVE)) {
+		button_cyc = k_cycle_get_32();
+		button_pending = true;
 	}
+
+	k_spin_unlock(&lock, key);
 }
 
 static void broadcast_usb_state(void)
@@ -216,10 +449,18 @@ static void broadcast_usb_state(void)
 
 static void reset_pending_report(void)
 {
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
 	if (sent_report_id != REPORT_ID_COUNT) {
 		LOG_WRN("USB clear report notification waiting flag");
 		sent_report_id = REPORT_ID_COUNT;
 	}
+
+	report_queue_clear();
+	button_pending = false;
+	sent_button_pending = false;
+
+	k_spin_unlock(&lock, key);
 }
 
 static void broadcast_subscription_change(void)
@@ -464,6 +705,13 @@ static bool event_handler(const struct event_header *eh)
 		return false;
 	}
 
+	if (IS_ENABLED(CONFIG_DESKTOP_USB_LATENCY_STATS) &&
+	    is_button_event(eh)) {
+		handle_button_event(cast_button_event(eh));
+
+		return false;
+	}
+
 	if (is_module_state_event(eh)) {
 		struct module_state_event *event = cast_module_state_event(eh);
 
@@ -515,6 +763,9 @@ static bool event_handler(const struct event_header *eh)
 EVENT_LISTENER(MODULE, event_handler);
 EVENT_SUBSCRIBE(MODULE, module_state_event);
 EVENT_SUBSCRIBE(MODULE, hid_report_event);
+#if CONFIG_DESKTOP_USB_LATENCY_STATS
+EVENT_SUBSCRIBE(MODULE, button_event);
+#endif
 #if CONFIG_DESKTOP_CONFIG_CHANNEL_ENABLE
 EVENT_SUBSCRIBE(MODULE, config_forwarded_event);
 EVENT_SUBSCRIBE(MODULE, config_fetch_event);
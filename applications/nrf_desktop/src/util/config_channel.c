@@ -56,6 +56,18 @@ static int data_len_check(const struct config_channel_frame *frame,
 	return 0;
 }
 
+static void window_reset(struct config_channel_window *window)
+{
+	k_spinlock_key_t key = k_spin_lock(&window->lock);
+
+	/* Events still in flight are not acknowledged anymore. */
+	window->active = false;
+	window->in_flight = 0;
+	window->head = 0;
+
+	k_spin_unlock(&window->lock, key);
+}
+
 static void timeout_handler(struct k_work *work)
 {
 	struct config_channel_state *cfg_chan =
@@ -65,6 +77,7 @@ static void timeout_handler(struct k_work *work)
 	LOG_WRN("Config channel transaction timed out");
 
 	cfg_chan->transaction_active = false;
+	window_reset(&cfg_chan->window);
 }
 
 void config_channel_init(struct config_channel_state *cfg_chan)
@@ -73,6 +86,8 @@ void config_channel_init(struct config_channel_state *cfg_chan)
 
 	cfg_chan->transaction_active = false;
 	cfg_chan->disconnected = false;
+	cfg_chan->is_window = false;
+	window_reset(&cfg_chan->window);
 }
 
 int config_channel_report_parse(const u8_t *buffer, size_t length,
@@ -151,6 +166,127 @@ int config_channel_report_fill(u8_t *buffer, const size_t length,
 	return pos;
 }
 
+static int window_report_get(struct config_channel_state *cfg_chan,
+			     u8_t *buffer, size_t length, bool usb)
+{
+	struct config_channel_window *window = &cfg_chan->window;
+	k_spinlock_key_t key = k_spin_lock(&window->lock);
+	u8_t acked_seq = window->acked_seq;
+	bool in_flight = (window->in_flight > 0);
+
+	k_spin_unlock(&window->lock, key);
+
+	/* Cumulative acknowledgment of the processed frames. */
+	cfg_chan->frame.status = in_flight ? CONFIG_STATUS_PENDING :
+					     CONFIG_STATUS_SUCCESS;
+	cfg_chan->frame.event_data_len = sizeof(acked_seq);
+	cfg_chan->frame.event_data = &acked_seq;
+
+	int pos = config_channel_report_fill(buffer, length,
+					     &cfg_chan->frame, usb);
+	if (pos < 0) {
+		LOG_WRN("Could not set report");
+		return pos;
+	}
+
+	return 0;
+}
+
+static int window_frame_receive(struct config_channel_state *cfg_chan,
+				const u8_t *data, u16_t local_product_id)
+{
+	struct config_channel_window *window = &cfg_chan->window;
+	const struct config_channel_frame *frame = &cfg_chan->frame;
+	struct config_event *event = NULL;
+
+	if ((frame->recipient != local_product_id) ||
+	    (frame->event_data_len < sizeof(window->next_seq))) {
+		LOG_WRN("Unsupported windowed frame");
+
+		atomic_set(&cfg_chan->status, CONFIG_STATUS_REJECT);
+		return -ENOTSUP;
+	}
+
+	u8_t seq = data[0];
+	size_t data_len = frame->event_data_len - sizeof(seq);
+
+	cfg_chan->is_fetch = false;
+	cfg_chan->is_window = true;
+	cfg_chan->disconnected = false;
+
+	k_spinlock_key_t key = k_spin_lock(&window->lock);
+
+	if (!window->active) {
+		window->active = true;
+		window->next_seq = seq;
+		window->acked_seq = seq - 1;
+		atomic_set(&cfg_chan->status, CONFIG_STATUS_SUCCESS);
+	}
+
+	/* Frames that do not follow the previous one are dropped. The host
+	 * resends all of the frames after the acknowledged one.
+	 */
+	if ((seq == window->next_seq) &&
+	    (window->in_flight < ARRAY_SIZE(window->pending))) {
+		event = new_config_event(data_len);
+
+		memcpy(event->dyndata.data, &data[sizeof(seq)], data_len);
+		event->id = frame->event_id;
+
+		size_t idx = (window->head + window->in_flight) %
+			     ARRAY_SIZE(window->pending);
+
+		window->pending[idx] = event;
+		window->in_flight++;
+		window->next_seq++;
+	}
+
+	k_spin_unlock(&window->lock, key);
+
+	if (!event) {
+		LOG_DBG("Frame %" PRIu8 " dropped", seq);
+		return 0;
+	}
+
+	k_delayed_work_submit(&cfg_chan->timeout,
+			      K_SECONDS(CONFIG_DESKTOP_CONFIG_CHANNEL_TIMEOUT));
+
+	EVENT_SUBMIT(event);
+
+	return 0;
+}
+
+static bool window_event_done(struct config_channel_state *cfg_chan,
+			      const struct config_event *event)
+{
+	struct config_channel_window *window = &cfg_chan->window;
+	bool done = false;
+	bool idle = false;
+	k_spinlock_key_t key = k_spin_lock(&window->lock);
+
+	/* Config events are processed in the order of submission. */
+	if ((window->in_flight > 0) &&
+	    (window->pending[window->head] == event)) {
+		window->head = (window->head + 1) % ARRAY_SIZE(window->pending);
+		window->in_flight--;
+		window->acked_seq++;
+
+		done = true;
+		idle = (window->in_flight == 0);
+	}
+
+	k_spin_unlock(&window->lock, key);
+
+	if (idle) {
+		k_delayed_work_cancel(&cfg_chan->timeout);
+	} else if (done) {
+		k_delayed_work_submit(&cfg_chan->timeout,
+			K_SECONDS(CONFIG_DESKTOP_CONFIG_CHANNEL_TIMEOUT));
+	}
+
+	return done;
+}
+
 int config_channel_report_get(struct config_channel_state *cfg_chan,
 			      u8_t *buffer, size_t length, bool usb,
 			      u16_t local_product_id)
@@ -173,6 +309,10 @@ int config_channel_report_get(struct config_channel_state *cfg_chan,
 		return -EIO;
 	}
 
+	if (cfg_chan->is_window) {
+		return window_report_get(cfg_chan, buffer, length, usb);
+	}
+
 	if (cfg_chan->is_fetch) {
 		__ASSERT_NO_MSG(cfg_chan->frame.event_data_len == 0);
 
@@ -259,6 +399,20 @@ int config_channel_report_set(struct config_channel_state *cfg_chan,
 		return -ENOTSUP;
 	}
 
+	if (cfg_chan->frame.status == CONFIG_STATUS_WINDOW_SET) {
+		return window_frame_receive(cfg_chan, &buffer[pos],
+					    local_product_id);
+	}
+
+	if (cfg_chan->window.in_flight > 0) {
+		LOG_WRN("Windowed transfer in progress");
+		return -EBUSY;
+	}
+
+	/* Request sent without the windowed mode ends the windowed transfer. */
+	cfg_chan->is_window = false;
+	window_reset(&cfg_chan->window);
+
 	/* Start transaction timeout. */
 	k_delayed_work_submit(&cfg_chan->timeout,
 			      K_SECONDS(CONFIG_DESKTOP_CONFIG_CHANNEL_TIMEOUT));
@@ -367,6 +521,10 @@ void config_channel_forwarded_receive(struct config_channel_state *cfg_chan,
 void config_channel_event_done(struct config_channel_state *cfg_chan,
 			       const struct config_event *event)
 {
+	if (window_event_done(cfg_chan, event)) {
+		return;
+	}
+
 	if (event == cfg_chan->pending_config_event) {
 		atomic_set(&cfg_chan->status, CONFIG_STATUS_SUCCESS);
 
@@ -377,6 +535,12 @@ void config_channel_event_done(struct config_channel_state *cfg_chan,
 
 void config_channel_disconnect(struct config_channel_state *cfg_chan)
 {
+	if (cfg_chan->is_window) {
+		cfg_chan->is_window = false;
+		window_reset(&cfg_chan->window);
+		k_delayed_work_cancel(&cfg_chan->timeout);
+	}
+
 	if (cfg_chan->transaction_active) {
 		cfg_chan->disconnected = true;
 		cfg_chan->transaction_active = false;
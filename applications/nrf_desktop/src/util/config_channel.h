@@ -49,6 +49,31 @@ struct fetch {
 	u16_t recipient;
 };
 
+/** @brief State of the windowed transfer.
+ */
+struct config_channel_window {
+	/** @c true if the windowed transfer is in progress. */
+	bool active;
+
+	/** Sequence number of the next expected frame. */
+	u8_t next_seq;
+
+	/** Sequence number of the most recent processed frame. */
+	u8_t acked_seq;
+
+	/** Number of frames submitted, but not yet processed. */
+	u8_t in_flight;
+
+	/** Index of the oldest frame in flight. */
+	u8_t head;
+
+	/** Config events of the frames in flight, from the oldest one. */
+	const void *pending[CONFIG_DESKTOP_CONFIG_CHANNEL_WINDOW_SIZE];
+
+	/** Lock protecting the window against the event processing. */
+	struct k_spinlock lock;
+};
+
 /** @brief Configuration channel instance.
  */
 struct config_channel_state {
@@ -64,6 +89,9 @@ struct config_channel_state {
 	/** @c true if the current transaction is a fetch request. */
 	bool is_fetch;
 
+	/** @c true if the current transaction is a windowed transfer. */
+	bool is_window;
+
 	/** Work handling transaction timeout. */
 	struct k_delayed_work timeout;
 
@@ -75,6 +103,9 @@ struct config_channel_state {
 
 	/** Currently processed config event. */
 	void *pending_config_event;
+
+	/** State of the windowed transfer. */
+	struct config_channel_window window;
 };
 
 /** @brief Initialize the configuration channel instance.
@@ -108,6 +139,10 @@ int config_channel_report_get(struct config_channel_state *cfg_chan,
  * @param usb @c true if the operation occurs for USB, @c false for Bluetooth.
  * @param local_product_id Product ID (USB PID) of the targeted device.
  *
+ * A report with the @ref CONFIG_STATUS_WINDOW_SET status is a frame of the
+ * windowed transfer. The first byte of its data is the sequence number of
+ * the frame.
+ *
  * @return 0 if the operation was successful. Otherwise, a (negative) error
  *	     code is returned.
  */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <errno.h>
+#include <sys/__assert.h>
+
+#include "hid_eventq.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(hid_eventq, CONFIG_DESKTOP_HID_STATE_LOG_LEVEL);
+
+
+static struct hid_eventq_event *event_at(const struct hid_eventq *eventq,
+					 size_t pos)
+{
+	size_t idx = eventq->head + pos;
+
+	if (idx >= eventq->size) {
+		idx -= eventq->size;
+	}
+
+	return &eventq->events[idx];
+}
+
+static bool event_is_expired(const struct hid_eventq *eventq, size_t pos,
+			     u32_t timestamp, u32_t expiration)
+{
+	u32_t diff = timestamp - event_at(eventq, pos)->timestamp;
+
+	return (diff >= expiration);
+}
+
+/* Events are ordered by timestamp, so the expired ones are at the head. */
+static size_t first_valid_find(const struct hid_eventq *eventq,
+			       u32_t timestamp, u32_t expiration)
+{
+	size_t lower = 0;
+	size_t upper = eventq->len;
+
+	while (lower < upper) {
+		size_t m = (lower + upper) / 2;
+
+		if (event_is_expired(eventq, m, timestamp, expiration)) {
+			lower = m + 1;
+		} else {
+			upper = m;
+		}
+	}
+
+	return lower;
+}
+
+static void region_purge(struct hid_eventq *eventq, size_t cnt)
+{
+	__ASSERT_NO_MSG(cnt <= eventq->len);
+
+	eventq->head = (eventq->head + cnt) % eventq->size;
+	eventq->len -= cnt;
+
+	LOG_WRN("%u stale events removed from the queue!", cnt);
+}
+
+void hid_eventq_init(struct hid_eventq *eventq,
+		     struct hid_eventq_event *events, size_t size)
+{
+	__ASSERT_NO_MSG(events);
+	__ASSERT_NO_MSG((size > 0) && (size <= UINT16_MAX));
+
+	eventq->events = events;
+	eventq->size = size;
+	hid_eventq_reset(eventq);
+}
+
+const struct hid_eventq_event *hid_eventq_peek(const struct hid_eventq *eventq,
+					       size_t pos)
+{
+	__ASSERT_NO_MSG(pos < eventq->len);
+
+	return event_at(eventq, pos);
+}
+
+bool hid_eventq_get(struct hid_eventq *eventq, struct hid_eventq_event *event)
+{
+	if (hid_eventq_is_empty(eventq)) {
+		return false;
+	}
+
+	*event = *event_at(eventq, 0);
+
+	eventq->head = (eventq->head + 1) % eventq->size;
+	eventq->len--;
+
+	return true;
+}
+
+int hid_eventq_append(struct hid_eventq *eventq, u16_t usage_id, s16_t value,
+		      u32_t timestamp)
+{
+	if (hid_eventq_is_full(eventq)) {
+		return -ENOBUFS;
+	}
+
+	struct hid_eventq_event *event = event_at(eventq, eventq->len);
+
+	event->usage_id = usage_id;
+	event->value = value;
+	event->timestamp = timestamp;
+
+	eventq->len++;
+
+	return 0;
+}
+
+size_t hid_eventq_cleanup(struct hid_eventq *eventq, u32_t timestamp,
+			  u32_t expiration)
+{
+	/* Find timed out events. */
+	size_t first_valid = first_valid_find(eventq, timestamp, expiration);
+
+	/* Remove events but only if key up was generated for each removed
+	 * key down.
+	 */
+	size_t maxfound_pos = 0;
+	size_t purge_cnt = 0;
+
+	for (size_t cur_pos = 0; cur_pos < first_valid; cur_pos++) {
+		const struct hid_eventq_event *cur = event_at(eventq, cur_pos);
+
+		if (cur->value > 0) {
+			/* Every key down must be paired with key up.
+			 * Set hit count to value as we just detected
+			 * first key down for this usage.
+			 */
+			unsigned int hit_count = cur->value;
+			size_t j_pos;
+
+			for (j_pos = cur_pos + 1; j_pos < first_valid;
+			     j_pos++) {
+				const struct hid_eventq_event *item =
+					event_at(eventq, j_pos);
+
+				if (cur->usage_id == item->usage_id) {
+					hit_count += item->value;
+
+					if (hit_count == 0) {
+						/* All events with this usage
+						 * are paired.
+						 */
+						break;
+					}
+				}
+			}
+
+			if (j_pos == first_valid) {
+				/* Pair not found. */
+				break;
+			}
+
+			if (j_pos > maxfound_pos) {
+				maxfound_pos = j_pos;
+			}
+		}
+
+		if (cur_pos == maxfound_pos) {
+			/* All events up to this point have pairs and can
+			 * be deleted.
+			 */
+			purge_cnt = cur_pos + 1;
+		}
+	}
+
+	if (purge_cnt > 0) {
+		region_purge(eventq, purge_cnt);
+	}
+
+	return purge_cnt;
+}
+
+bool hid_eventq_make_room(struct hid_eventq *eventq, u32_t timestamp,
+			  u32_t expiration, bool purge_valid)
+{
+	hid_eventq_cleanup(eventq, timestamp, expiration);
+
+	if (hid_eventq_is_full(eventq) && purge_valid) {
+		/* Try to remove queued events starting from the oldest
+		 * one.
+		 */
+		for (size_t i = 0; i < eventq->len; i++) {
+			/* Initial cleanup was done above. Queue will not
+			 * contain events with expired timestamp.
+			 */
+			u32_t ts = event_at(eventq, i)->timestamp + expiration;
+
+			hid_eventq_cleanup(eventq, ts, expiration);
+
+			if (!hid_eventq_is_full(eventq)) {
+				/* At least one element was removed from the
+				 * queue. Do not continue the traverse, content
+				 * was modified!
+				 */
+				break;
+			}
+		}
+	}
+
+	return !hid_eventq_is_full(eventq);
+}
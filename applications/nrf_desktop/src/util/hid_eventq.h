@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef _HID_EVENTQ_H_
+#define _HID_EVENTQ_H_
+
+/**
+ * @file
+ * @defgroup hid_eventq HID event queue
+ * @{
+ * @brief Fixed-capacity queue of HID usage updates for the HID state.
+ *
+ * The events are stored in a ring buffer in the order of their timestamps,
+ * so that expired events are always at the head of the queue and can be
+ * removed without allocating or freeing memory.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Enqueued HID usage update. */
+struct hid_eventq_event {
+	u16_t usage_id; /**< HID usage ID. */
+	s16_t value; /**< HID value. */
+	u32_t timestamp; /**< HID event timestamp. */
+};
+
+/** @brief HID event queue. */
+struct hid_eventq {
+	struct hid_eventq_event *events; /**< Ring buffer. */
+	u16_t size; /**< Capacity of the ring buffer. */
+	u16_t head; /**< Index of the oldest event. */
+	u16_t len; /**< Number of enqueued events. */
+};
+
+/** @brief Initialize the queue.
+ *
+ * @param eventq Queue.
+ * @param events Ring buffer used by the queue.
+ * @param size Capacity of the queue.
+ */
+void hid_eventq_init(struct hid_eventq *eventq,
+		     struct hid_eventq_event *events, size_t size);
+
+/** @brief Remove all events from the queue.
+ *
+ * @param eventq Queue.
+ */
+static inline void hid_eventq_reset(struct hid_eventq *eventq)
+{
+	eventq->head = 0;
+	eventq->len = 0;
+}
+
+/** @brief Check if the queue is full.
+ *
+ * @param eventq Queue.
+ *
+ * @return true if no event can be appended to the queue.
+ */
+static inline bool hid_eventq_is_full(const struct hid_eventq *eventq)
+{
+	return (eventq->len >= eventq->size);
+}
+
+/** @brief Check if the queue is empty.
+ *
+ * @param eventq Queue.
+ *
+ * @return true if the queue contains no events.
+ */
+static inline bool hid_eventq_is_empty(const struct hid_eventq *eventq)
+{
+	return (eventq->len == 0);
+}
+
+/** @brief Get an event from the queue.
+ *
+ * @param eventq Queue.
+ * @param pos Position of the event, counted from the oldest one.
+ *
+ * @return Pointer to the event. The pointer is valid until the event is
+ *	   removed from the queue.
+ */
+const struct hid_eventq_event *hid_eventq_peek(const struct hid_eventq *eventq,
+					       size_t pos);
+
+/** @brief Remove the oldest event from the queue.
+ *
+ * @param eventq Queue.
+ * @param[out] event Removed event.
+ *
+ * @return true if an event was removed, false if the queue is empty.
+ */
+bool hid_eventq_get(struct hid_eventq *eventq, struct hid_eventq_event *event);
+
+/** @brief Append an event to the queue.
+ *
+ * The timestamp must not be older than the timestamp of the last event in
+ * the queue.
+ *
+ * @param eventq Queue.
+ * @param usage_id HID usage ID.
+ * @param value HID value.
+ * @param timestamp Event timestamp.
+ *
+ * @return 0 if the event was appended, -ENOBUFS if the queue is full.
+ */
+int hid_eventq_append(struct hid_eventq *eventq, u16_t usage_id, s16_t value,
+		      u32_t timestamp);
+
+/** @brief Remove expired events from the queue.
+ *
+ * An expired event is removed only if all the expired key presses up to
+ * it are paired with key releases, so that no key is left pressed.
+ *
+ * @param eventq Queue.
+ * @param timestamp Current time.
+ * @param expiration Time after which an event expires.
+ *
+ * @return Number of removed events.
+ */
+size_t hid_eventq_cleanup(struct hid_eventq *eventq, u32_t timestamp,
+			  u32_t expiration);
+
+/** @brief Make room for a new event in the queue.
+ *
+ * Expired events are removed from the queue. If the queue is still full
+ * and purge_valid is set, the oldest events are removed as if they were
+ * expired, following the same pairing rule.
+ *
+ * @param eventq Queue.
+ * @param timestamp Current time.
+ * @param expiration Time after which an event expires.
+ * @param purge_valid Allow removing events that are not expired yet.
+ *
+ * @return true if an event can be appended to the queue.
+ */
+bool hid_eventq_make_room(struct hid_eventq *eventq, u32_t timestamp,
+			  u32_t expiration, bool purge_valid);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _HID_EVENTQ_H_ */
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include "key_matrix.h"
+
+
+void key_matrix_debounce(u32_t *raw_state, u32_t *prev_state,
+			 const u32_t *settled_state, size_t cols)
+{
+	for (size_t i = 0; i < cols; i++) {
+		u32_t bounce_mask = prev_state[i] ^ raw_state[i];
+
+		prev_state[i] = raw_state[i];
+		raw_state[i] &= ~bounce_mask;
+		raw_state[i] |= settled_state[i] & bounce_mask;
+	}
+}
+
+void key_matrix_ghost_filter(const u32_t *raw_state, u32_t *cur_state,
+			     size_t cols)
+{
+	u32_t once = 0;
+	u32_t twice = 0;
+
+	/* Find rows with keys pressed in more than one column. */
+	for (size_t i = 0; i < cols; i++) {
+		twice |= once & raw_state[i];
+		once |= raw_state[i];
+	}
+
+	for (size_t i = 0; i < cols; i++) {
+		cur_state[i] = raw_state[i];
+
+		if (__builtin_popcount(raw_state[i]) > 1) {
+			/* A key of this column sharing the row with a key of
+			 * another column can be a ghost.
+			 */
+			cur_state[i] &= ~twice;
+		}
+	}
+}
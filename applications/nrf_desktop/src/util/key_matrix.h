@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef _KEY_MATRIX_H_
+#define _KEY_MATRIX_H_
+
+/**
+ * @file
+ * @defgroup key_matrix Key matrix state processing
+ * @{
+ * @brief Debouncing and ghost filtering of the key matrix scan results.
+ *
+ * The state of the key matrix is kept as an array of row bitmasks, one
+ * bitmask per column. All operations are done on whole columns using mask
+ * algebra, so their cost does not depend on the number of rows.
+ */
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Filter out the keys that bounce between scans.
+ *
+ * A key that changed its state since the previous scan keeps its settled
+ * state.
+ *
+ * @param[in,out] raw_state Raw scan result. Bouncing keys are replaced with
+ *			    their settled state.
+ * @param[in,out] prev_state Raw scan result of the previous scan. Updated
+ *			     with the current raw scan result.
+ * @param settled_state Settled state of the keys.
+ * @param cols Number of columns.
+ */
+void key_matrix_debounce(u32_t *raw_state, u32_t *prev_state,
+			 const u32_t *settled_state, size_t cols);
+
+/** @brief Filter out the keys that may be ghosts.
+ *
+ * If more than one key is pressed in a column, the keys that share a row
+ * with a key pressed in another column cannot be told apart from ghosts.
+ * These keys are removed from the state.
+ *
+ * @param raw_state Debounced scan result.
+ * @param[out] cur_state State without the ambiguous keys.
+ * @param cols Number of columns.
+ */
+void key_matrix_ghost_filter(const u32_t *raw_state, u32_t *cur_state,
+			     size_t cols);
+
+/** @brief Get the keys that changed state in a column.
+ *
+ * Keys removed by the ghost filter are not reported.
+ *
+ * @param raw_state Debounced scan result of the column.
+ * @param cur_state Ghost filtered state of the column.
+ * @param settled_state Settled state of the column.
+ *
+ * @return Bitmask of the rows that changed state.
+ */
+static inline u32_t key_matrix_changed(u32_t raw_state, u32_t cur_state,
+				       u32_t settled_state)
+{
+	return (cur_state ^ settled_state) & ~(cur_state ^ raw_state);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _KEY_MATRIX_H_ */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <string.h>
+#include <sys/__assert.h>
+
+#include "led_seq.h"
+
+/* Colors are kept in Q8.8 fixed point */
+#define COLOR_FRAC_BITS	8
+#define COLOR_HALF	BIT(COLOR_FRAC_BITS - 1)
+
+static u16_t gcd(u16_t a, u16_t b)
+{
+	while (b != 0) {
+		u16_t rem = a % b;
+
+		a = b;
+		b = rem;
+	}
+
+	return a;
+}
+
+static void step_start(struct led_seq *seq)
+{
+	const struct led_effect_step *step = &seq->effect->steps[seq->step];
+
+	__ASSERT_NO_MSG(step->substep_count > 0);
+
+	for (size_t i = 0; i < ARRAY_SIZE(seq->color); i++) {
+		s32_t target = (s32_t)step->color.c[i] << COLOR_FRAC_BITS;
+
+		seq->color_inc[i] = (target - seq->color[i]) /
+				    step->substep_count;
+	}
+}
+
+static void substep_end(struct led_seq *seq)
+{
+	const struct led_effect *effect = seq->effect;
+	const struct led_effect_step *step = &effect->steps[seq->step];
+
+	seq->entry = 0;
+	seq->substep++;
+
+	if (seq->substep < step->substep_count) {
+		for (size_t i = 0; i < ARRAY_SIZE(seq->color); i++) {
+			seq->color[i] += seq->color_inc[i];
+		}
+		return;
+	}
+
+	/* Last substep reaches the step color exactly. */
+	for (size_t i = 0; i < ARRAY_SIZE(seq->color); i++) {
+		seq->color[i] = (s32_t)step->color.c[i] << COLOR_FRAC_BITS;
+	}
+
+	seq->substep = 0;
+	seq->step++;
+
+	/* Effect that takes no time cannot be looped. */
+	if ((seq->step == effect->step_count) && effect->loop_forever &&
+	    (seq->tick > 0)) {
+		seq->step = 0;
+		seq->pass_end = true;
+	}
+
+	if (seq->step < effect->step_count) {
+		step_start(seq);
+	}
+}
+
+static size_t substep_entries(const struct led_seq *seq)
+{
+	u16_t substep_time = seq->effect->steps[seq->step].substep_time;
+
+	if (substep_time == 0) {
+		return 0;
+	}
+
+	__ASSERT_NO_MSG((substep_time % seq->tick) == 0);
+
+	return substep_time / seq->tick;
+}
+
+static bool is_pass_start(const struct led_seq *seq)
+{
+	const struct led_effect *effect = seq->effect;
+
+	if (seq->done || (seq->step != 0) || (seq->substep != 0) ||
+	    (seq->entry != 0)) {
+		return false;
+	}
+
+	/* Pass must start from the color the pass ends with. */
+	const struct led_color *end_color =
+		&effect->steps[effect->step_count - 1].color;
+
+	for (size_t i = 0; i < ARRAY_SIZE(seq->color); i++) {
+		s32_t color = (s32_t)end_color->c[i] << COLOR_FRAC_BITS;
+
+		if (seq->color[i] != color) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void entry_get(const struct led_seq *seq, struct led_seq_entry *entry)
+{
+	memset(entry, 0, sizeof(*entry));
+
+	for (size_t i = 0; i < ARRAY_SIZE(seq->color); i++) {
+		entry->c[i] = (seq->color[i] + COLOR_HALF) >> COLOR_FRAC_BITS;
+	}
+}
+
+void led_seq_init(struct led_seq *seq, const struct led_effect *effect,
+		  const struct led_color *color)
+{
+	BUILD_ASSERT(CONFIG_DESKTOP_LED_COLOR_COUNT <= LED_SEQ_CHANNEL_COUNT);
+	__ASSERT_NO_MSG(effect);
+
+	seq->effect = effect;
+	seq->step = 0;
+	seq->substep = 0;
+	seq->entry = 0;
+	seq->tick = 0;
+	seq->pass_end = false;
+	seq->pass_loop = false;
+	seq->done = (effect->step_count == 0);
+
+	for (size_t i = 0; i < ARRAY_SIZE(seq->color); i++) {
+		seq->color[i] = (s32_t)color->c[i] << COLOR_FRAC_BITS;
+	}
+
+	/* Every substep lasts a whole number of ticks. */
+	for (size_t i = 0; i < effect->step_count; i++) {
+		seq->tick = gcd(seq->tick, effect->steps[i].substep_time);
+	}
+
+	if (!seq->done) {
+		step_start(seq);
+	}
+}
+
+size_t led_seq_fill(struct led_seq *seq, struct led_seq_entry *buf,
+		    size_t len)
+{
+	size_t cnt = 0;
+	bool pass_start = is_pass_start(seq);
+
+	seq->pass_end = false;
+
+	while ((cnt < len) && !seq->done && !seq->pass_end) {
+		if (seq->step == seq->effect->step_count) {
+			/* Keep the final color once the effect ends. */
+			entry_get(seq, &buf[cnt]);
+			cnt++;
+
+			seq->done = true;
+			seq->pass_end = true;
+		} else if (seq->entry < substep_entries(seq)) {
+			/* Color is updated after the substep time passes. */
+			entry_get(seq, &buf[cnt]);
+			cnt++;
+
+			seq->entry++;
+		} else {
+			substep_end(seq);
+		}
+	}
+
+	seq->pass_loop = pass_start && seq->pass_end && !seq->done &&
+			 seq->effect->loop_forever;
+
+	return cnt;
+}
+
+void led_seq_color_get(const struct led_seq *seq, struct led_color *color)
+{
+	struct led_seq_entry entry;
+
+	entry_get(seq, &entry);
+
+	for (size_t i = 0; i < ARRAY_SIZE(color->c); i++) {
+		color->c[i] = entry.c[i];
+	}
+}
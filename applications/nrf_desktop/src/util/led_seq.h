@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef _LED_SEQ_H_
+#define _LED_SEQ_H_
+
+/**
+ * @file
+ * @defgroup led_seq LED effect sequence
+ * @{
+ * @brief Conversion of LED effects to sequences of PWM values.
+ *
+ * The LED effect is expanded to a sequence of entries of equal duration
+ * (tick). Every entry holds the color of the LED for the tick. The color
+ * ramps are computed in fixed point ahead of time, so that the sequence can
+ * be played by the PWM peripheral without the CPU.
+ */
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+#include "led_effect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of PWM channels in a sequence entry. */
+#define LED_SEQ_CHANNEL_COUNT 4
+
+/** @brief Single entry of the sequence. */
+struct led_seq_entry {
+	/** Values for PWM channels. Unused channels are set to zero. */
+	u16_t c[LED_SEQ_CHANNEL_COUNT];
+};
+
+/** @brief Sequence state of the LED effect. */
+struct led_seq {
+	const struct led_effect *effect;
+	s32_t color[CONFIG_DESKTOP_LED_COLOR_COUNT];
+	s32_t color_inc[CONFIG_DESKTOP_LED_COLOR_COUNT];
+	u16_t step;
+	u16_t substep;
+	u16_t entry;
+	u16_t tick;
+	bool pass_end;
+	bool pass_loop;
+	bool done;
+};
+
+/** @brief Start the sequence of the LED effect.
+ *
+ * The tick of the sequence is the greatest common divisor of the non-zero
+ * substep times of the effect. Longer substeps are represented by multiple
+ * entries.
+ *
+ * @param seq Sequence state.
+ * @param effect LED effect.
+ * @param color LED color before the effect starts.
+ */
+void led_seq_init(struct led_seq *seq, const struct led_effect *effect,
+		  const struct led_color *color);
+
+/** @brief Fill the buffer with the subsequent sequence entries.
+ *
+ * Filling stops at the end of the effect, so that a single fill never covers
+ * more than one pass of a looped effect.
+ *
+ * @param seq Sequence state.
+ * @param[out] buf Buffer for the entries.
+ * @param len Number of entries that fit in the buffer.
+ *
+ * @return Number of entries written. Zero if the effect has finished.
+ */
+size_t led_seq_fill(struct led_seq *seq, struct led_seq_entry *buf,
+		    size_t len);
+
+/** @brief Get the LED color at the current position of the sequence.
+ *
+ * @param seq Sequence state.
+ * @param[out] color LED color.
+ */
+void led_seq_color_get(const struct led_seq *seq, struct led_color *color);
+
+/** @brief Get duration of a single sequence entry.
+ *
+ * @param seq Sequence state.
+ *
+ * @return Duration of the entry in milliseconds. Zero if no substep of the
+ *	   effect takes time.
+ */
+static inline u16_t led_seq_tick_get(const struct led_seq *seq)
+{
+	return seq->tick;
+}
+
+/** @brief Check if the last fill reached the end of the effect.
+ *
+ * For a looped effect, the next fill starts a new pass of the effect.
+ *
+ * @param seq Sequence state.
+ *
+ * @return True if the end of the effect was reached.
+ */
+static inline bool led_seq_is_pass_end(const struct led_seq *seq)
+{
+	return seq->pass_end;
+}
+
+/** @brief Check if the last fill can be played in a loop.
+ *
+ * The last fill must hold a whole pass of a looped effect that starts from
+ * the color at the end of the pass. The first pass of the effect starts from
+ * the LED color set before the effect and usually cannot be looped.
+ *
+ * @param seq Sequence state.
+ *
+ * @return True if the entries of the last fill can be repeated.
+ */
+static inline bool led_seq_is_pass_loop(const struct led_seq *seq)
+{
+	return seq->pass_loop;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _LED_SEQ_H_ */
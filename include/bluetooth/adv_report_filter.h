@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/**
+ * @file
+ * @defgroup bt_ctlr_adv_report_filter Advertising report filter API
+ * @{
+ * @brief API for the advertising report filter of the nRF BLE controller
+ *	  HCI driver.
+ *
+ * The API is available when CONFIG_BLECTLR_ADV_REPORT_FILTER is enabled.
+ */
+
+#ifndef BT_ADV_REPORT_FILTER_H_
+#define BT_ADV_REPORT_FILTER_H_
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Advertising report counters. */
+struct bt_ctlr_adv_report_stats {
+	/** Reports forwarded to the host. */
+	u32_t forwarded;
+
+	/** Reports suppressed as duplicates of a recently forwarded report. */
+	u32_t duplicates;
+
+	/** Reports suppressed because the rate limit was exceeded. */
+	u32_t rate_limited;
+
+	/** Reports discarded because no event buffer was available. */
+	u32_t no_buffer;
+};
+
+/** @brief Get the advertising report counters.
+ *
+ * The counters are incremented from the start of the Bluetooth stack or
+ * from the last reset of the counters.
+ *
+ * @param[out] stats Counters.
+ */
+void bt_ctlr_adv_report_stats_get(struct bt_ctlr_adv_report_stats *stats);
+
+/** @brief Reset the advertising report counters. */
+void bt_ctlr_adv_report_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* BT_ADV_REPORT_FILTER_H_ */
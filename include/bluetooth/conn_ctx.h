@@ -33,11 +33,9 @@ extern "C" {
 			  ROUND_UP(_ctx_sz, CONFIG_BT_CONN_CTX_MEM_BUF_ALIGN), \
 			  (_max_clients),                                      \
 			  CONFIG_BT_CONN_CTX_MEM_BUF_ALIGN);                   \
-	K_MUTEX_DEFINE(_name##_mutex);                                         \
 	static struct bt_conn_ctx_lib CONCAT(_name, _ctx_lib) =                \
 	{                                                                      \
 		.mem_slab = &CONCAT(_name, _mem_slab),                         \
-		.mutex = &_name##_mutex                                        \
 	}
 
 /** @brief Context data for a connection. */
@@ -47,17 +45,16 @@ struct bt_conn_ctx {
 
 	 /** The connection that the data is associated with. */
 	struct bt_conn *conn;
+
+	/** Reference count and state of the context, for internal use. */
+	atomic_t state;
 };
 
 /** @brief Bluetooth connection context library structure. */
 struct bt_conn_ctx_lib {
-	/** Connection contexts. */
+	/** Connection contexts, indexed by the connection index. */
 	struct bt_conn_ctx ctx[CONFIG_BT_MAX_CONN];
 
-	/** Context data mutex that ensures that only one connection context is
-	  * manipulated at a time. */
-	struct k_mutex * const mutex;
-
 	/** Memory slab instance where the memory is allocated. */
 	struct k_mem_slab * const mem_slab;
 };
@@ -105,6 +102,10 @@ void *bt_conn_ctx_alloc(struct bt_conn_ctx_lib *ctx_lib, struct bt_conn *conn);
 /**
  * @brief Free the allocated memory for a connection.
  *
+ * If the context is still in use, its memory is released when the last user
+ * calls @ref bt_conn_ctx_release. The context cannot be accessed with
+ * @ref bt_conn_ctx_get or @ref bt_conn_ctx_get_by_id after this call.
+ *
  * @param ctx_lib	Bluetooth connection context library instance.
  * @param conn		Bluetooth connection.
  *
@@ -124,7 +125,8 @@ void bt_conn_ctx_free_all(struct bt_conn_ctx_lib *ctx_lib);
  * @brief Get the context data of a connection from the memory pool.
  *
  * This function finds a connection's context data in the memory pool.
- * The link to find is identified by the connection object.
+ * The link to find is identified by the connection object. The lookup is
+ * indexed by the connection index and does not block.
  *
  * This function should be used in conjunction with
  * @ref bt_conn_ctx_release to ensure proper operation.
@@ -264,9 +264,15 @@ const struct bt_gatt_dm_attr *bt_gatt_dm_desc_next(
  * This function is asynchronous. Discovery results are passed through
  * the supplied callback.
  *
- * @note Only one discovery procedure can be started simultaneously. To start
- * another one, wait for the result of the previous procedure to finish
- * and call @ref bt_gatt_dm_data_release if it was successful.
+ * @note Up to CONFIG_BT_GATT_DM_MAX_INSTANCES discovery procedures can run
+ * simultaneously, each on a different connection. An instance is busy until
+ * the procedure fails or its data is released with
+ * @ref bt_gatt_dm_data_release.
+ *
+ * @note With CONFIG_BT_GATT_DM_CACHE, the attributes stored for a bonded peer
+ * are reported without running the discovery. If
+ * CONFIG_BT_GATT_DM_CACHE_DB_HASH is enabled, they are used only if the
+ * Database Hash of the peer did not change.
  *
  * @param[in]     conn Connection object.
  * @param[in]     svc_uuid UUID of target service
@@ -280,7 +286,9 @@ const struct bt_gatt_dm_attr *bt_gatt_dm_desc_next(
  * To process the next service, call @ref bt_gatt_dm_continue.
  *
  * @retval 0 If the operation was successful.
- *           Otherwise, a (negative) error code is returned.
+ * @retval -EALREADY If a discovery is already running on @p conn or all
+ *                   instances are busy.
+ *           Otherwise, another (negative) error code is returned.
  */
 int bt_gatt_dm_start(struct bt_conn *conn,
 		     const struct bt_uuid *svc_uuid,
@@ -291,6 +299,8 @@ int bt_gatt_dm_start(struct bt_conn *conn,
  *
  * This function continues service discovery.
  * Call it after the previous data was released by @ref bt_gatt_dm_data_release.
+ * The released instance can be taken by another call to @ref bt_gatt_dm_start,
+ * so continue the discovery right after releasing the data.
  *
  * @param[in,out] dm Discovery Manager instance.
  * @param[in]     context Context argument to
@@ -313,6 +323,23 @@ int bt_gatt_dm_continue(struct bt_gatt_dm *dm, void *context);
  */
 int bt_gatt_dm_data_release(struct bt_gatt_dm *dm);
 
+/** @brief Delete stored discovery results.
+ *
+ * Delete the attributes of a service that were stored for a peer.
+ * Call it when the bond with the peer is removed.
+ *
+ * Requires CONFIG_BT_GATT_DM_CACHE.
+ *
+ * @param[in] addr     Identity address of the peer.
+ * @param[in] svc_uuid UUID of the service or NULL to delete the attributes
+ *                     of all services stored for the peer.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int bt_gatt_dm_cache_delete(const bt_addr_le_t *addr,
+			    const struct bt_uuid *svc_uuid);
+
 /** @brief Print service discovery data.
  *
  * This function prints GATT attributes that belong to the discovered service.
@@ -187,6 +187,36 @@ int bt_gatt_pool_ccc_alloc(struct bt_gatt_pool *gp,
 void bt_gatt_pool_free(struct bt_gatt_pool *gp);
 
 #if CONFIG_BT_GATT_POOL_STATS != 0
+/** @brief Usage of a single pool. */
+struct bt_gatt_pool_usage {
+	/** Number of elements in the pool. */
+	u8_t size;
+	/** Number of elements in use. */
+	u8_t used;
+	/** Maximum number of elements in use at the same time. */
+	u8_t max_used;
+};
+
+/** @brief Usage of all the pools of the module. */
+struct bt_gatt_pool_stats {
+	/** 16-bit UUID pool. */
+	struct bt_gatt_pool_usage uuid_16;
+	/** 32-bit UUID pool. */
+	struct bt_gatt_pool_usage uuid_32;
+	/** 128-bit UUID pool. */
+	struct bt_gatt_pool_usage uuid_128;
+	/** Characteristic descriptor pool. */
+	struct bt_gatt_pool_usage chrc;
+};
+
+/** @brief Get the module statistics.
+ *
+ *  The maximum usage of the pools can be used to set their sizes.
+ *
+ *  @param stats Statistics of the pools.
+ */
+void bt_gatt_pool_stats_get(struct bt_gatt_pool_stats *stats);
+
 /** @brief Print basic module statistics (containing pool size usage).
  */
 void bt_gatt_pool_stats_print(void);
@@ -105,7 +105,7 @@ struct bt_scan_filter_info {
 	bool enabled;
 
 	/** Filter count. */
-	u8_t cnt;
+	u16_t cnt;
 };
 
 /**@brief Filter status structure.
@@ -163,6 +163,12 @@ struct bt_scan_manufacturer_data {
 
 	/** Manufacturer data length. */
 	u8_t data_len;
+
+	/** Mask applied to the received manufacturer data before it is
+	 *  compared with the filter data. Must be @p data_len long.
+	 *  If NULL, all bits are compared.
+	 */
+	const u8_t *mask;
 };
 
 /**@brief Structure for Scanning Module initialization.
@@ -217,10 +223,12 @@ struct bt_scan_uuid_filter_status {
 	/** Set to true if this type of filter is matched. */
 	bool match;
 
-	/** Array of pointers to the matched UUID filters. */
+	/** Array of pointers to the matched UUID filters. At most
+	 *  CONFIG_BT_SCAN_UUID_CNT matched filters are reported.
+	 */
 	const struct bt_uuid *uuid[CONFIG_BT_SCAN_UUID_CNT];
 
-	/** Matched UUID count. */
+	/** Number of matched UUID filters in the array. */
 	u8_t count;
 };
 
@@ -242,7 +250,9 @@ struct bt_scan_manufacturer_data_filter_status {
 	/** Set to true if this type of filter is matched. */
 	bool match;
 
-	/** Pointer to the matched filter manufacturer data. */
+	/** Pointer to the matched filter manufacturer data, with the mask
+	 *  of the filter applied.
+	 */
 	const u8_t *data;
 
 	/** Length of the matched manufacturer data. */
@@ -480,7 +490,8 @@ int bt_scan_filter_status(struct bt_filter_status *status);
  *
  * @details This function adds a new filter by type.
  *          The filter will be added if
- *          there is available space in this filter type array, and
+ *          there is available space in the filter memory pool
+ *          (CONFIG_BT_SCAN_FILTER_POOL_SIZE), and
  *          if the same filter has not already been set.
  *
  * @param[in] type Filter type.
@@ -54,10 +54,13 @@ extern "C" {
 	BT_CONN_CTX_DEF(_name,						       \
 			CONFIG_BT_GATT_HIDS_MAX_CLIENT_COUNT,		       \
 			_BT_GATT_HIDS_CONN_CTX_SIZE_CALC(__VA_ARGS__));	       \
+	static u8_t CONCAT(_name, _inp_rep_snapshot)			       \
+		[_BT_GATT_HIDS_REPORTS_SIZE_CALC(__VA_ARGS__)];		       \
 	static struct bt_gatt_hids _name =				       \
 	{								       \
 		.gp = BT_GATT_POOL_INIT(CONFIG_BT_GATT_HIDS_ATTR_MAX),	       \
 		.conn_ctx = &CONCAT(_name, _ctx_lib),			       \
+		.inp_rep_snapshot = CONCAT(_name, _inp_rep_snapshot),	       \
 	}
 
 
@@ -68,6 +71,12 @@ extern "C" {
 	(MACRO_MAP(_BLE_GATT_HIDS_REPORT_ADD, __VA_ARGS__) \
 	sizeof(struct bt_gatt_hids_conn_data))
 
+/**@brief Helping macro for @ref BT_GATT_HIDS_DEF, that calculates
+ *        the size of the Input Report snapshot for BLE HIDS instance.
+ */
+#define _BT_GATT_HIDS_REPORTS_SIZE_CALC(...)		   \
+	(MACRO_MAP(_BLE_GATT_HIDS_REPORT_ADD, __VA_ARGS__) 0)
+
 /**@brief Helping macro for @ref _BT_GATT_HIDS_CONN_CTX_SIZE_CALC,
  *        that adds Input/Output/Feature report lengths.
  */
@@ -464,6 +473,14 @@ struct bt_gatt_hids {
 
 	/** Bluetooth connection contexts. */
 	struct bt_conn_ctx_lib *conn_ctx;
+
+	/** Input Reports last sent to all connected peers. The reports are
+	 *  copied to the context of a peer only when it is accessed.
+	 */
+	u8_t *inp_rep_snapshot;
+
+	/** Lock protecting the Input Report snapshot. */
+	struct k_spinlock inp_rep_lock;
 };
 
 /** @brief HID Connection context data structure.
@@ -484,6 +501,11 @@ struct bt_gatt_hids_conn_data {
 	/** Pointer to Input Reports Context data. */
 	u8_t *inp_rep_ctx;
 
+	/** Input Reports with an update pending in the snapshot,
+	 *  one bit per Input Report index.
+	 */
+	atomic_t inp_rep_pending;
+
 	/** Pointer to Output Reports Context data. */
 	u8_t *outp_rep_ctx;
 
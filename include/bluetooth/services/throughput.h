@@ -66,6 +66,15 @@ struct bt_gatt_throughput_cb {
 	 * @param[in] met Throughput metrics.
 	 */
 	void (*data_send)(const struct bt_gatt_throughput_metrics *met);
+
+	/** @brief Notification state changed callback.
+	 *
+	 * This function is called when the client enables or disables
+	 * notifications of the Throughput Characteristic.
+	 *
+	 * @param[in] enabled True if notifications are enabled.
+	 */
+	void (*notify_enabled)(bool enabled);
 };
 
 /** @brief Throughput structure. */
@@ -73,9 +82,21 @@ struct bt_gatt_throughput {
 	/** Throughput Characteristic handle. */
 	u16_t char_handle;
 
+	/** Throughput Characteristic CCC handle. */
+	u16_t ccc_handle;
+
 	/** GATT read parameters for the Throughput Characteristic. */
 	struct bt_gatt_read_params read_params;
 
+	/** GATT write parameters for the Throughput Characteristic. */
+	struct bt_gatt_write_params write_params;
+
+	/** GATT subscribe parameters for the Throughput Characteristic. */
+	struct bt_gatt_subscribe_params notify_params;
+
+	/** Notification callback of the subscription. */
+	bt_gatt_notify_func_t notify_func;
+
 	/** Throughput callback structure. */
 	struct bt_gatt_throughput_cb *cb;
 
@@ -144,6 +165,99 @@ int bt_gatt_throughput_read(struct bt_gatt_throughput *throughput);
 int bt_gatt_throughput_write(struct bt_gatt_throughput *throughput,
 			     const u8_t *data, u16_t len);
 
+/** @brief Write data to the server and get notified when it is sent.
+ *
+ *  The data is written without response. The callback is called when the
+ *  packet has been transmitted to the server.
+ *
+ *  @param[in] throughput Throughput Service instance.
+ *  @param[in] data Data.
+ *  @param[in] len Data length.
+ *  @param[in] func Transmission complete callback.
+ *  @param[in] user_data Data passed to the callback.
+ *
+ *  @retval 0 If the operation was successful.
+ *            Otherwise, a negative error code is returned.
+ */
+int bt_gatt_throughput_write_cb(struct bt_gatt_throughput *throughput,
+				const u8_t *data, u16_t len,
+				bt_gatt_complete_func_t func, void *user_data);
+
+/** @brief Write data to the server with a Write Request.
+ *
+ *  @note This procedure is asynchronous. Only one request can be pending
+ *        at a time. The data must stay valid until the callback is called.
+ *
+ *  @param[in] throughput Throughput Service instance.
+ *  @param[in] data Data.
+ *  @param[in] len Data length.
+ *  @param[in] func Write Response callback.
+ *
+ *  @retval 0 If the operation was successful.
+ *            Otherwise, a negative error code is returned.
+ */
+int bt_gatt_throughput_write_req(struct bt_gatt_throughput *throughput,
+				 const u8_t *data, u16_t len,
+				 bt_gatt_write_func_t func);
+
+/** @brief Read the characteristic value from the server.
+ *
+ *  The value is longer than the ATT MTU. It is read with Read Blob
+ *  requests, one for each part of the value, for as long as the callback
+ *  returns BT_GATT_ITER_CONTINUE.
+ *
+ *  @note This procedure is asynchronous. It shares the parameters with
+ *        @ref bt_gatt_throughput_read.
+ *
+ *  @param[in] throughput Throughput Service instance.
+ *  @param[in] offset Offset to start reading from.
+ *  @param[in] func Read callback.
+ *
+ *  @retval 0 If the operation was successful.
+ *            Otherwise, a negative error code is returned.
+ */
+int bt_gatt_throughput_read_blob(struct bt_gatt_throughput *throughput,
+				 u16_t offset, bt_gatt_read_func_t func);
+
+/** @brief Subscribe to notifications from the server.
+ *
+ *  The callback is called for every notification. It is called with NULL
+ *  data when the subscription is removed.
+ *
+ *  @param[in] throughput Throughput Service instance.
+ *  @param[in] func Notification callback.
+ *
+ *  @retval 0 If the operation was successful.
+ *            Otherwise, a negative error code is returned.
+ *  @retval (-ENOTSUP) Special error code used when the server does not
+ *          support notifications.
+ */
+int bt_gatt_throughput_subscribe(struct bt_gatt_throughput *throughput,
+				 bt_gatt_notify_func_t func);
+
+/** @brief Unsubscribe from notifications from the server.
+ *
+ *  @param[in] throughput Throughput Service instance.
+ *
+ *  @retval 0 If the operation was successful.
+ *            Otherwise, a negative error code is returned.
+ */
+int bt_gatt_throughput_unsubscribe(struct bt_gatt_throughput *throughput);
+
+/** @brief Send a notification to the client.
+ *
+ *  @param[in] conn Connection object.
+ *  @param[in] data Data.
+ *  @param[in] len Data length.
+ *
+ *  @retval 0 If the operation was successful.
+ *            Otherwise, a negative error code is returned.
+ *  @retval (-EINVAL) Special error code used when the client has not
+ *          enabled notifications.
+ */
+int bt_gatt_throughput_notify(struct bt_conn *conn, const u8_t *data,
+			      u16_t len);
+
 #ifdef __cplusplus
 }
 #endif
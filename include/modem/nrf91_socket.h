@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef NRF91_SOCKET_H_
+#define NRF91_SOCKET_H_
+
+/**
+ * @file nrf91_socket.h
+ *
+ * @defgroup nrf91_socket nRF91 socket offload extensions
+ *
+ * @{
+ *
+ * @brief Extensions to the socket API of the nRF91 socket offload provider.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <kernel.h>
+
+/**
+ * @brief Raise a poll signal when a socket becomes ready.
+ *
+ * The signal is raised with the poll events that occurred on the socket
+ * (POLLIN, POLLOUT, POLLERR, POLLHUP or POLLNVAL) as the result. It is raised
+ * again after each modem event for as long as the socket stays ready, so the
+ * waiting thread should reset the signal before it handles the socket.
+ *
+ * This allows one thread to wait for several sockets and other kernel objects
+ * with a single k_poll() call.
+ *
+ * Requires CONFIG_NRF91_SOCKET_POLL_SIGNAL.
+ *
+ * @param fd     Socket file descriptor.
+ * @param events Requested poll events, POLLIN and/or POLLOUT.
+ * @param signal Signal to raise. The same signal can be used for several
+ *               sockets.
+ *
+ * @retval 0       If the signal was registered.
+ * @retval -EBADF  If the file descriptor is not an nRF91 socket.
+ * @retval -ENOMEM If too many signals are registered.
+ */
+int nrf91_socket_poll_signal_set(int fd, short events,
+				 struct k_poll_signal *signal);
+
+/**
+ * @brief Stop raising a poll signal for a socket.
+ *
+ * The registration is also removed when the socket is closed.
+ *
+ * @param fd Socket file descriptor.
+ *
+ * @retval 0       If the signal was removed.
+ * @retval -ENOENT If no signal was registered for the socket.
+ */
+int nrf91_socket_poll_signal_clear(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* NRF91_SOCKET_H_ */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef ZEPHYR_INCLUDE_CLOUD_QUEUE_H_
+#define ZEPHYR_INCLUDE_CLOUD_QUEUE_H_
+
+/**
+ * @brief Cloud message queue
+ * @defgroup cloud_queue Cloud message queue
+ * @{
+ *
+ * @details Flash-backed store-and-forward queue for cloud messages.
+ *	    Messages that cannot be sent while the cloud connection is
+ *	    down are stored in a flash circular buffer and replayed in
+ *	    order, in batches of bounded size, once the connection is back.
+ *
+ *	    Only the payload, the QoS and the endpoint type of a message are
+ *	    stored. The endpoint string is not preserved, so the backend must
+ *	    be able to resolve the endpoint from its type.
+ *
+ *	    The replay position is stored in flash each time the queue is
+ *	    drained, and a flash sector is only erased once all of its
+ *	    messages were replayed or dropped. Messages replayed while the
+ *	    queue was not yet drained are sent again after a reset.
+ */
+
+#include <zephyr.h>
+#include <net/cloud.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**@brief Cloud queue statistics. */
+struct cloud_queue_stats {
+	/** Number of messages currently waiting in the queue. */
+	u32_t depth;
+	/** Number of messages stored since initialization. */
+	u32_t stored;
+	/** Number of messages replayed since initialization. */
+	u32_t replayed;
+	/** Number of messages dropped because the queue was full. */
+	u32_t dropped;
+	/** Number of flash sector erases since initialization. */
+	u32_t erases;
+};
+
+/**@brief Initialize the cloud queue.
+ *
+ * @details Opens the cloud_queue_storage flash partition and recovers the
+ *	    messages stored before the last reset.
+ *
+ * @return 0 or a negative error code indicating reason of failure.
+ */
+int cloud_queue_init(void);
+
+/**@brief Store a message in the queue.
+ *
+ * @details If the queue is full, either the oldest messages or the new
+ *	    message are dropped, depending on the configured drop policy.
+ *
+ * @param msg Pointer to the message to store.
+ *
+ * @retval 0 If the message was stored.
+ * @retval -EMSGSIZE If the payload exceeds CONFIG_CLOUD_QUEUE_MSG_SIZE_MAX.
+ * @retval -ENOSPC If the queue is full and the message was dropped.
+ * @return Other negative error code indicating reason of failure.
+ */
+int cloud_queue_put(const struct cloud_msg *msg);
+
+/**@brief Send a message, keeping the order of the queued messages.
+ *
+ * @details The message is sent directly if the queue is empty and no
+ *	    replay is running. Otherwise, or if the direct send fails, it
+ *	    is stored behind the queued messages and sent by the replay.
+ *
+ * @param backend Pointer to the cloud backend used to send the message.
+ * @param msg Pointer to the message to send.
+ *
+ * @return 0 if the message was sent or stored, or a negative error code
+ *	   as returned by @ref cloud_queue_put.
+ */
+int cloud_queue_send(const struct cloud_backend *const backend,
+		     const struct cloud_msg *msg);
+
+/**@brief Start replaying the queued messages to a cloud backend.
+ *
+ * @details At most CONFIG_CLOUD_QUEUE_REPLAY_BATCH_SIZE messages are sent
+ *	    every CONFIG_CLOUD_QUEUE_REPLAY_INTERVAL milliseconds, until the
+ *	    queue is empty, a send fails, or the replay is stopped.
+ *
+ * @param backend Pointer to the cloud backend used to send the messages.
+ *
+ * @return 0 or a negative error code indicating reason of failure.
+ */
+int cloud_queue_replay_start(const struct cloud_backend *const backend);
+
+/**@brief Stop replaying the queued messages.
+ *
+ * @details Messages that were not yet replayed stay in the queue.
+ */
+void cloud_queue_replay_stop(void);
+
+/**@brief Uninitialize the cloud queue.
+ *
+ * @details Stops the replay. The queued messages stay in flash and are
+ *	    recovered by the next call to @ref cloud_queue_init.
+ */
+void cloud_queue_uninit(void);
+
+/**@brief Get the cloud queue statistics.
+ *
+ * @param stats Pointer to the structure that is filled with statistics.
+ */
+void cloud_queue_stats_get(struct cloud_queue_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* ZEPHYR_INCLUDE_CLOUD_QUEUE_H_ */
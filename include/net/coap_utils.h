@@ -15,7 +15,10 @@
 #include <net/coap.h>
 #include <net/net_ip.h>
 
-/** @brief Open socket and start the receiving thread.
+/** @brief Open socket and start receiving responses.
+ *
+ * Responses are received in a dedicated thread, or from the system work
+ * queue if CONFIG_NRF91_SOCKET_POLL_SIGNAL is enabled.
  *
  * @param[in] ip_family network ip protocol family (AF_INET or AF_INET6)
  */
@@ -37,6 +40,38 @@ int coap_send_request(enum coap_method method, const struct sockaddr *addr,
 		      const char *const *uri_path_options, u8_t *payload,
 		      u16_t payload_size, coap_reply_t reply_cb);
 
+/** @brief Observe a CoAP resource.
+ *
+ * Sends a GET request with the Observe option. The callback is called
+ * for the response and for every following notification, until the
+ * observation is cancelled.
+ *
+ * @param[in] addr             pointer to socket address struct.
+ * @param[in] uri_path_options pointer to CoAP URI schemes option.
+ * @param[in] reply_cb         function to call for each notification.
+ *
+ * @retval >= 0    On success.
+ * @retval -ENOMEM If CONFIG_COAP_UTILS_MAX_OBSERVERS resources are observed.
+ * @retval < 0     On other failure.
+ */
+int coap_observe_request(const struct sockaddr *addr,
+			 const char *const *uri_path_options,
+			 coap_reply_t reply_cb);
+
+/** @brief Cancel the observation of a CoAP resource.
+ *
+ * @param[in] addr             pointer to socket address struct.
+ * @param[in] uri_path_options pointer to CoAP URI schemes option.
+ * @param[in] reply_cb         callback passed to @ref coap_observe_request.
+ *
+ * @retval >= 0    On success.
+ * @retval -ENOENT If the resource is not observed with this callback.
+ * @retval < 0     On other failure.
+ */
+int coap_observe_cancel(const struct sockaddr *addr,
+			const char *const *uri_path_options,
+			coap_reply_t reply_cb);
+
 #endif
 
 /**
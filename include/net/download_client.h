@@ -43,7 +43,11 @@ enum download_client_evt_id {
 	 * Error reason may be one of the following:
 	 * - ENOTCONN: socket error during send() or recv()
 	 * - ECONNRESET: peer closed connection
-	 * - EBADMSG: HTTP response header not as expected
+	 * - EBADMSG: HTTP response header not as expected, or CoAP response
+	 *   code not as expected
+	 * - ETIMEDOUT: no response to CoAP block requests
+	 * - EHOSTDOWN: reconnecting to the server failed, the download is
+	 *   stopped regardless of the value returned from the callback
 	 *
 	 * In case of network-related errors (ENOTCONN or ECONNRESET),
 	 * returning zero from the callback will let the library attempt
@@ -119,9 +123,11 @@ typedef int (*download_client_callback_t)(
  * @brief Download client instance.
  */
 struct download_client {
-	/** HTTP socket. */
+	/** HTTP or CoAP socket. */
 	int fd;
-	/** HTTP response buffer. */
+	/** Protocol of the socket. */
+	int proto;
+	/** HTTP or CoAP response buffer. */
 	char buf[CONFIG_DOWNLOAD_CLIENT_MAX_RESPONSE_SIZE];
 	/** Buffer offset. */
 	size_t offset;
@@ -140,6 +146,22 @@ struct download_client {
 	/** The server has closed the connection. */
 	bool connection_close;
 
+#if defined(CONFIG_DOWNLOAD_CLIENT_COAP)
+	/** CoAP block-wise transfer state. */
+	struct {
+		/** Block size exponent (SZX) in use. */
+		u8_t szx;
+		/** Retransmissions since the last received block. */
+		u8_t retransmits;
+		/** Number of the next block to request. */
+		u32_t next_block;
+		/** Blocks below this one were requested again already. */
+		u32_t resend_end;
+		/** Token identifying the transfer. */
+		u8_t token[4];
+	} coap;
+#endif
+
 	/** Server hosting the file, null-terminated. */
 	const char *host;
 	/** File name, null-terminated. */
@@ -173,8 +195,11 @@ int download_client_init(struct download_client *client,
 /**
  * @brief Establish a connection to the server.
  *
+ * If CONFIG_DOWNLOAD_CLIENT_COAP is enabled, a CoAP server can be selected
+ * by prefixing @p host with coap:// or coaps://.
+ *
  * @param[in] client	Client instance.
- * @param[in] host	HTTP server to connect to, null-terminated.
+ * @param[in] host	HTTP or CoAP server to connect to, null-terminated.
  * @param[in] config	Configuration options.
  *
  * @retval int Zero on success, a negative error code otherwise.
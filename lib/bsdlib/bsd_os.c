@@ -50,6 +50,11 @@ static const nrfx_uarte_t uarte_inst = NRFX_UARTE_INSTANCE(1);
 
 void IPC_IRQHandler(void);
 
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+/* Defined in nrf91_sockets.c */
+void nrf91_socket_poll_signal_notify(void);
+#endif
+
 #define THREAD_MONITOR_ENTRIES 10
 
 LOG_MODULE_REGISTER(bsdlib);
@@ -376,6 +381,11 @@ ISR_DIRECT_DECLARE(rpc_proxy_irq_handler)
 		k_sem_give(&thread->sem);
 	}
 
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+	/* Socket readiness may have changed. */
+	nrf91_socket_poll_signal_notify();
+#endif
+
 	ISR_DIRECT_PM(); /* PM done after servicing interrupt for best latency
 			  */
 	return 1; /* We should check if scheduling decision should be made */
@@ -21,6 +21,7 @@
 #include <sockets_internal.h>
 #include <sys/fdtable.h>
 #include <zephyr.h>
+#include <modem/nrf91_socket.h>
 
 #if defined(CONFIG_NET_SOCKETS_OFFLOAD)
 
@@ -734,6 +735,11 @@ static ssize_t nrf91_socket_offload_recvfrom(void *obj, void *buf, size_t len,
 
 		retval = nrf_recvfrom(sd, buf, len, z_to_nrf_flags(flags),
 				      cliaddr, &sock_len);
+		if (retval < 0) {
+			/* The address is not filled in on failure. */
+			return retval;
+		}
+
 		if (cliaddr->sa_family == NRF_AF_INET) {
 			nrf_to_z_ipv4(from, (struct nrf_sockaddr_in *)cliaddr);
 			*fromlen = sizeof(struct sockaddr_in);
@@ -747,50 +753,68 @@ static ssize_t nrf91_socket_offload_recvfrom(void *obj, void *buf, size_t len,
 	return retval;
 }
 
-static ssize_t nrf91_socket_offload_sendto(void *obj, const void *buf,
-					   size_t len, int flags,
-					   const struct sockaddr *to,
-					   socklen_t tolen)
+/* Translate the destination address. Returns the length of the translated
+ * address, which is 0 if there is no destination address.
+ */
+static int z_to_nrf_addr(const struct sockaddr *z_in,
+			 struct nrf_sockaddr_in6 *nrf_out)
 {
-	int sd = OBJ_TO_SD(obj);
-	ssize_t retval;
+	if (z_in == NULL) {
+		return 0;
+	} else if (z_in->sa_family == AF_INET) {
+		z_to_nrf_ipv4(z_in, (struct nrf_sockaddr_in *)nrf_out);
+		return sizeof(struct nrf_sockaddr_in);
+	} else if (z_in->sa_family == AF_INET6) {
+		z_to_nrf_ipv6(z_in, nrf_out);
+		return sizeof(struct nrf_sockaddr_in6);
+	}
+
+	return -ENOTSUP;
+}
 
+/* Send using already translated flags and destination address. */
+static ssize_t nrf91_socket_send(int sd, const void *buf, size_t len,
+				 int nrf_flags,
+				 const struct nrf_sockaddr_in6 *nrf_addr,
+				 nrf_socklen_t nrf_addrlen)
+{
 	if (IS_ENABLED(CONFIG_NRF91_SOCKET_SEND_SPLIT_LARGE_BLOCKS)) {
 		len = MIN(len, CONFIG_NRF91_SOCKET_BLOCK_LIMIT);
 	}
 
-	if (to == NULL) {
-		retval = nrf_sendto(sd, buf, len, z_to_nrf_flags(flags), NULL,
-				    0);
-	} else if (to->sa_family == AF_INET) {
-		struct nrf_sockaddr_in ipv4;
-		nrf_socklen_t sock_len = sizeof(struct nrf_sockaddr_in);
+	return nrf_sendto(sd, buf, len, nrf_flags,
+			  (nrf_addrlen > 0) ? nrf_addr : NULL, nrf_addrlen);
+}
 
-		z_to_nrf_ipv4(to, &ipv4);
-		retval = nrf_sendto(sd, buf, len, z_to_nrf_flags(flags), &ipv4,
-				    sock_len);
-	} else if (to->sa_family == AF_INET6) {
-		struct nrf_sockaddr_in6 ipv6;
-		nrf_socklen_t sock_len = sizeof(struct nrf_sockaddr_in6);
+static ssize_t nrf91_socket_offload_sendto(void *obj, const void *buf,
+					   size_t len, int flags,
+					   const struct sockaddr *to,
+					   socklen_t tolen)
+{
+	int sd = OBJ_TO_SD(obj);
+	/* Use `struct nrf_sockaddr_in6` to fit both, IPv4 and IPv6 */
+	struct nrf_sockaddr_in6 nrf_addr;
+	int nrf_addrlen;
 
-		z_to_nrf_ipv6(to, &ipv6);
-		retval = nrf_sendto(sd, buf, len, z_to_nrf_flags(flags), &ipv6,
-				    sock_len);
-	} else {
-		goto error;
+	nrf_addrlen = z_to_nrf_addr(to, &nrf_addr);
+	if (nrf_addrlen < 0) {
+		errno = ENOTSUP;
+		return -1;
 	}
 
-	return retval;
-
-error:
-	retval = -1;
-	errno = ENOTSUP;
-	return retval;
+	return nrf91_socket_send(sd, buf, len, z_to_nrf_flags(flags),
+				 &nrf_addr, nrf_addrlen);
 }
 
 static ssize_t nrf91_socket_offload_sendmsg(void *obj, const struct msghdr *msg,
 					    int flags)
 {
+	int sd = OBJ_TO_SD(obj);
+	struct nrf_sockaddr_in6 nrf_addr;
+	int nrf_addrlen;
+	int nrf_flags;
+	const struct iovec *single = NULL;
+	size_t parts = 0;
 	ssize_t len = 0;
 	ssize_t ret;
 	int i;
@@ -802,14 +826,34 @@ static ssize_t nrf91_socket_offload_sendmsg(void *obj, const struct msghdr *msg,
 		return -1;
 	}
 
-	/* Try to reduce number of `sendto` calls - copy data if they fit into
-	 * a single buffer
-	 */
+	/* Translate the flags and the destination once for all the parts. */
+	nrf_flags = z_to_nrf_flags(flags);
+	nrf_addrlen = z_to_nrf_addr(msg->msg_name, &nrf_addr);
+	if (nrf_addrlen < 0) {
+		errno = ENOTSUP;
+		return -1;
+	}
 
 	for (i = 0; i < msg->msg_iovlen; i++) {
+		if (msg->msg_iov[i].iov_len == 0) {
+			continue;
+		}
+
+		single = &msg->msg_iov[i];
 		len += msg->msg_iov[i].iov_len;
+		parts++;
+	}
+
+	/* A message in one part is sent directly from the caller's buffer. */
+	if (parts <= 1) {
+		return nrf91_socket_send(sd, single ? single->iov_base : buf,
+					 len, nrf_flags, &nrf_addr,
+					 nrf_addrlen);
 	}
 
+	/* Try to reduce number of `sendto` calls - copy data if they fit into
+	 * a single buffer
+	 */
 	if (len <= sizeof(buf)) {
 		/* Protect `buf` access with a mutex. */
 		k_mutex_lock(&sendmsg_lock, K_FOREVER);
@@ -821,16 +865,15 @@ static ssize_t nrf91_socket_offload_sendmsg(void *obj, const struct msghdr *msg,
 			len += msg->msg_iov[i].iov_len;
 		}
 
-		ret = nrf91_socket_offload_sendto(obj, buf, len,
-						  flags, msg->msg_name,
-						  msg->msg_namelen);
+		ret = nrf91_socket_send(sd, buf, len, nrf_flags, &nrf_addr,
+					nrf_addrlen);
 
 		k_mutex_unlock(&sendmsg_lock);
 		return ret;
 	}
 
 	/* If the data won't fit into intermediate buffer, send the buffers
-	 * separately
+	 * separately, without copying them.
 	 */
 
 	len = 0;
@@ -840,20 +883,61 @@ static ssize_t nrf91_socket_offload_sendmsg(void *obj, const struct msghdr *msg,
 			continue;
 		}
 
-		ret = nrf91_socket_offload_sendto(obj, msg->msg_iov[i].iov_base,
-						  msg->msg_iov[i].iov_len,
-						  flags, msg->msg_name,
-						  msg->msg_namelen);
+		ret = nrf91_socket_send(sd, msg->msg_iov[i].iov_base,
+					msg->msg_iov[i].iov_len, nrf_flags,
+					&nrf_addr, nrf_addrlen);
 		if (ret < 0) {
-			return ret;
+			return (len > 0) ? len : ret;
 		}
 
 		len += ret;
+
+		if (ret < msg->msg_iov[i].iov_len) {
+			/* Partial send, the rest would be sent out of order. */
+			break;
+		}
 	}
 
 	return len;
 }
 
+static short z_to_nrf_poll_events(short z_events)
+{
+	short nrf_events = 0;
+
+	if (z_events & POLLIN) {
+		nrf_events |= NRF_POLLIN;
+	}
+	if (z_events & POLLOUT) {
+		nrf_events |= NRF_POLLOUT;
+	}
+
+	return nrf_events;
+}
+
+static short nrf_to_z_poll_events(short nrf_events)
+{
+	short z_events = 0;
+
+	if (nrf_events & NRF_POLLIN) {
+		z_events |= POLLIN;
+	}
+	if (nrf_events & NRF_POLLOUT) {
+		z_events |= POLLOUT;
+	}
+	if (nrf_events & NRF_POLLERR) {
+		z_events |= POLLERR;
+	}
+	if (nrf_events & NRF_POLLNVAL) {
+		z_events |= POLLNVAL;
+	}
+	if (nrf_events & NRF_POLLHUP) {
+		z_events |= POLLHUP;
+	}
+
+	return z_events;
+}
+
 static inline int nrf91_socket_offload_poll(struct pollfd *fds, int nfds,
 					    int timeout)
 {
@@ -885,12 +969,7 @@ static inline int nrf91_socket_offload_poll(struct pollfd *fds, int nfds,
 		}
 
 		/* Translate the API from native to nRF */
-		if (fds[i].events & POLLIN) {
-			tmp[i].requested |= NRF_POLLIN;
-		}
-		if (fds[i].events & POLLOUT) {
-			tmp[i].requested |= NRF_POLLOUT;
-		}
+		tmp[i].requested = z_to_nrf_poll_events(fds[i].events);
 	}
 
 	if (retval > 0) {
@@ -906,26 +985,143 @@ static inline int nrf91_socket_offload_poll(struct pollfd *fds, int nfds,
 			continue;
 		}
 
-		if (tmp[i].returned & NRF_POLLIN) {
-			fds[i].revents |= POLLIN;
-		}
-		if (tmp[i].returned & NRF_POLLOUT) {
-			fds[i].revents |= POLLOUT;
-		}
-		if (tmp[i].returned & NRF_POLLERR) {
-			fds[i].revents |= POLLERR;
+		fds[i].revents = nrf_to_z_poll_events(tmp[i].returned);
+	}
+
+	return retval;
+}
+
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+/* Sockets with a registered poll signal. The nRF poll descriptors are kept
+ * translated, so that checking the readiness after a modem event takes a
+ * single nrf_poll() call.
+ */
+static struct nrf_pollfd poll_signal_fds[BSD_MAX_SOCKET_COUNT];
+static struct k_poll_signal *poll_signals[BSD_MAX_SOCKET_COUNT];
+static int poll_signal_count;
+static K_MUTEX_DEFINE(poll_signal_lock);
+
+static void poll_signal_work_fn(struct k_work *work)
+{
+	int retval;
+
+	k_mutex_lock(&poll_signal_lock, K_FOREVER);
+
+	if (poll_signal_count == 0) {
+		k_mutex_unlock(&poll_signal_lock);
+		return;
+	}
+
+	retval = nrf_poll(poll_signal_fds, poll_signal_count, 0);
+	if (retval > 0) {
+		for (int i = 0; i < poll_signal_count; i++) {
+			if (poll_signal_fds[i].returned == 0) {
+				continue;
+			}
+
+			k_poll_signal_raise(poll_signals[i],
+				nrf_to_z_poll_events(
+					poll_signal_fds[i].returned));
 		}
-		if (tmp[i].returned & NRF_POLLNVAL) {
-			fds[i].revents |= POLLNVAL;
+	}
+
+	k_mutex_unlock(&poll_signal_lock);
+}
+
+static K_WORK_DEFINE(poll_signal_work, poll_signal_work_fn);
+
+/* Called from the modem event interrupt. */
+void nrf91_socket_poll_signal_notify(void)
+{
+	if (poll_signal_count > 0) {
+		k_work_submit(&poll_signal_work);
+	}
+}
+
+static int poll_signal_find(int sd)
+{
+	for (int i = 0; i < poll_signal_count; i++) {
+		if (poll_signal_fds[i].handle == sd) {
+			return i;
 		}
-		if (tmp[i].returned & NRF_POLLHUP) {
-			fds[i].revents |= POLLHUP;
+	}
+
+	return -ENOENT;
+}
+
+static int poll_signal_remove(int sd)
+{
+	int idx;
+
+	k_mutex_lock(&poll_signal_lock, K_FOREVER);
+
+	idx = poll_signal_find(sd);
+	if (idx >= 0) {
+		/* Move the last entry into the freed slot. */
+		poll_signal_count--;
+		poll_signal_fds[idx] = poll_signal_fds[poll_signal_count];
+		poll_signals[idx] = poll_signals[poll_signal_count];
+	}
+
+	k_mutex_unlock(&poll_signal_lock);
+
+	return (idx >= 0) ? 0 : -ENOENT;
+}
+
+int nrf91_socket_poll_signal_set(int fd, short events,
+				 struct k_poll_signal *signal)
+{
+	void *obj;
+	int sd;
+	int idx;
+
+	obj = z_get_fd_obj(fd, (const struct fd_op_vtable *)
+				       &nrf91_socket_fd_op_vtable, ENOTSUP);
+	if ((obj == NULL) || (signal == NULL)) {
+		return -EBADF;
+	}
+
+	sd = OBJ_TO_SD(obj);
+
+	k_mutex_lock(&poll_signal_lock, K_FOREVER);
+
+	idx = poll_signal_find(sd);
+	if (idx < 0) {
+		if (poll_signal_count == ARRAY_SIZE(poll_signal_fds)) {
+			k_mutex_unlock(&poll_signal_lock);
+			return -ENOMEM;
 		}
+
+		idx = poll_signal_count++;
 	}
 
-	return retval;
+	poll_signal_fds[idx].handle = sd;
+	poll_signal_fds[idx].requested = z_to_nrf_poll_events(events);
+	poll_signal_fds[idx].returned = 0;
+	poll_signals[idx] = signal;
+
+	k_mutex_unlock(&poll_signal_lock);
+
+	/* The socket may already be ready. */
+	k_work_submit(&poll_signal_work);
+
+	return 0;
 }
 
+int nrf91_socket_poll_signal_clear(int fd)
+{
+	void *obj;
+
+	obj = z_get_fd_obj(fd, (const struct fd_op_vtable *)
+				       &nrf91_socket_fd_op_vtable, ENOTSUP);
+	if (obj == NULL) {
+		return -ENOENT;
+	}
+
+	return poll_signal_remove(OBJ_TO_SD(obj));
+}
+#endif /* defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL) */
+
 static void nrf91_socket_offload_freeaddrinfo(struct zsock_addrinfo *root)
 {
 	struct zsock_addrinfo *next = root;
@@ -1070,6 +1266,9 @@ static int nrf91_socket_offload_ioctl(void *obj, unsigned int request,
 	switch (request) {
 	/* Handle close specifically. */
 	case ZFD_IOCTL_CLOSE:
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+		(void)poll_signal_remove(sd);
+#endif
 		return nrf_close(sd);
 
 	case ZFD_IOCTL_POLL_PREPARE:
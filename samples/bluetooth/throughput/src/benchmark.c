@@ -0,0 +1,704 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <kernel.h>
+#include <sys/printk.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <zephyr/types.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/services/throughput.h>
+#include <debug/cpu_load.h>
+
+#include "benchmark.h"
+
+#define RUN_DATA_SIZE	CONFIG_THROUGHPUT_BENCHMARK_DATA_SIZE
+#define RUN_TIMEOUT	CONFIG_THROUGHPUT_BENCHMARK_RUN_TIMEOUT
+#define LATENCY_SAMPLES	CONFIG_THROUGHPUT_BENCHMARK_LATENCY_SAMPLES
+
+/* Write commands queued in the stack at a time. */
+#define TX_CREDITS	8
+
+/* Time to wait for a single ATT operation or procedure to complete. */
+#define OP_TIMEOUT_MS	10000
+#define OP_TIMEOUT	K_MSEC(OP_TIMEOUT_MS)
+#define PARAM_TIMEOUT	K_SECONDS(10)
+
+/* Data length update is not reported if the data length does not change. */
+#define DATA_LEN_TIMEOUT	K_SECONDS(2)
+
+#define SUPERVISION_TIMEOUT	400	/* 4 s */
+
+enum bench_op {
+	BENCH_OP_WRITE_CMD,
+	BENCH_OP_WRITE_REQ,
+	BENCH_OP_READ_BLOB,
+	BENCH_OP_NOTIFY,
+
+	BENCH_OP_COUNT
+};
+
+static const char * const op_name[] = {
+	[BENCH_OP_WRITE_CMD] = "write_cmd",
+	[BENCH_OP_WRITE_REQ] = "write_req",
+	[BENCH_OP_READ_BLOB] = "read_blob",
+	[BENCH_OP_NOTIFY] = "notify",
+};
+
+static const u8_t phys[] = {
+	BT_GAP_LE_PHY_1M,
+	BT_GAP_LE_PHY_2M,
+	BT_GAP_LE_PHY_CODED,
+};
+
+static const u16_t data_lens[] = {
+	BT_GAP_DATA_LEN_DEFAULT,
+	BT_GAP_DATA_LEN_MAX,
+};
+
+/* Connection intervals in 1.25 ms units. */
+static const u16_t intervals[] = {
+	6,	/* 7.5 ms */
+	24,	/* 30 ms */
+	80,	/* 100 ms */
+	320,	/* 400 ms */
+};
+
+struct bench_run {
+	enum bench_op op;
+	u16_t payload;
+	u32_t bytes;
+	u32_t ops;
+	u32_t start;
+	u32_t last;
+	s64_t deadline;
+	u8_t att_err;
+	bool done;
+};
+
+static struct bt_conn *bench_conn;
+static struct bt_gatt_throughput *bench_throughput;
+static struct bench_run run;
+static bool cpu_load_ready;
+
+static u32_t latencies[LATENCY_SAMPLES];
+static atomic_t latency_cnt;
+
+static u8_t payload_buf[CONFIG_BT_L2CAP_TX_MTU];
+
+static K_SEM_DEFINE(param_sem, 0, 1);
+static K_SEM_DEFINE(op_sem, 0, 1);
+static K_SEM_DEFINE(unsubscribed_sem, 0, 1);
+static K_SEM_DEFINE(tx_credits, TX_CREDITS, TX_CREDITS);
+
+static void latency_add(u32_t cycles)
+{
+	atomic_val_t idx = atomic_inc(&latency_cnt);
+
+	if (idx < ARRAY_SIZE(latencies)) {
+		latencies[idx] = k_cyc_to_us_floor32(cycles);
+	}
+}
+
+static void latency_sort(size_t cnt)
+{
+	for (size_t i = 1; i < cnt; i++) {
+		u32_t val = latencies[i];
+		size_t j = i;
+
+		while ((j > 0) && (latencies[j - 1] > val)) {
+			latencies[j] = latencies[j - 1];
+			j--;
+		}
+
+		latencies[j] = val;
+	}
+}
+
+static u32_t latency_percentile(size_t cnt, u8_t percent)
+{
+	return latencies[(cnt - 1) * percent / 100];
+}
+
+static const char *phy_name(u8_t phy)
+{
+	switch (phy) {
+	case BT_GAP_LE_PHY_1M:
+		return "1M";
+	case BT_GAP_LE_PHY_2M:
+		return "2M";
+	case BT_GAP_LE_PHY_CODED:
+		return "coded";
+	default:
+		return "unknown";
+	}
+}
+
+static void le_param_updated(struct bt_conn *conn, u16_t interval,
+			     u16_t latency, u16_t timeout)
+{
+	if (conn == bench_conn) {
+		k_sem_give(&param_sem);
+	}
+}
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+static void le_phy_updated(struct bt_conn *conn,
+			   struct bt_conn_le_phy_info *param)
+{
+	if (conn == bench_conn) {
+		k_sem_give(&param_sem);
+	}
+}
+#endif
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+static void le_data_len_updated(struct bt_conn *conn,
+				struct bt_conn_le_data_len_info *info)
+{
+	if (conn == bench_conn) {
+		k_sem_give(&param_sem);
+	}
+}
+#endif
+
+static struct bt_conn_cb conn_callbacks = {
+	.le_param_updated = le_param_updated,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	.le_phy_updated = le_phy_updated,
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	.le_data_len_updated = le_data_len_updated,
+#endif
+};
+
+static int phy_set(u8_t phy)
+{
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	const struct bt_conn_le_phy_param param = {
+		.options = BT_CONN_LE_PHY_OPT_NONE,
+		.pref_tx_phy = phy,
+		.pref_rx_phy = phy,
+	};
+	struct bt_conn_info info;
+	int err;
+
+	k_sem_reset(&param_sem);
+
+	err = bt_conn_le_phy_update(bench_conn, &param);
+	if (err) {
+		return err;
+	}
+
+	if (k_sem_take(&param_sem, PARAM_TIMEOUT)) {
+		return -ETIMEDOUT;
+	}
+
+	err = bt_conn_get_info(bench_conn, &info);
+	if (err) {
+		return err;
+	}
+
+	/* The peer may not support the PHY. */
+	if ((info.le.phy->tx_phy != phy) || (info.le.phy->rx_phy != phy)) {
+		return -ENOTSUP;
+	}
+
+	return 0;
+#else
+	return (phy == BT_GAP_LE_PHY_1M) ? 0 : -ENOTSUP;
+#endif
+}
+
+static int data_len_set(u16_t data_len)
+{
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	const struct bt_conn_le_data_len_param param = {
+		.tx_max_len = data_len,
+		.tx_max_time = BT_GAP_DATA_TIME_MAX,
+	};
+	int err;
+
+	k_sem_reset(&param_sem);
+
+	err = bt_conn_le_data_len_update(bench_conn, &param);
+	if (err) {
+		return err;
+	}
+
+	/* The actual data length is read from the connection info. */
+	(void)k_sem_take(&param_sem, DATA_LEN_TIMEOUT);
+
+	return 0;
+#else
+	return (data_len == BT_GAP_DATA_LEN_DEFAULT) ? 0 : -ENOTSUP;
+#endif
+}
+
+static int interval_set(u16_t interval)
+{
+	const struct bt_le_conn_param param = {
+		.interval_min = interval,
+		.interval_max = interval,
+		.latency = 0,
+		.timeout = SUPERVISION_TIMEOUT,
+	};
+	int err;
+
+	k_sem_reset(&param_sem);
+
+	err = bt_conn_le_param_update(bench_conn, &param);
+	if (err == -EALREADY) {
+		return 0;
+	} else if (err) {
+		return err;
+	}
+
+	if (k_sem_take(&param_sem, PARAM_TIMEOUT)) {
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+static void write_cmd_sent(struct bt_conn *conn, void *user_data)
+{
+	u32_t now = k_cycle_get_32();
+
+	latency_add(now - POINTER_TO_UINT(user_data));
+	run.last = now;
+	k_sem_give(&tx_credits);
+}
+
+static int write_cmd_run(void)
+{
+	int err = 0;
+
+	while ((run.bytes < RUN_DATA_SIZE) &&
+	       (k_uptime_get() < run.deadline)) {
+		if (k_sem_take(&tx_credits, OP_TIMEOUT)) {
+			err = -ETIMEDOUT;
+			break;
+		}
+
+		err = bt_gatt_throughput_write_cb(
+			bench_throughput, payload_buf, run.payload,
+			write_cmd_sent, UINT_TO_POINTER(k_cycle_get_32()));
+		if (err) {
+			k_sem_give(&tx_credits);
+			break;
+		}
+
+		run.bytes += run.payload;
+		run.ops++;
+	}
+
+	/* Wait until all the queued packets are sent. */
+	for (size_t i = 0; i < TX_CREDITS; i++) {
+		if (k_sem_take(&tx_credits, OP_TIMEOUT)) {
+			k_sem_init(&tx_credits, TX_CREDITS, TX_CREDITS);
+			return -ETIMEDOUT;
+		}
+	}
+
+	for (size_t i = 0; i < TX_CREDITS; i++) {
+		k_sem_give(&tx_credits);
+	}
+
+	return err;
+}
+
+static void write_rsp(struct bt_conn *conn, u8_t err,
+		      struct bt_gatt_write_params *params)
+{
+	run.att_err = err;
+	k_sem_give(&op_sem);
+}
+
+static int write_req_run(void)
+{
+	int err;
+
+	while ((run.bytes < RUN_DATA_SIZE) &&
+	       (k_uptime_get() < run.deadline)) {
+		u32_t stamp = k_cycle_get_32();
+
+		err = bt_gatt_throughput_write_req(bench_throughput,
+						   payload_buf, run.payload,
+						   write_rsp);
+		if (err) {
+			return err;
+		}
+
+		if (k_sem_take(&op_sem, OP_TIMEOUT)) {
+			return -ETIMEDOUT;
+		}
+
+		run.last = k_cycle_get_32();
+		latency_add(run.last - stamp);
+
+		if (run.att_err) {
+			return -EIO;
+		}
+
+		run.bytes += run.payload;
+		run.ops++;
+	}
+
+	return 0;
+}
+
+static u8_t read_rsp(struct bt_conn *conn, u8_t err,
+		     struct bt_gatt_read_params *params, const void *data,
+		     u16_t len)
+{
+	u32_t now = k_cycle_get_32();
+
+	if (err || !data) {
+		/* Error or end of the value. */
+		run.att_err = err;
+		k_sem_give(&op_sem);
+		return BT_GATT_ITER_STOP;
+	}
+
+	latency_add(now - run.last);
+	run.last = now;
+	run.bytes += len;
+	run.ops++;
+
+	if (run.bytes >= RUN_DATA_SIZE) {
+		k_sem_give(&op_sem);
+		return BT_GATT_ITER_STOP;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static int read_blob_run(void)
+{
+	int err;
+
+	while ((run.bytes < RUN_DATA_SIZE) &&
+	       (k_uptime_get() < run.deadline)) {
+		run.last = k_cycle_get_32();
+
+		/* Read only the filler data after the metrics, with Read Blob
+		 * requests, so that the peer does not report a metrics read.
+		 */
+		err = bt_gatt_throughput_read_blob(
+			bench_throughput,
+			sizeof(struct bt_gatt_throughput_metrics), read_rsp);
+		if (err) {
+			return err;
+		}
+
+		if (k_sem_take(&op_sem, OP_TIMEOUT)) {
+			return -ETIMEDOUT;
+		}
+
+		if (run.att_err) {
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+static u8_t notify_rsp(struct bt_conn *conn,
+		       struct bt_gatt_subscribe_params *params,
+		       const void *data, u16_t len)
+{
+	u32_t now = k_cycle_get_32();
+
+	if (!data) {
+		k_sem_give(&unsubscribed_sem);
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (run.done) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	/* The measurement starts with the first notification. */
+	if (run.ops == 0) {
+		run.start = now;
+	} else {
+		latency_add(now - run.last);
+		run.bytes += len;
+	}
+
+	run.last = now;
+	run.ops++;
+
+	if ((run.bytes >= RUN_DATA_SIZE) || (k_uptime_get() >= run.deadline)) {
+		run.done = true;
+		k_sem_give(&op_sem);
+		return BT_GATT_ITER_STOP;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static int notify_run(void)
+{
+	int err;
+
+	k_sem_reset(&unsubscribed_sem);
+
+	err = bt_gatt_throughput_subscribe(bench_throughput, notify_rsp);
+	if (err) {
+		return err;
+	}
+
+	if (k_sem_take(&op_sem, K_MSEC(RUN_TIMEOUT + OP_TIMEOUT_MS))) {
+		/* The peer does not send notifications. */
+		run.done = true;
+		err = bt_gatt_throughput_unsubscribe(bench_throughput);
+		if (err) {
+			return err;
+		}
+
+		err = -ENODATA;
+	}
+
+	/* The subscription parameters are reused in the next run. */
+	if (k_sem_take(&unsubscribed_sem, OP_TIMEOUT)) {
+		return -ETIMEDOUT;
+	}
+
+	return err;
+}
+
+static void run_print(const struct bt_conn_info *info, int err)
+{
+	size_t cnt = MIN(atomic_get(&latency_cnt), ARRAY_SIZE(latencies));
+	u32_t time_us = k_cyc_to_us_floor32(run.last - run.start);
+	u32_t kbps = 0;
+	u16_t data_len = BT_GAP_DATA_LEN_DEFAULT;
+	const char *phy = phy_name(BT_GAP_LE_PHY_1M);
+	s32_t load = -1;
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	phy = phy_name(info->le.phy->tx_phy);
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	data_len = info->le.data_len->tx_max_len;
+#endif
+
+	if (cpu_load_ready) {
+		load = cpu_load_get();
+	}
+
+	if (time_us > 0) {
+		kbps = ((u64_t)run.bytes * 8 * 1000) / time_us;
+	}
+
+	if (cnt == 0) {
+		latencies[0] = 0;
+		cnt = 1;
+	}
+
+	latency_sort(cnt);
+
+	printk("bench,run,%s,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d\n",
+	       op_name[run.op], phy, data_len, info->le.interval * 1250,
+	       run.payload, run.bytes, time_us / 1000, kbps, run.ops,
+	       latencies[0], latency_percentile(cnt, 50),
+	       latency_percentile(cnt, 90), latency_percentile(cnt, 99),
+	       latencies[cnt - 1], load, err);
+}
+
+static int op_run(enum bench_op op)
+{
+	struct bt_conn_info info;
+	int err;
+
+	memset(&run, 0, sizeof(run));
+	atomic_set(&latency_cnt, 0);
+	k_sem_reset(&op_sem);
+
+	run.op = op;
+	run.payload = MIN(bt_gatt_get_mtu(bench_conn) - 3,
+			  sizeof(payload_buf));
+
+	err = bt_conn_get_info(bench_conn, &info);
+	if (err) {
+		return err;
+	}
+
+	if (cpu_load_ready) {
+		cpu_load_reset();
+	}
+
+	run.deadline = k_uptime_get() + RUN_TIMEOUT;
+	run.start = k_cycle_get_32();
+	run.last = run.start;
+
+	switch (op) {
+	case BENCH_OP_WRITE_CMD:
+		err = write_cmd_run();
+		break;
+	case BENCH_OP_WRITE_REQ:
+		err = write_req_run();
+		break;
+	case BENCH_OP_READ_BLOB:
+		err = read_blob_run();
+		break;
+	case BENCH_OP_NOTIFY:
+		err = notify_run();
+		break;
+	default:
+		err = -EINVAL;
+		break;
+	}
+
+	run_print(&info, err);
+
+	return err;
+}
+
+static void ctlr_version_print(void)
+{
+	struct bt_hci_rp_read_local_version_info *rp;
+	struct net_buf *rsp;
+	int err;
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_LOCAL_VERSION_INFO, NULL,
+				   &rsp);
+	if (err) {
+		printk("bench,ctlr,,,,,%d\n", err);
+		return;
+	}
+
+	rp = (void *)rsp->data;
+	printk("bench,ctlr,%u,%u,%u,%u,%u,%d\n",
+	       rp->hci_version, sys_le16_to_cpu(rp->hci_revision),
+	       rp->lmp_version, sys_le16_to_cpu(rp->manufacturer),
+	       sys_le16_to_cpu(rp->lmp_subversion), rp->status);
+
+	net_buf_unref(rsp);
+}
+
+static int interval_sweep_run(void)
+{
+	int err;
+
+	for (size_t i = 0; i < ARRAY_SIZE(intervals); i++) {
+		err = interval_set(intervals[i]);
+		if (err) {
+			printk("bench,skip,interval,%u,%d\n",
+			       intervals[i] * 1250, err);
+			return err;
+		}
+
+		for (size_t op = 0; op < BENCH_OP_COUNT; op++) {
+			err = op_run(op);
+			if ((err == -ENOTCONN) || (err == -ETIMEDOUT)) {
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int sweep_run(void)
+{
+	int err;
+
+	for (size_t p = 0; p < ARRAY_SIZE(phys); p++) {
+		err = phy_set(phys[p]);
+		if (err == -ENOTCONN) {
+			return err;
+		} else if (err) {
+			printk("bench,skip,phy,%s,%d\n",
+			       phy_name(phys[p]), err);
+			continue;
+		}
+
+		for (size_t d = 0; d < ARRAY_SIZE(data_lens); d++) {
+			err = data_len_set(data_lens[d]);
+			if (err == -ENOTCONN) {
+				return err;
+			} else if (err) {
+				printk("bench,skip,data_len,%u,%d\n",
+				       data_lens[d], err);
+				continue;
+			}
+
+			err = interval_sweep_run();
+			if (err) {
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int benchmark_run(struct bt_conn *conn,
+		  struct bt_gatt_throughput *throughput)
+{
+	struct bt_conn_info info;
+	u16_t interval;
+	int err;
+
+	err = bt_conn_get_info(conn, &info);
+	if (err) {
+		return err;
+	}
+
+	if (info.role != BT_CONN_ROLE_MASTER) {
+		return -EINVAL;
+	}
+
+	bench_conn = conn;
+	bench_throughput = throughput;
+	interval = info.le.interval;
+
+	ctlr_version_print();
+	printk("bench,fields,op,phy,data_len,interval_us,payload,bytes,"
+	       "time_ms,kbps,ops,lat_min_us,lat_p50_us,lat_p90_us,"
+	       "lat_p99_us,lat_max_us,cpu_load,err\n");
+
+	err = sweep_run();
+
+	printk("bench,done,%d\n", err);
+
+	if (err != -ENOTCONN) {
+		(void)phy_set(BT_GAP_LE_PHY_1M);
+		(void)data_len_set(BT_GAP_DATA_LEN_MAX);
+		(void)interval_set(interval);
+	}
+
+	bench_conn = NULL;
+
+	return err;
+}
+
+int benchmark_init(void)
+{
+	int err;
+
+	bt_conn_cb_register(&conn_callbacks);
+
+	if (IS_ENABLED(CONFIG_CPU_LOAD)) {
+		/* The benchmark runs without CPU load measurement. */
+		err = cpu_load_init();
+		if (err) {
+			printk("CPU load measurement unavailable (err %d)\n",
+			       err);
+		} else {
+			cpu_load_ready = true;
+		}
+	}
+
+	return 0;
+}
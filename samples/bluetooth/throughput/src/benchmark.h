@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <bluetooth/conn.h>
+#include <bluetooth/services/throughput.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize the benchmark.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a negative error code is returned.
+ */
+int benchmark_init(void);
+
+/** @brief Run the benchmark.
+ *
+ * Sweeps the PHY, the data length, the connection interval and the ATT
+ * operation used to transfer data, and prints one line with the results of
+ * every combination. The connection parameters are restored at the end.
+ *
+ * @param[in] conn Connection to the peer, in the master role.
+ * @param[in] throughput Throughput Service client instance.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a negative error code is returned.
+ */
+int benchmark_run(struct bt_conn *conn,
+		  struct bt_gatt_throughput *throughput);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCHMARK_H_ */
@@ -21,12 +21,15 @@
 #include <bluetooth/scan.h>
 #include <bluetooth/gatt_dm.h>
 
+#include "benchmark.h"
+
 #define DEVICE_NAME	CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
 #define INTERVAL_MIN	0x140	/* 320 units, 400 ms */
 #define INTERVAL_MAX	0x140	/* 320 units, 400 ms */
 
 static volatile bool test_ready;
+static atomic_t notify_enabled;
 static struct bt_conn *default_conn;
 static struct bt_gatt_throughput gatt_throughput;
 static struct bt_uuid *uuid128 = BT_UUID_THROUGHPUT;
@@ -310,10 +313,16 @@ static void throughput_send(const struct bt_gatt_throughput_metrics *met)
 		met->write_count, met->write_rate);
 }
 
+static void throughput_notify_enabled(bool enabled)
+{
+	atomic_set(&notify_enabled, enabled);
+}
+
 static const struct bt_gatt_throughput_cb throughput_cb = {
 	.data_read = throughput_read,
 	.data_received = throughput_received,
-	.data_send = throughput_send
+	.data_send = throughput_send,
+	.notify_enabled = throughput_notify_enabled
 };
 
 static void test_run(void)
@@ -323,20 +332,36 @@ static void test_run(void)
 	s64_t delta;
 	u32_t data = 0;
 	u32_t prog = 0;
+	char key;
 
 	/* a dummy data buffer */
 	static char dummy[256];
 
 
 	/* wait for user input to continue */
-	printk("Ready, press any key to start\n");
-	console_getchar();
+	if (IS_ENABLED(CONFIG_THROUGHPUT_BENCHMARK)) {
+		printk("Ready, press b to run the benchmark or any other key "
+		       "to start\n");
+	} else {
+		printk("Ready, press any key to start\n");
+	}
+
+	key = console_getchar();
 
 	if (!test_ready) {
 		/* disconnected while blocking inside _getchar() */
 		return;
 	}
 
+	if (IS_ENABLED(CONFIG_THROUGHPUT_BENCHMARK) && (key == 'b')) {
+		err = benchmark_run(default_conn, &gatt_throughput);
+		if (err) {
+			printk("Benchmark failed (err %d)\n", err);
+		}
+
+		return;
+	}
+
 	test_ready = false;
 
 	/* reset peer metrics */
@@ -375,6 +400,33 @@ static void test_run(void)
 	}
 }
 
+static void notify_run(void)
+{
+	struct bt_conn *conn;
+	u16_t len;
+	int err;
+
+	/* a dummy data buffer */
+	static u8_t dummy[256];
+
+	if (!default_conn) {
+		return;
+	}
+
+	conn = bt_conn_ref(default_conn);
+	len = MIN(bt_gatt_get_mtu(conn) - 3, sizeof(dummy));
+
+	/* send notifications for as long as the peer is subscribed */
+	while (atomic_get(&notify_enabled)) {
+		err = bt_gatt_throughput_notify(conn, dummy, len);
+		if (err) {
+			break;
+		}
+	}
+
+	bt_conn_unref(conn);
+}
+
 static bool le_param_req(struct bt_conn *conn, struct bt_le_conn_param *param)
 {
 	/* reject peer conn param request */
@@ -437,11 +489,24 @@ void main(void)
 		return;
 	}
 
+	if (IS_ENABLED(CONFIG_THROUGHPUT_BENCHMARK)) {
+		err = benchmark_init();
+		if (err) {
+			printk("Benchmark initialization failed (err %d)\n",
+			       err);
+			return;
+		}
+	}
+
 	device_role_select();
 
 	for (;;) {
 		if (test_ready) {
 			test_run();
 		}
+
+		if (atomic_get(&notify_enabled)) {
+			notify_run();
+		}
 	}
 }
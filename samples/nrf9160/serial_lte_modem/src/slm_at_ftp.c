@@ -23,8 +23,6 @@ LOG_MODULE_REGISTER(ftp, CONFIG_SLM_LOG_LEVEL);
 #define FTP_MAX_OPTION		32
 #define FTP_MAX_FILEPATH	128
 
-#define AT_FTP_STR		"AT#XFTP"
-
 /*
  * Known limitation in this version
  */
@@ -465,51 +463,42 @@ static int do_ftp_put(void)
 	return (ret == FTP_CODE_226) ? 0 : -1;
 }
 
-/**@brief API to handle FTP AT command
+/**@brief handle AT#XFTP commands
+ *  AT#XFTP=<cmd>[,<param1>[<param2]..]]
+ *  AT#XFTP? READ command not supported
+ *  AT#XFTP=? TEST command not supported
  */
-int slm_at_ftp_parse(const char *at_cmd)
+static int handle_at_ftp(enum at_cmd_type cmd_type)
 {
-	int ret = -ENOTSUP;
+	int ret;
 	char op_str[16];
 	int size = 16;
 
-	if (slm_util_cmd_casecmp(at_cmd, AT_FTP_STR)) {
-		ret = at_parser_params_from_str(at_cmd, NULL, &at_param_list);
-		if (ret) {
-			LOG_ERR("Failed to parse AT command %d", ret);
-			return -EINVAL;
-		}
-		if (at_parser_cmd_type_get(at_cmd) != AT_CMD_TYPE_SET_COMMAND) {
-			return -EINVAL;
-		}
-		if (at_params_valid_count_get(&at_param_list) < 2) {
-			return -EINVAL;
-		}
-		ret = at_params_string_get(&at_param_list, 1, op_str, &size);
-		if (ret) {
-			return ret;
-		}
-		op_str[size] = '\0';
-		ret = -EINVAL;
-		for (int i = 0; i < FTP_OP_MAX; i++) {
-			if (slm_util_casecmp(op_str,
-				ftp_op_list[i].op_str)) {
-				ret = ftp_op_list[i].handler();
-				break;
-			}
+	if (cmd_type != AT_CMD_TYPE_SET_COMMAND) {
+		return -EINVAL;
+	}
+	if (at_params_valid_count_get(&at_param_list) < 2) {
+		return -EINVAL;
+	}
+	ret = at_params_string_get(&at_param_list, 1, op_str, &size);
+	if (ret) {
+		return ret;
+	}
+	op_str[size] = '\0';
+	ret = -EINVAL;
+	for (int i = 0; i < FTP_OP_MAX; i++) {
+		if (slm_util_casecmp(op_str,
+			ftp_op_list[i].op_str)) {
+			ret = ftp_op_list[i].handler();
+			break;
 		}
 	}
 
 	return ret;
 }
 
-/**@brief API to list FTP AT commands
- */
-void slm_at_ftp_clac(void)
-{
-	sprintf(rsp_buf, "%s\r\n", AT_FTP_STR);
-	rsp_send(rsp_buf, strlen(rsp_buf));
-}
+/**@brief AT commands registered with the AT host. */
+SLM_AT_CMD_DEFINE(XFTP, handle_at_ftp);
 
 /**@brief API to initialize FTP AT commands handler
  */
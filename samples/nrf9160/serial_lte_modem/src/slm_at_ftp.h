@@ -16,22 +16,6 @@
 #include <zephyr/types.h>
 #include <modem/at_cmd.h>
 
-/**
- * @brief FTP AT command parser.
- *
- * @param at_cmd AT command string.
- *
- * @retval 0 If the operation was successful.
- *           Otherwise, a (negative) error code is returned.
- */
-int slm_at_ftp_parse(const char *at_cmd);
-
-/**
- * @brief List FTP AT commands.
- *
- */
-void slm_at_ftp_clac(void);
-
 /**
  * @brief Initialize FTP AT command parser.
  *
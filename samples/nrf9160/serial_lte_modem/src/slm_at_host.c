@@ -11,6 +11,7 @@
 #include <drivers/uart.h>
 #include <string.h>
 #include <init.h>
+#include <sys/ring_buffer.h>
 #include <modem/at_cmd.h>
 #include <modem/at_notif.h>
 
@@ -30,6 +31,10 @@ LOG_MODULE_REGISTER(at_host, CONFIG_SLM_LOG_LEVEL);
 #endif
 #include "slm_at_mqtt.h"
 
+/* AT command table, sorted by name at link time */
+extern const struct slm_at_cmd _slm_at_cmd_list_start[];
+extern const struct slm_at_cmd _slm_at_cmd_list_end[];
+
 #define SLM_UART_0_NAME	"UART_0"
 #define SLM_UART_2_NAME	"UART_2"
 
@@ -39,13 +44,27 @@ LOG_MODULE_REGISTER(at_host, CONFIG_SLM_LOG_LEVEL);
 #define SLM_SYNC_STR	"Ready\r\n"
 
 #define SLM_VERSION	"#XSLMVER: 1.2\r\n"
-#define AT_CMD_SLMVER	"AT#XSLMVER"
-#define AT_CMD_SLEEP	"AT#XSLEEP"
-#define AT_CMD_CLAC	"AT#XCLAC"
 
 #define AT_MAX_CMD_LEN	CONFIG_AT_CMD_RESPONSE_MAX_LEN
 #define UART_RX_LEN	8  /* UART FIFO depth is 6 (?) */
 
+#define DATAMODE_ESCAPE		"+++"
+#define DATAMODE_ESCAPE_LEN	(sizeof(DATAMODE_ESCAPE) - 1)
+#define DATAMODE_ESCAPE_GUARD	CONFIG_SLM_DATAMODE_ESCAPE_GUARD_TIME
+#define DATAMODE_BUF_SIZE	CONFIG_SLM_DATAMODE_BUF_SIZE
+/* RX is paused when the free space drops below two DMA buffers, so that
+ * the data flushed from the DMA buffers after the pause still fits.
+ */
+#define DATAMODE_RX_RESERVE	(DATAMODE_BUF_SIZE * 2)
+#define DATAMODE_RB_SIZE	(DATAMODE_BUF_SIZE * 3 + DATAMODE_ESCAPE_LEN)
+
+/** @brief UART RX states in data mode. */
+enum datamode_rx_state {
+	DATAMODE_RX_RUNNING,
+	DATAMODE_RX_PAUSING,
+	DATAMODE_RX_PAUSED
+};
+
 /** @brief Termination Modes. */
 enum term_modes {
 	MODE_NULL_TERM, /**< Null Termination */
@@ -75,6 +94,38 @@ static u8_t buf_num;
 
 static K_SEM_DEFINE(tx_done, 0, 1);
 
+/* Data mode: UART DMA writes into large buffers, and the received bytes
+ * are passed to the handler straight from the ring buffer storage. The
+ * handler is called from a dedicated work queue, as sending can block.
+ */
+static slm_datamode_handler_t datamode_handler;
+static u8_t datamode_uart_buf[2][DATAMODE_BUF_SIZE];
+static u8_t datamode_buf_idx;
+RING_BUF_DECLARE(datamode_rb, DATAMODE_RB_SIZE);
+static atomic_t datamode_rx_state;
+static u32_t datamode_rx_time;
+static size_t datamode_escape_cnt;
+static struct k_work_q datamode_work_q;
+static K_THREAD_STACK_DEFINE(datamode_work_q_stack,
+			     CONFIG_SLM_DATAMODE_SEND_STACK_SIZE);
+static struct k_work datamode_send_work;
+static struct k_work datamode_exit_work;
+static struct k_delayed_work datamode_escape_work;
+static bool datamode_work_q_started;
+
+#if defined(CONFIG_SLM_DATAMODE_LOOPBACK_TEST)
+#define LOOPBACK_TEST_SIZE	CONFIG_SLM_DATAMODE_LOOPBACK_TEST_SIZE
+#define LOOPBACK_TEST_TIMEOUT	K_SECONDS(30)
+
+static u32_t loopback_rx_len;
+static u32_t loopback_err_cnt;
+static K_SEM_DEFINE(loopback_done, 0, 1);
+#endif
+
+static const struct slm_at_cmd *at_cmd_list;
+static size_t at_cmd_count;
+static bool at_host_stopped;
+
 /* global functions defined in different files */
 void enter_idle(void);
 void enter_sleep(void);
@@ -121,41 +172,48 @@ static void response_handler(void *context, const char *response)
 	}
 }
 
-static void handle_at_clac(void)
+/**@brief handle AT#XSLMVER commands
+ *  AT#XSLMVER
+ */
+static int handle_at_slmver(enum at_cmd_type cmd_type)
 {
-	rsp_send(AT_CMD_SLMVER, sizeof(AT_CMD_SLMVER) - 1);
-	rsp_send("\r\n", 2);
-	rsp_send(AT_CMD_SLEEP, sizeof(AT_CMD_SLEEP) - 1);
-	rsp_send("\r\n", 2);
-	rsp_send(AT_CMD_CLAC, sizeof(AT_CMD_CLAC) - 1);
-	rsp_send("\r\n", 2);
-	slm_at_tcpip_clac();
-#if defined(CONFIG_SLM_TCP_PROXY)
-	slm_at_tcp_proxy_clac();
-#endif
-#if defined(CONFIG_SLM_UDP_PROXY)
-	slm_at_udp_proxy_clac();
-#endif
-	slm_at_icmp_clac();
-	slm_at_gps_clac();
-	slm_at_mqtt_clac();
-	slm_at_ftp_clac();
+	if (cmd_type != AT_CMD_TYPE_SET_COMMAND) {
+		return -EINVAL;
+	}
+
+	rsp_send(SLM_VERSION, sizeof(SLM_VERSION) - 1);
+
+	return 0;
 }
 
-static int handle_at_sleep(const char *at_cmd, enum shutdown_modes *mode)
+/**@brief handle AT#XCLAC commands
+ *  AT#XCLAC
+ */
+static int handle_at_clac(enum at_cmd_type cmd_type)
 {
-	int ret = -EINVAL;
-	enum at_cmd_type type;
-	u16_t shutdown_mode;
-
-	ret = at_parser_params_from_str(at_cmd, NULL, &at_param_list);
-	if (ret < 0) {
-		LOG_ERR("Failed to parse AT command %d", ret);
+	if (cmd_type != AT_CMD_TYPE_SET_COMMAND) {
 		return -EINVAL;
 	}
 
-	type = at_parser_cmd_type_get(at_cmd);
-	if (type == AT_CMD_TYPE_SET_COMMAND) {
+	for (size_t i = 0; i < at_cmd_count; i++) {
+		rsp_send(at_cmd_list[i].string, strlen(at_cmd_list[i].string));
+		rsp_send("\r\n", 2);
+	}
+
+	return 0;
+}
+
+/**@brief handle AT#XSLEEP commands
+ *  AT#XSLEEP[=<shutdown_mode>]
+ *  AT#XSLEEP? READ command not supported
+ *  AT#XSLEEP=?
+ */
+static int handle_at_sleep(enum at_cmd_type cmd_type)
+{
+	int ret = -EINVAL;
+	u16_t shutdown_mode;
+
+	if (cmd_type == AT_CMD_TYPE_SET_COMMAND) {
 		shutdown_mode = SHUTDOWN_MODE_IDLE;
 		if (at_params_valid_count_get(&at_param_list) > 1) {
 			ret = at_params_short_get(&at_param_list, 1,
@@ -168,7 +226,7 @@ static int handle_at_sleep(const char *at_cmd, enum shutdown_modes *mode)
 		if (shutdown_mode == SHUTDOWN_MODE_IDLE) {
 			slm_at_host_uninit();
 			enter_idle();
-			*mode = SHUTDOWN_MODE_IDLE;
+			at_host_stopped = true;
 			ret = 0; /*Will send no "OK"*/
 		} else if (shutdown_mode == SHUTDOWN_MODE_SLEEP) {
 			slm_at_host_uninit();
@@ -180,7 +238,7 @@ static int handle_at_sleep(const char *at_cmd, enum shutdown_modes *mode)
 		}
 	}
 
-	if (type == AT_CMD_TYPE_TEST_COMMAND) {
+	if (cmd_type == AT_CMD_TYPE_TEST_COMMAND) {
 		char buf[64];
 
 		sprintf(buf, "#XSLEEP: (%d, %d)\r\n", SHUTDOWN_MODE_IDLE,
@@ -192,11 +250,56 @@ static int handle_at_sleep(const char *at_cmd, enum shutdown_modes *mode)
 	return ret;
 }
 
+/**@brief AT commands registered with the AT host. */
+SLM_AT_CMD_DEFINE(XSLEEP, handle_at_sleep);
+SLM_AT_CMD_DEFINE(XSLMVER, handle_at_slmver);
+SLM_AT_CMD_DEFINE(XCLAC, handle_at_clac);
+
+static int at_cmd_list_init(void)
+{
+	at_cmd_list = _slm_at_cmd_list_start;
+	at_cmd_count = _slm_at_cmd_list_end - _slm_at_cmd_list_start;
+
+	for (size_t i = 0; i < at_cmd_count; i++) {
+		if (strlen(at_cmd_list[i].string) >
+		    SLM_AT_CMD_NAME_MAX_LEN) {
+			LOG_ERR("AT command name too long: %s",
+				at_cmd_list[i].string);
+			return -EINVAL;
+		}
+		/* The binary search relies on the link time sorting */
+		if ((i > 0) && (strcmp(at_cmd_list[i - 1].string,
+				       at_cmd_list[i].string) >= 0)) {
+			LOG_ERR("AT command table not sorted: %s",
+				at_cmd_list[i].string);
+			return -EINVAL;
+		}
+	}
+
+	LOG_DBG("%d AT commands registered", at_cmd_count);
+
+	return 0;
+}
+
+static int uart_receive(void)
+{
+	if (datamode_handler != NULL) {
+		datamode_buf_idx = 1U;
+		return uart_rx_enable(uart_dev, datamode_uart_buf[0],
+				      DATAMODE_BUF_SIZE,
+				      CONFIG_SLM_DATAMODE_RX_TIMEOUT);
+	}
+
+	buf_num = 1U;
+	return uart_rx_enable(uart_dev, &uart_rx_buf[0], 1, K_FOREVER);
+}
+
 static void cmd_send(struct k_work *work)
 {
 	size_t chars;
 	char str[24];
 	static char buf[AT_MAX_CMD_LEN];
+	const struct slm_at_cmd *slm_cmd;
 	enum at_cmd_state state;
 	int err;
 
@@ -207,99 +310,25 @@ static void cmd_send(struct k_work *work)
 
 	LOG_HEXDUMP_DBG(at_buf, at_buf_len, "RX");
 
-	if (slm_util_cmd_casecmp(at_buf, AT_CMD_SLMVER)) {
-		rsp_send(SLM_VERSION, sizeof(SLM_VERSION) - 1);
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	}
-
-	if (slm_util_cmd_casecmp(at_buf, AT_CMD_CLAC)) {
-		handle_at_clac();
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	}
-
-	if (slm_util_cmd_casecmp(at_buf, AT_CMD_SLEEP)) {
-		enum shutdown_modes mode = SHUTDOWN_MODE_INVALID;
-
-		err = handle_at_sleep(at_buf, &mode);
+	slm_cmd = slm_util_at_cmd_find(at_cmd_list, at_cmd_count, at_buf);
+	if (slm_cmd != NULL) {
+		err = at_parser_params_from_str(at_buf, NULL, &at_param_list);
 		if (err) {
+			LOG_ERR("Failed to parse AT command %d", err);
 			rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
 			goto done;
-		} else {
-			if (mode == SHUTDOWN_MODE_INVALID) {
-				/*Test command*/
-				rsp_send(OK_STR, sizeof(OK_STR) - 1);
-				goto done;
-			} else {
-				/*Entered IDLE*/
-				return;
-			}
 		}
-	}
-
-	err = slm_at_tcpip_parse(at_buf);
-	if (err == 0) {
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
-		goto done;
-	}
-#if defined(CONFIG_SLM_TCP_PROXY)
-	err = slm_at_tcp_proxy_parse(at_buf);
-	if (err == 0) {
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
-		goto done;
-	}
-#endif
-
-#if defined(CONFIG_SLM_UDP_PROXY)
-	err = slm_at_udp_proxy_parse(at_buf);
-	if (err == 0) {
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
-		goto done;
-	}
-#endif
-
-	err = slm_at_icmp_parse(at_buf);
-	if (err == 0) {
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
-		goto done;
-	}
-
-	err = slm_at_gps_parse(at_buf);
-	if (err == 0) {
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
-		goto done;
-	}
 
-	err = slm_at_mqtt_parse(at_buf);
-	if (err == 0) {
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
-		goto done;
-	}
-
-	err = slm_at_ftp_parse(at_buf);
-	if (err == 0) {
-		rsp_send(OK_STR, sizeof(OK_STR) - 1);
-		goto done;
-	} else if (err != -ENOTSUP) {
-		rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
+		err = slm_cmd->handler(at_parser_cmd_type_get(at_buf));
+		if (at_host_stopped) {
+			/* Entered IDLE */
+			return;
+		}
+		if (err) {
+			rsp_send(ERROR_STR, sizeof(ERROR_STR) - 1);
+		} else if (!slm_cmd->async_rsp) {
+			rsp_send(OK_STR, sizeof(OK_STR) - 1);
+		}
 		goto done;
 	}
 
@@ -331,14 +360,182 @@ static void cmd_send(struct k_work *work)
 
 done:
 	k_sleep(K_MSEC(100)); /* allow time for TX DMA */
-	buf_num = 1U;
-	err = uart_rx_enable(uart_dev, &uart_rx_buf[0], 1, K_FOREVER);
+	err = uart_receive();
 	if (err) {
 		LOG_ERR("UART RX failed: %d", err);
 		rsp_send(FATAL_STR, sizeof(FATAL_STR) - 1);
 	}
 }
 
+static void datamode_send(struct k_work *work)
+{
+	u8_t *data;
+	u32_t len;
+	int ret;
+
+	ARG_UNUSED(work);
+
+	/* Single producer (UART callback), single consumer (this work) */
+	while (datamode_handler != NULL) {
+		len = ring_buf_get_claim(&datamode_rb, &data,
+					 DATAMODE_BUF_SIZE);
+		if (len == 0) {
+			break;
+		}
+		ret = datamode_handler(DATAMODE_SEND, data, len);
+		ring_buf_get_finish(&datamode_rb, len);
+		if (ret < 0) {
+			LOG_WRN("Data mode send failed: %d", ret);
+		}
+
+		/* Resume RX paused by the UART callback */
+		if ((ring_buf_space_get(&datamode_rb) >= DATAMODE_RX_RESERVE) &&
+		    atomic_cas(&datamode_rx_state, DATAMODE_RX_PAUSED,
+			       DATAMODE_RX_RUNNING)) {
+			LOG_DBG("Data mode RX resumed");
+			ret = uart_receive();
+			if (ret) {
+				LOG_ERR("UART RX failed: %d", ret);
+			}
+		}
+	}
+}
+
+static void datamode_exit(struct k_work *work)
+{
+	slm_datamode_handler_t handler = datamode_handler;
+	int err;
+
+	ARG_UNUSED(work);
+
+	if (handler == NULL) {
+		return;
+	}
+
+	k_delayed_work_cancel(&datamode_escape_work);
+	uart_rx_disable(uart_dev);
+	datamode_handler = NULL;
+	(void)handler(DATAMODE_EXIT, NULL, 0);
+	ring_buf_reset(&datamode_rb);
+
+	rsp_send(OK_STR, sizeof(OK_STR) - 1);
+	k_sleep(K_MSEC(100)); /* allow time for RX to stop */
+	err = uart_receive();
+	if (err) {
+		LOG_ERR("UART RX failed: %d", err);
+		rsp_send(FATAL_STR, sizeof(FATAL_STR) - 1);
+	}
+}
+
+int enter_datamode(slm_datamode_handler_t handler)
+{
+	if (handler == NULL) {
+		return -EINVAL;
+	}
+	if (datamode_handler != NULL) {
+		return -EBUSY;
+	}
+
+	ring_buf_reset(&datamode_rb);
+	atomic_set(&datamode_rx_state, DATAMODE_RX_RUNNING);
+	datamode_escape_cnt = 0;
+	datamode_rx_time = k_uptime_get_32();
+	datamode_handler = handler;
+
+	/* UART RX is switched over when the command has completed */
+	return 0;
+}
+
+void exit_datamode(void)
+{
+	k_work_submit_to_queue(&datamode_work_q, &datamode_exit_work);
+}
+
+static void datamode_put(const u8_t *data, size_t len)
+{
+	u32_t written = ring_buf_put(&datamode_rb, data, len);
+
+	if (written < len) {
+		LOG_WRN("Data mode overflow, %d bytes dropped",
+			(int)(len - written));
+	}
+
+	/* Stop RX until the ring buffer is drained. With hardware flow
+	 * control, the UART holds the host off in the meantime.
+	 */
+	if ((ring_buf_space_get(&datamode_rb) < DATAMODE_RX_RESERVE) &&
+	    atomic_cas(&datamode_rx_state, DATAMODE_RX_RUNNING,
+		       DATAMODE_RX_PAUSING)) {
+		uart_rx_disable(uart_dev);
+	}
+}
+
+static void datamode_escape(struct k_work *work)
+{
+	bool escape;
+	unsigned int key;
+
+	ARG_UNUSED(work);
+
+	/* Guard time has passed since the last received data */
+	key = irq_lock();
+	escape = (datamode_escape_cnt == DATAMODE_ESCAPE_LEN);
+	if (!escape) {
+		/* Sequence not completed in time, the characters are data */
+		datamode_put(DATAMODE_ESCAPE, datamode_escape_cnt);
+	}
+	datamode_escape_cnt = 0;
+	irq_unlock(key);
+
+	if (escape) {
+		LOG_DBG("Data mode escape sequence received");
+		datamode_exit(NULL);
+	} else {
+		datamode_send(NULL);
+	}
+}
+
+static void datamode_rx_handler(const u8_t *data, size_t len)
+{
+	u32_t now = k_uptime_get_32();
+	bool idle = (now - datamode_rx_time) >= DATAMODE_ESCAPE_GUARD;
+	size_t pos = 0;
+
+	datamode_rx_time = now;
+
+	/* The escape sequence must be preceded and followed by the guard
+	 * time, and its characters must arrive within the guard time.
+	 * Matched characters are held back until the sequence is decided,
+	 * so the sequence can be split over any number of DMA transfers.
+	 */
+	if (datamode_escape_cnt > 0) {
+		k_delayed_work_cancel(&datamode_escape_work);
+	}
+
+	if ((datamode_escape_cnt > 0) || idle) {
+		while ((pos < len) &&
+		       (datamode_escape_cnt < DATAMODE_ESCAPE_LEN) &&
+		       (data[pos] == DATAMODE_ESCAPE[datamode_escape_cnt])) {
+			datamode_escape_cnt++;
+			pos++;
+		}
+
+		if (pos == len) {
+			k_delayed_work_submit_to_queue(&datamode_work_q,
+						       &datamode_escape_work,
+						       DATAMODE_ESCAPE_GUARD);
+			return;
+		}
+
+		/* Not an escape sequence, pass on the held characters */
+		datamode_put(DATAMODE_ESCAPE, datamode_escape_cnt);
+		datamode_escape_cnt = 0;
+	}
+
+	datamode_put(&data[pos], len - pos);
+	k_work_submit_to_queue(&datamode_work_q, &datamode_send_work);
+}
+
 static void uart_rx_handler(u8_t character)
 {
 	static bool inside_quotes;
@@ -430,9 +627,25 @@ static void uart_callback(struct uart_event *evt, void *user_data)
 		LOG_INF("TX_ABORTED");
 		break;
 	case UART_RX_RDY:
-		uart_rx_handler(evt->data.rx.buf[0]);
+		if (datamode_handler != NULL) {
+			datamode_rx_handler(evt->data.rx.buf +
+					    evt->data.rx.offset,
+					    evt->data.rx.len);
+		} else {
+			uart_rx_handler(evt->data.rx.buf[0]);
+		}
 		break;
 	case UART_RX_BUF_REQUEST:
+		if (datamode_handler != NULL) {
+			err = uart_rx_buf_rsp(uart_dev,
+					datamode_uart_buf[datamode_buf_idx],
+					DATAMODE_BUF_SIZE);
+			if (err) {
+				LOG_WRN("UART RX buf rsp: %d", err);
+			}
+			datamode_buf_idx ^= 1U;
+			break;
+		}
 		err = uart_rx_buf_rsp(uart_dev, &uart_rx_buf[buf_num], 1);
 		if (err) {
 			LOG_WRN("UART RX buf rsp: %d", err);
@@ -447,12 +660,89 @@ static void uart_callback(struct uart_event *evt, void *user_data)
 		break;
 	case UART_RX_DISABLED:
 		LOG_DBG("RX_DISABLED");
+		if (atomic_cas(&datamode_rx_state, DATAMODE_RX_PAUSING,
+			       DATAMODE_RX_PAUSED)) {
+			/* Resumed once the pending data is sent */
+			k_work_submit_to_queue(&datamode_work_q,
+					       &datamode_send_work);
+		}
 		break;
 	default:
 		break;
 	}
 }
 
+#if defined(CONFIG_SLM_DATAMODE_LOOPBACK_TEST)
+static u8_t loopback_pattern(u32_t pos)
+{
+	/* Never contains the escape sequence */
+	return (u8_t)(pos % 251);
+}
+
+static int loopback_handler(enum slm_datamode_op op, const u8_t *data,
+			    int len)
+{
+	if (op != DATAMODE_SEND) {
+		return 0;
+	}
+
+	for (int i = 0; i < len; i++) {
+		if (data[i] != loopback_pattern(loopback_rx_len + i)) {
+			loopback_err_cnt++;
+		}
+	}
+
+	loopback_rx_len += len;
+	if (loopback_rx_len >= LOOPBACK_TEST_SIZE) {
+		k_sem_give(&loopback_done);
+	}
+
+	return len;
+}
+
+/* UART TX is wired to RX: the pattern sent through rsp_send() comes back
+ * through the data mode RX path, as data from a host would.
+ */
+static void datamode_loopback_test(void)
+{
+	static u8_t chunk[DATAMODE_BUF_SIZE];
+	u32_t start;
+	u32_t elapsed;
+	u32_t len;
+	int err;
+
+	uart_rx_disable(uart_dev);
+	k_sleep(K_MSEC(100)); /* allow time for RX to stop */
+
+	loopback_rx_len = 0;
+	loopback_err_cnt = 0;
+	(void)enter_datamode(loopback_handler);
+	err = uart_receive();
+	if (err) {
+		LOG_ERR("UART RX failed: %d", err);
+		return;
+	}
+
+	start = k_uptime_get_32();
+
+	for (u32_t sent = 0; sent < LOOPBACK_TEST_SIZE; sent += len) {
+		len = MIN(sizeof(chunk), LOOPBACK_TEST_SIZE - sent);
+		for (u32_t i = 0; i < len; i++) {
+			chunk[i] = loopback_pattern(sent + i);
+		}
+		rsp_send(chunk, len);
+	}
+
+	err = k_sem_take(&loopback_done, LOOPBACK_TEST_TIMEOUT);
+	elapsed = MAX(k_uptime_get_32() - start, 1);
+
+	LOG_INF("Loopback: %u/%u bytes in %u ms, %u kbit/s, %u errors%s",
+		loopback_rx_len, LOOPBACK_TEST_SIZE, elapsed,
+		(u32_t)(((u64_t)loopback_rx_len * 8) / elapsed),
+		loopback_err_cnt, err ? ", timed out" : "");
+}
+#endif
+
 int slm_at_host_init(void)
 {
 	char *uart_dev_name;
@@ -503,8 +793,7 @@ int slm_at_host_init(void)
 	/* Power on UART module */
 	device_set_power_state(uart_dev, DEVICE_PM_ACTIVE_STATE,
 				NULL, NULL);
-	buf_num = 1U;
-	err = uart_rx_enable(uart_dev, &uart_rx_buf[0], 1, K_FOREVER);
+	err = uart_receive();
 	if (err) {
 		LOG_ERR("Cannot enable rx: %d", err);
 		return -EFAULT;
@@ -516,6 +805,12 @@ int slm_at_host_init(void)
 		return err;
 	}
 
+	at_host_stopped = false;
+	err = at_cmd_list_init();
+	if (err) {
+		return err;
+	}
+
 	err = slm_at_tcpip_init();
 	if (err) {
 		LOG_ERR("TCPIP could not be initialized: %d", err);
@@ -558,7 +853,25 @@ int slm_at_host_init(void)
 	}
 
 	k_work_init(&cmd_send_work, cmd_send);
+	/* The AT host is initialized again after every idle period, while
+	 * the work queue thread keeps running.
+	 */
+	if (!datamode_work_q_started) {
+		k_work_q_start(&datamode_work_q, datamode_work_q_stack,
+			K_THREAD_STACK_SIZEOF(datamode_work_q_stack),
+			K_PRIO_PREEMPT(CONFIG_SLM_DATAMODE_SEND_PRIORITY));
+		k_work_init(&datamode_send_work, datamode_send);
+		k_work_init(&datamode_exit_work, datamode_exit);
+		k_delayed_work_init(&datamode_escape_work, datamode_escape);
+		datamode_work_q_started = true;
+	}
 	k_sem_give(&tx_done);
+
+#if defined(CONFIG_SLM_DATAMODE_LOOPBACK_TEST)
+	datamode_loopback_test();
+	return 0;
+#endif
+
 	rsp_send(SLM_SYNC_STR, sizeof(SLM_SYNC_STR)-1);
 
 	LOG_DBG("at_host init done");
@@ -13,20 +13,74 @@
  * @{
  */
 
+#include <zephyr.h>
 #include <zephyr/types.h>
 #include <ctype.h>
 #include <modem/at_cmd_parser.h>
 #include <modem/at_cmd.h>
 
+/**@brief Maximum length of a proprietary AT command name, with "AT#". */
+#define SLM_AT_CMD_NAME_MAX_LEN	32
+
 /**@brief AT command handler type. */
 typedef int (*slm_at_handler_t) (enum at_cmd_type);
 
-/**@brief AT command list item type. */
-typedef struct slm_at_cmd_list {
-	u8_t type;
-	char *string;
+/**@brief AT command registered with the AT host.
+ *
+ * Commands are placed in a dedicated linker section, sorted by name, so that
+ * the AT host can look them up with a binary search. Use
+ * @ref SLM_AT_CMD_DEFINE to register a command.
+ */
+struct slm_at_cmd {
+	const char *string;
 	slm_at_handler_t handler;
-} slm_at_cmd_list_t;
+	/* Handler sends the final result code itself */
+	bool async_rsp;
+};
+
+#define Z_SLM_AT_CMD_DEFINE(_name, _handler, _async_rsp)		\
+	static const Z_STRUCT_SECTION_ITERABLE(slm_at_cmd,		\
+					       slm_at_cmd_##_name) = {	\
+		.string = "AT#" #_name,					\
+		.handler = _handler,					\
+		.async_rsp = _async_rsp,				\
+	}
+
+/**@brief Register a proprietary AT command.
+ *
+ * The AT host parses the parameters into at_param_list, calls the handler
+ * with the command type, and sends OK or ERROR depending on the result.
+ *
+ * @param _name Command name following "AT#", in upper case, for example
+ *              XSOCKET.
+ * @param _handler Command handler of type @ref slm_at_handler_t.
+ */
+#define SLM_AT_CMD_DEFINE(_name, _handler) \
+	Z_SLM_AT_CMD_DEFINE(_name, _handler, false)
+
+/**@brief Register a proprietary AT command that sends its own result code.
+ *
+ * Same as @ref SLM_AT_CMD_DEFINE, but the AT host sends only ERROR, if the
+ * handler fails. The handler is responsible for sending OK.
+ */
+#define SLM_AT_CMD_ASYNC_DEFINE(_name, _handler) \
+	Z_SLM_AT_CMD_DEFINE(_name, _handler, true)
+
+/**@brief Operations requested from a data mode handler. */
+enum slm_datamode_op {
+	DATAMODE_SEND,	/* Send raw data received from UART */
+	DATAMODE_EXIT	/* Data mode is being exited */
+};
+
+/**@brief Data mode handler type.
+ *
+ * Called from the data mode work queue with raw data received from UART,
+ * without any AT parsing. The handler may block, UART RX is paused while
+ * the received data waits to be sent. Returns the number of bytes consumed or
+ * a negative error code.
+ */
+typedef int (*slm_datamode_handler_t)(enum slm_datamode_op op,
+				      const u8_t *data, int len);
 
 /**@brief Arbitrary data type over AT channel. */
 enum slm_data_type_t {
@@ -16,22 +16,6 @@
 #include <zephyr/types.h>
 #include <modem/at_cmd.h>
 
-/**
- * @brief ICMP AT command parser.
- *
- * @param at_cmd AT command string.
- *
- * @retval 0 If the operation was successful.
- *           Otherwise, a (negative) error code is returned.
- */
-int slm_at_icmp_parse(const char *at_cmd);
-
-/**
- * @brief List ICMP AT commands.
- *
- */
-void slm_at_icmp_clac(void);
-
 /**
  * @brief Initialize ICMP AT command parser.
  *
@@ -33,28 +33,17 @@ enum slm_mqttsub_operation {
 	AT_MQTTSUB_SUB
 };
 
-/**@brief List of supported AT commands. */
-enum slm_mqtt_at_cmd_type {
-	AT_MQTT_CONNECT,
-	AT_MQTT_PUBLISH,
-	AT_MQTT_SUBSCRIBE,
-	AT_MQTT_UNSUBSCRIBE,
-	AT_MQTT_MAX
-};
-
 /** forward declaration of cmd handlers **/
 static int handle_at_mqtt_connect(enum at_cmd_type cmd_type);
 static int handle_at_mqtt_publish(enum at_cmd_type cmd_type);
 static int handle_at_mqtt_subscribe(enum at_cmd_type cmd_type);
 static int handle_at_mqtt_unsubscribe(enum at_cmd_type cmd_type);
 
-/**@brief SLM AT Command list type. */
-static slm_at_cmd_list_t m_mqtt_at_list[AT_MQTT_MAX] = {
-	{AT_MQTT_CONNECT, "AT#XMQTTCON", handle_at_mqtt_connect},
-	{AT_MQTT_PUBLISH, "AT#XMQTTPUB", handle_at_mqtt_publish},
-	{AT_MQTT_SUBSCRIBE, "AT#XMQTTSUB", handle_at_mqtt_subscribe},
-	{AT_MQTT_UNSUBSCRIBE, "AT#XMQTTUNSUB", handle_at_mqtt_unsubscribe},
-};
+/**@brief AT commands registered with the AT host. */
+SLM_AT_CMD_DEFINE(XMQTTCON, handle_at_mqtt_connect);
+SLM_AT_CMD_DEFINE(XMQTTPUB, handle_at_mqtt_publish);
+SLM_AT_CMD_DEFINE(XMQTTSUB, handle_at_mqtt_subscribe);
+SLM_AT_CMD_DEFINE(XMQTTUNSUB, handle_at_mqtt_unsubscribe);
 
 static struct slm_mqtt_ctx {
 	bool connected;
@@ -783,40 +772,6 @@ static int handle_at_mqtt_unsubscribe(enum at_cmd_type cmd_type)
 	return err;
 }
 
-/**@brief API to handle MQTT AT commands
- */
-int slm_at_mqtt_parse(const char *at_cmd)
-{
-	int ret = -ENOTSUP;
-	enum at_cmd_type type;
-
-	for (int i = 0; i < AT_MQTT_MAX; i++) {
-		if (slm_util_cmd_casecmp(at_cmd, m_mqtt_at_list[i].string)) {
-			ret = at_parser_params_from_str(at_cmd, NULL,
-						&at_param_list);
-			if (ret) {
-				LOG_ERR("Failed to parse AT command %d", ret);
-				return -EINVAL;
-			}
-			type = at_parser_cmd_type_get(at_cmd);
-			ret = m_mqtt_at_list[i].handler(type);
-			break;
-		}
-	}
-
-	return ret;
-}
-
-/**@brief API to list MQTT AT commands
- */
-void slm_at_mqtt_clac(void)
-{
-	for (int i = 0; i < AT_MQTT_MAX; i++) {
-		sprintf(rsp_buf, "%s\r\n", m_mqtt_at_list[i].string);
-		rsp_send(rsp_buf, strlen(rsp_buf));
-	}
-}
-
 int slm_at_mqtt_init(void)
 {
 	return 0;
@@ -18,7 +18,6 @@ LOG_MODULE_REGISTER(tcpip, CONFIG_SLM_LOG_LEVEL);
 
 /*
  * Known limitation in this version
- * - Multiple concurrent sockets
  * - Socket type other than SOCK_STREAM(1) and SOCK_DGRAM(2)
  * - IP Protocol other than TCP(6) and UDP(17)
  * - TCP server accept one connection only
@@ -45,22 +44,6 @@ enum slm_socket_role {
 	AT_SOCKET_ROLE_SERVER
 };
 
-/**@brief List of supported AT commands. */
-enum slm_tcpip_at_cmd_type {
-	AT_SOCKET,
-	AT_SOCKETOPT,
-	AT_BIND,
-	AT_CONNECT,
-	AT_LISTEN,
-	AT_ACCEPT,
-	AT_SEND,
-	AT_RECV,
-	AT_SENDTO,
-	AT_RECVFROM,
-	AT_GETADDRINFO,
-	AT_TCPIP_MAX
-};
-
 /** forward declaration of cmd handlers **/
 static int handle_at_socket(enum at_cmd_type cmd_type);
 static int handle_at_socketopt(enum at_cmd_type cmd_type);
@@ -73,21 +56,23 @@ static int handle_at_recv(enum at_cmd_type cmd_type);
 static int handle_at_sendto(enum at_cmd_type cmd_type);
 static int handle_at_recvfrom(enum at_cmd_type cmd_type);
 static int handle_at_getaddrinfo(enum at_cmd_type cmd_type);
-
-/**@brief SLM AT Command list type. */
-static slm_at_cmd_list_t m_tcpip_at_list[AT_TCPIP_MAX] = {
-	{AT_SOCKET, "AT#XSOCKET", handle_at_socket},
-	{AT_SOCKETOPT, "AT#XSOCKETOPT", handle_at_socketopt},
-	{AT_BIND, "AT#XBIND", handle_at_bind},
-	{AT_CONNECT, "AT#XCONNECT", handle_at_connect},
-	{AT_LISTEN, "AT#XLISTEN", handle_at_listen},
-	{AT_ACCEPT, "AT#XACCEPT", handle_at_accept},
-	{AT_SEND, "AT#XSEND", handle_at_send},
-	{AT_RECV, "AT#XRECV", handle_at_recv},
-	{AT_SENDTO, "AT#XSENDTO", handle_at_sendto},
-	{AT_RECVFROM, "AT#XRECVFROM", handle_at_recvfrom},
-	{AT_GETADDRINFO, "AT#XGETADDRINFO", handle_at_getaddrinfo},
-};
+static int handle_at_socketselect(enum at_cmd_type cmd_type);
+static int handle_at_datamode(enum at_cmd_type cmd_type);
+
+/**@brief AT commands registered with the AT host. */
+SLM_AT_CMD_DEFINE(XSOCKET, handle_at_socket);
+SLM_AT_CMD_DEFINE(XSOCKETOPT, handle_at_socketopt);
+SLM_AT_CMD_DEFINE(XBIND, handle_at_bind);
+SLM_AT_CMD_DEFINE(XCONNECT, handle_at_connect);
+SLM_AT_CMD_DEFINE(XLISTEN, handle_at_listen);
+SLM_AT_CMD_DEFINE(XACCEPT, handle_at_accept);
+SLM_AT_CMD_DEFINE(XSEND, handle_at_send);
+SLM_AT_CMD_DEFINE(XRECV, handle_at_recv);
+SLM_AT_CMD_DEFINE(XSENDTO, handle_at_sendto);
+SLM_AT_CMD_DEFINE(XRECVFROM, handle_at_recvfrom);
+SLM_AT_CMD_DEFINE(XGETADDRINFO, handle_at_getaddrinfo);
+SLM_AT_CMD_DEFINE(XSOCKETSELECT, handle_at_socketselect);
+SLM_AT_CMD_DEFINE(XDATAMODE, handle_at_datamode);
 
 static struct sockaddr_in remote;
 
@@ -97,10 +82,27 @@ static struct tcpip_client {
 	int sock_peer; /* Socket descriptor for peer. */
 	int ip_proto; /* IP protocol */
 	bool connected; /* TCP connected flag */
-} client;
+} clients[CONFIG_SLM_MAX_SOCKETS];
+
+/* Socket that the AT commands operate on, selected by AT#XSOCKETSELECT. */
+static struct tcpip_client *client = &clients[0];
+
+/* Socket used for transparent data mode. */
+static int datamode_sock = INVALID_SOCKET;
+static u8_t datamode_rx_buf[NET_IPV4_MTU];
+static struct k_thread datamode_thread;
+static K_THREAD_STACK_DEFINE(datamode_thread_stack,
+			     CONFIG_SLM_DATAMODE_STACK_SIZE);
+/* Receive thread stop request, checked at least every poll period. */
+#define DATAMODE_POLL_PERIOD	100 /* ms */
+static atomic_t datamode_stop;
+static bool datamode_remote_closed;
+static K_SEM_DEFINE(datamode_thread_done, 0, 1);
 
 /* global functions defined in different files */
 void rsp_send(const u8_t *str, size_t len);
+int enter_datamode(slm_datamode_handler_t handler);
+void exit_datamode(void);
 
 /* global variable defined in different files */
 extern struct at_param_list at_param_list;
@@ -163,40 +165,76 @@ static int parse_host_by_name(const char *name, u16_t port, int socktype)
 	return 0;
 }
 
+static struct tcpip_client *client_find(int sock)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		if (clients[i].sock == sock) {
+			return &clients[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void client_reset(struct tcpip_client *slot)
+{
+	slot->sock = INVALID_SOCKET;
+	slot->role = AT_SOCKET_ROLE_CLIENT;
+	slot->sock_peer = INVALID_SOCKET;
+	slot->connected = false;
+	slot->ip_proto = IPPROTO_IP;
+}
+
+/* Data socket of the selected client: the peer socket for servers. */
+static int client_data_sock(void)
+{
+	if (client->role == AT_SOCKET_ROLE_SERVER) {
+		return client->sock_peer;
+	}
+
+	return client->sock;
+}
+
 static int do_socket_open(u8_t type, u8_t role, int sec_tag)
 {
 	int ret = 0;
+	struct tcpip_client *slot = client_find(INVALID_SOCKET);
 
+	if (slot == NULL) {
+		LOG_ERR("No free socket, max %d", CONFIG_SLM_MAX_SOCKETS);
+		return -ENOMEM;
+	}
 	if (type == SOCK_STREAM) {
 		if (sec_tag == INVALID_SEC_TAG) {
-			client.sock = socket(AF_INET, SOCK_STREAM,
+			slot->sock = socket(AF_INET, SOCK_STREAM,
 					IPPROTO_TCP);
-			client.ip_proto = IPPROTO_TCP;
+			slot->ip_proto = IPPROTO_TCP;
 		} else {
-			client.sock = socket(AF_INET, SOCK_STREAM,
+			slot->sock = socket(AF_INET, SOCK_STREAM,
 					IPPROTO_TLS_1_2);
-			client.ip_proto = IPPROTO_TLS_1_2;
+			slot->ip_proto = IPPROTO_TLS_1_2;
 		}
 	} else if (type == SOCK_DGRAM) {
 		if (sec_tag == INVALID_SEC_TAG) {
-			client.sock = socket(AF_INET, SOCK_DGRAM,
+			slot->sock = socket(AF_INET, SOCK_DGRAM,
 					IPPROTO_UDP);
-			client.ip_proto = IPPROTO_UDP;
+			slot->ip_proto = IPPROTO_UDP;
 		} else {
-			client.sock = socket(AF_INET, SOCK_DGRAM,
+			slot->sock = socket(AF_INET, SOCK_DGRAM,
 					IPPROTO_DTLS_1_2);
-			client.ip_proto = IPPROTO_DTLS_1_2;
+			slot->ip_proto = IPPROTO_DTLS_1_2;
 		}
 	} else {
 		LOG_ERR("socket type %d not supported", type);
 		return -ENOTSUP;
 	}
-	if (client.sock < 0) {
-		LOG_ERR("socket() failed: %d", -errno);
-		sprintf(rsp_buf, "#XSOCKET: %d\r\n", -errno);
-		rsp_send(rsp_buf, strlen(rsp_buf));
-		client.ip_proto = IPPROTO_IP;
+	if (slot->sock < 0) {
 		ret = -errno;
+		LOG_ERR("socket() failed: %d", ret);
+		sprintf(rsp_buf, "#XSOCKET: %d\r\n", ret);
+		rsp_send(rsp_buf, strlen(rsp_buf));
+		client_reset(slot);
+		return ret;
 	}
 
 	if (sec_tag != INVALID_SEC_TAG) {
@@ -206,23 +244,27 @@ static int do_socket_open(u8_t type, u8_t role, int sec_tag)
 			sprintf(rsp_buf,
 				"#XSOCKET: (D)TLS Server not supported\r\n");
 			rsp_send(rsp_buf, strlen(rsp_buf));
-			close(client.sock);
-			client.sock = INVALID_SOCKET;
+			close(slot->sock);
+			client_reset(slot);
 			return -ENOTSUP;
 		}
 
-		ret = setsockopt(client.sock, SOL_TLS, TLS_SEC_TAG_LIST,
+		ret = setsockopt(slot->sock, SOL_TLS, TLS_SEC_TAG_LIST,
 				sec_tag_list, sizeof(sec_tag_t));
 		if (ret) {
 			LOG_ERR("set tag list failed: %d", -errno);
-			close(client.sock);
-			return -errno;
+			ret = -errno;
+			close(slot->sock);
+			client_reset(slot);
+			return ret;
 		}
 	}
 
-	client.role = role;
-	sprintf(rsp_buf, "#XSOCKET: %d, %d, %d, %d\r\n", client.sock,
-		type, role, client.ip_proto);
+	slot->role = role;
+	/* A newly opened socket becomes the selected one */
+	client = slot;
+	sprintf(rsp_buf, "#XSOCKET: %d, %d, %d, %d\r\n", slot->sock,
+		type, role, slot->ip_proto);
 	rsp_send(rsp_buf, strlen(rsp_buf));
 
 	LOG_DBG("Socket opened");
@@ -233,19 +275,16 @@ static int do_socket_close(int error)
 {
 	int ret = 0;
 
-	if (client.sock > 0) {
-		ret = close(client.sock);
+	if (client->sock > 0) {
+		ret = close(client->sock);
 		if (ret < 0) {
 			LOG_WRN("close() failed: %d", -errno);
 			ret = -errno;
 		}
-		client.sock = INVALID_SOCKET;
-		if (client.sock_peer > 0) {
-			close(client.sock_peer);
+		if (client->sock_peer > 0) {
+			close(client->sock_peer);
 		}
-		client.role = AT_SOCKET_ROLE_CLIENT;
-		client.sock_peer = INVALID_SOCKET;
-		client.connected = false;
+		client_reset(client);
 
 		sprintf(rsp_buf, "#XSOCKET: %d, closed\r\n", error);
 		rsp_send(rsp_buf, strlen(rsp_buf));
@@ -270,7 +309,7 @@ static int do_socketopt_set(int name, int value)
 	case SO_RCVTIMEO: {
 		struct timeval tmo = { .tv_sec = value };
 
-		ret = setsockopt(client.sock, SOL_SOCKET, SO_RCVTIMEO,
+		ret = setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO,
 				&tmo, sizeof(struct timeval));
 		if (ret < 0) {
 			LOG_ERR("setsockopt() error: %d", -errno);
@@ -306,7 +345,7 @@ static int do_socketopt_get(int name)
 		struct timeval tmo;
 		socklen_t len = sizeof(struct timeval);
 
-		ret = getsockopt(client.sock, SOL_SOCKET, SO_RCVTIMEO,
+		ret = getsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO,
 				&tmo, &len);
 		if (ret) {
 			LOG_ERR("getsockopt() error: %d", -errno);
@@ -363,7 +402,7 @@ static int do_bind(u16_t port)
 		return -EINVAL;
 	}
 
-	ret = bind(client.sock, (struct sockaddr *)&local,
+	ret = bind(client->sock, (struct sockaddr *)&local,
 		 sizeof(struct sockaddr_in));
 	if (ret) {
 		LOG_ERR("bind() failed: %d", -errno);
@@ -390,7 +429,7 @@ static int do_connect(const char *url, u16_t port)
 		return ret;
 	}
 
-	ret = connect(client.sock, (struct sockaddr *)&remote,
+	ret = connect(client->sock, (struct sockaddr *)&remote,
 		sizeof(struct sockaddr_in));
 	if (ret < 0) {
 		LOG_ERR("connect() failed: %d", -errno);
@@ -398,7 +437,7 @@ static int do_connect(const char *url, u16_t port)
 		return -errno;
 	}
 
-	client.connected = true;
+	client->connected = true;
 	sprintf(rsp_buf, "#XCONNECT: 1\r\n");
 	rsp_send(rsp_buf, strlen(rsp_buf));
 	return 0;
@@ -409,14 +448,14 @@ static int do_listen(void)
 	int ret;
 
 	/* hardcode backlog to be 1 for now */
-	ret = listen(client.sock, 1);
+	ret = listen(client->sock, 1);
 	if (ret < 0) {
 		LOG_ERR("listen() failed: %d", -errno);
 		do_socket_close(-errno);
 		return -errno;
 	}
 
-	client.sock_peer = INVALID_SOCKET;
+	client->sock_peer = INVALID_SOCKET;
 	return 0;
 }
 
@@ -426,7 +465,7 @@ static int do_accept(void)
 	char peer_addr[INET_ADDRSTRLEN];
 	socklen_t len = sizeof(struct sockaddr_in);
 
-	ret = accept(client.sock, (struct sockaddr *)&remote, &len);
+	ret = accept(client->sock, (struct sockaddr *)&remote, &len);
 	if (ret < 0) {
 		LOG_ERR("accept() failed: %d/%d", -errno, ret);
 		do_socket_close(-errno);
@@ -440,10 +479,10 @@ static int do_accept(void)
 	sprintf(rsp_buf, "#XACCEPT: connected with %s\r\n",
 		peer_addr);
 	rsp_send(rsp_buf, strlen(rsp_buf));
-	client.sock_peer = ret;
-	client.connected = true;
+	client->sock_peer = ret;
+	client->connected = true;
 
-	sprintf(rsp_buf, "#XACCEPT: %d\r\n", client.sock_peer);
+	sprintf(rsp_buf, "#XACCEPT: %d\r\n", client->sock_peer);
 	rsp_send(rsp_buf, strlen(rsp_buf));
 
 	return 0;
@@ -453,12 +492,12 @@ static int do_send(const u8_t *data, int datalen)
 {
 	u32_t offset = 0;
 	int ret = 0;
-	int sock = client.sock;
+	int sock = client->sock;
 
 	/* For TCP/TLS Server, send to imcoming socket */
-	if (client.role == AT_SOCKET_ROLE_SERVER) {
-		if (client.sock_peer != INVALID_SOCKET) {
-			sock = client.sock_peer;
+	if (client->role == AT_SOCKET_ROLE_SERVER) {
+		if (client->sock_peer != INVALID_SOCKET) {
+			sock = client->sock_peer;
 		} else {
 			LOG_ERR("No remote connection");
 			return -EINVAL;
@@ -496,12 +535,12 @@ static int do_recv(u16_t length)
 {
 	int ret;
 	char data[NET_IPV4_MTU];
-	int sock = client.sock;
+	int sock = client->sock;
 
 	/* For TCP/TLS Server, receive from imcoming socket */
-	if (client.role == AT_SOCKET_ROLE_SERVER) {
-		if (client.sock_peer != INVALID_SOCKET) {
-			sock = client.sock_peer;
+	if (client->role == AT_SOCKET_ROLE_SERVER) {
+		if (client->sock_peer != INVALID_SOCKET) {
+			sock = client->sock_peer;
 		} else {
 			LOG_ERR("No remote connection");
 			return -EINVAL;
@@ -584,7 +623,7 @@ static int do_sendto(const char *url, u16_t port, const u8_t *data, int datalen)
 	}
 
 	while (offset < datalen) {
-		ret = sendto(client.sock, data + offset,
+		ret = sendto(client->sock, data + offset,
 			datalen - offset, 0,
 			(struct sockaddr *)&remote,
 			sizeof(struct sockaddr_in));
@@ -624,7 +663,7 @@ static int do_recvfrom(const char *url, u16_t port, u16_t length)
 		return ret;
 	}
 
-	ret = recvfrom(client.sock, data, length, 0,
+	ret = recvfrom(client->sock, data, length, 0,
 		(struct sockaddr *)&remote, &sockaddr_len);
 	if (ret < 0) {
 		LOG_ERR("recvfrom() error: %d", -errno);
@@ -667,6 +706,133 @@ static int do_recvfrom(const char *url, u16_t port, u16_t length)
 	return 0;
 }
 
+static void datamode_thread_func(void *p1, void *p2, void *p3)
+{
+	struct pollfd fds = {
+		.fd = datamode_sock,
+		.events = POLLIN
+	};
+	int ret;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	/* Forward raw socket data to UART, without any AT formatting.
+	 * Never block in recv() so that data mode exit can stop the thread.
+	 */
+	while (!atomic_get(&datamode_stop)) {
+		ret = poll(&fds, 1, DATAMODE_POLL_PERIOD);
+		if (ret == 0) {
+			continue;
+		}
+		if (ret > 0) {
+			ret = recv(datamode_sock, datamode_rx_buf,
+				   sizeof(datamode_rx_buf), MSG_DONTWAIT);
+			if (ret > 0) {
+				rsp_send(datamode_rx_buf, ret);
+				continue;
+			}
+			if (ret < 0 && (errno == EAGAIN ||
+					errno == ETIMEDOUT)) {
+				continue;
+			}
+		}
+
+		LOG_INF("Remote closed in data mode: %d", ret < 0 ? -errno : 0);
+		datamode_remote_closed = true;
+		exit_datamode();
+		break;
+	}
+
+	k_sem_give(&datamode_thread_done);
+}
+
+/* Release the data mode socket after the remote closed it. */
+static void datamode_sock_close(void)
+{
+	char buf[32];
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		struct tcpip_client *slot = &clients[i];
+
+		if (slot->sock == datamode_sock) {
+			close(slot->sock);
+			client_reset(slot);
+		} else if (slot->sock_peer == datamode_sock) {
+			/* Server keeps listening, only the peer is gone */
+			close(slot->sock_peer);
+			slot->sock_peer = INVALID_SOCKET;
+			slot->connected = false;
+		} else {
+			continue;
+		}
+
+		sprintf(buf, "#XSOCKET: %d, closed\r\n", 0);
+		rsp_send(buf, strlen(buf));
+		break;
+	}
+}
+
+static int datamode_handler(enum slm_datamode_op op, const u8_t *data,
+			    int len)
+{
+	int offset = 0;
+	int ret;
+
+	if (op == DATAMODE_EXIT) {
+		/* Join the receive thread, it returns within a poll period */
+		atomic_set(&datamode_stop, true);
+		k_sem_take(&datamode_thread_done, K_FOREVER);
+		if (datamode_remote_closed) {
+			datamode_sock_close();
+		}
+		datamode_sock = INVALID_SOCKET;
+		LOG_DBG("Data mode exited");
+		return 0;
+	}
+
+	while (offset < len) {
+		ret = send(datamode_sock, data + offset, len - offset, 0);
+		if (ret < 0) {
+			LOG_ERR("send() failed: %d", -errno);
+			return -errno;
+		}
+		offset += ret;
+	}
+
+	return offset;
+}
+
+static int do_datamode_enter(void)
+{
+	int sock = client_data_sock();
+	int ret;
+
+	if (!client->connected || sock == INVALID_SOCKET) {
+		LOG_ERR("Not connected yet");
+		return -EINVAL;
+	}
+
+	datamode_sock = sock;
+	atomic_set(&datamode_stop, false);
+	datamode_remote_closed = false;
+	k_sem_reset(&datamode_thread_done);
+	ret = enter_datamode(datamode_handler);
+	if (ret) {
+		datamode_sock = INVALID_SOCKET;
+		return ret;
+	}
+
+	k_thread_create(&datamode_thread, datamode_thread_stack,
+			K_THREAD_STACK_SIZEOF(datamode_thread_stack),
+			datamode_thread_func, NULL, NULL, NULL,
+			K_PRIO_COOP(7), 0, K_NO_WAIT);
+
+	LOG_DBG("Data mode entered on socket %d", sock);
+	return 0;
+}
+
 /**@brief handle AT#XSOCKET commands
  *  AT#XSOCKET=<op>[,<type>,<role>,[sec_tag]]
  *  AT#XSOCKET?
@@ -705,14 +871,9 @@ static int handle_at_socket(enum at_cmd_type cmd_type)
 			if (at_params_valid_count_get(&at_param_list) > 4) {
 				at_params_int_get(&at_param_list, 4, &sec_tag);
 			}
-			if (client.sock > 0) {
-				LOG_WRN("Socket is already opened");
-				return -EINVAL;
-			} else {
-				err = do_socket_open(type, role, sec_tag);
-			}
+			err = do_socket_open(type, role, sec_tag);
 		} else if (op == AT_SOCKET_CLOSE) {
-			if (client.sock < 0) {
+			if (client->sock < 0) {
 				LOG_WRN("Socket is not opened yet");
 				return -EINVAL;
 			} else {
@@ -721,9 +882,9 @@ static int handle_at_socket(enum at_cmd_type cmd_type)
 		} break;
 
 	case AT_CMD_TYPE_READ_COMMAND:
-		if (client.sock != INVALID_SOCKET) {
+		if (client->sock != INVALID_SOCKET) {
 			sprintf(rsp_buf, "#XSOCKET: %d, %d, %d\r\n",
-				client.sock, client.ip_proto, client.role);
+				client->sock, client->ip_proto, client->role);
 		} else {
 			sprintf(rsp_buf, "#XSOCKET: 0\r\n");
 		}
@@ -762,11 +923,11 @@ static int handle_at_socketopt(enum at_cmd_type cmd_type)
 
 	switch (cmd_type) {
 	case AT_CMD_TYPE_SET_COMMAND:
-		if (client.sock < 0) {
+		if (client->sock < 0) {
 			LOG_ERR("Socket not opened yet");
 			return err;
 		}
-		if (client.role != AT_SOCKET_ROLE_CLIENT) {
+		if (client->role != AT_SOCKET_ROLE_CLIENT) {
 			LOG_ERR("Invalid role");
 			return err;
 		}
@@ -820,7 +981,7 @@ static int handle_at_bind(enum at_cmd_type cmd_type)
 	int err = -EINVAL;
 	u16_t port;
 
-	if (client.sock < 0) {
+	if (client->sock < 0) {
 		LOG_ERR("Socket not opened yet");
 		return err;
 	}
@@ -856,11 +1017,11 @@ static int handle_at_connect(enum at_cmd_type cmd_type)
 	int size = TCPIP_MAX_URL;
 	u16_t port;
 
-	if (client.sock < 0) {
+	if (client->sock < 0) {
 		LOG_ERR("Socket not opened yet");
 		return err;
 	}
-	if (client.role != AT_SOCKET_ROLE_CLIENT) {
+	if (client->role != AT_SOCKET_ROLE_CLIENT) {
 		LOG_ERR("Invalid role");
 		return err;
 	}
@@ -883,7 +1044,7 @@ static int handle_at_connect(enum at_cmd_type cmd_type)
 		break;
 
 	case AT_CMD_TYPE_READ_COMMAND:
-		if (client.connected) {
+		if (client->connected) {
 			sprintf(rsp_buf, "+XCONNECT: 1\r\n");
 		} else {
 			sprintf(rsp_buf, "+XCONNECT: 0\r\n");
@@ -908,16 +1069,16 @@ static int handle_at_listen(enum at_cmd_type cmd_type)
 {
 	int err = -EINVAL;
 
-	if (client.sock < 0) {
+	if (client->sock < 0) {
 		LOG_ERR("Socket not opened yet");
 		return err;
 	}
-	if (client.role != AT_SOCKET_ROLE_SERVER) {
+	if (client->role != AT_SOCKET_ROLE_SERVER) {
 		LOG_ERR("Invalid role");
 		return err;
 	}
-	if (client.ip_proto != IPPROTO_TCP &&
-		client.ip_proto != IPPROTO_TLS_1_2) {
+	if (client->ip_proto != IPPROTO_TCP &&
+		client->ip_proto != IPPROTO_TLS_1_2) {
 		LOG_ERR("Invalid protocol");
 		return err;
 	}
@@ -943,16 +1104,16 @@ static int handle_at_accept(enum at_cmd_type cmd_type)
 {
 	int err = -EINVAL;
 
-	if (client.sock < 0) {
+	if (client->sock < 0) {
 		LOG_ERR("Socket not opened yet");
 		return err;
 	}
-	if (client.role != AT_SOCKET_ROLE_SERVER) {
+	if (client->role != AT_SOCKET_ROLE_SERVER) {
 		LOG_ERR("Invalid role");
 		return err;
 	}
-	if (client.ip_proto != IPPROTO_TCP &&
-		client.ip_proto != IPPROTO_TLS_1_2) {
+	if (client->ip_proto != IPPROTO_TCP &&
+		client->ip_proto != IPPROTO_TLS_1_2) {
 		LOG_ERR("Invalid protocol");
 		return err;
 	}
@@ -963,9 +1124,9 @@ static int handle_at_accept(enum at_cmd_type cmd_type)
 		break;
 
 	case AT_CMD_TYPE_READ_COMMAND:
-		if (client.sock_peer != INVALID_SOCKET) {
+		if (client->sock_peer != INVALID_SOCKET) {
 			sprintf(rsp_buf, "#XTCPACCEPT: %d\r\n",
-				client.sock_peer);
+				client->sock_peer);
 		} else {
 			sprintf(rsp_buf, "#XTCPACCEPT: 0\r\n");
 		}
@@ -992,7 +1153,7 @@ static int handle_at_send(enum at_cmd_type cmd_type)
 	char data[NET_IPV4_MTU];
 	int size = NET_IPV4_MTU;
 
-	if (!client.connected) {
+	if (!client->connected) {
 		LOG_ERR("Not connected yet");
 		return err;
 	}
@@ -1039,7 +1200,7 @@ static int handle_at_recv(enum at_cmd_type cmd_type)
 	int err = -EINVAL;
 	u16_t length = NET_IPV4_MTU;
 
-	if (!client.connected) {
+	if (!client->connected) {
 		LOG_ERR("Not connected yet");
 		return err;
 	}
@@ -1076,12 +1237,12 @@ static int handle_at_sendto(enum at_cmd_type cmd_type)
 	char data[NET_IPV4_MTU];
 	int size;
 
-	if (client.sock < 0) {
+	if (client->sock < 0) {
 		LOG_ERR("Socket not opened yet");
 		return err;
 	}
-	if (client.ip_proto != IPPROTO_UDP &&
-		client.ip_proto != IPPROTO_DTLS_1_2) {
+	if (client->ip_proto != IPPROTO_UDP &&
+		client->ip_proto != IPPROTO_DTLS_1_2) {
 		LOG_ERR("Invalid protocol");
 		return err;
 	}
@@ -1142,12 +1303,12 @@ static int handle_at_recvfrom(enum at_cmd_type cmd_type)
 	u16_t port;
 	u16_t length = NET_IPV4_MTU;
 
-	if (client.sock < 0) {
+	if (client->sock < 0) {
 		LOG_ERR("Socket not opened yet");
 		return err;
 	}
-	if (client.ip_proto != IPPROTO_UDP &&
-		client.ip_proto != IPPROTO_DTLS_1_2) {
+	if (client->ip_proto != IPPROTO_UDP &&
+		client->ip_proto != IPPROTO_DTLS_1_2) {
 		LOG_ERR("Invalid protocol");
 		return err;
 	}
@@ -1241,49 +1402,101 @@ static int handle_at_getaddrinfo(enum at_cmd_type cmd_type)
 	return err;
 }
 
-/**@brief API to handle TCP/IP AT commands
+/**@brief handle AT#XSOCKETSELECT commands
+ *  AT#XSOCKETSELECT=<handle>
+ *  AT#XSOCKETSELECT?
+ *  AT#XSOCKETSELECT=? TEST command not supported
  */
-int slm_at_tcpip_parse(const char *at_cmd)
+static int handle_at_socketselect(enum at_cmd_type cmd_type)
 {
-	int ret = -ENOTSUP;
-	enum at_cmd_type type;
-
-	for (int i = 0; i < AT_TCPIP_MAX; i++) {
-		if (slm_util_cmd_casecmp(at_cmd, m_tcpip_at_list[i].string)) {
-			ret = at_parser_params_from_str(at_cmd, NULL,
-						&at_param_list);
-			if (ret) {
-				LOG_ERR("Failed to parse AT command %d", ret);
-				return -EINVAL;
+	int err = -EINVAL;
+	int handle;
+	struct tcpip_client *slot;
+
+	switch (cmd_type) {
+	case AT_CMD_TYPE_SET_COMMAND:
+		if (at_params_valid_count_get(&at_param_list) < 2) {
+			return -EINVAL;
+		}
+		err = at_params_int_get(&at_param_list, 1, &handle);
+		if (err) {
+			return err;
+		}
+		slot = (handle == INVALID_SOCKET) ? NULL : client_find(handle);
+		if (slot == NULL) {
+			LOG_ERR("Invalid handle: %d", handle);
+			return -EINVAL;
+		}
+		client = slot;
+		sprintf(rsp_buf, "#XSOCKETSELECT: %d\r\n", client->sock);
+		rsp_send(rsp_buf, strlen(rsp_buf));
+		break;
+
+	case AT_CMD_TYPE_READ_COMMAND:
+		for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+			if (clients[i].sock == INVALID_SOCKET) {
+				continue;
 			}
-			type = at_parser_cmd_type_get(at_cmd);
-			ret = m_tcpip_at_list[i].handler(type);
-			break;
+			sprintf(rsp_buf, "#XSOCKETSELECT: %d, %d, %d\r\n",
+				clients[i].sock, clients[i].ip_proto,
+				clients[i].role);
+			rsp_send(rsp_buf, strlen(rsp_buf));
 		}
+		sprintf(rsp_buf, "#XSOCKETSELECT: %d\r\n", client->sock);
+		rsp_send(rsp_buf, strlen(rsp_buf));
+		err = 0;
+		break;
+
+	default:
+		break;
 	}
 
-	return ret;
+	return err;
 }
 
-/**@brief API to list TCP/IP AT commands
+/**@brief handle AT#XDATAMODE commands
+ *  AT#XDATAMODE=1
+ *  AT#XDATAMODE? READ command not supported
+ *  AT#XDATAMODE=? TEST command not supported
+ *
+ *  Data mode is exited by sending the escape sequence, surrounded by
+ *  idle periods on the UART, or when the remote closes the connection.
  */
-void slm_at_tcpip_clac(void)
+static int handle_at_datamode(enum at_cmd_type cmd_type)
 {
-	for (int i = 0; i < AT_TCPIP_MAX; i++) {
-		sprintf(rsp_buf, "%s\r\n", m_tcpip_at_list[i].string);
-		rsp_send(rsp_buf, strlen(rsp_buf));
+	int err = -EINVAL;
+	u16_t op;
+
+	switch (cmd_type) {
+	case AT_CMD_TYPE_SET_COMMAND:
+		if (at_params_valid_count_get(&at_param_list) < 2) {
+			return -EINVAL;
+		}
+		err = at_params_short_get(&at_param_list, 1, &op);
+		if (err) {
+			return err;
+		}
+		if (op != 1) {
+			return -EINVAL;
+		}
+		err = do_datamode_enter();
+		break;
+
+	default:
+		break;
 	}
+
+	return err;
 }
 
 /**@brief API to initialize TCP/IP AT commands handler
  */
 int slm_at_tcpip_init(void)
 {
-	client.sock = INVALID_SOCKET;
-	client.role = AT_SOCKET_ROLE_CLIENT;
-	client.sock_peer = INVALID_SOCKET;
-	client.connected = false;
-	client.ip_proto = IPPROTO_IP;
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		client_reset(&clients[i]);
+	}
+	client = &clients[0];
 	return 0;
 }
 
@@ -1291,5 +1504,17 @@ int slm_at_tcpip_init(void)
  */
 int slm_at_tcpip_uninit(void)
 {
-	return do_socket_close(0);
+	int ret = 0;
+	int err;
+
+	for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+		client = &clients[i];
+		err = do_socket_close(0);
+		if (err) {
+			ret = err;
+		}
+	}
+	client = &clients[0];
+
+	return ret;
 }
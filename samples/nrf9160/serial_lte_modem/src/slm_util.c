@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include "slm_util.h"
+#include "slm_at_host.h"
 
 #define PRINTABLE_ASCII(ch) (ch > 0x1f && ch < 0x7f)
 
@@ -62,6 +63,54 @@ bool slm_util_cmd_casecmp(const char *cmd, const char *slm_cmd)
 	return true;
 }
 
+/**
+ * @brief Find the SLM AT command matching a received command line
+ */
+const struct slm_at_cmd *slm_util_at_cmd_find(const struct slm_at_cmd *list,
+					      size_t count, const char *at_cmd)
+{
+	char name[SLM_AT_CMD_NAME_MAX_LEN + 1];
+	size_t lo = 0;
+	size_t hi = count;
+	size_t len;
+
+	/* Quickly reject commands forwarded to the modem */
+	if ((toupper((int)at_cmd[0]) != 'A') ||
+	    (toupper((int)at_cmd[1]) != 'T') ||
+	    (at_cmd[2] != '#')) {
+		return NULL;
+	}
+
+	for (len = 0; len < sizeof(name); len++) {
+		char ch = at_cmd[len];
+
+		if ((ch == '\0') || (ch == '=') || (ch == '?') ||
+		    (ch == '\r') || (ch == '\n')) {
+			break;
+		}
+		name[len] = toupper((int)ch);
+	}
+	if (len == sizeof(name)) {
+		return NULL;
+	}
+	name[len] = '\0';
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(name, list[mid].string);
+
+		if (cmp == 0) {
+			return &list[mid];
+		} else if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return NULL;
+}
+
 /**
  * @brief Detect hexdecimal data type
  */
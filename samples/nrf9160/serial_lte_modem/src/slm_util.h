@@ -14,6 +14,7 @@
  */
 
 #include <zephyr/types.h>
+#include <stddef.h>
 #include <ctype.h>
 #include <stdbool.h>
 
@@ -44,6 +45,24 @@ bool slm_util_casecmp(const char *str1, const char *str2);
  */
 bool slm_util_cmd_casecmp(const char *cmd, const char *slm_cmd);
 
+struct slm_at_cmd;
+
+/**
+ * @brief Find the SLM AT command matching a received command line
+ *
+ * The command name ends at the first '=', '?' or line termination character.
+ * It is compared ignoring case against the sorted command table, so the
+ * lookup takes a binary search instead of a scan of every command.
+ *
+ * @param list Command table, sorted by command name
+ * @param count Number of commands in the table
+ * @param at_cmd Command line received from UART
+ *
+ * @return Matching command, or NULL if the command is not an SLM command.
+ */
+const struct slm_at_cmd *slm_util_at_cmd_find(const struct slm_at_cmd *list,
+					      size_t count, const char *at_cmd);
+
 /**
  * @brief Detect hexdecimal data type
  *
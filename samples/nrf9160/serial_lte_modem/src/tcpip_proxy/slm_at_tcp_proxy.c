@@ -34,25 +34,15 @@ enum slm_tcp_proxy_role {
 	AT_TCP_ROLE_SERVER
 };
 
-/**@brief List of supported AT commands. */
-enum slm_tcp_proxy_at_cmd_type {
-	AT_TCP_SERVER,
-	AT_TCP_CLIENT,
-	AT_TCP_SEND,
-	AT_TCP_PROXY_MAX
-};
-
 /** forward declaration of cmd handlers **/
 static int handle_at_tcp_server(enum at_cmd_type cmd_type);
 static int handle_at_tcp_client(enum at_cmd_type cmd_type);
 static int handle_at_tcp_send(enum at_cmd_type cmd_type);
 
-/**@brief SLM AT Command list type. */
-static slm_at_cmd_list_t m_tcp_proxy_at_list[AT_TCP_PROXY_MAX] = {
-	{AT_TCP_SERVER, "AT#XTCPSVR", handle_at_tcp_server},
-	{AT_TCP_CLIENT, "AT#XTCPCLI", handle_at_tcp_client},
-	{AT_TCP_SEND, "AT#XTCPSEND", handle_at_tcp_send},
-};
+/**@brief AT commands registered with the AT host. */
+SLM_AT_CMD_DEFINE(XTCPSVR, handle_at_tcp_server);
+SLM_AT_CMD_DEFINE(XTCPCLI, handle_at_tcp_client);
+SLM_AT_CMD_DEFINE(XTCPSEND, handle_at_tcp_send);
 
 static u8_t data_hex[DATA_HEX_MAX_SIZE];
 static struct k_thread tcp_thread;
@@ -606,41 +596,6 @@ static int handle_at_tcp_send(enum at_cmd_type cmd_type)
 	return err;
 }
 
-/**@brief API to handle TCP proxy AT commands
- */
-int slm_at_tcp_proxy_parse(const char *at_cmd)
-{
-	int ret = -ENOTSUP;
-	enum at_cmd_type type;
-
-	for (int i = 0; i < AT_TCP_PROXY_MAX; i++) {
-		if (slm_util_cmd_casecmp(at_cmd,
-			m_tcp_proxy_at_list[i].string)) {
-			ret = at_parser_params_from_str(at_cmd, NULL,
-						&at_param_list);
-			if (ret) {
-				LOG_ERR("Failed to parse AT command %d", ret);
-				return -EINVAL;
-			}
-			type = at_parser_cmd_type_get(at_cmd);
-			ret = m_tcp_proxy_at_list[i].handler(type);
-			break;
-		}
-	}
-
-	return ret;
-}
-
-/**@brief API to list TCP proxy AT commands
- */
-void slm_at_tcp_proxy_clac(void)
-{
-	for (int i = 0; i < AT_TCP_PROXY_MAX; i++) {
-		sprintf(rsp_buf, "%s\r\n", m_tcp_proxy_at_list[i].string);
-		rsp_send(rsp_buf, strlen(rsp_buf));
-	}
-}
-
 /**@brief API to initialize TCP proxy AT commands handler
  */
 int slm_at_tcp_proxy_init(void)
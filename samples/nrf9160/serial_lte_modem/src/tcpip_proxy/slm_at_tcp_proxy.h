@@ -16,22 +16,6 @@
 #include <zephyr/types.h>
 #include <modem/at_cmd.h>
 
-/**
- * @brief TCP proxy AT command parser.
- *
- * @param at_cmd AT command string.
- *
- * @retval 0 If the operation was successful.
- *           Otherwise, a (negative) error code is returned.
- */
-int slm_at_tcp_proxy_parse(const char *at_cmd);
-
-/**
- * @brief List TCP proxy AT commands.
- *
- */
-void slm_at_tcp_proxy_clac(void);
-
 /**
  * @brief Initialize TCP proxy AT command parser.
  *
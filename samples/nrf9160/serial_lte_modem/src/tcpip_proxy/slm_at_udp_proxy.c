@@ -42,25 +42,15 @@ enum slm_udp_proxy_role {
 	AT_UDP_ROLE_SERVER
 };
 
-/**@brief List of supported AT commands. */
-enum slm_udp_proxy_at_cmd_type {
-	AT_UDP_SERVER,
-	AT_UDP_CLIENT,
-	AT_UDP_SEND,
-	AT_UDP_PROXY_MAX
-};
-
 /** forward declaration of cmd handlers **/
 static int handle_at_udp_server(enum at_cmd_type cmd_type);
 static int handle_at_udp_client(enum at_cmd_type cmd_type);
 static int handle_at_udp_send(enum at_cmd_type cmd_type);
 
-/**@brief SLM AT Command list type. */
-static slm_at_cmd_list_t m_udp_proxy_at_list[AT_UDP_PROXY_MAX] = {
-	{AT_UDP_SERVER, "AT#XUDPSVR", handle_at_udp_server},
-	{AT_UDP_CLIENT, "AT#XUDPCLI", handle_at_udp_client},
-	{AT_UDP_SEND, "AT#XUDPSEND", handle_at_udp_send},
-};
+/**@brief AT commands registered with the AT host. */
+SLM_AT_CMD_DEFINE(XUDPSVR, handle_at_udp_server);
+SLM_AT_CMD_DEFINE(XUDPCLI, handle_at_udp_client);
+SLM_AT_CMD_DEFINE(XUDPSEND, handle_at_udp_send);
 
 static u8_t data_hex[DATA_HEX_MAX_SIZE];
 static struct k_thread udp_thread;
@@ -537,41 +527,6 @@ static int handle_at_udp_send(enum at_cmd_type cmd_type)
 	return err;
 }
 
-/**@brief API to handle UDP Proxy AT commands
- */
-int slm_at_udp_proxy_parse(const char *at_cmd)
-{
-	int ret = -ENOTSUP;
-	enum at_cmd_type type;
-
-	for (int i = 0; i < AT_UDP_PROXY_MAX; i++) {
-		if (slm_util_cmd_casecmp(at_cmd,
-					m_udp_proxy_at_list[i].string)) {
-			ret = at_parser_params_from_str(at_cmd, NULL,
-						&at_param_list);
-			if (ret) {
-				LOG_ERR("Failed to parse AT command %d", ret);
-				return -EINVAL;
-			}
-			type = at_parser_cmd_type_get(at_cmd);
-			ret = m_udp_proxy_at_list[i].handler(type);
-			break;
-		}
-	}
-
-	return ret;
-}
-
-/**@brief API to list UDP Proxy AT commands
- */
-void slm_at_udp_proxy_clac(void)
-{
-	for (int i = 0; i < AT_UDP_PROXY_MAX; i++) {
-		sprintf(rsp_buf, "%s\r\n", m_udp_proxy_at_list[i].string);
-		rsp_send(rsp_buf, strlen(rsp_buf));
-	}
-}
-
 /**@brief API to initialize UDP Proxy AT commands handler
  */
 int slm_at_udp_proxy_init(void)
@@ -16,22 +16,6 @@
 #include <zephyr/types.h>
 #include <modem/at_cmd.h>
 
-/**
- * @brief UDP proxy AT command parser.
- *
- * @param at_cmd AT command string.
- *
- * @retval 0 If the operation was successful.
- *           Otherwise, a (negative) error code is returned.
- */
-int slm_at_udp_proxy_parse(const char *at_cmd);
-
-/**
- * @brief List UDP/IP AT commands.
- *
- */
-void slm_at_udp_proxy_clac(void);
-
 /**
  * @brief Initialize UDP proxy AT command parser.
  *
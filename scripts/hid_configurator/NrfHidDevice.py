@@ -11,7 +11,8 @@ from enum import IntEnum
 
 REPORT_ID = 6
 REPORT_SIZE = 30
-EVENT_DATA_LEN_MAX = REPORT_SIZE - 6
+REPORT_HEADER_SIZE = 6
+EVENT_DATA_LEN_MAX = REPORT_SIZE - REPORT_HEADER_SIZE
 
 MOD_FIELD_POS = 4
 MOD_BROADCAST = 0xf
@@ -24,8 +25,11 @@ OPT_BROADCAST_MAX_MOD_ID = 0x0
 OPT_MODULE_DEV_DESCR = 0x0
 
 POLL_INTERVAL_DEFAULT = 0.02
+POLL_INTERVAL_WINDOW = 0.002
 POLL_RETRY_COUNT = 200
 
+WINDOW_SEQ_MASK = 0xff
+
 END_OF_TRANSFER_CHAR = '\n'
 
 
@@ -37,6 +41,7 @@ class ConfigStatus(IntEnum):
     REJECT             = 4
     WRITE_ERROR        = 5
     DISCONNECTED_ERROR = 6
+    WINDOW_SET         = 7
     FAULT              = 99
 
 class Response(object):
@@ -96,6 +101,9 @@ class NrfHidDevice():
         self.pid = pid
         self.dev_ptr = None
         self.dev_config = None
+        self.report_size = REPORT_SIZE
+        self.window_size = 0
+        self.window_seq = 0
 
         direct_devs = NrfHidDevice._open_devices(vid, pid)
         dongle_devs = []
@@ -117,7 +125,15 @@ class NrfHidDevice():
                 if config is not None:
                     self.dev_config = config
                     self.dev_ptr = d
+                    self.report_size = NrfHidDevice._discover_report_size(d, pid,
+                                                                          config)
                     print("Device board name is {}".format(board_name))
+
+                    # Requests forwarded by a dongle cannot be windowed.
+                    if d in direct_devs:
+                        self.window_size = NrfHidDevice._discover_window_size(d, pid,
+                                                                              self.report_size,
+                                                                              config)
                 else:
                     d.close()
             else:
@@ -140,7 +156,7 @@ class NrfHidDevice():
         return devs
 
     @staticmethod
-    def _create_set_report(recipient, event_id, event_data):
+    def _create_set_report(recipient, event_id, event_data, report_size=REPORT_SIZE):
         """ Function creating a report in order to set a specified configuration
             value. """
 
@@ -158,13 +174,13 @@ class NrfHidDevice():
         if event_data:
             report += event_data
 
-        assert len(report) <= REPORT_SIZE
-        report += b'\0' * (REPORT_SIZE - len(report))
+        assert len(report) <= report_size
+        report += b'\0' * (report_size - len(report))
 
         return report
 
     @staticmethod
-    def _create_fetch_report(recipient, event_id):
+    def _create_fetch_report(recipient, event_id, report_size=REPORT_SIZE):
         """ Function for creating a report which requests fetching of
             a configuration value from a device. """
 
@@ -174,18 +190,49 @@ class NrfHidDevice():
         status = ConfigStatus.FETCH
         report = struct.pack('<BHBBB', REPORT_ID, recipient, event_id, status, 0)
 
-        assert len(report) <= REPORT_SIZE
-        report += b'\0' * (REPORT_SIZE - len(report))
+        assert len(report) <= report_size
+        report += b'\0' * (report_size - len(report))
+
+        return report
+
+    @staticmethod
+    def _create_window_report(recipient, event_id, seq, event_data, report_size):
+        """ Function creating a frame of the windowed transfer. The sequence
+            number of the frame precedes the configuration value. """
+
+        assert isinstance(recipient, int)
+        assert isinstance(event_id, int)
+        assert isinstance(event_data, bytes)
+
+        status = ConfigStatus.WINDOW_SET
+        report = struct.pack('<BHBBBB', REPORT_ID, recipient, event_id, status,
+                             len(event_data) + 1, seq)
+        report += event_data
+
+        assert len(report) <= report_size
+        report += b'\0' * (report_size - len(report))
 
         return report
 
+    @staticmethod
+    def _get_response(dev, report_size):
+        try:
+            response_raw = dev.get_feature_report(REPORT_ID, report_size)
+            response = Response.parse_response(response_raw)
+        except Exception:
+            response = None
+
+        return response
+
     @staticmethod
     def _exchange_feature_report(dev, recipient, event_id, event_data, is_fetch,
-                                 poll_interval=POLL_INTERVAL_DEFAULT):
+                                 poll_interval=POLL_INTERVAL_DEFAULT,
+                                 report_size=REPORT_SIZE):
         if is_fetch:
-            data = NrfHidDevice._create_fetch_report(recipient, event_id)
+            data = NrfHidDevice._create_fetch_report(recipient, event_id, report_size)
         else:
-            data = NrfHidDevice._create_set_report(recipient, event_id, event_data)
+            data = NrfHidDevice._create_set_report(recipient, event_id, event_data,
+                                                   report_size)
 
         try:
             dev.send_feature_report(data)
@@ -195,11 +242,7 @@ class NrfHidDevice():
         for _ in range(POLL_RETRY_COUNT):
             time.sleep(poll_interval)
 
-            try:
-                response_raw = dev.get_feature_report(REPORT_ID, REPORT_SIZE)
-                response = Response.parse_response(response_raw)
-            except Exception:
-                response = None
+            response = NrfHidDevice._get_response(dev, report_size)
 
             if response is None:
                 logging.error('Invalid response')
@@ -237,20 +280,85 @@ class NrfHidDevice():
         return success, fetched_data
 
     @staticmethod
-    def _fetch_max_mod_id(dev, recipient):
+    def _exchange_window(dev, recipient, event_id, chunks, seq, window_size,
+                         report_size, poll_interval=POLL_INTERVAL_WINDOW):
+        """ Function setting a configuration value with every chunk in the
+            windowed mode. Up to window_size frames are sent without waiting
+            for the device. The device acknowledges the sequence number of the
+            most recent processed frame. Frames that are not acknowledged once
+            the device is idle are sent again. """
+
+        base = 0
+        next_idx = 0
+        retries = 0
+
+        while base < len(chunks):
+            while (next_idx < len(chunks)) and (next_idx - base < window_size):
+                data = NrfHidDevice._create_window_report(recipient, event_id,
+                                                          (seq + next_idx) & WINDOW_SEQ_MASK,
+                                                          chunks[next_idx],
+                                                          report_size)
+                try:
+                    dev.send_feature_report(data)
+                except Exception:
+                    return False, seq + base
+
+                next_idx += 1
+
+            response = NrfHidDevice._get_response(dev, report_size)
+
+            if (response is None) or (response.data is None):
+                logging.error('Invalid response')
+                return False, seq + base
+
+            logging.debug('Parsed response: {}'.format(response))
+
+            if response.status not in (ConfigStatus.SUCCESS, ConfigStatus.PENDING):
+                logging.warning('Error: {}'.format(response.status.name))
+                return False, seq + base
+
+            acked = (response.data[0] - (seq + base - 1)) & WINDOW_SEQ_MASK
+            if acked > next_idx - base:
+                logging.error('Acknowledged frame was not sent')
+                return False, seq + base
+
+            base += acked
+
+            if acked > 0:
+                retries = 0
+            elif retries < POLL_RETRY_COUNT:
+                retries += 1
+            else:
+                logging.warning('Error: {}'.format(ConfigStatus.TIMEOUT.name))
+                return False, seq + base
+
+            if response.status == ConfigStatus.SUCCESS:
+                # Device is idle, frames that were not acknowledged are lost.
+                next_idx = base
+            elif acked == 0:
+                time.sleep(poll_interval)
+
+        logging.info('Success')
+
+        return True, seq + base
+
+    @staticmethod
+    def _fetch_max_mod_id(dev, recipient, report_size=REPORT_SIZE):
         event_id = (MOD_BROADCAST << MOD_FIELD_POS) | \
                    (OPT_BROADCAST_MAX_MOD_ID << OPT_FIELD_POS)
         event_data = struct.pack('<B', 0)
 
         success = NrfHidDevice._exchange_feature_report(dev, recipient,
                                                         event_id, event_data,
-                                                        False)
+                                                        False,
+                                                        report_size=report_size)
         if not success:
             return False, None
 
         success, fetched_data = NrfHidDevice._exchange_feature_report(dev, recipient,
                                                                       event_id, None,
-                                                                      True)
+                                                                      True,
+                                                                      report_size=report_size)
         if not success or not fetched_data:
             return False, None
 
@@ -259,12 +367,13 @@ class NrfHidDevice():
         return success, max_mod_id
 
     @staticmethod
-    def _fetch_next_option(dev, recipient, module_id):
+    def _fetch_next_option(dev, recipient, module_id, report_size=REPORT_SIZE):
         event_id = (module_id << MOD_FIELD_POS) | (OPT_MODULE_DEV_DESCR << OPT_FIELD_POS)
 
         success, fetched_data = NrfHidDevice._exchange_feature_report(dev, recipient,
                                                                       event_id, None,
-                                                                      True)
+                                                                      True,
+                                                                      report_size=report_size)
         if not success or not fetched_data:
             return False, None
 
@@ -280,11 +389,12 @@ class NrfHidDevice():
         return (module_id << MOD_FIELD_POS) | (option_id << OPT_FIELD_POS)
 
     @staticmethod
-    def _discover_module_config(dev, recipient, module_id):
+    def _discover_module_config(dev, recipient, module_id, report_size=REPORT_SIZE):
         module_config = {}
 
         success, module_name = NrfHidDevice._fetch_next_option(dev, recipient,
-                                                               module_id)
+                                                               module_id,
+                                                               report_size)
         if not success:
             return None, None
 
@@ -295,7 +405,8 @@ class NrfHidDevice():
 
         while True:
             success, opt = NrfHidDevice._fetch_next_option(dev, recipient,
-                                                           module_id)
+                                                           module_id,
+                                                           report_size)
             if not success:
                 return None, None
 
@@ -315,15 +426,17 @@ class NrfHidDevice():
         return module_name, module_config
 
     @staticmethod
-    def _discover_device_config(dev, recipient):
+    def _discover_device_config(dev, recipient, report_size=REPORT_SIZE):
         device_config = {}
 
-        success, max_mod_id = NrfHidDevice._fetch_max_mod_id(dev, recipient)
+        success, max_mod_id = NrfHidDevice._fetch_max_mod_id(dev, recipient,
+                                                             report_size)
         if not success or (max_mod_id is None):
             return None
 
         for i in range(0, max_mod_id + 1):
-            module_name, module_config = NrfHidDevice._discover_module_config(dev, recipient, i)
+            module_name, module_config = NrfHidDevice._discover_module_config(dev, recipient, i,
+                                                                              report_size)
             if (module_name is None) or (module_config is None):
                 return None
 
@@ -332,8 +445,9 @@ class NrfHidDevice():
         return device_config
 
     @staticmethod
-    def _discover_board_name(dev, recipient):
-        success, max_mod_id = NrfHidDevice._fetch_max_mod_id(dev, recipient)
+    def _discover_board_name(dev, recipient, report_size=REPORT_SIZE):
+        success, max_mod_id = NrfHidDevice._fetch_max_mod_id(dev, recipient,
+                                                             report_size)
         if not success:
             return None
 
@@ -341,7 +455,8 @@ class NrfHidDevice():
         # Discover only this module to recude discovery time.
         module_name, module_config = NrfHidDevice._discover_module_config(dev,
                                                                           recipient,
-                                                                          max_mod_id)
+                                                                          max_mod_id,
+                                                                          report_size)
         if (module_name is None) or (module_config is None):
             return None
 
@@ -350,12 +465,47 @@ class NrfHidDevice():
 
         success, fetched_data = NrfHidDevice._exchange_feature_report(dev, recipient,
                                                                       event_id, None,
-                                                                      True)
+                                                                      True,
+                                                                      report_size=report_size)
 
         board_name = fetched_data.decode('utf-8').replace(chr(0x00), '')
 
         return board_name
 
+    @staticmethod
+    def _discover_report_size(dev, recipient, device_config):
+        # Older firmware uses the default report size.
+        try:
+            event_id = NrfHidDevice._get_event_id('info', 'report_size', device_config)
+        except KeyError:
+            return REPORT_SIZE
+
+        success, fetched_data = NrfHidDevice._exchange_feature_report(dev, recipient,
+                                                                      event_id, None,
+                                                                      True)
+        if not success or not fetched_data:
+            return REPORT_SIZE
+
+        # Add the report ID that is not included in the option value.
+        return max(fetched_data[0] + 1, REPORT_SIZE)
+
+    @staticmethod
+    def _discover_window_size(dev, recipient, report_size, device_config):
+        # Older firmware does not support the windowed transfer.
+        try:
+            event_id = NrfHidDevice._get_event_id('info', 'window_size', device_config)
+        except KeyError:
+            return 0
+
+        success, fetched_data = NrfHidDevice._exchange_feature_report(dev, recipient,
+                                                                      event_id, None,
+                                                                      True,
+                                                                      report_size=report_size)
+        if not success or not fetched_data:
+            return 0
+
+        return fetched_data[0]
+
     def _config_operation(self, module_name, option_name, is_get, value, poll_interval):
         if not self.initialized():
             print("Device not found")
@@ -376,7 +526,8 @@ class NrfHidDevice():
 
         success, fetched_data = NrfHidDevice._exchange_feature_report(self.dev_ptr, self.pid,
                                                                       event_id, value,
-                                                                      is_get, poll_interval)
+                                                                      is_get, poll_interval,
+                                                                      self.report_size)
         if is_get:
             return success, fetched_data
         else:
@@ -386,6 +537,8 @@ class NrfHidDevice():
         self.dev_ptr.close()
         self.dev_ptr = None
         self.dev_config = None
+        self.report_size = REPORT_SIZE
+        self.window_size = 0
 
     def initialized(self):
         if (self.dev_ptr is None) or (self.dev_config is None):
@@ -410,3 +563,32 @@ class NrfHidDevice():
 
     def config_set(self, module_name, option_name, value, poll_interval=POLL_INTERVAL_DEFAULT):
         return self._config_operation(module_name, option_name, False, value, poll_interval)
+
+    def get_event_data_len_max(self):
+        return self.report_size - REPORT_HEADER_SIZE
+
+    def get_window_size(self):
+        """ Returns number of frames in flight in the windowed transfer.
+            Zero if the windowed transfer is not supported. """
+        return self.window_size
+
+    def config_set_window(self, module_name, option_name, chunks):
+        """ Sets the option to every of the chunks in order, using the
+            windowed transfer. A chunk is one byte shorter than
+            get_event_data_len_max(), to fit the sequence number. """
+        if not self.initialized() or (self.window_size == 0):
+            print("Windowed transfer is not supported")
+            return False
+
+        try:
+            event_id = NrfHidDevice._get_event_id(module_name, option_name, self.dev_config)
+        except KeyError:
+            print("No module: {} or option: {}".format(module_name, option_name))
+            return False
+
+        success, self.window_seq = NrfHidDevice._exchange_window(self.dev_ptr, self.pid,
+                                                                 event_id, chunks,
+                                                                 self.window_seq,
+                                                                 self.window_size,
+                                                                 self.report_size)
+        return success
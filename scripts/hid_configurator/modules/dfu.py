@@ -12,6 +12,7 @@ import logging
 from NrfHidDevice import EVENT_DATA_LEN_MAX
 
 FLASH_PAGE_SIZE = 4096
+FLASH_WRITE_ALIGN = 4
 
 DFU_SYNC_RETRIES = 3
 DFU_SYNC_INTERVAL = 1
@@ -93,6 +94,21 @@ def dfu_sync(dev):
     return struct.unpack(fmt, fetched_data)
 
 
+def dfu_flash_stats(dev):
+    if 'flash_stats' not in dev.get_device_config()['dfu']:
+        return None
+
+    success, fetched_data = dev.config_get('dfu', 'flash_stats')
+
+    fmt = '<II'
+    assert struct.calcsize(fmt) <= EVENT_DATA_LEN_MAX
+
+    if (not success) or (fetched_data is None) or (len(fetched_data) < struct.calcsize(fmt)):
+        return None
+
+    return struct.unpack(fmt, fetched_data)
+
+
 def dfu_start(dev, img_length, img_csum, offset):
     # Start DFU operation at selected offset.
     # It can happen that device will reject this request - this will be
@@ -177,7 +193,12 @@ def dfu_transfer(dev, dfu_image, progress_callback):
     img_file.seek(offset)
 
     try:
-        offset, success = send_chunk(dev, img_csum, img_file, img_length, offset, success, progress_callback)
+        if dev.get_window_size() > 0:
+            offset, success = send_chunks_window(dev, img_csum, img_file, img_length, offset,
+                                                 progress_callback)
+        else:
+            offset, success = send_chunk(dev, img_csum, img_file, img_length, offset, success,
+                                         progress_callback)
     except Exception:
         success = False
 
@@ -200,25 +221,38 @@ def dfu_transfer(dev, dfu_image, progress_callback):
             else:
                 success = True
 
+        flash_stats = dfu_flash_stats(dev)
+
+        if success and flash_stats is not None:
+            print('Flash writes: {}, worst stall: {} us'.format(*flash_stats))
+
     return success
 
 
+def dfu_sync_check(dev, img_csum, img_length, offset):
+    dfu_info = dfu_sync(dev)
+
+    if dfu_info is None:
+        print('Lost communication with the device')
+        return False
+    if dfu_info[0] == 0:
+        print('DFU interrupted by device')
+        return False
+    if (dfu_info[1] != img_length) or (dfu_info[2] != img_csum) or (dfu_info[3] != offset):
+        print('Invalid sync information')
+        return False
+
+    return True
+
+
 def send_chunk(dev, img_csum, img_file, img_length, offset, success, progress_callback):
     while offset < img_length:
         if offset % FLASH_PAGE_SIZE == 0:
             # Sync DFU state at regular intervals to ensure everything
             # is all right.
-            success = False
-            dfu_info = dfu_sync(dev)
+            success = dfu_sync_check(dev, img_csum, img_length, offset)
 
-            if dfu_info is None:
-                print('Lost communication with the device')
-                break
-            if dfu_info[0] == 0:
-                print('DFU interrupted by device')
-                break
-            if (dfu_info[1] != img_length) or (dfu_info[2] != img_csum) or (dfu_info[3] != offset):
-                print('Invalid sync information')
+            if not success:
                 break
 
         chunk_data = img_file.read(EVENT_DATA_LEN_MAX)
@@ -242,6 +276,52 @@ def send_chunk(dev, img_csum, img_file, img_length, offset, success, progress_ca
     return offset, success
 
 
+def send_chunks_window(dev, img_csum, img_file, img_length, offset, progress_callback):
+    # Chunks of a flash page are sent using the windowed transfer. The DFU state
+    # is synced before every page. Sequence number of the frame takes one byte
+    # of the event data and the chunks are kept aligned for flash writes.
+    chunk_len_max = dev.get_event_data_len_max() - 1
+    chunk_len_max -= chunk_len_max % FLASH_WRITE_ALIGN
+    success = False
+
+    while offset < img_length:
+        success = dfu_sync_check(dev, img_csum, img_length, offset)
+
+        if not success:
+            break
+
+        page_end = min((offset // FLASH_PAGE_SIZE + 1) * FLASH_PAGE_SIZE, img_length)
+        chunks = []
+        chunk_offset = offset
+
+        while chunk_offset < page_end:
+            chunk_data = img_file.read(min(chunk_len_max, page_end - chunk_offset))
+
+            if len(chunk_data) == 0:
+                break
+
+            chunks.append(chunk_data)
+            chunk_offset += len(chunk_data)
+
+        if len(chunks) == 0:
+            break
+
+        logging.debug('Send DFU requests: offset {}, size {}'.format(offset,
+                                                                    chunk_offset - offset))
+
+        progress_callback(int(offset / img_length * 1000))
+
+        success = dev.config_set_window('dfu', 'data', chunks)
+
+        if not success:
+            print('Lost communication with the device')
+            break
+
+        offset = chunk_offset
+
+    return offset, success
+
+
 def get_dfu_operation_offset(dfu_image, dfu_info, img_csum):
     # Check if the previously interrupted DFU operation can be resumed.
     img_length = os.stat(dfu_image).st_size
@@ -9,100 +9,149 @@
 
 LOG_MODULE_REGISTER(bt_conn_ctx, CONFIG_BT_CONN_CTX_LOG_LEVEL);
 
-static void bt_conn_ctx_mem_free(struct k_mem_slab *mem_slab, void **data)
+/* Layout of the context state: the context data can be accessed while
+ * CTX_VALID is set. The lower bits count the references, one held by the
+ * allocation and one by every user between a get and a release. The context
+ * is set valid when the allocating user releases it, after it initialized
+ * the data. The last reference frees the data, with CTX_FREEING set until
+ * the context can be allocated again.
+ */
+#define CTX_ALLOCATING	BIT(30)
+#define CTX_VALID	BIT(29)
+#define CTX_FREEING	BIT(28)
+#define CTX_REF_MASK	(BIT(28) - 1)
+
+static struct bt_conn_ctx *ctx_by_conn(struct bt_conn_ctx_lib *ctx_lib,
+				       struct bt_conn *conn)
 {
-	k_mem_slab_free(mem_slab, data);
-	*data = NULL;
+	u8_t index = bt_conn_index(conn);
+
+	__ASSERT_NO_MSG(index < bt_conn_ctx_count(ctx_lib));
+
+	return &ctx_lib->ctx[index];
 }
 
-void *bt_conn_ctx_alloc(struct bt_conn_ctx_lib *ctx_lib, struct bt_conn *conn)
+static bool ctx_ref_get(struct bt_conn_ctx *ctx)
 {
-	__ASSERT_NO_MSG(conn != NULL);
-	__ASSERT_NO_MSG(ctx_lib != NULL);
+	atomic_val_t state;
 
-	int err = -ENOMEM;
-	struct bt_conn_ctx *ctx;
+	do {
+		state = atomic_get(&ctx->state);
+		if (!(state & CTX_VALID)) {
+			return false;
+		}
+	} while (!atomic_cas(&ctx->state, state, state + 1));
 
-	k_mutex_lock(ctx_lib->mutex, K_FOREVER);
+	return true;
+}
 
-	for (size_t i = 0; i < CONFIG_BT_MAX_CONN; i++) {
-		ctx = &ctx_lib->ctx[i];
+static void ctx_ref_put(struct bt_conn_ctx_lib *ctx_lib,
+			struct bt_conn_ctx *ctx)
+{
+	atomic_val_t state;
+	atomic_val_t new_state;
+
+	do {
+		state = atomic_get(&ctx->state);
+		__ASSERT_NO_MSG((state & CTX_REF_MASK) > 0);
+
+		if (state & CTX_ALLOCATING) {
+			new_state = (state - 1) & ~CTX_ALLOCATING;
+			new_state |= CTX_VALID;
+		} else if ((state & CTX_REF_MASK) == 1) {
+			/* CTX_VALID is already cleared, as it comes
+			 * with the reference of the allocation.
+			 */
+			new_state = CTX_FREEING;
+		} else {
+			new_state = state - 1;
+		}
+	} while (!atomic_cas(&ctx->state, state, new_state));
 
-		if (!ctx->conn && !ctx->data) {
-			err = k_mem_slab_alloc(ctx_lib->mem_slab,
-					       &ctx->data,
-					       K_NO_WAIT);
-			if (!err) {
-				ctx->conn = conn;
+	if (new_state != CTX_FREEING) {
+		return;
+	}
 
-				LOG_DBG("The memory for the connection context "
-					"has been allocated, conn %p, index: %u",
-					conn, i);
+	k_mem_slab_free(ctx_lib->mem_slab, &ctx->data);
+	ctx->data = NULL;
+	ctx->conn = NULL;
 
-				return ctx->data;
+	atomic_set(&ctx->state, 0);
 
-			} else {
-				break;
-			}
+	LOG_DBG("The context memory has been released, index %u",
+		ctx - ctx_lib->ctx);
+}
 
-		}
+/* Drops the reference of the allocation, the last user frees the data */
+static bool ctx_invalidate(struct bt_conn_ctx_lib *ctx_lib,
+			   struct bt_conn_ctx *ctx)
+{
+	if (!(atomic_and(&ctx->state, ~CTX_VALID) & CTX_VALID)) {
+		return false;
 	}
 
-	LOG_WRN("Memory can not be allocated");
-	k_mutex_unlock(ctx_lib->mutex);
+	ctx_ref_put(ctx_lib, ctx);
 
-	return NULL;
+	return true;
 }
 
-int bt_conn_ctx_free(struct bt_conn_ctx_lib *ctx_lib, struct bt_conn *conn)
+void *bt_conn_ctx_alloc(struct bt_conn_ctx_lib *ctx_lib, struct bt_conn *conn)
 {
 	__ASSERT_NO_MSG(conn != NULL);
 	__ASSERT_NO_MSG(ctx_lib != NULL);
 
-	k_mutex_lock(ctx_lib->mutex, K_FOREVER);
+	struct bt_conn_ctx *ctx = ctx_by_conn(ctx_lib, conn);
+	int err;
 
-	for (size_t i = 0; i < CONFIG_BT_MAX_CONN; i++) {
-		struct bt_conn_ctx *ctx = &ctx_lib->ctx[i];
+	/* One reference for the allocation and one for the caller */
+	if (!atomic_cas(&ctx->state, 0, CTX_ALLOCATING | 2)) {
+		LOG_WRN("Memory can not be allocated");
+		return NULL;
+	}
 
-		if (ctx->conn == conn) {
-			bt_conn_ctx_mem_free(ctx_lib->mem_slab, &ctx->data);
-			ctx->conn = NULL;
-			ctx->data = NULL;
+	err = k_mem_slab_alloc(ctx_lib->mem_slab, &ctx->data, K_NO_WAIT);
+	if (err) {
+		LOG_WRN("Memory can not be allocated");
+		ctx->data = NULL;
+		atomic_set(&ctx->state, 0);
+		return NULL;
+	}
 
-			LOG_DBG("The context memory for the connection "
-				"has been released, conn %p index %u",
-				conn, i);
+	ctx->conn = conn;
 
-			k_mutex_unlock(ctx_lib->mutex);
+	LOG_DBG("The memory for the connection context "
+		"has been allocated, conn %p, index: %u",
+		conn, ctx - ctx_lib->ctx);
 
-			return 0;
-		}
+	return ctx->data;
+}
+
+int bt_conn_ctx_free(struct bt_conn_ctx_lib *ctx_lib, struct bt_conn *conn)
+{
+	__ASSERT_NO_MSG(conn != NULL);
+	__ASSERT_NO_MSG(ctx_lib != NULL);
+
+	struct bt_conn_ctx *ctx = ctx_by_conn(ctx_lib, conn);
+
+	if ((ctx->conn != conn) || !ctx_invalidate(ctx_lib, ctx)) {
+		LOG_WRN("There is no allocated memory for this connection");
+		return -EINVAL;
 	}
 
-	LOG_WRN("There is no allocated memory for this connection");
-	k_mutex_unlock(ctx_lib->mutex);
+	LOG_DBG("The context memory for the connection is released, conn %p",
+		conn);
 
-	return  -EINVAL;
+	return 0;
 }
 
 void bt_conn_ctx_free_all(struct bt_conn_ctx_lib *ctx_lib)
 {
 	__ASSERT_NO_MSG(ctx_lib != NULL);
 
-	k_mutex_lock(ctx_lib->mutex, K_FOREVER);
-
-	for (size_t i = 0; i < CONFIG_BT_MAX_CONN; i++) {
-		struct bt_conn_ctx *ctx = &ctx_lib->ctx[i];
-
-		if (ctx->data != NULL) {
-			k_mem_slab_free(ctx_lib->mem_slab, &ctx->data);
-			ctx->conn = NULL;
-			ctx->data = NULL;
-		}
+	for (size_t i = 0; i < bt_conn_ctx_count(ctx_lib); i++) {
+		(void)ctx_invalidate(ctx_lib, &ctx_lib->ctx[i]);
 	}
 
-	k_mutex_unlock(ctx_lib->mutex);
-
 	LOG_DBG("All allocated memory has been released");
 }
 
@@ -111,23 +160,20 @@ void *bt_conn_ctx_get(struct bt_conn_ctx_lib *ctx_lib, struct bt_conn *conn)
 	__ASSERT_NO_MSG(conn != NULL);
 	__ASSERT_NO_MSG(ctx_lib != NULL);
 
-	k_mutex_lock(ctx_lib->mutex, K_FOREVER);
+	struct bt_conn_ctx *ctx = ctx_by_conn(ctx_lib, conn);
 
-	for (size_t i = 0; i < CONFIG_BT_MAX_CONN; i++) {
-		struct bt_conn_ctx *ctx = &ctx_lib->ctx[i];
-
-		if (ctx->conn == conn) {
-			LOG_DBG("Memory block found for the connection");
-
-			return ctx->data;
-		}
+	if (!ctx_ref_get(ctx)) {
+		LOG_WRN("No memory block for connection");
+		return NULL;
 	}
 
-	LOG_WRN("No memory block for connection");
-
-	k_mutex_unlock(ctx_lib->mutex);
+	if (ctx->conn != conn) {
+		ctx_ref_put(ctx_lib, ctx);
+		LOG_WRN("No memory block for connection");
+		return NULL;
+	}
 
-	return NULL;
+	return ctx->data;
 }
 
 const struct bt_conn_ctx *bt_conn_ctx_get_by_id(struct bt_conn_ctx_lib *ctx_lib, u8_t id)
@@ -135,17 +181,9 @@ const struct bt_conn_ctx *bt_conn_ctx_get_by_id(struct bt_conn_ctx_lib *ctx_lib,
 	__ASSERT_NO_MSG(ctx_lib != NULL);
 	__ASSERT_NO_MSG(id < bt_conn_ctx_count(ctx_lib));
 
-	k_mutex_lock(ctx_lib->mutex, K_FOREVER);
-
 	struct bt_conn_ctx *ctx = &ctx_lib->ctx[id];
 
-	if (ctx_lib->ctx[id].conn != NULL) {
-		return ctx;
-	}
-
-	k_mutex_unlock(ctx_lib->mutex);
-
-	return NULL;
+	return ctx_ref_get(ctx) ? ctx : NULL;
 }
 
 void bt_conn_ctx_release(struct bt_conn_ctx_lib *ctx_lib, void *ctx_data)
@@ -153,12 +191,12 @@ void bt_conn_ctx_release(struct bt_conn_ctx_lib *ctx_lib, void *ctx_data)
 	__ASSERT_NO_MSG(ctx_lib != NULL);
 	__ASSERT_NO_MSG(ctx_data != NULL);
 
-	for (size_t i = 0; i < CONFIG_BT_MAX_CONN; i++) {
+	/* The data pointer is stable while the caller holds a reference */
+	for (size_t i = 0; i < bt_conn_ctx_count(ctx_lib); i++) {
 		struct bt_conn_ctx *ctx = &ctx_lib->ctx[i];
 
 		if (ctx->data == ctx_data) {
-			k_mutex_unlock(ctx_lib->mutex);
-
+			ctx_ref_put(ctx_lib, ctx);
 			return;
 		}
 	}
@@ -6,6 +6,7 @@
 
 #include <drivers/bluetooth/hci_driver.h>
 #include <bluetooth/hci_vs.h>
+#include <bluetooth/adv_report_filter.h>
 #include <init.h>
 #include <irq.h>
 #include <kernel.h>
@@ -167,18 +168,13 @@ static int hci_driver_send(struct net_buf *buf)
 	return err;
 }
 
-static void data_packet_process(u8_t *hci_buf)
+/* Returns the length of the ACL data packet, including the header. */
+static u16_t data_packet_len(const u8_t *hci_buf)
 {
-	struct net_buf *data_buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
-	struct bt_hci_acl_hdr *hdr = (void *)hci_buf;
+	const struct bt_hci_acl_hdr *hdr = (const void *)hci_buf;
 	u16_t hf, handle, len;
 	u8_t flags, pb, bc;
 
-	if (!data_buf) {
-		BT_ERR("No data buffer available");
-		return;
-	}
-
 	len = sys_le16_to_cpu(hdr->len);
 	hf = sys_le16_to_cpu(hdr->handle);
 	handle = bt_acl_handle(hf);
@@ -189,26 +185,47 @@ static void data_packet_process(u8_t *hci_buf)
 	BT_DBG("Data: handle (0x%02x), PB(%01d), BC(%01d), len(%u)", handle,
 	       pb, bc, len);
 
-	net_buf_add_mem(data_buf, &hci_buf[0], len + sizeof(*hdr));
+	return len + sizeof(*hdr);
+}
+
+static void data_packet_process(u8_t *hci_buf)
+{
+	struct net_buf *data_buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_FOREVER);
+
+	if (!data_buf) {
+		BT_ERR("No data buffer available");
+		return;
+	}
+
+	net_buf_add_mem(data_buf, &hci_buf[0], data_packet_len(hci_buf));
 	bt_recv(data_buf);
 }
 
-static bool event_packet_is_discardable(const u8_t *hci_buf)
+static bool event_packet_is_adv_report(const u8_t *hci_buf)
 {
 	struct bt_hci_evt_hdr *hdr = (void *)hci_buf;
+	struct bt_hci_evt_le_meta_event *me = (void *)&hci_buf[2];
 
-	switch (hdr->evt) {
-	case BT_HCI_EVT_LE_META_EVENT: {
-		struct bt_hci_evt_le_meta_event *me = (void *)&hci_buf[2];
+	if (hdr->evt != BT_HCI_EVT_LE_META_EVENT) {
+		return false;
+	}
 
-		switch (me->subevent) {
-		case BT_HCI_EVT_LE_ADVERTISING_REPORT:
-		case BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT:
-			return true;
-		default:
-			return false;
-		}
+	switch (me->subevent) {
+	case BT_HCI_EVT_LE_ADVERTISING_REPORT:
+	case BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT:
+		return true;
+	default:
+		return false;
 	}
+}
+
+static bool event_packet_is_discardable(const u8_t *hci_buf)
+{
+	struct bt_hci_evt_hdr *hdr = (void *)hci_buf;
+
+	switch (hdr->evt) {
+	case BT_HCI_EVT_LE_META_EVENT:
+		return event_packet_is_adv_report(hci_buf);
 	case BT_HCI_EVT_VENDOR:
 	{
 		u8_t subevent = hci_buf[2];
@@ -225,12 +242,262 @@ static bool event_packet_is_discardable(const u8_t *hci_buf)
 	}
 }
 
+#if defined(CONFIG_BLECTLR_ADV_REPORT_FILTER)
+#define ADV_REPORT_DEDUP_COUNT CONFIG_BLECTLR_ADV_REPORT_DEDUP_COUNT
+
+/* The rate limiter is a token bucket, refilled by
+ * CONFIG_BLECTLR_ADV_REPORT_RATE tokens per millisecond. Forwarding a report
+ * takes ADV_REPORT_TOKEN tokens.
+ */
+#define ADV_REPORT_TOKEN 1000
+#define ADV_REPORT_TOKENS_MAX (CONFIG_BLECTLR_ADV_REPORT_BURST * \
+			       ADV_REPORT_TOKEN)
+
+#define FNV_OFFSET_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+
+/* Data status of an extended advertising report, 0 when the data is complete */
+#define EXT_ADV_DATA_STATUS(evt_type) (((evt_type) >> 5) & 0x03)
+
+/* A recently forwarded report */
+struct adv_report_entry {
+	u32_t hash;
+	u32_t timestamp;
+};
+
+static struct {
+#if ADV_REPORT_DEDUP_COUNT > 0
+	struct adv_report_entry recent[ADV_REPORT_DEDUP_COUNT];
+	size_t recent_cnt;
+#endif
+	u32_t tokens;
+	u32_t last_refill;
+} adv_filter = {
+	.tokens = ADV_REPORT_TOKENS_MAX,
+};
+
+static atomic_t adv_report_forwarded;
+static atomic_t adv_report_duplicates;
+static atomic_t adv_report_rate_limited;
+static atomic_t adv_report_no_buffer;
+
+#if ADV_REPORT_DEDUP_COUNT > 0
+static u32_t hash_update(u32_t hash, const void *data, size_t len)
+{
+	const u8_t *bytes = data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/* Hashes the type, address and data of all reports in the event, leaving
+ * out the fields that change between repetitions, like the RSSI. Returns
+ * false if the event is malformed or holds incomplete data, which must not
+ * be suppressed.
+ */
+static bool adv_report_hash(const u8_t *hci_buf, u32_t *hash)
+{
+	struct bt_hci_evt_hdr *hdr = (void *)hci_buf;
+	struct bt_hci_evt_le_meta_event *me = (void *)&hci_buf[2];
+	const u8_t *end = &hci_buf[sizeof(*hdr) + hdr->len];
+	const u8_t *p = &hci_buf[sizeof(*hdr) + sizeof(*me)];
+	u8_t num_reports;
+
+	if (p >= end) {
+		return false;
+	}
+
+	num_reports = *p++;
+	*hash = hash_update(FNV_OFFSET_BASIS, &me->subevent,
+			    sizeof(me->subevent));
+
+	for (u8_t i = 0; i < num_reports; i++) {
+		if (me->subevent == BT_HCI_EVT_LE_ADVERTISING_REPORT) {
+			const struct bt_hci_evt_le_advertising_info *info =
+				(const void *)p;
+
+			if ((p + sizeof(*info) > end) ||
+			    (&info->data[info->length] + sizeof(s8_t) > end)) {
+				return false;
+			}
+
+			*hash = hash_update(*hash, &info->evt_type,
+					    sizeof(info->evt_type));
+			*hash = hash_update(*hash, &info->addr,
+					    sizeof(info->addr));
+			*hash = hash_update(*hash, &info->length,
+					    sizeof(info->length));
+			*hash = hash_update(*hash, info->data, info->length);
+
+			/* The RSSI follows the data */
+			p = &info->data[info->length] + sizeof(s8_t);
+		} else {
+			const struct bt_hci_evt_le_ext_advertising_info *info =
+				(const void *)p;
+
+			if ((p + sizeof(*info) > end) ||
+			    (&info->data[info->length] > end)) {
+				return false;
+			}
+
+			if (EXT_ADV_DATA_STATUS(
+				    sys_le16_to_cpu(info->evt_type))) {
+				return false;
+			}
+
+			*hash = hash_update(*hash, &info->evt_type,
+					    sizeof(info->evt_type));
+			*hash = hash_update(*hash, &info->addr,
+					    sizeof(info->addr));
+			*hash = hash_update(*hash, &info->sid,
+					    sizeof(info->sid));
+			*hash = hash_update(*hash, &info->length,
+					    sizeof(info->length));
+			*hash = hash_update(*hash, info->data, info->length);
+
+			p = &info->data[info->length];
+		}
+	}
+
+	return true;
+}
+
+static struct adv_report_entry *adv_report_recent_find(u32_t hash)
+{
+	for (size_t i = 0; i < adv_filter.recent_cnt; i++) {
+		if (adv_filter.recent[i].hash == hash) {
+			return &adv_filter.recent[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Remembers a forwarded report, replacing the least recently forwarded one
+ * when all entries are in use.
+ */
+static void adv_report_recent_add(u32_t hash, u32_t now)
+{
+	struct adv_report_entry *entry = adv_report_recent_find(hash);
+
+	if (!entry && (adv_filter.recent_cnt < ADV_REPORT_DEDUP_COUNT)) {
+		entry = &adv_filter.recent[adv_filter.recent_cnt++];
+	}
+
+	if (!entry) {
+		entry = &adv_filter.recent[0];
+
+		for (size_t i = 1; i < adv_filter.recent_cnt; i++) {
+			struct adv_report_entry *e = &adv_filter.recent[i];
+
+			if ((now - e->timestamp) > (now - entry->timestamp)) {
+				entry = e;
+			}
+		}
+	}
+
+	entry->hash = hash;
+	entry->timestamp = now;
+}
+#endif /* ADV_REPORT_DEDUP_COUNT > 0 */
+
+static bool adv_report_rate_exceeded(u32_t now)
+{
+	u32_t elapsed;
+
+	if (CONFIG_BLECTLR_ADV_REPORT_RATE == 0) {
+		return false;
+	}
+
+	elapsed = MIN(now - adv_filter.last_refill, ADV_REPORT_TOKENS_MAX);
+	adv_filter.last_refill = now;
+	adv_filter.tokens = MIN(adv_filter.tokens +
+				elapsed * CONFIG_BLECTLR_ADV_REPORT_RATE,
+				ADV_REPORT_TOKENS_MAX);
+
+	if (adv_filter.tokens < ADV_REPORT_TOKEN) {
+		return true;
+	}
+
+	adv_filter.tokens -= ADV_REPORT_TOKEN;
+
+	return false;
+}
+
+/* Returns true if the advertising report event should be passed to the
+ * host. Only called from the receiving thread.
+ */
+static bool adv_report_filter(const u8_t *hci_buf)
+{
+	u32_t now = k_uptime_get_32();
+
+#if ADV_REPORT_DEDUP_COUNT > 0
+	struct adv_report_entry *entry = NULL;
+	u32_t hash;
+	bool hashed = adv_report_hash(hci_buf, &hash);
+
+	if (hashed) {
+		entry = adv_report_recent_find(hash);
+	}
+
+	if (entry && ((now - entry->timestamp) <
+		      CONFIG_BLECTLR_ADV_REPORT_DEDUP_TIMEOUT)) {
+		atomic_inc(&adv_report_duplicates);
+		return false;
+	}
+#endif
+
+	if (adv_report_rate_exceeded(now)) {
+		atomic_inc(&adv_report_rate_limited);
+		return false;
+	}
+
+#if ADV_REPORT_DEDUP_COUNT > 0
+	if (hashed) {
+		adv_report_recent_add(hash, now);
+	}
+#endif
+
+	return true;
+}
+
+void bt_ctlr_adv_report_stats_get(struct bt_ctlr_adv_report_stats *stats)
+{
+	__ASSERT_NO_MSG(stats != NULL);
+
+	stats->forwarded = atomic_get(&adv_report_forwarded);
+	stats->duplicates = atomic_get(&adv_report_duplicates);
+	stats->rate_limited = atomic_get(&adv_report_rate_limited);
+	stats->no_buffer = atomic_get(&adv_report_no_buffer);
+}
+
+void bt_ctlr_adv_report_stats_reset(void)
+{
+	atomic_clear(&adv_report_forwarded);
+	atomic_clear(&adv_report_duplicates);
+	atomic_clear(&adv_report_rate_limited);
+	atomic_clear(&adv_report_no_buffer);
+}
+#endif /* CONFIG_BLECTLR_ADV_REPORT_FILTER */
+
 static void event_packet_process(u8_t *hci_buf)
 {
 	bool discardable = event_packet_is_discardable(hci_buf);
 	struct bt_hci_evt_hdr *hdr = (void *)hci_buf;
 	struct net_buf *evt_buf;
 
+#if defined(CONFIG_BLECTLR_ADV_REPORT_FILTER)
+	bool adv_report = event_packet_is_adv_report(hci_buf);
+
+	if (adv_report && !adv_report_filter(hci_buf)) {
+		BT_DBG("Suppressing advertising report");
+		return;
+	}
+#endif
+
 	if (hdr->evt == BT_HCI_EVT_LE_META_EVENT) {
 		struct bt_hci_evt_le_meta_event *me = (void *)&hci_buf[2];
 
@@ -259,6 +526,11 @@ static void event_packet_process(u8_t *hci_buf)
 
 	if (!evt_buf) {
 		if (discardable) {
+#if defined(CONFIG_BLECTLR_ADV_REPORT_FILTER)
+			if (adv_report) {
+				atomic_inc(&adv_report_no_buffer);
+			}
+#endif
 			BT_DBG("Discarding event");
 			return;
 		}
@@ -267,6 +539,12 @@ static void event_packet_process(u8_t *hci_buf)
 		return;
 	}
 
+#if defined(CONFIG_BLECTLR_ADV_REPORT_FILTER)
+	if (adv_report) {
+		atomic_inc(&adv_report_forwarded);
+	}
+#endif
+
 	net_buf_add_mem(evt_buf, &hci_buf[0], hdr->len + sizeof(*hdr));
 	if (bt_hci_evt_is_prio(hdr->evt)) {
 		bt_recv_prio(evt_buf);
@@ -275,40 +553,126 @@ static void event_packet_process(u8_t *hci_buf)
 	}
 }
 
-static bool fetch_and_process_hci_evt(uint8_t *p_hci_buffer)
-{
-	int errcode;
+/* Packets retrieved from the controller in one batch, in the order they
+ * were retrieved. ACL data is written directly into a host buffer when one
+ * is available, other packets are copied from an intermediate buffer.
+ */
+enum rx_packet_type {
+	RX_PACKET_EVT,
+	RX_PACKET_ACL,
+	RX_PACKET_ACL_BUF,
+};
 
-	errcode = MULTITHREADING_LOCK_ACQUIRE();
-	if (!errcode) {
-		errcode = hci_evt_get(p_hci_buffer);
-		MULTITHREADING_LOCK_RELEASE();
-	}
+struct rx_packet {
+	enum rx_packet_type type;
+	union {
+		u8_t *hci_buf;
+		struct net_buf *buf;
+	};
+};
 
-	if (errcode) {
-		return false;
+static u8_t hci_buffers[CONFIG_BLECTLR_RX_BATCH_SIZE][HCI_MSG_BUFFER_MAX_SIZE];
+
+/* An ACL data buffer the controller can write any packet into. */
+static struct net_buf *acl_buf_get(void)
+{
+	struct net_buf *buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_NO_WAIT);
+
+	if (buf && (net_buf_tailroom(buf) <
+		    sizeof(struct bt_hci_acl_hdr) + MAX_RX_PACKET_SIZE)) {
+		net_buf_unref(buf);
+		return NULL;
 	}
 
-	event_packet_process(p_hci_buffer);
-	return true;
+	return buf;
 }
 
-static bool fetch_and_process_acl_data(uint8_t *p_hci_buffer)
+/* Returns the number of packets retrieved, at most
+ * CONFIG_BLECTLR_RX_BATCH_SIZE.
+ */
+static size_t rx_batch_fetch(struct rx_packet *packets)
 {
-	int errcode;
+	struct net_buf *acl_buf = NULL;
+	size_t hci_buf_cnt = 0;
+	size_t cnt = 0;
+	bool evt_pending = true;
+	bool acl_pending = true;
+
+	if (MULTITHREADING_LOCK_ACQUIRE()) {
+		return 0;
+	}
 
-	errcode = MULTITHREADING_LOCK_ACQUIRE();
-	if (!errcode) {
-		errcode = hci_data_get(p_hci_buffer);
-		MULTITHREADING_LOCK_RELEASE();
+	while ((cnt < CONFIG_BLECTLR_RX_BATCH_SIZE) &&
+	       (evt_pending || acl_pending)) {
+		if (evt_pending) {
+			u8_t *hci_buf = hci_buffers[hci_buf_cnt];
+
+			evt_pending = !hci_evt_get(hci_buf);
+			if (evt_pending) {
+				packets[cnt].type = RX_PACKET_EVT;
+				packets[cnt].hci_buf = hci_buf;
+				hci_buf_cnt++;
+				cnt++;
+			}
+		}
+
+		if (!acl_pending || (cnt == CONFIG_BLECTLR_RX_BATCH_SIZE)) {
+			continue;
+		}
+
+		if (!acl_buf) {
+			acl_buf = acl_buf_get();
+		}
+
+		if (acl_buf) {
+			acl_pending = !hci_data_get(net_buf_tail(acl_buf));
+			if (acl_pending) {
+				packets[cnt].type = RX_PACKET_ACL_BUF;
+				packets[cnt].buf = acl_buf;
+				acl_buf = NULL;
+				cnt++;
+			}
+		} else {
+			u8_t *hci_buf = hci_buffers[hci_buf_cnt];
+
+			acl_pending = !hci_data_get(hci_buf);
+			if (acl_pending) {
+				packets[cnt].type = RX_PACKET_ACL;
+				packets[cnt].hci_buf = hci_buf;
+				hci_buf_cnt++;
+				cnt++;
+			}
+		}
 	}
 
-	if (errcode) {
-		return false;
+	MULTITHREADING_LOCK_RELEASE();
+
+	if (acl_buf) {
+		net_buf_unref(acl_buf);
 	}
 
-	data_packet_process(p_hci_buffer);
-	return true;
+	return cnt;
+}
+
+static void rx_batch_process(struct rx_packet *packets, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; i++) {
+		struct net_buf *buf;
+
+		switch (packets[i].type) {
+		case RX_PACKET_EVT:
+			event_packet_process(packets[i].hci_buf);
+			break;
+		case RX_PACKET_ACL:
+			data_packet_process(packets[i].hci_buf);
+			break;
+		case RX_PACKET_ACL_BUF:
+			buf = packets[i].buf;
+			net_buf_add(buf, data_packet_len(buf->data));
+			bt_recv(buf);
+			break;
+		}
+	}
 }
 
 static void recv_thread(void *p1, void *p2, void *p3)
@@ -317,20 +681,19 @@ static void recv_thread(void *p1, void *p2, void *p3)
 	ARG_UNUSED(p2);
 	ARG_UNUSED(p3);
 
-	static u8_t hci_buffer[HCI_MSG_BUFFER_MAX_SIZE];
-
-	bool received_evt = false;
-	bool received_data = false;
+	struct rx_packet packets[CONFIG_BLECTLR_RX_BATCH_SIZE];
+	size_t cnt = 0;
 
 	while (true) {
-		if (!received_evt && !received_data) {
-			/* Wait for a signal from the controller. */
+		if (cnt < CONFIG_BLECTLR_RX_BATCH_SIZE) {
+			/* The controller had no more packets, wait for
+			 * a signal from it.
+			 */
 			k_sem_take(&sem_recv, K_FOREVER);
 		}
 
-		received_evt = fetch_and_process_hci_evt(&hci_buffer[0]);
-
-		received_data = fetch_and_process_acl_data(&hci_buffer[0]);
+		cnt = rx_batch_fetch(packets);
+		rx_batch_process(packets, cnt);
 
 		/* Let other threads of same priority run in between. */
 		k_yield();
@@ -7,18 +7,18 @@
 #include <inttypes.h>
 #include <zephyr.h>
 #include <logging/log.h>
+#include <settings/settings.h>
 
+#include <bluetooth/bluetooth.h>
 #include <bluetooth/gatt_dm.h>
 
 LOG_MODULE_REGISTER(bt_gatt_dm, CONFIG_BT_GATT_DM_LOG_LEVEL);
 
-/* Available sizes: 128, 512, 2048... */
-#define CHUNK_DATA_SIZE (128 - sizeof(struct k_mem_block_id) \
-		- sizeof(struct data_chunk_item *))
-
 #define DATA_ALIGN 4U
 
-/* They are placed in data_chunk without padding, so they must be aligned */
+#define DB_HASH_LEN 16
+
+/* They are placed in dm->data without padding, so they must be aligned */
 BUILD_ASSERT(sizeof(struct bt_gatt_service_val) % DATA_ALIGN == 0);
 BUILD_ASSERT(sizeof(struct bt_gatt_chrc) % DATA_ALIGN == 0);
 
@@ -26,17 +26,12 @@ BUILD_ASSERT(sizeof(struct bt_gatt_chrc) % DATA_ALIGN == 0);
 enum {
 	STATE_ATTRS_LOCKED,
 	STATE_ATTRS_RELEASE_PENDING,
+	STATE_CACHE_ACTIVE,
+	STATE_CACHE_HIT,
+	STATE_CACHE_DB_HASH,
 	STATE_NUM
 };
 
-/* One item in linked list containing dynamically allocated user data chunks */
-struct data_chunk_item {
-	/* Required by the sys_slist */
-	sys_snode_t node;
-	/* User data storage */
-	u8_t data[CHUNK_DATA_SIZE];
-};
-
 /* The instance structure real declaration */
 struct bt_gatt_dm {
 	/* Connection object */
@@ -53,75 +48,57 @@ struct bt_gatt_dm {
 	/* Flags with the status of the attributes */
 	ATOMIC_DEFINE(state_flags, STATE_NUM);
 
-	/* Single-linked list of allocated chunks for user data */
-	sys_slist_t chunk_list;
-	/* The used length of the current chunk */
-	size_t cur_chunk_len;
+	/* Storage for the UUIDs and values of the attributes */
+	u8_t data[CONFIG_BT_GATT_DM_DATA_SIZE] __aligned(DATA_ALIGN);
+	/* The used length of the data storage */
+	size_t data_len;
 
 	/* The pointer to callback structure */
 	const struct bt_gatt_dm_cb *callback;
+
+#if CONFIG_BT_GATT_DM_CACHE
+	/* Database Hash of the cached entry or of the peer */
+	u8_t db_hash[DB_HASH_LEN];
+	/* The parameters used to read the Database Hash */
+	struct bt_gatt_read_params read_params;
+	/* Completes the discovery with the cached attributes */
+	struct k_work cache_work;
+#endif
 };
 
-/* Currently only one instance is supported */
-static struct bt_gatt_dm bt_gatt_dm_inst;
+/* Each instance runs one discovery procedure on its connection */
+static struct bt_gatt_dm bt_gatt_dm_inst[CONFIG_BT_GATT_DM_MAX_INSTANCES];
+/* Serializes the search for a free instance with its claim */
+static K_MUTEX_DEFINE(inst_lock);
 
-/* Returns pointer to newly allocated space in a dm->data_chunk */
+/* Returns pointer to newly allocated space in dm->data */
 static void *user_data_alloc(struct bt_gatt_dm *dm,
 			     size_t len)
 {
 	u8_t *user_data_loc;
-	struct data_chunk_item *item;
 
 	/* Round up len to 32 bits to make sure that return pointers are always
 	 * correctly aligned.
 	 */
 	len = (len + DATA_ALIGN - 1) & ~(DATA_ALIGN - 1);
 
-	__ASSERT_NO_MSG(len <= CHUNK_DATA_SIZE);
-
-	if (sys_slist_is_empty(&dm->chunk_list) ||
-	    dm->cur_chunk_len + len > CHUNK_DATA_SIZE) {
-
-		item = k_malloc(sizeof(struct data_chunk_item));
-
-		if (!item) {
-			return NULL;
-		}
-
-		sys_slist_append(&dm->chunk_list, &item->node);
-		dm->cur_chunk_len = 0;
-
-	} else {
-
-		item = SYS_SLIST_PEEK_TAIL_CONTAINER(&dm->chunk_list, item,
-						     node);
-
+	if (dm->data_len + len > sizeof(dm->data)) {
+		return NULL;
 	}
 
-	user_data_loc = &item->data[dm->cur_chunk_len];
-	dm->cur_chunk_len += len;
+	user_data_loc = &dm->data[dm->data_len];
+	dm->data_len += len;
 
 	return user_data_loc;
 }
 
 static void svc_attr_memory_release(struct bt_gatt_dm *dm)
 {
-	sys_snode_t *node;
-	struct data_chunk_item *item;
-
 	LOG_DBG("Attr memory release");
 
-	/* Clear attributes */
+	/* Clear attributes and their data */
 	dm->cur_attr_id = 0;
-
-	/* Release dynamic memory data chunks */
-	while (!sys_slist_is_empty(&dm->chunk_list)) {
-		node = sys_slist_get_not_empty(&dm->chunk_list);
-		item = CONTAINER_OF(node, struct data_chunk_item, node);
-		k_free(item);
-	}
-
-	dm->cur_chunk_len = 0;
+	dm->data_len = 0;
 }
 
 /* Returns size of UUID structure with padding for memory alignment */
@@ -143,7 +120,7 @@ static size_t get_uuid_size(const struct bt_uuid *uuid)
 /** @brief Stores attribute in bt_gatt_dm instance.
  *
  * This function stores attr at dm->attrs array. Its UUID is stored in
- * dm->data_chunk. The Discovery Manager attribute does not contain
+ * dm->data. The Discovery Manager attribute does not contain
  * a pointer to the context data. This data could be either
  * bt_gatt_service_val or bt_gatt_chrc. It is assumed that attribute context
  * data (if any) is always placed before its UUID data. For this purpose,
@@ -198,6 +175,10 @@ static struct bt_uuid *uuid_store(struct bt_gatt_dm *dm,
 	size_t size = get_uuid_size(uuid);
 	void *buffer = user_data_alloc(dm, size);
 
+	if (!buffer) {
+		return NULL;
+	}
+
 	memcpy(buffer, uuid, size);
 
 	return (struct bt_uuid *)buffer;
@@ -231,9 +212,566 @@ static struct bt_gatt_dm_attr *attr_find_by_handle(
 	return NULL;
 }
 
+#if CONFIG_BT_GATT_DM_CACHE
+
+#define CACHE_VERSION 1
+#define CACHE_NO_VAL 0xffff
+
+/* "bt/dm/<identity address>/<service UUID>" */
+#define CACHE_KEY_SIZE (sizeof("bt/dm/") + 13 + 1 + 32)
+
+/* Attribute record of a cache entry, offsets point into dm->data */
+struct cache_attr {
+	u16_t handle;
+	u16_t uuid_off;
+	u16_t val_uuid_off;
+	u8_t perm;
+} __packed;
+
+/* Cache entry as stored in the settings */
+struct cache_entry {
+	u8_t db_hash[DB_HASH_LEN];
+	u16_t attr_cnt;
+	u16_t data_len;
+	u8_t version;
+	u8_t has_db_hash;
+	/* Attribute records followed by the attribute data */
+	u8_t payload[CONFIG_BT_GATT_DM_MAX_ATTRS * sizeof(struct cache_attr) +
+		     CONFIG_BT_GATT_DM_DATA_SIZE];
+};
+
+static void discovery_complete(struct bt_gatt_dm *dm);
+static void discovery_complete_error(struct bt_gatt_dm *dm, int err);
+
+static struct bt_uuid_16 db_hash_uuid =
+	BT_UUID_INIT_16(BT_UUID_GATT_DB_HASH_VAL);
+
+/* Shared by all instances, protected by cache_lock */
+static struct cache_entry cache_buf;
+static K_MUTEX_DEFINE(cache_lock);
+
+/* Entry waiting to be stored, owned by store_work while store_busy is set.
+ * Storing can take long, so it is not done from the Bluetooth RX context.
+ */
+static struct cache_entry store_buf;
+static char store_key[CACHE_KEY_SIZE];
+static size_t store_size;
+static atomic_t store_busy;
+
+/* Encodes the key of the peer subtree, returns its length */
+static int cache_peer_key_encode(char *key, const bt_addr_le_t *addr)
+{
+	return snprintk(key, CACHE_KEY_SIZE,
+			"bt/dm/%02x%02x%02x%02x%02x%02x%u",
+			addr->a.val[5], addr->a.val[4], addr->a.val[3],
+			addr->a.val[2], addr->a.val[1], addr->a.val[0],
+			addr->type);
+}
+
+static int cache_key_encode(char *key, const bt_addr_le_t *addr,
+			    const struct bt_uuid *uuid)
+{
+	int len = cache_peer_key_encode(key, addr);
+
+	len += snprintk(&key[len], CACHE_KEY_SIZE - len, "/");
+
+	switch (uuid->type) {
+	case BT_UUID_TYPE_16:
+		snprintk(&key[len], CACHE_KEY_SIZE - len, "%04x",
+			 BT_UUID_16(uuid)->val);
+		return 0;
+	case BT_UUID_TYPE_128:
+		for (int i = 15; i >= 0; i--) {
+			len += snprintk(&key[len], CACHE_KEY_SIZE - len,
+					"%02x", BT_UUID_128(uuid)->val[i]);
+		}
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Only the results of bonded peers are cached, as they are identified by
+ * their identity address and notify about changes of their database.
+ */
+static int cache_key_get(struct bt_gatt_dm *dm, char *key)
+{
+	struct bt_conn_info info;
+	int err;
+
+	err = bt_conn_get_info(dm->conn, &info);
+	if (err) {
+		return err;
+	}
+
+	if (!bt_addr_le_is_bonded(info.id, info.le.dst)) {
+		return -ENOENT;
+	}
+
+	return cache_key_encode(key, info.le.dst, dm->discover_params.uuid);
+}
+
+static int cache_read(const char *key, size_t len, settings_read_cb read_cb,
+		      void *cb_arg, void *param)
+{
+	ssize_t *size = param;
+	const char *next;
+
+	/* Skip entries below the requested one */
+	if (settings_name_next(key, &next)) {
+		return 0;
+	}
+
+	*size = read_cb(cb_arg, &cache_buf, sizeof(cache_buf));
+
+	return 0;
+}
+
+/* Returns the UUID stored at the offset or NULL if it is invalid */
+static struct bt_uuid *cache_uuid_get(struct bt_gatt_dm *dm, u16_t off)
+{
+	struct bt_uuid *uuid = (struct bt_uuid *)&dm->data[off];
+
+	if ((off % DATA_ALIGN) || (off + sizeof(*uuid) > dm->data_len)) {
+		return NULL;
+	}
+
+	switch (uuid->type) {
+	case BT_UUID_TYPE_16:
+	case BT_UUID_TYPE_32:
+	case BT_UUID_TYPE_128:
+		break;
+	default:
+		return NULL;
+	}
+
+	return (off + get_uuid_size(uuid) <= dm->data_len) ? uuid : NULL;
+}
+
+static int cache_entry_restore(struct bt_gatt_dm *dm, ssize_t size,
+			       const struct bt_uuid *svc_uuid)
+{
+	const struct cache_entry *entry = &cache_buf;
+	const u8_t *data;
+	struct cache_attr rec;
+
+	if ((size < (ssize_t)offsetof(struct cache_entry, payload)) ||
+	    (entry->version != CACHE_VERSION) ||
+	    (entry->attr_cnt == 0) ||
+	    (entry->attr_cnt > ARRAY_SIZE(dm->attrs)) ||
+	    (entry->data_len > sizeof(dm->data)) ||
+	    ((size_t)size != offsetof(struct cache_entry, payload) +
+			     entry->attr_cnt * sizeof(rec) + entry->data_len)) {
+		return -EINVAL;
+	}
+
+	data = &entry->payload[entry->attr_cnt * sizeof(rec)];
+	memcpy(dm->data, data, entry->data_len);
+	dm->data_len = entry->data_len;
+
+	/* The UUID of the searched service is stored first */
+	if (!cache_uuid_get(dm, 0) ||
+	    bt_uuid_cmp((struct bt_uuid *)dm->data, svc_uuid)) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < entry->attr_cnt; i++) {
+		struct bt_gatt_dm_attr *attr = &dm->attrs[i];
+		struct bt_gatt_service_val *service_val;
+		struct bt_gatt_chrc *chrc;
+		struct bt_uuid *val_uuid;
+
+		memcpy(&rec, &entry->payload[i * sizeof(rec)], sizeof(rec));
+
+		attr->handle = rec.handle;
+		attr->perm = rec.perm;
+		attr->uuid = cache_uuid_get(dm, rec.uuid_off);
+		if (!attr->uuid) {
+			return -EINVAL;
+		}
+
+		if (rec.val_uuid_off == CACHE_NO_VAL) {
+			continue;
+		}
+
+		val_uuid = cache_uuid_get(dm, rec.val_uuid_off);
+		if (!val_uuid) {
+			return -EINVAL;
+		}
+
+		/* The value is placed in front of the attribute UUID */
+		service_val = bt_gatt_dm_attr_service_val(attr);
+		chrc = bt_gatt_dm_attr_chrc_val(attr);
+		if (service_val && rec.uuid_off >= sizeof(*service_val)) {
+			service_val->uuid = val_uuid;
+		} else if (chrc && rec.uuid_off >= sizeof(*chrc)) {
+			chrc->uuid = val_uuid;
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	dm->cur_attr_id = entry->attr_cnt;
+
+	if (entry->has_db_hash) {
+		memcpy(dm->db_hash, entry->db_hash, sizeof(dm->db_hash));
+		atomic_set_bit(dm->state_flags, STATE_CACHE_DB_HASH);
+	}
+
+	return 0;
+}
+
+/* Drops the restored attributes, keeping the UUID of the searched service */
+static void cache_discard(struct bt_gatt_dm *dm)
+{
+	atomic_clear_bit(dm->state_flags, STATE_CACHE_HIT);
+	dm->cur_attr_id = 0;
+	dm->data_len = (get_uuid_size(dm->discover_params.uuid) +
+			DATA_ALIGN - 1) & ~(DATA_ALIGN - 1);
+}
+
+static int cache_restore(struct bt_gatt_dm *dm, const char *key)
+{
+	struct bt_uuid_128 svc_uuid;
+	size_t svc_uuid_size = get_uuid_size(dm->discover_params.uuid);
+	ssize_t size = 0;
+	int err;
+
+	memcpy(&svc_uuid, dm->discover_params.uuid, svc_uuid_size);
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+
+	err = settings_load_subtree_direct(key, cache_read, &size);
+	if (!err) {
+		err = (size > 0) ?
+		      cache_entry_restore(dm, size, &svc_uuid.uuid) : -ENOENT;
+	}
+
+	k_mutex_unlock(&cache_lock);
+
+	if (err) {
+		memcpy(dm->data, &svc_uuid, svc_uuid_size);
+		cache_discard(dm);
+	}
+
+	return err;
+}
+
+static int data_offset_get(const struct bt_gatt_dm *dm, const void *ptr,
+			   u16_t *off)
+{
+	const u8_t *p = ptr;
+
+	if ((p < dm->data) || (p >= &dm->data[dm->data_len])) {
+		return -EINVAL;
+	}
+
+	*off = p - dm->data;
+
+	return 0;
+}
+
+static int cache_entry_build(const struct bt_gatt_dm *dm,
+			     struct cache_entry *entry)
+{
+	struct cache_attr rec;
+	int err;
+
+	entry->version = CACHE_VERSION;
+	entry->attr_cnt = dm->cur_attr_id;
+	entry->data_len = dm->data_len;
+	entry->has_db_hash = atomic_test_bit(dm->state_flags,
+					     STATE_CACHE_DB_HASH);
+	memcpy(entry->db_hash, dm->db_hash, sizeof(entry->db_hash));
+
+	for (size_t i = 0; i < dm->cur_attr_id; i++) {
+		const struct bt_gatt_dm_attr *attr = &dm->attrs[i];
+		const struct bt_gatt_service_val *service_val =
+			bt_gatt_dm_attr_service_val(attr);
+		const struct bt_gatt_chrc *chrc = bt_gatt_dm_attr_chrc_val(attr);
+
+		rec.handle = attr->handle;
+		rec.perm = attr->perm;
+		rec.val_uuid_off = CACHE_NO_VAL;
+
+		err = data_offset_get(dm, attr->uuid, &rec.uuid_off);
+		if (!err && service_val) {
+			err = data_offset_get(dm, service_val->uuid,
+					      &rec.val_uuid_off);
+		} else if (!err && chrc) {
+			err = data_offset_get(dm, chrc->uuid,
+					      &rec.val_uuid_off);
+		}
+
+		if (err) {
+			return err;
+		}
+
+		memcpy(&entry->payload[i * sizeof(rec)], &rec, sizeof(rec));
+	}
+
+	memcpy(&entry->payload[dm->cur_attr_id * sizeof(rec)], dm->data,
+	       dm->data_len);
+
+	return offsetof(struct cache_entry, payload) +
+	       dm->cur_attr_id * sizeof(rec) + dm->data_len;
+}
+
+static void store_work_handler(struct k_work *work)
+{
+	int err = settings_save_one(store_key, &store_buf, store_size);
+
+	if (err) {
+		LOG_WRN("Cannot cache discovery results, err %d", err);
+	} else {
+		LOG_DBG("Cached discovery results under %s",
+			log_strdup(store_key));
+	}
+
+	atomic_clear(&store_busy);
+}
+
+static K_WORK_DEFINE(store_work, store_work_handler);
+
+static void cache_store(struct bt_gatt_dm *dm)
+{
+	int size;
+	int err;
+
+	if (!atomic_test_bit(dm->state_flags, STATE_CACHE_ACTIVE) ||
+	    atomic_test_bit(dm->state_flags, STATE_CACHE_HIT)) {
+		return;
+	}
+
+	/* The results are stored again on the next discovery */
+	if (!atomic_cas(&store_busy, 0, 1)) {
+		LOG_WRN("Cache busy, discovery results not stored");
+		return;
+	}
+
+	err = cache_key_get(dm, store_key);
+	if (err) {
+		atomic_clear(&store_busy);
+		return;
+	}
+
+	size = cache_entry_build(dm, &store_buf);
+	if (size < 0) {
+		LOG_WRN("Cannot cache discovery results, err %d", size);
+		atomic_clear(&store_busy);
+		return;
+	}
+
+	store_size = size;
+	k_work_submit(&store_work);
+}
+
+static u8_t db_hash_read(struct bt_conn *conn, u8_t err,
+			 struct bt_gatt_read_params *params,
+			 const void *data, u16_t length)
+{
+	struct bt_gatt_dm *dm =
+		CONTAINER_OF(params, struct bt_gatt_dm, read_params);
+	bool cached_hash = atomic_test_bit(dm->state_flags,
+					   STATE_CACHE_DB_HASH);
+	bool peer_hash = (!err && data && (length == sizeof(dm->db_hash)));
+	bool valid = false;
+	int ret;
+
+	if (atomic_test_bit(dm->state_flags, STATE_CACHE_HIT)) {
+		if (peer_hash) {
+			valid = cached_hash &&
+				!memcmp(dm->db_hash, data, sizeof(dm->db_hash));
+		} else {
+			/* A peer without the hash must still not have one */
+			valid = !cached_hash &&
+				((err == BT_ATT_ERR_ATTRIBUTE_NOT_FOUND) ||
+				 (!err && !data));
+		}
+	}
+
+	if (valid) {
+		LOG_DBG("Using cached discovery results");
+		discovery_complete(dm);
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (peer_hash) {
+		memcpy(dm->db_hash, data, sizeof(dm->db_hash));
+		atomic_set_bit(dm->state_flags, STATE_CACHE_DB_HASH);
+	} else {
+		atomic_clear_bit(dm->state_flags, STATE_CACHE_DB_HASH);
+	}
+
+	if (atomic_test_bit(dm->state_flags, STATE_CACHE_HIT)) {
+		LOG_DBG("Database changed, discarding cached results");
+		cache_discard(dm);
+	}
+
+	ret = bt_gatt_discover(dm->conn, &dm->discover_params);
+	if (ret) {
+		LOG_ERR("Discover failed, error: %d.", ret);
+		discovery_complete_error(dm, ret);
+	}
+
+	return BT_GATT_ITER_STOP;
+}
+
+static void cache_work_handler(struct k_work *work)
+{
+	struct bt_gatt_dm *dm = CONTAINER_OF(work, struct bt_gatt_dm,
+					     cache_work);
+
+	LOG_DBG("Using cached discovery results");
+	discovery_complete(dm);
+}
+
+/* Returns -ENOENT if the discovery is to be started right away */
+static int cache_lookup(struct bt_gatt_dm *dm)
+{
+	char key[CACHE_KEY_SIZE];
+	int err;
+
+	atomic_clear_bit(dm->state_flags, STATE_CACHE_ACTIVE);
+	atomic_clear_bit(dm->state_flags, STATE_CACHE_HIT);
+	atomic_clear_bit(dm->state_flags, STATE_CACHE_DB_HASH);
+
+	if (!dm->discover_params.uuid || cache_key_get(dm, key)) {
+		return -ENOENT;
+	}
+
+	atomic_set_bit(dm->state_flags, STATE_CACHE_ACTIVE);
+
+	if (!cache_restore(dm, key)) {
+		atomic_set_bit(dm->state_flags, STATE_CACHE_HIT);
+	}
+
+	if (IS_ENABLED(CONFIG_BT_GATT_DM_CACHE_DB_HASH)) {
+		dm->read_params.func = db_hash_read;
+		dm->read_params.handle_count = 0;
+		dm->read_params.by_uuid.start_handle = 0x0001;
+		dm->read_params.by_uuid.end_handle = 0xffff;
+		dm->read_params.by_uuid.uuid = &db_hash_uuid.uuid;
+
+		err = bt_gatt_read(dm->conn, &dm->read_params);
+		if (!err) {
+			return 0;
+		}
+
+		LOG_WRN("Cannot read Database Hash, err %d", err);
+		atomic_clear_bit(dm->state_flags, STATE_CACHE_ACTIVE);
+		cache_discard(dm);
+		return -ENOENT;
+	}
+
+	if (!atomic_test_bit(dm->state_flags, STATE_CACHE_HIT)) {
+		return -ENOENT;
+	}
+
+	/* Report the results from the thread the discovery results are
+	 * usually reported from, not from within bt_gatt_dm_start.
+	 */
+	k_work_init(&dm->cache_work, cache_work_handler);
+	k_work_submit(&dm->cache_work);
+
+	return 0;
+}
+
+/* The entries are not loaded at boot but on request */
+static int cache_set(const char *key, size_t len, settings_read_cb read_cb,
+		     void *cb_arg)
+{
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(bt_gatt_dm, "bt/dm", NULL, cache_set, NULL,
+			       NULL);
+
+/* Finds the first stored service of a peer */
+static int cache_peer_read(const char *key, size_t len,
+			   settings_read_cb read_cb, void *cb_arg,
+			   void *param)
+{
+	char *svc_key = param;
+
+	/* Deleted entries are reported without a value */
+	if (!key || !len || svc_key[0]) {
+		return 0;
+	}
+
+	strncpy(svc_key, key, CACHE_KEY_SIZE - 1);
+
+	return 0;
+}
+
+static int cache_peer_delete(const bt_addr_le_t *addr)
+{
+	char key[CACHE_KEY_SIZE];
+	char svc_key[CACHE_KEY_SIZE];
+	char prev_key[CACHE_KEY_SIZE] = "";
+	int len = cache_peer_key_encode(key, addr);
+	int err;
+
+	/* Entries are deleted one by one, as the settings cannot delete
+	 * a subtree.
+	 */
+	do {
+		memset(svc_key, 0, sizeof(svc_key));
+
+		key[len] = '\0';
+		err = settings_load_subtree_direct(key, cache_peer_read,
+						   svc_key);
+		if (err || !svc_key[0] || !strcmp(svc_key, prev_key)) {
+			break;
+		}
+		strcpy(prev_key, svc_key);
+
+		snprintk(&key[len], sizeof(key) - len, "/%s", svc_key);
+		err = settings_delete(key);
+	} while (!err);
+
+	return err;
+}
+
+int bt_gatt_dm_cache_delete(const bt_addr_le_t *addr,
+			    const struct bt_uuid *svc_uuid)
+{
+	char key[CACHE_KEY_SIZE];
+	int err;
+
+	if (!addr) {
+		return -EINVAL;
+	}
+
+	if (!svc_uuid) {
+		return cache_peer_delete(addr);
+	}
+
+	err = cache_key_encode(key, addr, svc_uuid);
+	if (err) {
+		return err;
+	}
+
+	return settings_delete(key);
+}
+
+#else
+
+static int cache_lookup(struct bt_gatt_dm *dm)
+{
+	return -ENOENT;
+}
+
+static void cache_store(struct bt_gatt_dm *dm)
+{
+}
+
+#endif /* CONFIG_BT_GATT_DM_CACHE */
+
 static void discovery_complete(struct bt_gatt_dm *dm)
 {
 	LOG_DBG("Discovery complete.");
+	cache_store(dm);
 	atomic_set_bit(dm->state_flags, STATE_ATTRS_RELEASE_PENDING);
 	if (dm->callback->completed) {
 		dm->callback->completed(dm, dm->context);
@@ -412,24 +950,23 @@ static u8_t discovery_callback(struct bt_conn *conn,
 		LOG_DBG("Attr: handle %u", attr->handle);
 	}
 
-	if (conn != bt_gatt_dm_inst.conn) {
+	struct bt_gatt_dm *dm =
+		CONTAINER_OF(params, struct bt_gatt_dm, discover_params);
+
+	if (conn != dm->conn) {
 		LOG_ERR("Unexpected conn object. Aborting.");
-		discovery_complete_error(&bt_gatt_dm_inst, -EFAULT);
+		discovery_complete_error(dm, -EFAULT);
 		return BT_GATT_ITER_STOP;
 	}
 
 	switch (params->type) {
 	case BT_GATT_DISCOVER_PRIMARY:
 	case BT_GATT_DISCOVER_SECONDARY:
-		return discovery_process_service(&bt_gatt_dm_inst,
-						 attr, params);
+		return discovery_process_service(dm, attr, params);
 	case BT_GATT_DISCOVER_ATTRIBUTE:
-		return discovery_process_attribute(&bt_gatt_dm_inst,
-						   attr, params);
+		return discovery_process_attribute(dm, attr, params);
 	case BT_GATT_DISCOVER_CHARACTERISTIC:
-		return discovery_process_characteristic(&bt_gatt_dm_inst,
-							attr,
-							params);
+		return discovery_process_characteristic(dm, attr, params);
 	default:
 		/* This should not be possible */
 		__ASSERT(false, "Unknown param type.");
@@ -568,6 +1105,40 @@ const struct bt_gatt_dm_attr *bt_gatt_dm_desc_next(
 	return curr;
 }
 
+/* Claims a free instance, unless a discovery is already running on conn */
+static struct bt_gatt_dm *instance_claim(struct bt_conn *conn)
+{
+	struct bt_gatt_dm *dm = NULL;
+
+	k_mutex_lock(&inst_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(bt_gatt_dm_inst); i++) {
+		struct bt_gatt_dm *cur = &bt_gatt_dm_inst[i];
+
+		if (!atomic_test_bit(cur->state_flags, STATE_ATTRS_LOCKED)) {
+			if (!dm) {
+				dm = cur;
+			}
+		} else if (cur->conn == conn) {
+			LOG_DBG("Discovery already running on this connection");
+			dm = NULL;
+			break;
+		}
+	}
+
+	if (dm) {
+		/* Instances are only claimed under the lock, so the
+		 * free instance found above is still free.
+		 */
+		atomic_set_bit(dm->state_flags, STATE_ATTRS_LOCKED);
+		dm->conn = conn;
+	}
+
+	k_mutex_unlock(&inst_lock);
+
+	return dm;
+}
+
 int bt_gatt_dm_start(struct bt_conn *conn,
 		     const struct bt_uuid *svc_uuid,
 		     const struct bt_gatt_dm_cb *cb,
@@ -586,18 +1157,15 @@ int bt_gatt_dm_start(struct bt_conn *conn,
 		return -EINVAL;
 	}
 
-	dm = &bt_gatt_dm_inst;
-
-	if (atomic_test_and_set_bit(dm->state_flags, STATE_ATTRS_LOCKED)) {
+	dm = instance_claim(conn);
+	if (!dm) {
 		return -EALREADY;
 	}
 
-	dm->conn = conn;
 	dm->context = context;
 	dm->callback = cb;
 	dm->cur_attr_id = 0;
-	sys_slist_init(&dm->chunk_list);
-	dm->cur_chunk_len = 0;
+	dm->data_len = 0;
 
 	dm->discover_params.uuid = svc_uuid ? uuid_store(dm, svc_uuid) : NULL;
 	dm->discover_params.func = discovery_callback;
@@ -605,7 +1173,11 @@ int bt_gatt_dm_start(struct bt_conn *conn,
 	dm->discover_params.end_handle = 0xffff;
 	dm->discover_params.type = BT_GATT_DISCOVER_PRIMARY;
 
-	err = bt_gatt_discover(conn, &dm->discover_params);
+	err = cache_lookup(dm);
+	if (err == -ENOENT) {
+		err = bt_gatt_discover(conn, &dm->discover_params);
+	}
+
 	if (err) {
 		LOG_ERR("Discover failed, error: %d.", err);
 		atomic_clear_bit(dm->state_flags, STATE_ATTRS_LOCKED);
@@ -617,6 +1189,7 @@ int bt_gatt_dm_start(struct bt_conn *conn,
 int bt_gatt_dm_continue(struct bt_gatt_dm *dm, void *context)
 {
 	int err;
+	bool busy;
 
 	if ((!dm) ||
 	    (!dm->callback) ||
@@ -631,7 +1204,11 @@ int bt_gatt_dm_continue(struct bt_gatt_dm *dm, void *context)
 		return -EINVAL;
 	}
 
-	if (atomic_test_and_set_bit(dm->state_flags, STATE_ATTRS_LOCKED)) {
+	k_mutex_lock(&inst_lock, K_FOREVER);
+	busy = atomic_test_and_set_bit(dm->state_flags, STATE_ATTRS_LOCKED);
+	k_mutex_unlock(&inst_lock);
+
+	if (busy) {
 		return -EALREADY;
 	}
 
@@ -11,229 +11,286 @@
 LOG_MODULE_REGISTER(bt_gatt_pool, CONFIG_BT_GATT_POOL_LOG_LEVEL);
 
 
+#define MASK_WORD_BITS 32
+#define MASK_WORDS(el_cnt) ceiling_fraction(el_cnt, MASK_WORD_BITS)
+
+/* Elements are taken from the lowest free bit of the mask. UUIDs are
+ * deduplicated: attributes with the same UUID share one element, which is
+ * released with the last reference.
+ */
 struct svc_el_pool {
-	void *elements;
-	atomic_t *locks;
+	u8_t *elements;
+	u32_t *mask;
+	u16_t *refs;
+	size_t el_size;
+	size_t el_cnt;
+	size_t used_cnt;
+	size_t max_used_cnt;
+	const char *name;
 };
 
 #if CONFIG_BT_GATT_UUID16_POOL_SIZE != 0
 static struct bt_uuid_16 uuid_16_tab[CONFIG_BT_GATT_UUID16_POOL_SIZE];
-static ATOMIC_DEFINE(uuid_16_locks, ARRAY_SIZE(uuid_16_tab));
+static u32_t uuid_16_mask[MASK_WORDS(ARRAY_SIZE(uuid_16_tab))];
+static u16_t uuid_16_refs[ARRAY_SIZE(uuid_16_tab)];
 #define BT_UUID_16_TAB uuid_16_tab
-#define BT_UUID_16_LOCKS uuid_16_locks
+#define BT_UUID_16_MASK uuid_16_mask
+#define BT_UUID_16_REFS uuid_16_refs
 #else
 #define BT_UUID_16_TAB NULL
-#define BT_UUID_16_LOCKS NULL
+#define BT_UUID_16_MASK NULL
+#define BT_UUID_16_REFS NULL
 #endif
 
 #if CONFIG_BT_GATT_UUID32_POOL_SIZE != 0
 static struct bt_uuid_32 uuid_32_tab[CONFIG_BT_GATT_UUID32_POOL_SIZE];
-static ATOMIC_DEFINE(uuid_32_locks, ARRAY_SIZE(uuid_32_tab));
+static u32_t uuid_32_mask[MASK_WORDS(ARRAY_SIZE(uuid_32_tab))];
+static u16_t uuid_32_refs[ARRAY_SIZE(uuid_32_tab)];
 #define BT_UUID_32_TAB uuid_32_tab
-#define BT_UUID_32_LOCKS uuid_32_locks
+#define BT_UUID_32_MASK uuid_32_mask
+#define BT_UUID_32_REFS uuid_32_refs
 #else
 #define BT_UUID_32_TAB NULL
-#define BT_UUID_32_LOCKS NULL
+#define BT_UUID_32_MASK NULL
+#define BT_UUID_32_REFS NULL
 #endif
 
 #if CONFIG_BT_GATT_UUID128_POOL_SIZE != 0
 static struct bt_uuid_128 uuid_128_tab[CONFIG_BT_GATT_UUID128_POOL_SIZE];
-static ATOMIC_DEFINE(uuid_128_locks, ARRAY_SIZE(uuid_128_tab));
+static u32_t uuid_128_mask[MASK_WORDS(ARRAY_SIZE(uuid_128_tab))];
+static u16_t uuid_128_refs[ARRAY_SIZE(uuid_128_tab)];
 #define BT_UUID_128_TAB uuid_128_tab
-#define BT_UUID_128_LOCKS uuid_128_locks
+#define BT_UUID_128_MASK uuid_128_mask
+#define BT_UUID_128_REFS uuid_128_refs
 #else
 #define BT_UUID_128_TAB NULL
-#define BT_UUID_128_LOCKS NULL
+#define BT_UUID_128_MASK NULL
+#define BT_UUID_128_REFS NULL
 #endif
 
 #if CONFIG_BT_GATT_CHRC_POOL_SIZE != 0
 static struct bt_gatt_chrc chrc_tab[CONFIG_BT_GATT_CHRC_POOL_SIZE];
-static ATOMIC_DEFINE(chrc_locks, ARRAY_SIZE(chrc_tab));
+static u32_t chrc_mask[MASK_WORDS(ARRAY_SIZE(chrc_tab))];
 #define BT_GATT_CHRC_TAB chrc_tab
-#define BT_GATT_CHRC_LOCKS chrc_locks
+#define BT_GATT_CHRC_MASK chrc_mask
 #else
 #define BT_GATT_CHRC_TAB NULL
-#define BT_GATT_CHRC_LOCKS NULL
+#define BT_GATT_CHRC_MASK NULL
 #endif
 
 static struct svc_el_pool uuid_16_pool = {
-	.elements = BT_UUID_16_TAB,
-	.locks = BT_UUID_16_LOCKS,
+	.elements = (u8_t *)BT_UUID_16_TAB,
+	.mask = BT_UUID_16_MASK,
+	.refs = BT_UUID_16_REFS,
+	.el_size = sizeof(struct bt_uuid_16),
+	.el_cnt = CONFIG_BT_GATT_UUID16_POOL_SIZE,
+	.name = "UUID16s",
 };
 static struct svc_el_pool uuid_32_pool = {
-	.elements = BT_UUID_32_TAB,
-	.locks = BT_UUID_32_LOCKS,
+	.elements = (u8_t *)BT_UUID_32_TAB,
+	.mask = BT_UUID_32_MASK,
+	.refs = BT_UUID_32_REFS,
+	.el_size = sizeof(struct bt_uuid_32),
+	.el_cnt = CONFIG_BT_GATT_UUID32_POOL_SIZE,
+	.name = "UUID32s",
 };
 static struct svc_el_pool uuid_128_pool = {
-	.elements = BT_UUID_128_TAB,
-	.locks = BT_UUID_128_LOCKS,
+	.elements = (u8_t *)BT_UUID_128_TAB,
+	.mask = BT_UUID_128_MASK,
+	.refs = BT_UUID_128_REFS,
+	.el_size = sizeof(struct bt_uuid_128),
+	.el_cnt = CONFIG_BT_GATT_UUID128_POOL_SIZE,
+	.name = "UUID128s",
 };
 static struct svc_el_pool chrc_pool = {
-	.elements = BT_GATT_CHRC_TAB,
-	.locks = BT_GATT_CHRC_LOCKS,
+	.elements = (u8_t *)BT_GATT_CHRC_TAB,
+	.mask = BT_GATT_CHRC_MASK,
+	.el_size = sizeof(struct bt_gatt_chrc),
+	.el_cnt = CONFIG_BT_GATT_CHRC_POOL_SIZE,
+	.name = "chrc descriptors",
 };
 
+static struct k_spinlock pool_lock;
+
 static struct bt_uuid const * const uuid_primary = BT_UUID_GATT_PRIMARY;
 static struct bt_uuid const * const uuid_chrc = BT_UUID_GATT_CHRC;
 static struct bt_uuid const * const uuid_ccc = BT_UUID_GATT_CCC;
 
-#define EL_IN_POOL_VERIFY(pool, el)                                            \
-	do {                                                                   \
-		__ASSERT(pool != NULL, "Pool is uninitialized");               \
-		__ASSERT(((u32_t)el >= (u32_t)pool) &&                         \
-			     (((u32_t)el) < (((u32_t)pool) + sizeof(pool))),   \
-			 "Element does not belong to the pool");               \
-	} while ((0))
+static size_t el_index(struct svc_el_pool *el_pool, void const *el)
+{
+	size_t ind = ((u8_t const *)el - el_pool->elements) /
+		     el_pool->el_size;
+
+	__ASSERT((el_pool->elements != NULL) &&
+		 ((u8_t const *)el >= el_pool->elements) &&
+		 (ind < el_pool->el_cnt),
+		 "Element does not belong to the pool");
+
+	return ind;
+}
 
-#define ADDR_2_INDEX(pool, el)                                                 \
-	((((u32_t)el) - ((u32_t)pool)) / (sizeof(pool[0])))
+static void *el_get(struct svc_el_pool *el_pool, size_t ind)
+{
+	return &el_pool->elements[ind * el_pool->el_size];
+}
 
-static size_t free_element_find(struct svc_el_pool *el_pool, size_t el_cnt)
+/* Must be called with pool_lock held. */
+static void *el_alloc(struct svc_el_pool *el_pool)
 {
-	__ASSERT((el_pool->elements != NULL) && (el_pool->locks != NULL),
-		 "Pool uninitialized");
+	for (size_t i = 0; i < MASK_WORDS(el_pool->el_cnt); i++) {
+		u32_t free_mask = ~el_pool->mask[i];
+		size_t ind;
 
-	for (size_t i = 0; i < el_cnt; i++) {
-		if (!atomic_test_and_set_bit(el_pool->locks, i)) {
-			return i;
+		if (!free_mask) {
+			continue;
 		}
+
+		ind = i * MASK_WORD_BITS + __builtin_ctz(free_mask);
+		if (ind >= el_pool->el_cnt) {
+			break;
+		}
+
+		el_pool->mask[i] |= BIT(ind % MASK_WORD_BITS);
+		el_pool->used_cnt++;
+		el_pool->max_used_cnt = MAX(el_pool->max_used_cnt,
+					    el_pool->used_cnt);
+
+		return el_get(el_pool, ind);
 	}
-	return el_cnt;
+
+	LOG_ERR("No more %s in the pool!", el_pool->name);
+	return NULL;
 }
 
-static int uuid_16_get(struct bt_uuid **uuid, struct svc_el_pool *uuid_pool)
+/* Must be called with pool_lock held. */
+static void el_free(struct svc_el_pool *el_pool, void const *el)
 {
-	size_t ind = free_element_find(uuid_pool,
-				       CONFIG_BT_GATT_UUID16_POOL_SIZE);
+	size_t ind = el_index(el_pool, el);
+	u32_t bit = BIT(ind % MASK_WORD_BITS);
 
-	if (ind >= CONFIG_BT_GATT_UUID16_POOL_SIZE) {
-		LOG_ERR("No more UUID16s in the pool!");
-		return -ENOMEM;
-	}
+	__ASSERT(el_pool->mask[ind / MASK_WORD_BITS] & bit,
+		 "Element is not allocated");
 
-	*uuid = (struct bt_uuid *)
-		&((struct bt_uuid_16 *) uuid_pool->elements)[ind];
-	return 0;
+	el_pool->mask[ind / MASK_WORD_BITS] &= ~bit;
+	el_pool->used_cnt--;
 }
 
-static int uuid_32_get(struct bt_uuid **uuid, struct svc_el_pool *uuid_pool)
+static struct svc_el_pool *uuid_pool_get(u8_t type)
 {
-	size_t ind = free_element_find(uuid_pool,
-				       CONFIG_BT_GATT_UUID32_POOL_SIZE);
-
-	if (ind >= CONFIG_BT_GATT_UUID32_POOL_SIZE) {
-		LOG_ERR("No more UUID32s in the pool!");
-		return -ENOMEM;
+	switch (type) {
+	case BT_UUID_TYPE_16:
+		return &uuid_16_pool;
+	case BT_UUID_TYPE_32:
+		return &uuid_32_pool;
+	case BT_UUID_TYPE_128:
+		return &uuid_128_pool;
+	default:
+		return NULL;
 	}
-
-	*uuid = (struct bt_uuid *)
-		&((struct bt_uuid_32 *) uuid_pool->elements)[ind];
-	return 0;
 }
 
-static int uuid_128_get(struct bt_uuid **uuid, struct svc_el_pool *uuid_pool)
+/* Must be called with pool_lock held. */
+static struct bt_uuid *uuid_find(struct svc_el_pool *uuid_pool,
+				 struct bt_uuid const *uuid)
 {
-	size_t ind = free_element_find(uuid_pool,
-				       CONFIG_BT_GATT_UUID128_POOL_SIZE);
+	for (size_t i = 0; i < MASK_WORDS(uuid_pool->el_cnt); i++) {
+		u32_t used_mask = uuid_pool->mask[i];
 
-	if (ind >= CONFIG_BT_GATT_UUID128_POOL_SIZE) {
-		LOG_ERR("No more UUID128s in the pool!");
-		return -ENOMEM;
+		while (used_mask) {
+			size_t ind = i * MASK_WORD_BITS +
+				     __builtin_ctz(used_mask);
+			struct bt_uuid *el = el_get(uuid_pool, ind);
+
+			if (!bt_uuid_cmp(el, uuid)) {
+				return el;
+			}
+
+			used_mask &= used_mask - 1;
+		}
 	}
 
-	*uuid = (struct bt_uuid *)
-		&((struct bt_uuid_128 *) uuid_pool->elements)[ind];
-	return 0;
+	return NULL;
 }
 
 static int chrc_get(struct bt_gatt_chrc **chrc)
 {
-	size_t ind = free_element_find(&chrc_pool,
-				       CONFIG_BT_GATT_CHRC_POOL_SIZE);
+	k_spinlock_key_t key = k_spin_lock(&pool_lock);
 
-	if (ind >= CONFIG_BT_GATT_CHRC_POOL_SIZE) {
-		LOG_ERR("No more chrc descriptors in the pool!");
-		return -ENOMEM;
-	}
+	*chrc = el_alloc(&chrc_pool);
 
-	*chrc = &((struct bt_gatt_chrc *) chrc_pool.elements)[ind];
-	return 0;
+	k_spin_unlock(&pool_lock, key);
+
+	return *chrc ? 0 : -ENOMEM;
 }
 
 static void chrc_release(struct bt_gatt_chrc const *chrc)
 {
-	EL_IN_POOL_VERIFY(BT_GATT_CHRC_TAB, chrc);
-	atomic_clear_bit(chrc_pool.locks,
-			 ADDR_2_INDEX(BT_GATT_CHRC_TAB, chrc));
+	k_spinlock_key_t key = k_spin_lock(&pool_lock);
+
+	el_free(&chrc_pool, chrc);
+
+	k_spin_unlock(&pool_lock, key);
 }
 
 static int uuid_register(struct bt_uuid **dest_uuid,
 			 struct bt_uuid const *src_uuid)
 {
-	int ret = -EINVAL;
+	struct svc_el_pool *uuid_pool = uuid_pool_get(src_uuid->type);
+	struct bt_uuid *uuid;
+	k_spinlock_key_t key;
 
 	__ASSERT(*dest_uuid == NULL, "Overriding attribute UUID!");
 
-	switch (src_uuid->type) {
-	case BT_UUID_TYPE_16:
-		ret = uuid_16_get(dest_uuid, &uuid_16_pool);
-		if (!ret) {
-			memcpy(*dest_uuid, src_uuid, sizeof(struct bt_uuid_16));
-		}
-		break;
+	if (!uuid_pool) {
+		LOG_ERR("Unknown UUID type");
+		return -EINVAL;
+	}
 
-	case BT_UUID_TYPE_32:
-		ret = uuid_32_get(dest_uuid, &uuid_32_pool);
-		if (!ret) {
-			memcpy(*dest_uuid, src_uuid, sizeof(struct bt_uuid_32));
-		}
-		break;
+	key = k_spin_lock(&pool_lock);
 
-	case BT_UUID_TYPE_128:
-		ret = uuid_128_get(dest_uuid, &uuid_128_pool);
-		if (!ret) {
-			memcpy(*dest_uuid, src_uuid,
-			       sizeof(struct bt_uuid_128));
+	uuid = uuid_find(uuid_pool, src_uuid);
+	if (!uuid) {
+		uuid = el_alloc(uuid_pool);
+		if (uuid) {
+			memcpy(uuid, src_uuid, uuid_pool->el_size);
 		}
-		break;
+	}
 
-	default:
-		LOG_ERR("Unknown UUID type");
-		break;
+	if (uuid) {
+		uuid_pool->refs[el_index(uuid_pool, uuid)]++;
+	}
+
+	k_spin_unlock(&pool_lock, key);
+
+	if (!uuid) {
+		return -ENOMEM;
 	}
-	return ret;
+
+	*dest_uuid = uuid;
+	return 0;
 }
 
 static void uuid_unregister(struct bt_uuid const *uuid)
 {
-	switch (uuid->type) {
-	case BT_UUID_TYPE_16:
-		EL_IN_POOL_VERIFY(BT_UUID_16_TAB, uuid);
-#if CONFIG_BT_GATT_UUID16_POOL_SIZE != 0
-		atomic_clear_bit(uuid_16_pool.locks,
-				 ADDR_2_INDEX(BT_UUID_16_TAB, uuid));
-#endif
-		break;
+	struct svc_el_pool *uuid_pool = uuid_pool_get(uuid->type);
+	k_spinlock_key_t key;
+	size_t ind;
 
-	case BT_UUID_TYPE_32:
-		EL_IN_POOL_VERIFY(BT_UUID_32_TAB, uuid);
-#if CONFIG_BT_GATT_UUID32_POOL_SIZE != 0
-		atomic_clear_bit(uuid_32_pool.locks,
-				 ADDR_2_INDEX(BT_UUID_32_TAB, uuid));
-#endif
-		break;
+	if (!uuid_pool) {
+		__ASSERT(false, "Unknown UUID type");
+		return;
+	}
 
-	case BT_UUID_TYPE_128:
-		EL_IN_POOL_VERIFY(BT_UUID_128_TAB, uuid);
-#if CONFIG_BT_GATT_UUID128_POOL_SIZE != 0
-		atomic_clear_bit(uuid_128_pool.locks,
-				 ADDR_2_INDEX(BT_UUID_128_TAB, uuid));
-#endif
-		break;
+	key = k_spin_lock(&pool_lock);
 
-	default:
-		__ASSERT(false, "Unknown UUID type");
+	ind = el_index(uuid_pool, uuid);
+	__ASSERT(uuid_pool->refs[ind] > 0, "UUID is not registered");
+
+	if (--uuid_pool->refs[ind] == 0) {
+		el_free(uuid_pool, uuid);
 	}
+
+	k_spin_unlock(&pool_lock, key);
 }
 
 /** @brief Free a single attribute.
@@ -420,61 +477,53 @@ void bt_gatt_pool_free(struct bt_gatt_pool *gp)
 
 
 #if CONFIG_BT_GATT_POOL_STATS != 0
-static size_t mask_print(atomic_t *mask, size_t mask_size)
+static void pool_usage_get(struct svc_el_pool *el_pool,
+			   struct bt_gatt_pool_usage *usage)
 {
-	size_t used_el_cnt = 0;
+	k_spinlock_key_t key = k_spin_lock(&pool_lock);
 
-	for (size_t i = 0; i < mask_size; i++) {
-		u32_t state_part = mask[mask_size - i - 1];
+	usage->size = el_pool->el_cnt;
+	usage->used = el_pool->used_cnt;
+	usage->max_used = el_pool->max_used_cnt;
 
-		printk("%08X", state_part);
-		used_el_cnt += popcount(state_part);
-	}
-	return used_el_cnt;
+	k_spin_unlock(&pool_lock, key);
 }
 
-void bt_gatt_pool_stats_print(void)
+void bt_gatt_pool_stats_get(struct bt_gatt_pool_stats *stats)
 {
-	size_t used_el_cnt;
-
-#if CONFIG_BT_GATT_UUID16_POOL_SIZE != 0
-	printk("UUID 16 Pool. Locked elements mask:\n");
-
-	used_el_cnt = mask_print(BT_UUID_16_LOCKS,
-				 ARRAY_SIZE(BT_UUID_16_LOCKS));
+	__ASSERT_NO_MSG(stats != NULL);
 
-	printk("\nPool element usage: %d out of %d\n\n", used_el_cnt,
-	       CONFIG_BT_GATT_UUID16_POOL_SIZE);
-#endif
-
-#if CONFIG_BT_GATT_UUID32_POOL_SIZE != 0
-	printk("UUID 32 Pool. Locked elements mask:\n");
-
-	used_el_cnt = mask_print(BT_UUID_32_LOCKS,
-				 ARRAY_SIZE(BT_UUID_32_LOCKS));
+	pool_usage_get(&uuid_16_pool, &stats->uuid_16);
+	pool_usage_get(&uuid_32_pool, &stats->uuid_32);
+	pool_usage_get(&uuid_128_pool, &stats->uuid_128);
+	pool_usage_get(&chrc_pool, &stats->chrc);
+}
 
-	printk("\nPool element usage: %d out of %d\n\n", used_el_cnt,
-	       CONFIG_BT_GATT_UUID32_POOL_SIZE);
-#endif
+static void pool_print(const char *title, struct svc_el_pool *el_pool)
+{
+	struct bt_gatt_pool_usage usage;
 
-#if CONFIG_BT_GATT_UUID128_POOL_SIZE != 0
-	printk("UUID 128 Pool. Locked elements mask:\n");
+	if (el_pool->el_cnt == 0) {
+		return;
+	}
 
-	used_el_cnt = mask_print(BT_UUID_128_LOCKS,
-				 ARRAY_SIZE(BT_UUID_128_LOCKS));
+	printk("%s. Locked elements mask:\n", title);
 
-	printk("\nPool element usage: %d out of %d\n\n", used_el_cnt,
-	       CONFIG_BT_GATT_UUID128_POOL_SIZE);
-#endif
+	for (size_t i = MASK_WORDS(el_pool->el_cnt); i > 0; i--) {
+		printk("%08X", el_pool->mask[i - 1]);
+	}
 
-#if CONFIG_BT_GATT_CHRC_POOL_SIZE != 0
-	printk("Characteristic Pool. Locked elements mask:\n");
+	pool_usage_get(el_pool, &usage);
 
-	used_el_cnt = mask_print(BT_GATT_CHRC_LOCKS,
-				 ARRAY_SIZE(BT_GATT_CHRC_LOCKS));
+	printk("\nPool element usage: %d out of %d, maximum %d\n\n",
+	       usage.used, usage.size, usage.max_used);
+}
 
-	printk("\nPool element usage: %d out of %d\n\n", used_el_cnt,
-	       CONFIG_BT_GATT_CHRC_POOL_SIZE);
-#endif
+void bt_gatt_pool_stats_print(void)
+{
+	pool_print("UUID 16 Pool", &uuid_16_pool);
+	pool_print("UUID 32 Pool", &uuid_32_pool);
+	pool_print("UUID 128 Pool", &uuid_128_pool);
+	pool_print("Characteristic Pool", &chrc_pool);
 }
 #endif /* CONFIG_BT_GATT_POOL_STATS */
@@ -18,7 +18,25 @@ LOG_MODULE_REGISTER(nrf_bt_scan, CONFIG_BT_SCAN_LOG_LEVEL);
 	BT_SCAN_SHORT_NAME_FILTER | BT_SCAN_APPEARANCE_FILTER | \
 	BT_SCAN_UUID_FILTER | BT_SCAN_MANUFACTURER_DATA_FILTER)
 
-/* Scan filter add mutex. */
+/* Filters are allocated in blocks of 16, 64 or 256 bytes. */
+#define FILTER_POOL_BLOCK_MIN 16
+#define FILTER_POOL_BLOCK_MAX 256
+
+/* Length of the Company Identifier in the manufacturer data. */
+#define COMPANY_ID_LEN 2
+
+BUILD_ASSERT((CONFIG_BT_SCAN_FILTER_HASH_SIZE &
+	      (CONFIG_BT_SCAN_FILTER_HASH_SIZE - 1)) == 0,
+	     "The number of hash buckets must be a power of two");
+
+#if CONFIG_BT_SCAN_FILTER_ENABLE
+K_MEM_POOL_DEFINE(filter_pool, FILTER_POOL_BLOCK_MIN, FILTER_POOL_BLOCK_MAX,
+		  CONFIG_BT_SCAN_FILTER_POOL_SIZE / FILTER_POOL_BLOCK_MAX, 4);
+#endif
+
+/* Scan filter mutex. Protects the filters while they are modified
+ * and while an advertising report is matched against them.
+ */
 K_MUTEX_DEFINE(scan_add_mutex);
 
 /* Scanning control structure used to
@@ -40,6 +58,9 @@ struct bt_scan_control {
 	/* Inform that device is connectable. */
 	bool connectable;
 
+	/* Number of distinct UUID filters found in the advertising data. */
+	u16_t uuid_match_cnt;
+
 	/* Data needed to establish connection and advertising information. */
 	struct bt_scan_device_info device_info;
 
@@ -47,55 +68,81 @@ struct bt_scan_control {
 	struct bt_scan_filter_match filter_status;
 };
 
-/* Name filter structure.
+/* Hash set of filters of one type. Every filter entry starts with
+ * a sys_snode_t and is linked into the bucket selected by the hash
+ * of its key.
  */
-struct bt_scan_name_filter {
-	/* Names that the main application will scan for,
-	 * and that will be advertised by the peripherals.
-	 */
-	char target_name[CONFIG_BT_SCAN_NAME_CNT][CONFIG_BT_SCAN_NAME_MAX_LEN];
+struct bt_scan_filter_set {
+	sys_slist_t bucket[CONFIG_BT_SCAN_FILTER_HASH_SIZE];
 
-	/* Name filter counter. */
-	u8_t cnt;
+	/* Number of filters in the set. */
+	u16_t cnt;
 
-	/* Flag to inform about enabling or disabling this filter.
-	 */
+	/* Flag to inform about enabling or disabling this filter. */
 	bool enabled;
 };
 
-/* Short names filter structure.
+/* Name or short name filter entry. */
+struct bt_scan_name_entry {
+	sys_snode_t node;
+
+	/* Minimum length of the short name, 0 for the name filter. */
+	u8_t min_len;
+
+	/* Name that the main application will scan for. */
+	char name[];
+};
+
+/* Node of the name prefix trie. The edge leading to the node is labeled
+ * with one or more characters, so that the trie only has a node where
+ * two names diverge.
  */
-struct bt_scan_short_name_filter {
-	struct {
-		/* Short names that the main application will scan for,
-		 * and that will be advertised by the peripherals.
-		 */
-		char target_name[CONFIG_BT_SCAN_SHORT_NAME_MAX_LEN];
+struct bt_scan_name_trie_node {
+	/* First child, children are linked through the sibling pointer. */
+	struct bt_scan_name_trie_node *child;
 
-		/* Minimum length of the short name. */
-		u8_t min_len;
-	} name[CONFIG_BT_SCAN_SHORT_NAME_CNT];
+	/* Next node with the same parent. */
+	struct bt_scan_name_trie_node *sibling;
 
-	/* Short name filter counter. */
-	u8_t cnt;
+	/* Name with the lowest minimum length among the names that
+	 * start with the characters leading to this node.
+	 */
+	const struct bt_scan_name_entry *best;
 
-	/* Flag to inform about enabling or disabling this filter. */
-	bool enabled;
+	/* Length of the edge label. */
+	u8_t label_len;
+
+	/* Edge label. */
+	char label[];
 };
 
-/* BLE Addresses filter structure.
+/* Name and short name filter structure.
  */
-struct bt_scan_addr_filter {
-	/* Addresses advertised by the peripherals. */
-	bt_addr_le_t target_addr[CONFIG_BT_SCAN_ADDRESS_CNT];
+struct bt_scan_name_filter {
+	/* Added names, used to release them and to find duplicates. */
+	sys_slist_t names;
+
+	/* First level of the prefix trie built from the names. */
+	struct bt_scan_name_trie_node *trie;
+
+	/* Name with the lowest minimum length among all names. */
+	const struct bt_scan_name_entry *best;
 
-	/* Address filter counter. */
-	u8_t cnt;
+	/* Name filter counter. */
+	u16_t cnt;
 
 	/* Flag to inform about enabling or disabling this filter. */
 	bool enabled;
 };
 
+/* Address filter entry. */
+struct bt_scan_addr_entry {
+	sys_snode_t node;
+
+	/* Address advertised by the peripherals. */
+	bt_addr_le_t addr;
+};
+
 /* Structure for storing different types of UUIDs */
 struct bt_scan_uuid {
 	/* Pointer to the appropriate type of UUID. **/
@@ -112,54 +159,53 @@ struct bt_scan_uuid {
 	} uuid_data;
 };
 
-/* UUIDs filter structure.
- */
-struct bt_scan_uuid_filter {
-	/* UUIDs that the main application will scan for,
-	 * and that will be advertised by the peripherals.
+/* UUID filter entry. */
+struct bt_scan_uuid_entry {
+	sys_snode_t node;
+
+	/* Report in which the UUID was last found, used to count
+	 * every filter once even if the UUID is advertised several times.
 	 */
-	struct bt_scan_uuid uuid[CONFIG_BT_SCAN_UUID_CNT];
+	u32_t match_gen;
 
-	/* UUID filter counter. */
-	u8_t cnt;
+	/* UUID in the 128-bit little-endian form. */
+	u8_t key[BT_SCAN_UUID_128_SIZE];
 
-	/* Flag to inform about enabling or disabling this filter. */
-	bool enabled;
+	/* UUID that the main application will scan for. */
+	struct bt_scan_uuid uuid;
 };
 
-struct bt_scan_appearance_filter {
-	/* Apperances that the main application will scan for,
-	 * and that will be advertised by the peripherals.
-	 */
-	u16_t appearance[CONFIG_BT_SCAN_APPEARANCE_CNT];
+/* Appearance filter entry. */
+struct bt_scan_appearance_entry {
+	sys_snode_t node;
 
-	/* Appearance filter counter. */
-	u8_t cnt;
+	/* Appearance that the main application will scan for. */
+	u16_t appearance;
+};
 
-	/* Flag to inform about enabling or disabling this filter. */
-	bool enabled;
+/* Manufacturer data filter entry. */
+struct bt_scan_manufacturer_data_entry {
+	sys_snode_t node;
+
+	/* Length of the manufacturer data that the main application
+	 * will scan for.
+	 */
+	u8_t data_len;
+
+	/* Masked manufacturer data followed by the mask. */
+	u8_t data[];
 };
 
-/* Manufacturer data filter structure.
+/* Manufacturer data filter structure. Filters that compare the whole
+ * Company Identifier are hashed by it, the others are kept in a list
+ * checked against every report.
  */
 struct bt_scan_manufacturer_data_filter {
-	struct {
-		/* Manufacturer data that the main application will scan for,
-		 * and that will be advertised by the peripherals.
-		 */
-		u8_t data[CONFIG_BT_SCAN_MANUFACTURER_DATA_MAX_LEN];
+	/* Filters hashed by the Company Identifier. */
+	struct bt_scan_filter_set set;
 
-		/* Length of the manufacturere data that the main application
-		 * will scan for.
-		 */
-		u8_t data_len;
-	} manufacturer_data[CONFIG_BT_SCAN_MANUFACTURER_DATA_CNT];
-
-	/* Name filter counter. */
-	u8_t cnt;
-
-	/* Flag to inform about enabling or disabling this filter. */
-	bool enabled;
+	/* Filters that do not compare the whole Company Identifier. */
+	sys_slist_t unkeyed;
 };
 
 /* Filters data.
@@ -176,16 +222,16 @@ struct bt_scan_filters {
 	struct bt_scan_name_filter name;
 
 	/* Short name filter data. */
-	struct bt_scan_short_name_filter short_name;
+	struct bt_scan_name_filter short_name;
 
 	/* Address filter data. */
-	struct bt_scan_addr_filter addr;
+	struct bt_scan_filter_set addr;
 
 	/* UUID filter data. */
-	struct bt_scan_uuid_filter uuid;
+	struct bt_scan_filter_set uuid;
 
 	/* Appearance filter data. */
-	struct bt_scan_appearance_filter appearance;
+	struct bt_scan_filter_set appearance;
 
 	/* Manufacturer data filter data. */
 	struct bt_scan_manufacturer_data_filter manufacturer_data;
@@ -220,9 +266,16 @@ static struct bt_scan {
 	 */
 	struct bt_le_conn_param conn_param;
 
-
+	/* Number of the advertising report being matched. */
+	u32_t report_gen;
 } bt_scan;
 
+/* Bluetooth Base UUID in the little-endian form. */
+static const u8_t uuid_base[BT_SCAN_UUID_128_SIZE] = {
+	0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+	0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
 static sys_slist_t callback_list;
 
 void bt_scan_cb_register(struct bt_scan_cb *cb)
@@ -316,22 +369,73 @@ static void scan_connect_with_target(struct bt_scan_control *control,
 	}
 }
 
-static bool adv_addr_compare(const bt_addr_le_t *target_addr,
-			     struct bt_scan_control *control)
+static void *filter_alloc(size_t size)
+{
+#if CONFIG_BT_SCAN_FILTER_ENABLE
+	void *filter = k_mem_pool_malloc(&filter_pool, size);
+
+	if (filter) {
+		memset(filter, 0, size);
+	}
+
+	return filter;
+#else
+	return NULL;
+#endif
+}
+
+/* FNV-1a hash of the filter key. */
+static u32_t filter_hash(const u8_t *key, size_t len)
 {
-	const bt_addr_le_t *addr =
-			bt_scan.scan_filters.addr.target_addr;
-	u8_t counter = bt_scan.scan_filters.addr.cnt;
+	u32_t hash = 2166136261U;
 
-	for (size_t i = 0; i < counter; i++) {
-		if (bt_addr_le_cmp(target_addr, &addr[i]) == 0) {
-			control->filter_status.addr.addr = &addr[i];
+	for (size_t i = 0; i < len; i++) {
+		hash ^= key[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
 
-			return true;
+static sys_slist_t *filter_bucket(struct bt_scan_filter_set *set,
+				  const void *key, size_t len)
+{
+	u32_t hash = filter_hash(key, len);
+
+	return &set->bucket[hash & (CONFIG_BT_SCAN_FILTER_HASH_SIZE - 1)];
+}
+
+static void filter_list_free(sys_slist_t *list)
+{
+	sys_snode_t *node;
+
+	while ((node = sys_slist_get(list)) != NULL) {
+		k_free(node);
+	}
+}
+
+static void filter_set_free(struct bt_scan_filter_set *set)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(set->bucket); i++) {
+		filter_list_free(&set->bucket[i]);
+	}
+
+	set->cnt = 0;
+}
+
+static struct bt_scan_addr_entry *addr_find(const bt_addr_le_t *addr)
+{
+	struct bt_scan_filter_set *set = &bt_scan.scan_filters.addr;
+	struct bt_scan_addr_entry *entry;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(filter_bucket(set, addr, sizeof(*addr)),
+				     entry, node) {
+		if (bt_addr_le_cmp(addr, &entry->addr) == 0) {
+			return entry;
 		}
 	}
 
-	return false;
+	return NULL;
 }
 
 static bool is_addr_filter_enabled(void)
@@ -342,13 +446,14 @@ static bool is_addr_filter_enabled(void)
 static void check_addr(struct bt_scan_control *control,
 		       const bt_addr_le_t *addr)
 {
-	if (is_addr_filter_enabled()) {
-		if (adv_addr_compare(addr, control)) {
-			control->filter_match_cnt++;
+	struct bt_scan_addr_entry *entry;
 
+	if (is_addr_filter_enabled()) {
+		entry = addr_find(addr);
+		if (entry) {
 			/* Information about the filters matched. */
+			control->filter_status.addr.addr = &entry->addr;
 			control->filter_status.addr.match = true;
-			control->filter_match = true;
 		}
 	}
 }
@@ -356,161 +461,301 @@ static void check_addr(struct bt_scan_control *control,
 static int scan_addr_filter_add(const bt_addr_le_t *target_addr)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
-	bt_addr_le_t *addr_filter =
-			bt_scan.scan_filters.addr.target_addr;
-	u8_t counter = bt_scan.scan_filters.addr.cnt;
+	struct bt_scan_filter_set *set = &bt_scan.scan_filters.addr;
+	struct bt_scan_addr_entry *entry;
 
-	/* If no memory for filter. */
-	if (counter >= CONFIG_BT_SCAN_ADDRESS_CNT) {
-		return -ENOMEM;
+	/* Check for duplicated filter. */
+	if (addr_find(target_addr)) {
+		return 0;
 	}
 
-	/* Check for duplicated filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (bt_addr_le_cmp(target_addr, &addr_filter[i]) == 0) {
-			return 0;
-		}
+	entry = filter_alloc(sizeof(*entry));
+
+	/* If no memory for filter. */
+	if (!entry) {
+		return -ENOMEM;
 	}
 
 	/* Add target address to filter. */
-	bt_addr_le_copy(&addr_filter[counter], target_addr);
+	bt_addr_le_copy(&entry->addr, target_addr);
+	sys_slist_prepend(filter_bucket(set, target_addr,
+					sizeof(*target_addr)),
+			  &entry->node);
 
-	LOG_DBG("Filter set on address type %i",
-		addr_filter[counter].type);
+	LOG_DBG("Filter set on address type %i", entry->addr.type);
 
 	bt_addr_le_to_str(target_addr, addr, sizeof(addr));
 
 	LOG_DBG("Address: %s", addr);
 
 	/* Increase the address filter counter. */
-	bt_scan.scan_filters.addr.cnt++;
+	set->cnt++;
 
 	return 0;
 }
 
-static bool adv_name_cmp(const u8_t *data,
-			 u8_t data_len,
-			 const char *target_name)
+static struct bt_scan_name_trie_node *
+name_trie_child_find(struct bt_scan_name_trie_node *first, char c)
 {
-	return strncmp(target_name, data, data_len) == 0;
+	for (; first; first = first->sibling) {
+		if (first->label[0] == c) {
+			return first;
+		}
+	}
+
+	return NULL;
 }
 
-static bool adv_name_compare(const struct bt_data *data,
-			     struct bt_scan_control *control)
+static struct bt_scan_name_trie_node *name_trie_node_alloc(const char *label,
+							   size_t len)
 {
-	struct bt_scan_name_filter const *name_filter =
-			&bt_scan.scan_filters.name;
-	u8_t counter = bt_scan.scan_filters.name.cnt;
-	u8_t data_len = data->data_len;
+	struct bt_scan_name_trie_node *node;
 
-	/* Compare the name found with the name filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (adv_name_cmp(data->data,
-				 data_len,
-				 name_filter->target_name[i])) {
+	node = filter_alloc(sizeof(*node) + len);
+	if (node) {
+		memcpy(node->label, label, len);
+		node->label_len = len;
+	}
 
-			control->filter_status.name.name =
-				name_filter->target_name[i];
-			control->filter_status.name.len = data_len;
+	return node;
+}
 
-			return true;
+static void name_trie_best_update(const struct bt_scan_name_entry **best,
+				  const struct bt_scan_name_entry *entry)
+{
+	if (!*best || (entry->min_len < (*best)->min_len)) {
+		*best = entry;
+	}
+}
+
+static size_t name_trie_label_match(const struct bt_scan_name_trie_node *node,
+				    const char *name, size_t len)
+{
+	size_t i;
+
+	for (i = 0; (i < node->label_len) && (i < len); i++) {
+		if (node->label[i] != name[i]) {
+			break;
 		}
 	}
 
-	return false;
+	return i;
 }
 
-static bool is_name_filter_enabled(void)
+static int name_trie_insert(struct bt_scan_name_filter *filter,
+			    const struct bt_scan_name_entry *entry)
 {
-	return bt_scan.scan_filters.name.enabled;
+	struct bt_scan_name_trie_node **children = &filter->trie;
+	struct bt_scan_name_trie_node *child = NULL;
+	struct bt_scan_name_trie_node *split = NULL;
+	struct bt_scan_name_trie_node *leaf = NULL;
+	struct bt_scan_name_trie_node *node;
+	const char *name = entry->name;
+	size_t len = strlen(name);
+	size_t common = 0;
+	size_t pos = 0;
+
+	/* Follow the edges whose labels are a prefix of the name. */
+	while (pos < len) {
+		child = name_trie_child_find(*children, name[pos]);
+		if (!child) {
+			break;
+		}
+
+		common = name_trie_label_match(child, &name[pos], len - pos);
+		if (common < child->label_len) {
+			break;
+		}
+
+		children = &child->child;
+		pos += common;
+		child = NULL;
+	}
+
+	/* Allocate all nodes before the trie is modified, so that it stays
+	 * consistent when the pool is exhausted.
+	 */
+	if (child) {
+		split = name_trie_node_alloc(child->label, common);
+		if (!split) {
+			return -ENOMEM;
+		}
+
+		pos += common;
+	}
+
+	if (pos < len) {
+		leaf = name_trie_node_alloc(&name[pos], len - pos);
+		if (!leaf) {
+			k_free(split);
+			return -ENOMEM;
+		}
+	}
+
+	if (split) {
+		/* The name diverges in the middle of the edge label. */
+		split->best = child->best;
+		split->child = child;
+		split->sibling = child->sibling;
+
+		while (*children != child) {
+			children = &(*children)->sibling;
+		}
+		*children = split;
+
+		child->sibling = NULL;
+		child->label_len -= common;
+		memmove(child->label, &child->label[common], child->label_len);
+
+		children = &split->child;
+	}
+
+	if (leaf) {
+		leaf->sibling = *children;
+		*children = leaf;
+	}
+
+	/* Update the nodes on the path of the name. */
+	name_trie_best_update(&filter->best, entry);
+
+	node = filter->trie;
+	pos = 0;
+
+	while (pos < len) {
+		node = name_trie_child_find(node, name[pos]);
+		__ASSERT_NO_MSG(node);
+
+		name_trie_best_update(&node->best, entry);
+
+		pos += node->label_len;
+		node = node->child;
+	}
+
+	return 0;
 }
 
-static void name_check(struct bt_scan_control *control,
-		       const struct bt_data *data)
+/* Find the name that starts with the advertised name. */
+static const struct bt_scan_name_entry *
+name_trie_find(struct bt_scan_name_filter *filter, const u8_t *data, u8_t len)
 {
-	if (is_name_filter_enabled()) {
-		if (adv_name_compare(data, control)) {
-			control->filter_match_cnt++;
+	struct bt_scan_name_trie_node *node = filter->trie;
+	const struct bt_scan_name_entry *best = filter->best;
+	size_t pos = 0;
+	size_t cmp_len;
+
+	while (pos < len) {
+		node = name_trie_child_find(node, data[pos]);
+		if (!node) {
+			return NULL;
+		}
 
-			/* Information about the filters matched. */
-			control->filter_status.name.match = true;
-			control->filter_match = true;
+		cmp_len = MIN(node->label_len, len - pos);
+		if (memcmp(node->label, &data[pos], cmp_len) != 0) {
+			return NULL;
 		}
+
+		best = node->best;
+		pos += cmp_len;
+		node = node->child;
 	}
+
+	return best;
 }
 
-static int scan_name_filter_add(const char *name)
+static void name_trie_free(struct bt_scan_name_trie_node *node)
 {
-	u8_t counter = bt_scan.scan_filters.name.cnt;
-	size_t name_len;
+	struct bt_scan_name_trie_node *next;
 
-	/* If no memory for filter. */
-	if (counter >= CONFIG_BT_SCAN_NAME_CNT) {
-		return -ENOMEM;
+	/* The recursion depth is limited by the maximum name length. */
+	while (node) {
+		next = node->sibling;
+		name_trie_free(node->child);
+		k_free(node);
+		node = next;
 	}
+}
+
+static void name_filter_free(struct bt_scan_name_filter *filter)
+{
+	name_trie_free(filter->trie);
+	filter_list_free(&filter->names);
+
+	filter->trie = NULL;
+	filter->best = NULL;
+	filter->cnt = 0;
+}
+
+static int name_filter_add(struct bt_scan_name_filter *filter,
+			   const char *name, u8_t min_len, size_t max_len)
+{
+	struct bt_scan_name_entry *entry;
+	size_t name_len;
+	int err;
 
 	name_len = strlen(name);
 
 	/* Check the name length. */
-	if ((name_len == 0) || (name_len > CONFIG_BT_SCAN_NAME_MAX_LEN)) {
+	if ((name_len == 0) || (name_len > max_len)) {
 		return -EINVAL;
 	}
 
 	/* Check for duplicated filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (!strcmp(bt_scan.scan_filters.name.target_name[i], name)) {
+	SYS_SLIST_FOR_EACH_CONTAINER(&filter->names, entry, node) {
+		if (!strcmp(entry->name, name)) {
 			return 0;
 		}
 	}
 
-	/* Add name to filter. */
-	memcpy(bt_scan.scan_filters.name.target_name[counter],
-	       name, name_len);
+	entry = filter_alloc(sizeof(*entry) + name_len + 1);
+
+	/* If no memory for filter. */
+	if (!entry) {
+		return -ENOMEM;
+	}
+
+	entry->min_len = min_len;
+	memcpy(entry->name, name, name_len);
+
+	err = name_trie_insert(filter, entry);
+	if (err) {
+		k_free(entry);
+		return err;
+	}
 
-	bt_scan.scan_filters.name.cnt++;
+	sys_slist_append(&filter->names, &entry->node);
+	filter->cnt++;
 
 	LOG_DBG("Adding filter on %s name", name);
 
 	return 0;
 }
 
-static bool adv_short_name_cmp(const u8_t *data,
-			       u8_t data_len,
-			       const char *target_name,
-			       u8_t short_name_min_len)
+static bool is_name_filter_enabled(void)
 {
-	if ((data_len >= short_name_min_len) &&
-	    (strncmp(target_name, data, data_len) == 0)) {
-		return true;
-	}
-
-	return false;
+	return bt_scan.scan_filters.name.enabled;
 }
 
-static bool adv_short_name_compare(const struct bt_data *data,
-				   struct bt_scan_control *control)
+static void name_check(struct bt_scan_control *control,
+		       const struct bt_data *data)
 {
-	const struct bt_scan_short_name_filter *name_filter =
-			&bt_scan.scan_filters.short_name;
-	u8_t counter = bt_scan.scan_filters.short_name.cnt;
-	u8_t data_len = data->data_len;
+	const struct bt_scan_name_entry *entry;
 
-	/* Compare the name found with the name filters. */
-	for (size_t i = 0; i < counter; i++) {
-		if (adv_short_name_cmp(data->data,
-				       data_len,
-				       name_filter->name[i].target_name,
-				       name_filter->name[i].min_len)) {
-
-			control->filter_status.short_name.name =
-				name_filter->name[i].target_name;
-			control->filter_status.short_name.len = data_len;
-
-			return true;
+	if (is_name_filter_enabled() && !control->filter_status.name.match) {
+		entry = name_trie_find(&bt_scan.scan_filters.name,
+				       data->data, data->data_len);
+		if (entry) {
+			/* Information about the filters matched. */
+			control->filter_status.name.name = entry->name;
+			control->filter_status.name.len = data->data_len;
+			control->filter_status.name.match = true;
 		}
 	}
+}
 
-	return false;
+static int scan_name_filter_add(const char *name)
+{
+	return name_filter_add(&bt_scan.scan_filters.name, name, 0,
+			       CONFIG_BT_SCAN_NAME_MAX_LEN);
 }
 
 static bool is_short_name_filter_enabled(void)
@@ -521,67 +766,85 @@ static bool is_short_name_filter_enabled(void)
 static void short_name_check(struct bt_scan_control *control,
 			     const struct bt_data *data)
 {
-	if (is_short_name_filter_enabled()) {
-		if (adv_short_name_compare(data, control)) {
-			control->filter_match_cnt++;
+	const struct bt_scan_name_entry *entry;
 
+	if (is_short_name_filter_enabled() &&
+	    !control->filter_status.short_name.match) {
+		entry = name_trie_find(&bt_scan.scan_filters.short_name,
+				       data->data, data->data_len);
+		if (entry && (data->data_len >= entry->min_len)) {
 			/* Information about the filters matched. */
+			control->filter_status.short_name.name = entry->name;
+			control->filter_status.short_name.len = data->data_len;
 			control->filter_status.short_name.match = true;
-			control->filter_match = true;
 		}
 	}
 }
 
 static int scan_short_name_filter_add(const struct bt_scan_short_name *short_name)
 {
-	u8_t counter =
-		bt_scan.scan_filters.short_name.cnt;
-	struct bt_scan_short_name_filter *short_name_filter =
-		    &bt_scan.scan_filters.short_name;
-	u8_t name_len;
-
-	/* If no memory for filter. */
-	if (counter >= CONFIG_BT_SCAN_SHORT_NAME_CNT) {
-		return -ENOMEM;
-	}
-
-	name_len = strlen(short_name->name);
-
-	/* Check the name length. */
-	if ((name_len == 0) ||
-	    (name_len > CONFIG_BT_SCAN_SHORT_NAME_MAX_LEN)) {
+	if (!short_name->name) {
 		return -EINVAL;
 	}
 
-	/* Check for duplicated filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (!strcmp(short_name_filter->name[i].target_name,
-			    short_name->name)) {
-			return 0;
+	return name_filter_add(&bt_scan.scan_filters.short_name,
+			       short_name->name, short_name->min_len,
+			       CONFIG_BT_SCAN_SHORT_NAME_MAX_LEN);
+}
+
+static struct bt_scan_uuid_entry *uuid_find(const u8_t *key)
+{
+	struct bt_scan_filter_set *set = &bt_scan.scan_filters.uuid;
+	struct bt_scan_uuid_entry *entry;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(filter_bucket(set, key,
+						   BT_SCAN_UUID_128_SIZE),
+				     entry, node) {
+		if (memcmp(key, entry->key, BT_SCAN_UUID_128_SIZE) == 0) {
+			return entry;
 		}
 	}
 
-	/* Add name to the filter. */
-	short_name_filter->name[counter].min_len = short_name->min_len;
-	memcpy(short_name_filter->name[counter].target_name,
-	       short_name->name,
-	       name_len);
+	return NULL;
+}
+
+static void uuid_match(struct bt_scan_control *control, const u8_t *key)
+{
+	struct bt_scan_uuid_filter_status *status =
+			&control->filter_status.uuid;
+	struct bt_scan_uuid_entry *entry = uuid_find(key);
 
-	bt_scan.scan_filters.short_name.cnt++;
+	if (!entry || (entry->match_gen == bt_scan.report_gen)) {
+		return;
+	}
 
-	LOG_DBG("Adding filter on %s name", short_name->name);
+	entry->match_gen = bt_scan.report_gen;
+	control->uuid_match_cnt++;
 
-	return 0;
+	if (status->count < ARRAY_SIZE(status->uuid)) {
+		status->uuid[status->count] = entry->uuid.uuid;
+		status->count++;
+	}
 }
 
-static bool find_uuid(const u8_t *data,
-		      u8_t data_len,
-		      u8_t uuid_type,
-		      const struct bt_scan_uuid *target_uuid)
+static bool is_uuid_filter_enabled(void)
 {
+	return bt_scan.scan_filters.uuid.enabled;
+}
+
+static void uuid_check(struct bt_scan_control *control,
+		       const struct bt_data *data,
+		       u8_t type)
+{
+	u8_t key[BT_SCAN_UUID_128_SIZE];
 	u8_t uuid_len;
+	u8_t key_off;
 
-	switch (uuid_type) {
+	if (!is_uuid_filter_enabled()) {
+		return;
+	}
+
+	switch (type) {
 	case BT_UUID_TYPE_16:
 		uuid_len = sizeof(u16_t);
 		break;
@@ -591,191 +854,107 @@ static bool find_uuid(const u8_t *data,
 		break;
 
 	case BT_UUID_TYPE_128:
-		uuid_len = BT_SCAN_UUID_128_SIZE * sizeof(u8_t);
+		uuid_len = BT_SCAN_UUID_128_SIZE;
 		break;
 
 	default:
-		return false;
+		return;
 	}
 
-	for (size_t i = 0; i < data_len; i += uuid_len) {
-		struct bt_uuid_128 uuid;
-
-		if (!bt_uuid_create(&uuid.uuid, &data[i], uuid_len)) {
-			return false;
-		}
+	/* 16-bit and 32-bit UUIDs replace the value at offset 12
+	 * of the Bluetooth Base UUID.
+	 */
+	key_off = (uuid_len == BT_SCAN_UUID_128_SIZE) ? 0 : 12;
+	memcpy(key, uuid_base, sizeof(key));
 
-		if (bt_uuid_cmp(&uuid.uuid, target_uuid->uuid) == 0) {
-			return true;
-		}
+	for (size_t i = 0; i + uuid_len <= data->data_len; i += uuid_len) {
+		memcpy(&key[key_off], &data->data[i], uuid_len);
+		uuid_match(control, key);
 	}
-
-	return false;
 }
 
-static bool adv_uuid_compare(const struct bt_data *data, u8_t uuid_type,
-			     struct bt_scan_control *control)
+static int scan_uuid_filter_add(struct bt_uuid *uuid)
 {
-	const struct bt_scan_uuid_filter *uuid_filter =
-			&bt_scan.scan_filters.uuid;
-	const bool all_filters_mode = bt_scan.scan_filters.all_mode;
-	const u8_t counter = bt_scan.scan_filters.uuid.cnt;
-	u8_t data_len = data->data_len;
-	u8_t uuid_match_cnt = 0;
+	struct bt_scan_filter_set *set = &bt_scan.scan_filters.uuid;
+	struct bt_scan_uuid_entry *entry;
+	u8_t key[BT_SCAN_UUID_128_SIZE];
 
-	for (size_t i = 0; i < counter; i++) {
+	memcpy(key, uuid_base, sizeof(key));
 
-		if (find_uuid(data->data, data_len, uuid_type,
-			      &uuid_filter->uuid[i])) {
-			control->filter_status.uuid.uuid[uuid_match_cnt] =
-				uuid_filter->uuid[i].uuid;
-
-			uuid_match_cnt++;
-
-			/* In the normal filter mode,
-			 * only one UUID is needed to match.
-			 */
-			if (!all_filters_mode) {
-				break;
-			}
+	switch (uuid->type) {
+	case BT_UUID_TYPE_16:
+		sys_put_le16(BT_UUID_16(uuid)->val, &key[12]);
+		break;
 
-		} else if (all_filters_mode) {
-			break;
-		}
-	}
+	case BT_UUID_TYPE_32:
+		sys_put_le32(BT_UUID_32(uuid)->val, &key[12]);
+		break;
 
-	control->filter_status.uuid.count = uuid_match_cnt;
+	case BT_UUID_TYPE_128:
+		memcpy(key, BT_UUID_128(uuid)->val, sizeof(key));
+		break;
 
-	/* In the multifilter mode, all UUIDs must be found in
-	 * the advertisement packets.
-	 */
-	if ((all_filters_mode && (uuid_match_cnt == counter)) ||
-	    ((!all_filters_mode) && (uuid_match_cnt > 0))) {
-		return true;
+	default:
+		return -EINVAL;
 	}
 
-	return false;
-}
-
-static bool is_uuid_filter_enabled(void)
-{
-	return bt_scan.scan_filters.uuid.enabled;
-}
-
-static void uuid_check(struct bt_scan_control *control,
-		       const struct bt_data *data,
-		       u8_t type)
-{
-	if (is_uuid_filter_enabled()) {
-		if (adv_uuid_compare(data, type, control)) {
-			control->filter_match_cnt++;
-
-			/* Information about the filters matched. */
-			control->filter_status.uuid.match = true;
-			control->filter_match = true;
-		}
+	/* Check for duplicated filter. */
+	if (uuid_find(key)) {
+		return 0;
 	}
-}
 
-static int scan_uuid_filter_add(struct bt_uuid *uuid)
-{
-	struct bt_scan_uuid *uuid_filter = bt_scan.scan_filters.uuid.uuid;
-	u8_t counter = bt_scan.scan_filters.uuid.cnt;
-	struct bt_uuid_16 *uuid_16;
-	struct bt_uuid_32 *uuid_32;
-	struct bt_uuid_128 *uuid_128;
+	entry = filter_alloc(sizeof(*entry));
 
 	/* If no memory. */
-	if (counter >= CONFIG_BT_SCAN_UUID_CNT) {
+	if (!entry) {
 		return -ENOMEM;
 	}
 
-	/* Check for duplicated filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (bt_uuid_cmp(uuid_filter[i].uuid, uuid) == 0) {
-			return 0;
-		}
-	}
+	memcpy(entry->key, key, sizeof(key));
 
 	/* Add UUID to the filter. */
 	switch (uuid->type) {
 	case BT_UUID_TYPE_16:
-		uuid_16 = BT_UUID_16(uuid);
-
-		uuid_filter[counter].uuid_data.uuid_16 = *uuid_16;
-		uuid_filter[counter].uuid =
-				(struct bt_uuid *)&uuid_filter[counter].uuid_data.uuid_16;
+		entry->uuid.uuid_data.uuid_16 = *BT_UUID_16(uuid);
+		entry->uuid.uuid =
+			(struct bt_uuid *)&entry->uuid.uuid_data.uuid_16;
 		break;
 
 	case BT_UUID_TYPE_32:
-		uuid_32 = BT_UUID_32(uuid);
-
-		uuid_filter[counter].uuid_data.uuid_32 = *uuid_32;
-		uuid_filter[counter].uuid =
-				(struct bt_uuid *)&uuid_filter[counter].uuid_data.uuid_32;
-		break;
-
-	case BT_UUID_TYPE_128:
-		uuid_128 = BT_UUID_128(uuid);
-
-		uuid_filter[counter].uuid_data.uuid_128 = *uuid_128;
-		uuid_filter[counter].uuid =
-				(struct bt_uuid *)&uuid_filter[counter].uuid_data.uuid_128;
+		entry->uuid.uuid_data.uuid_32 = *BT_UUID_32(uuid);
+		entry->uuid.uuid =
+			(struct bt_uuid *)&entry->uuid.uuid_data.uuid_32;
 		break;
 
 	default:
-		return -EINVAL;
+		entry->uuid.uuid_data.uuid_128 = *BT_UUID_128(uuid);
+		entry->uuid.uuid =
+			(struct bt_uuid *)&entry->uuid.uuid_data.uuid_128;
+		break;
 	}
 
-	bt_scan.scan_filters.uuid.cnt++;
+	sys_slist_prepend(filter_bucket(set, key, sizeof(key)), &entry->node);
+	set->cnt++;
+
 	LOG_DBG("Added filter on UUID type %x", uuid->type);
 
 	return 0;
 }
 
-static bool find_appearance(const u8_t *data,
-			    u8_t data_len,
-			    const u16_t *appearance)
+static struct bt_scan_appearance_entry *appearance_find(u16_t appearance)
 {
-	if (data_len != sizeof(u16_t)) {
-		return false;
-	}
-
-	u16_t decoded_appearance = sys_get_be16(data);
-
-	if (decoded_appearance == *appearance) {
-		return true;
-	}
-
-	/* Could not find the appearance among the encoded data. */
-	return false;
-}
-
-static bool adv_appearance_compare(const struct bt_data *data,
-				   struct bt_scan_control *control)
-{
-	const struct bt_scan_appearance_filter *appearance_filter =
-			&bt_scan.scan_filters.appearance;
-	const u8_t counter =
-			bt_scan.scan_filters.appearance.cnt;
-	u8_t data_len = data->data_len;
-
-	/* Verify if the advertised appearance matches
-	 * the provided appearance.
-	 */
-	for (size_t i = 0; i < counter; i++) {
-		if (find_appearance(data->data,
-				    data_len,
-				    &appearance_filter->appearance[i])) {
-
-			control->filter_status.appearance.appearance =
-					&appearance_filter->appearance[i];
-
-			return true;
+	struct bt_scan_filter_set *set = &bt_scan.scan_filters.appearance;
+	struct bt_scan_appearance_entry *entry;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(filter_bucket(set, &appearance,
+						   sizeof(appearance)),
+				     entry, node) {
+		if (entry->appearance == appearance) {
+			return entry;
 		}
 	}
 
-	return false;
+	return NULL;
 }
 
 static bool is_appearance_filter_enabled(void)
@@ -786,139 +965,188 @@ static bool is_appearance_filter_enabled(void)
 static void appearance_check(struct bt_scan_control *control,
 			     const struct bt_data *data)
 {
-	if (is_appearance_filter_enabled()) {
-		if (adv_appearance_compare(data, control)) {
-			control->filter_match_cnt++;
+	struct bt_scan_appearance_entry *entry;
 
-			/* Information about the filters matched. */
-			control->filter_status.appearance.match = true;
-			control->filter_match = true;
-		}
+	if (!is_appearance_filter_enabled() ||
+	    (data->data_len != sizeof(u16_t))) {
+		return;
+	}
+
+	/* Verify if the advertised appearance matches
+	 * the provided appearance.
+	 */
+	entry = appearance_find(sys_get_be16(data->data));
+	if (entry) {
+		/* Information about the filters matched. */
+		control->filter_status.appearance.appearance =
+				&entry->appearance;
+		control->filter_status.appearance.match = true;
 	}
 }
 
 static int scan_appearance_filter_add(u16_t appearance)
 {
-	u16_t *appearance_filter = bt_scan.scan_filters.appearance.appearance;
-	u8_t counter = bt_scan.scan_filters.appearance.cnt;
+	struct bt_scan_filter_set *set = &bt_scan.scan_filters.appearance;
+	struct bt_scan_appearance_entry *entry;
 
-	/* If no memory. */
-	if (counter >= CONFIG_BT_SCAN_APPEARANCE_CNT) {
-		return -ENOMEM;
+	/* Check for duplicated filter. */
+	if (appearance_find(appearance)) {
+		return 0;
 	}
 
-	/* Check for duplicated filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (appearance_filter[i] == appearance) {
-			return 0;
-		}
+	entry = filter_alloc(sizeof(*entry));
+
+	/* If no memory. */
+	if (!entry) {
+		return -ENOMEM;
 	}
 
 	/* Add appearance to the filter. */
-	appearance_filter[counter] = appearance;
-	bt_scan.scan_filters.appearance.cnt++;
+	entry->appearance = appearance;
+	sys_slist_prepend(filter_bucket(set, &appearance, sizeof(appearance)),
+			  &entry->node);
+	set->cnt++;
 
 	LOG_DBG("Added filter on appearance %x", appearance);
 
 	return 0;
 }
 
-static bool adv_manufacturer_data_cmp(const u8_t *data,
-				      u8_t data_len,
-				      const u8_t *target_data,
-				      u8_t target_data_len)
+static bool manufacturer_data_entry_match(
+		const struct bt_scan_manufacturer_data_entry *entry,
+		const u8_t *data, u8_t data_len)
 {
-	if (target_data_len > data_len) {
+	const u8_t *mask = &entry->data[entry->data_len];
+
+	if (entry->data_len > data_len) {
 		return false;
 	}
 
-	if (memcmp(target_data, data, target_data_len) != 0) {
-		return false;
+	for (size_t i = 0; i < entry->data_len; i++) {
+		if ((data[i] & mask[i]) != entry->data[i]) {
+			return false;
+		}
 	}
 
 	return true;
 }
 
-static bool adv_manufacturer_data_compare(const struct bt_data *data,
-					  struct bt_scan_control *control)
+static bool manufacturer_data_entry_is_keyed(
+		const struct bt_scan_manufacturer_data_entry *entry)
 {
-	const struct bt_scan_manufacturer_data_filter *md_filter =
-		&bt_scan.scan_filters.manufacturer_data;
-	u8_t counter = bt_scan.scan_filters.manufacturer_data.cnt;
+	const u8_t *mask = &entry->data[entry->data_len];
 
-	/* Compare the name found with the name filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (adv_manufacturer_data_cmp(data->data,
-				data->data_len,
-				md_filter->manufacturer_data[i].data,
-				md_filter->manufacturer_data[i].data_len)) {
+	return (entry->data_len >= COMPANY_ID_LEN) &&
+	       (mask[0] == 0xff) && (mask[1] == 0xff);
+}
 
-			control->filter_status.manufacturer_data.data =
-				md_filter->manufacturer_data[i].data;
-			control->filter_status.manufacturer_data.len =
-				md_filter->manufacturer_data[i].data_len;
+static sys_slist_t *manufacturer_data_list(
+		const struct bt_scan_manufacturer_data_entry *entry)
+{
+	struct bt_scan_manufacturer_data_filter *md_filter =
+		&bt_scan.scan_filters.manufacturer_data;
 
-			return true;
-		}
+	if (manufacturer_data_entry_is_keyed(entry)) {
+		return filter_bucket(&md_filter->set, entry->data,
+				     COMPANY_ID_LEN);
 	}
 
-	return false;
+	return &md_filter->unkeyed;
 }
 
 static bool is_manufacturer_data_filter_enabled(void)
 {
-	return bt_scan.scan_filters.manufacturer_data.enabled;
+	return bt_scan.scan_filters.manufacturer_data.set.enabled;
 }
 
 static void manufacturer_data_check(struct bt_scan_control *control,
 				    const struct bt_data *data)
 {
-	if (is_manufacturer_data_filter_enabled()) {
-		if (adv_manufacturer_data_compare(data, control)) {
-			control->filter_match_cnt++;
+	struct bt_scan_manufacturer_data_filter *md_filter =
+		&bt_scan.scan_filters.manufacturer_data;
+	struct bt_scan_manufacturer_data_entry *entry;
+	struct bt_scan_manufacturer_data_entry *found = NULL;
 
-			/* Information about the filters matched. */
-			control->filter_status.manufacturer_data.match = true;
-			control->filter_match = true;
+	if (!is_manufacturer_data_filter_enabled() ||
+	    control->filter_status.manufacturer_data.match) {
+		return;
+	}
+
+	if (data->data_len >= COMPANY_ID_LEN) {
+		SYS_SLIST_FOR_EACH_CONTAINER(filter_bucket(&md_filter->set,
+							   data->data,
+							   COMPANY_ID_LEN),
+					     entry, node) {
+			if (manufacturer_data_entry_match(entry, data->data,
+							  data->data_len)) {
+				found = entry;
+				break;
+			}
 		}
 	}
+
+	if (!found) {
+		SYS_SLIST_FOR_EACH_CONTAINER(&md_filter->unkeyed, entry, node) {
+			if (manufacturer_data_entry_match(entry, data->data,
+							  data->data_len)) {
+				found = entry;
+				break;
+			}
+		}
+	}
+
+	if (found) {
+		/* Information about the filters matched. */
+		control->filter_status.manufacturer_data.data = found->data;
+		control->filter_status.manufacturer_data.len = found->data_len;
+		control->filter_status.manufacturer_data.match = true;
+	}
 }
 
 static int scan_manufacturer_data_filter_add(const struct bt_scan_manufacturer_data *manufacturer_data)
 {
 	struct bt_scan_manufacturer_data_filter *md_filter =
 		&bt_scan.scan_filters.manufacturer_data;
-	u8_t counter = bt_scan.scan_filters.manufacturer_data.cnt;
+	struct bt_scan_manufacturer_data_entry *entry;
+	struct bt_scan_manufacturer_data_entry *item;
+	u8_t data_len = manufacturer_data->data_len;
+	u8_t *mask;
+
+	/* Check the data length. */
+	if ((data_len == 0) ||
+	    (data_len > CONFIG_BT_SCAN_MANUFACTURER_DATA_MAX_LEN)) {
+		return -EINVAL;
+	}
+
+	entry = filter_alloc(sizeof(*entry) + 2 * data_len);
 
 	/* If no memory for filter. */
-	if (counter >= CONFIG_BT_SCAN_MANUFACTURER_DATA_CNT) {
+	if (!entry) {
 		return -ENOMEM;
 	}
 
-	/* Check the data length. */
-	if ((manufacturer_data->data_len == 0) ||
-			(manufacturer_data->data_len >
-			 CONFIG_BT_SCAN_MANUFACTURER_DATA_MAX_LEN)) {
-		return -EINVAL;
+	entry->data_len = data_len;
+	mask = &entry->data[data_len];
+
+	for (size_t i = 0; i < data_len; i++) {
+		mask[i] = manufacturer_data->mask ?
+			  manufacturer_data->mask[i] : 0xff;
+		entry->data[i] = manufacturer_data->data[i] & mask[i];
 	}
 
 	/* Check for duplicated filter. */
-	for (size_t i = 0; i < counter; i++) {
-		if (adv_manufacturer_data_cmp(manufacturer_data->data,
-				manufacturer_data->data_len,
-				md_filter->manufacturer_data[i].data,
-				md_filter->manufacturer_data[i].data_len)) {
+	SYS_SLIST_FOR_EACH_CONTAINER(manufacturer_data_list(entry),
+				     item, node) {
+		if ((item->data_len == data_len) &&
+		    (memcmp(item->data, entry->data, 2 * data_len) == 0)) {
+			k_free(entry);
 			return 0;
 		}
 	}
 
 	/* Add manufacturer data to filter. */
-	memcpy(md_filter->manufacturer_data[counter].data,
-			manufacturer_data->data, manufacturer_data->data_len);
-	md_filter->manufacturer_data[counter].data_len =
-		manufacturer_data->data_len;
-
-	bt_scan.scan_filters.manufacturer_data.cnt++;
+	sys_slist_prepend(manufacturer_data_list(entry), &entry->node);
+	md_filter->set.cnt++;
 
 	LOG_DBG("Adding filter on manufacturer data");
 
@@ -1004,34 +1232,23 @@ int bt_scan_filter_add(enum bt_scan_filter_type type,
 	return err;
 }
 
-void bt_scan_filter_remove_all(void)
+static void scan_filters_free(void)
 {
-	k_mutex_lock(&scan_add_mutex, K_FOREVER);
-
-	struct bt_scan_name_filter *name_filter =
-			&bt_scan.scan_filters.name;
-	name_filter->cnt = 0;
-
-	struct bt_scan_short_name_filter *short_name_filter =
-			&bt_scan.scan_filters.short_name;
-	short_name_filter->cnt = 0;
-
-	struct bt_scan_addr_filter *addr_filter =
-			&bt_scan.scan_filters.addr;
-	addr_filter->cnt = 0;
-
-	struct bt_scan_uuid_filter *uuid_filter =
-			&bt_scan.scan_filters.uuid;
-	uuid_filter->cnt = 0;
-
-	struct bt_scan_appearance_filter *appearance_filter =
-			&bt_scan.scan_filters.appearance;
-	appearance_filter->cnt = 0;
+	struct bt_scan_filters *filters = &bt_scan.scan_filters;
 
-	struct bt_scan_manufacturer_data_filter *manufacturer_data_filter =
-		&bt_scan.scan_filters.manufacturer_data;
-	manufacturer_data_filter->cnt = 0;
+	name_filter_free(&filters->name);
+	name_filter_free(&filters->short_name);
+	filter_set_free(&filters->addr);
+	filter_set_free(&filters->uuid);
+	filter_set_free(&filters->appearance);
+	filter_set_free(&filters->manufacturer_data.set);
+	filter_list_free(&filters->manufacturer_data.unkeyed);
+}
 
+void bt_scan_filter_remove_all(void)
+{
+	k_mutex_lock(&scan_add_mutex, K_FOREVER);
+	scan_filters_free();
 	k_mutex_unlock(&scan_add_mutex);
 }
 
@@ -1043,7 +1260,7 @@ void bt_scan_filter_disable(void)
 	bt_scan.scan_filters.addr.enabled = false;
 	bt_scan.scan_filters.uuid.enabled = false;
 	bt_scan.scan_filters.appearance.enabled = false;
-	bt_scan.scan_filters.manufacturer_data.enabled = false;
+	bt_scan.scan_filters.manufacturer_data.set.enabled = false;
 }
 
 int bt_scan_filter_enable(u8_t mode, bool match_all)
@@ -1080,7 +1297,7 @@ int bt_scan_filter_enable(u8_t mode, bool match_all)
 	}
 
 	if (mode & BT_SCAN_MANUFACTURER_DATA_FILTER) {
-		filters->manufacturer_data.enabled = true;
+		filters->manufacturer_data.set.enabled = true;
 	}
 
 	/* Select the filter mode. */
@@ -1109,7 +1326,7 @@ int bt_scan_filter_get(struct bt_filter_status *status)
 	status->appearance.cnt =
 			bt_scan.scan_filters.appearance.cnt;
 	status->manufacturer_data.cnt =
-			bt_scan.scan_filters.manufacturer_data.cnt;
+			bt_scan.scan_filters.manufacturer_data.set.cnt;
 
 	return 0;
 }
@@ -1121,8 +1338,12 @@ int bt_scan_stop(void)
 
 void bt_scan_init(const struct bt_scan_init_param *init)
 {
-	/* Disable all scanning filters. */
-	memset(&bt_scan.scan_filters, 0, sizeof(bt_scan.scan_filters));
+	/* Remove and disable all scanning filters. */
+	k_mutex_lock(&scan_add_mutex, K_FOREVER);
+	scan_filters_free();
+	bt_scan_filter_disable();
+	bt_scan.scan_filters.all_mode = false;
+	k_mutex_unlock(&scan_add_mutex);
 
 	/* If the pointer to the initialization structure exist,
 	 * use it to scan the configuration.
@@ -1236,6 +1457,27 @@ static bool adv_data_found(struct bt_data *data, void *user_data)
 	return true;
 }
 
+static void filter_match_count(struct bt_scan_control *control)
+{
+	struct bt_scan_filter_match *status = &control->filter_status;
+	u16_t uuid_cnt = bt_scan.scan_filters.uuid.cnt;
+
+	/* In the multifilter mode, all UUIDs must be found in
+	 * the advertisement packets.
+	 */
+	status->uuid.match = (control->uuid_match_cnt > 0) &&
+			     (!control->all_mode ||
+			      (control->uuid_match_cnt == uuid_cnt));
+
+	control->filter_match_cnt = status->name.match +
+				    status->short_name.match +
+				    status->addr.match +
+				    status->uuid.match +
+				    status->appearance.match +
+				    status->manufacturer_data.match;
+	control->filter_match = (control->filter_match_cnt > 0);
+}
+
 static void filter_state_check(struct bt_scan_control *control,
 			       const bt_addr_le_t *addr)
 {
@@ -1269,6 +1511,12 @@ static void scan_device_found(const bt_addr_le_t *addr, s8_t rssi, u8_t type,
 
 	memset(&scan_control, 0, sizeof(scan_control));
 
+	/* The filter status points to the filters, so they cannot be
+	 * removed until the application is notified.
+	 */
+	k_mutex_lock(&scan_add_mutex, K_FOREVER);
+
+	bt_scan.report_gen++;
 	scan_control.all_mode = bt_scan.scan_filters.all_mode;
 
 	check_enabled_filters(&scan_control);
@@ -1289,6 +1537,8 @@ static void scan_device_found(const bt_addr_le_t *addr, s8_t rssi, u8_t type,
 	bt_data_parse(ad, adv_data_found, (void *)&scan_control);
 	net_buf_simple_restore(ad, &state);
 
+	filter_match_count(&scan_control);
+
 	scan_control.device_info.addr = addr;
 	scan_control.device_info.conn_param = &bt_scan.conn_param;
 	scan_control.device_info.adv_info.adv_type = type;
@@ -1300,6 +1550,8 @@ static void scan_device_found(const bt_addr_le_t *addr, s8_t rssi, u8_t type,
 	 * If the event handler is not NULL, notify the main application.
 	 */
 	filter_state_check(&scan_control, addr);
+
+	k_mutex_unlock(&scan_add_mutex);
 }
 
 int bt_scan_start(enum bt_scan_type scan_type)
@@ -114,6 +114,78 @@ int bt_gatt_hids_notify_disconnected(struct bt_gatt_hids *hids_obj,
 	return 0;
 }
 
+BUILD_ASSERT(CONFIG_BT_GATT_HIDS_INPUT_REP_MAX <= ATOMIC_BITS,
+	     "Pending Input Reports do not fit in atomic_t");
+
+/* Expands four bits of a report mask to a mask of four bytes, in memory
+ * order.
+ */
+static u32_t rep_mask_expand(u8_t bits)
+{
+	static const u32_t expanded[] = {
+		0x00000000, 0x000000FF, 0x0000FF00, 0x0000FFFF,
+		0x00FF0000, 0x00FF00FF, 0x00FFFF00, 0x00FFFFFF,
+		0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFF00FFFF,
+		0xFFFF0000, 0xFFFF00FF, 0xFFFFFF00, 0xFFFFFFFF,
+	};
+
+	return sys_le32_to_cpu(expanded[bits & 0x0F]);
+}
+
+static void store_input_report(struct bt_gatt_hids_inp_rep *hids_inp_rep,
+			       u8_t *rep_data, u8_t const *rep, u8_t len)
+{
+	if (!hids_inp_rep->rep_mask) {
+		memcpy(rep_data, rep, len);
+		return;
+	}
+
+	const u8_t *rep_mask = hids_inp_rep->rep_mask;
+	size_t i;
+
+	/* Merge a word at a time, the tail byte by byte. */
+	for (i = 0; i + sizeof(u32_t) <= len; i += sizeof(u32_t)) {
+		u32_t mask = rep_mask_expand(rep_mask[i / 8] >> (i % 8));
+		u32_t cur = UNALIGNED_GET((u32_t *)&rep_data[i]);
+		u32_t new = UNALIGNED_GET((u32_t *)&rep[i]);
+
+		UNALIGNED_PUT((cur & ~mask) | (new & mask),
+			      (u32_t *)&rep_data[i]);
+	}
+
+	for (; i < len; i++) {
+		if ((rep_mask[i / 8] & BIT(i % 8)) != 0) {
+			rep_data[i] = rep[i];
+		}
+	}
+}
+
+/* Copies the report sent to all peers to the context of the peer, if the
+ * peer has not got it yet.
+ */
+static void inp_rep_sync(struct bt_gatt_hids *hids_obj,
+			 struct bt_gatt_hids_conn_data *conn_data,
+			 struct bt_gatt_hids_inp_rep *hids_inp_rep)
+{
+	u8_t offset = hids_inp_rep->offset;
+	k_spinlock_key_t key;
+
+	/* The snapshot can be updated by the application thread while
+	 * it is copied from the Bluetooth RX thread.
+	 */
+	key = k_spin_lock(&hids_obj->inp_rep_lock);
+
+	if (atomic_test_and_clear_bit(&conn_data->inp_rep_pending,
+				      hids_inp_rep->idx)) {
+		store_input_report(hids_inp_rep,
+				   conn_data->inp_rep_ctx + offset,
+				   hids_obj->inp_rep_snapshot + offset,
+				   hids_inp_rep->size);
+	}
+
+	k_spin_unlock(&hids_obj->inp_rep_lock, key);
+}
+
 static ssize_t hids_protocol_mode_write(struct bt_conn *conn,
 					struct bt_gatt_attr const *attr,
 					void const *buf, u16_t len,
@@ -225,6 +297,7 @@ static ssize_t hids_inp_rep_read(struct bt_conn *conn,
 		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
 	}
 
+	inp_rep_sync(hids, conn_data, rep);
 	rep_data = conn_data->inp_rep_ctx + rep->offset;
 
 	ret_len = bt_gatt_attr_read(conn, attr, buf, len, offset, rep_data,
@@ -978,6 +1051,7 @@ int bt_gatt_hids_uninit(struct bt_gatt_hids *hids_obj)
 
 	struct bt_gatt_attr *attr_start = hids_obj->gp.svc.attrs;
 	struct bt_conn_ctx_lib *conn_ctx = hids_obj->conn_ctx;
+	u8_t *inp_rep_snapshot = hids_obj->inp_rep_snapshot;
 
 	/* Free the whole GATT pool */
 	bt_gatt_pool_free(&hids_obj->gp);
@@ -989,40 +1063,28 @@ int bt_gatt_hids_uninit(struct bt_gatt_hids *hids_obj)
 	memset(hids_obj, 0, sizeof(*hids_obj));
 	hids_obj->gp.svc.attrs = attr_start;
 	hids_obj->conn_ctx = conn_ctx;
+	hids_obj->inp_rep_snapshot = inp_rep_snapshot;
 
 	return 0;
 }
 
-static void store_input_report(struct bt_gatt_hids_inp_rep *hids_inp_rep,
-			       u8_t *rep_data, u8_t const *rep, u8_t len)
-{
-	if (!hids_inp_rep->rep_mask) {
-		memcpy(rep_data, rep, len);
-		return;
-	}
-
-	const u8_t *rep_mask = hids_inp_rep->rep_mask;
-
-	for (size_t i = 0; i < len; i++) {
-		if ((rep_mask[i / 8] & BIT(i % 8)) != 0) {
-			rep_data[i] = rep[i];
-		}
-	}
-}
-
 static int inp_rep_notify_all(struct bt_gatt_hids *hids_obj,
 			      struct bt_gatt_hids_inp_rep *hids_inp_rep,
 			      u8_t const *rep, u8_t len,
 			      bt_gatt_complete_func_t cb)
 {
 	struct bt_gatt_hids_conn_data *conn_data;
-	u8_t *rep_data = NULL;
+	struct bt_conn *subscribed[CONFIG_BT_MAX_CONN] = {NULL};
+	bool notify = false;
+	k_spinlock_key_t key;
 	struct bt_gatt_attr *rep_attr =
 		&hids_obj->gp.svc.attrs[hids_inp_rep->att_ind];
 
 	const size_t contexts =
 	    bt_conn_ctx_count(hids_obj->conn_ctx);
 
+	__ASSERT_NO_MSG(contexts <= ARRAY_SIZE(subscribed));
+
 	for (size_t i = 0; i < contexts; i++) {
 		const struct bt_conn_ctx *ctx =
 			bt_conn_ctx_get_by_id(hids_obj->conn_ctx, i);
@@ -1032,12 +1094,14 @@ static int inp_rep_notify_all(struct bt_gatt_hids *hids_obj,
 				ctx->conn, rep_attr, BT_GATT_CCC_NOTIFY);
 
 			if (notification_enabled) {
-				conn_data = ctx->data;
-				rep_data = conn_data->inp_rep_ctx +
-					   hids_inp_rep->offset;
-
-				store_input_report(hids_inp_rep, rep_data, rep,
-						   len);
+				subscribed[i] = ctx->conn;
+				notify = true;
+			} else {
+				/* The peer keeps the last report it was
+				 * sent, take it before the snapshot changes.
+				 */
+				inp_rep_sync(hids_obj, ctx->data,
+					     hids_inp_rep);
 			}
 
 			bt_conn_ctx_release(hids_obj->conn_ctx,
@@ -1045,18 +1109,43 @@ static int inp_rep_notify_all(struct bt_gatt_hids *hids_obj,
 		}
 	}
 
-	if (rep_data != NULL) {
-		struct bt_gatt_notify_params params = {0};
+	if (!notify) {
+		return -ENODATA;
+	}
 
-		params.attr = rep_attr;
-		params.data = rep;
-		params.len = hids_inp_rep->size;
-		params.func = cb;
+	key = k_spin_lock(&hids_obj->inp_rep_lock);
+	memcpy(hids_obj->inp_rep_snapshot + hids_inp_rep->offset, rep, len);
+	k_spin_unlock(&hids_obj->inp_rep_lock, key);
 
-		return bt_gatt_notify_cb(NULL, &params);
-	} else {
-		return -ENODATA;
+	/* The peers copy the snapshot when they access the report. */
+	for (size_t i = 0; i < contexts; i++) {
+		if (!subscribed[i]) {
+			continue;
+		}
+
+		const struct bt_conn_ctx *ctx =
+			bt_conn_ctx_get_by_id(hids_obj->conn_ctx, i);
+
+		if (ctx) {
+			if (ctx->conn == subscribed[i]) {
+				conn_data = ctx->data;
+				atomic_set_bit(&conn_data->inp_rep_pending,
+					       hids_inp_rep->idx);
+			}
+
+			bt_conn_ctx_release(hids_obj->conn_ctx,
+					    (void *)ctx->data);
+		}
 	}
+
+	struct bt_gatt_notify_params params = {0};
+
+	params.attr = rep_attr;
+	params.data = rep;
+	params.len = hids_inp_rep->size;
+	params.func = cb;
+
+	return bt_gatt_notify_cb(NULL, &params);
 }
 
 int bt_gatt_hids_inp_rep_send(struct bt_gatt_hids *hids_obj,
@@ -1090,6 +1179,8 @@ int bt_gatt_hids_inp_rep_send(struct bt_gatt_hids *hids_obj,
 		return -EINVAL;
 	}
 
+	/* Apply the report sent to all peers first, to keep the order. */
+	inp_rep_sync(hids_obj, conn_data, hids_inp_rep);
 	rep_data = conn_data->inp_rep_ctx + hids_inp_rep->offset;
 
 	store_input_report(hids_inp_rep, rep_data, rep, len);
@@ -21,6 +21,17 @@
 
 LOG_MODULE_REGISTER(bt_gatt_throughput, CONFIG_BT_GATT_THROUGHPUT_LOG_LEVEL);
 
+#if defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED)
+/* The characteristic value is the metrics followed by filler data up to the
+ * maximum attribute length, so that reading the whole value takes several
+ * Read Blob requests.
+ */
+#define THROUGHPUT_VALUE_LEN	512
+#else
+#define THROUGHPUT_VALUE_LEN	sizeof(struct bt_gatt_throughput_metrics)
+#endif
+#define THROUGHPUT_VALUE_FILL	0xA5
+
 static struct bt_gatt_throughput_metrics met;
 static const struct bt_gatt_throughput_cb *callbacks;
 
@@ -86,20 +97,77 @@ static ssize_t read_callback(struct bt_conn *conn,
 			     u16_t len, u16_t offset)
 {
 	const struct bt_gatt_throughput_metrics *metrics = attr->user_data;
+	u8_t *data = buf;
+	u16_t metrics_len = 0;
 
-	len = MIN(sizeof(struct bt_gatt_throughput_metrics), len);
+	if (offset > THROUGHPUT_VALUE_LEN) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
 
-	if (callbacks->data_send) {
+	len = MIN(len, THROUGHPUT_VALUE_LEN - offset);
+
+	if (offset < sizeof(struct bt_gatt_throughput_metrics)) {
+		metrics_len = MIN(len, sizeof(*metrics) - offset);
+		memcpy(data, (const u8_t *)metrics + offset, metrics_len);
+	}
+
+	memset(&data[metrics_len], THROUGHPUT_VALUE_FILL, len - metrics_len);
+
+	if ((offset == 0) && callbacks->data_send) {
 		callbacks->data_send(metrics);
 	}
 
 	LOG_DBG("Data send.");
 
-	return bt_gatt_attr_read(
-		conn, attr, buf, len, offset, attr->user_data, len);
+	return len;
+}
+
+#if defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED)
+static void ccc_cfg_changed(const struct bt_gatt_attr *attr, u16_t value)
+{
+	bool enabled = (value == BT_GATT_CCC_NOTIFY);
+
+	LOG_DBG("Notifications %s.", enabled ? "enabled" : "disabled");
+
+	if (callbacks && callbacks->notify_enabled) {
+		callbacks->notify_enabled(enabled);
+	}
+}
+#endif /* defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED) */
+
+static u8_t notify_fn(struct bt_conn *conn,
+		      struct bt_gatt_subscribe_params *params,
+		      const void *data, u16_t len)
+{
+	struct bt_gatt_throughput *throughput;
+
+	throughput = CONTAINER_OF(params, struct bt_gatt_throughput,
+				  notify_params);
+
+	if (!data) {
+		LOG_DBG("Unsubscribed.");
+		params->value_handle = 0;
+	}
+
+	if (throughput->notify_func) {
+		return throughput->notify_func(conn, params, data, len);
+	}
+
+	return data ? BT_GATT_ITER_CONTINUE : BT_GATT_ITER_STOP;
 }
 
 
+#if defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED)
+BT_GATT_SERVICE_DEFINE(throughput_svc,
+BT_GATT_PRIMARY_SERVICE(BT_UUID_THROUGHPUT),
+	BT_GATT_CHARACTERISTIC(BT_UUID_THROUGHPUT_CHAR,
+		BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE_WITHOUT_RESP |
+		BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+		read_callback, write_callback, &met),
+	BT_GATT_CCC(ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+);
+#else
 BT_GATT_SERVICE_DEFINE(throughput_svc,
 BT_GATT_PRIMARY_SERVICE(BT_UUID_THROUGHPUT),
 	BT_GATT_CHARACTERISTIC(BT_UUID_THROUGHPUT_CHAR,
@@ -107,6 +175,7 @@ BT_GATT_PRIMARY_SERVICE(BT_UUID_THROUGHPUT),
 		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
 		read_callback, write_callback, &met),
 );
+#endif /* defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED) */
 
 int bt_gatt_throughput_init(struct bt_gatt_throughput *throughput,
 			    const struct bt_gatt_throughput_cb *cb)
@@ -152,6 +221,16 @@ int bt_gatt_throughput_handles_assign(struct bt_gatt_dm *dm,
 	LOG_DBG("Found handle for Throughput characteristic.");
 	throughput->char_handle = gatt_desc->handle;
 
+	/* Peers with an older version of the service do not notify. */
+	gatt_desc = bt_gatt_dm_desc_by_uuid(dm, gatt_chrc, BT_UUID_GATT_CCC);
+	if (gatt_desc) {
+		LOG_DBG("Found handle for CCC of Throughput characteristic.");
+		throughput->ccc_handle = gatt_desc->handle;
+	} else {
+		LOG_WRN("Missing Throughput characteristic CCC.");
+		throughput->ccc_handle = 0;
+	}
+
 	/* Assign connection object. */
 	throughput->conn = bt_gatt_dm_conn_get(dm);
 	return 0;
@@ -181,3 +260,93 @@ int bt_gatt_throughput_write(struct bt_gatt_throughput *throughput,
 					      throughput->char_handle,
 					      data, len, false);
 }
+
+int bt_gatt_throughput_write_cb(struct bt_gatt_throughput *throughput,
+				const u8_t *data, u16_t len,
+				bt_gatt_complete_func_t func, void *user_data)
+{
+	return bt_gatt_write_without_response_cb(throughput->conn,
+						 throughput->char_handle,
+						 data, len, false,
+						 func, user_data);
+}
+
+int bt_gatt_throughput_write_req(struct bt_gatt_throughput *throughput,
+				 const u8_t *data, u16_t len,
+				 bt_gatt_write_func_t func)
+{
+	throughput->write_params.func = func;
+	throughput->write_params.handle = throughput->char_handle;
+	throughput->write_params.offset = 0;
+	throughput->write_params.data = data;
+	throughput->write_params.length = len;
+
+	return bt_gatt_write(throughput->conn, &throughput->write_params);
+}
+
+int bt_gatt_throughput_read_blob(struct bt_gatt_throughput *throughput,
+				 u16_t offset, bt_gatt_read_func_t func)
+{
+	throughput->read_params.single.handle = throughput->char_handle;
+	throughput->read_params.single.offset = offset;
+	throughput->read_params.handle_count = 1;
+	throughput->read_params.func = func;
+
+	return bt_gatt_read(throughput->conn, &throughput->read_params);
+}
+
+int bt_gatt_throughput_subscribe(struct bt_gatt_throughput *throughput,
+				 bt_gatt_notify_func_t func)
+{
+	int err;
+
+	if (!throughput->ccc_handle) {
+		return -ENOTSUP;
+	}
+
+	if (throughput->notify_params.value_handle) {
+		return -EALREADY;
+	}
+
+	throughput->notify_func = func;
+	throughput->notify_params.notify = notify_fn;
+	throughput->notify_params.value = BT_GATT_CCC_NOTIFY;
+	throughput->notify_params.value_handle = throughput->char_handle;
+	throughput->notify_params.ccc_handle = throughput->ccc_handle;
+	atomic_set_bit(throughput->notify_params.flags,
+		       BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
+
+	err = bt_gatt_subscribe(throughput->conn, &throughput->notify_params);
+	if (err) {
+		LOG_ERR("Subscribe failed (err %d)", err);
+		throughput->notify_params.value_handle = 0;
+	}
+
+	return err;
+}
+
+int bt_gatt_throughput_unsubscribe(struct bt_gatt_throughput *throughput)
+{
+	if (!throughput->notify_params.value_handle) {
+		return -EALREADY;
+	}
+
+	return bt_gatt_unsubscribe(throughput->conn,
+				   &throughput->notify_params);
+}
+
+int bt_gatt_throughput_notify(struct bt_conn *conn, const u8_t *data,
+			      u16_t len)
+{
+#if defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED)
+	const struct bt_gatt_attr *attr = &throughput_svc.attrs[2];
+
+	if (!bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
+		return -EINVAL;
+	}
+
+	return bt_gatt_notify(conn, attr, data, len);
+#else
+	return -ENOTSUP;
+#endif /* defined(CONFIG_BT_GATT_THROUGHPUT_EXTENDED) */
+}
@@ -0,0 +1,554 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <pm_config.h>
+#include <storage/flash_map.h>
+#include <fs/fcb.h>
+#include <net/cloud.h>
+#include <net/cloud_queue.h>
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(cloud_queue, CONFIG_CLOUD_QUEUE_LOG_LEVEL);
+
+#define CLOUD_QUEUE_FLASH_AREA_ID	PM_CLOUD_QUEUE_STORAGE_ID
+#define CLOUD_QUEUE_FCB_MAGIC		0x436c5130 /* "ClQ0" */
+#define CLOUD_QUEUE_FCB_VERSION		1
+/* Endpoint type of the entry that marks all previous entries replayed. */
+#define CLOUD_QUEUE_MARKER		0xffff
+
+/* Header stored in front of every queued payload. */
+struct cloud_queue_hdr {
+	u16_t ep_type;
+	u8_t qos;
+	u8_t reserved;
+} __packed;
+
+struct sector_count_ctx {
+	u32_t min_off;
+	u32_t count;
+	/* Last replay marker found, fe_sector is NULL if there is none. */
+	struct fcb_entry marker;
+};
+
+static struct fcb queue_fcb;
+static struct flash_sector queue_sectors[CONFIG_CLOUD_QUEUE_SECTOR_COUNT];
+
+/* Last replayed entry. The entry with fe_sector set to NULL means that
+ * nothing was replayed from the oldest sector yet.
+ */
+static struct fcb_entry read_loc;
+
+static struct cloud_queue_stats stats;
+static bool initialized;
+static K_MUTEX_DEFINE(queue_lock);
+
+static const struct cloud_backend *replay_backend;
+static struct k_delayed_work replay_work;
+static u8_t replay_buf[sizeof(struct cloud_queue_hdr) +
+		       CONFIG_CLOUD_QUEUE_MSG_SIZE_MAX];
+
+static int entry_count_cb(struct fcb_entry_ctx *loc_ctx, void *arg)
+{
+	struct sector_count_ctx *ctx = arg;
+	struct cloud_queue_hdr hdr;
+	int err;
+
+	if (loc_ctx->loc.fe_elem_off <= ctx->min_off) {
+		return 0;
+	}
+
+	if (loc_ctx->loc.fe_data_len >= sizeof(hdr)) {
+		err = flash_area_read(loc_ctx->fap,
+				      FCB_ENTRY_FA_DATA_OFF(loc_ctx->loc),
+				      &hdr, sizeof(hdr));
+		if (!err && (hdr.ep_type == CLOUD_QUEUE_MARKER)) {
+			/* All entries before the marker were replayed. */
+			ctx->marker = loc_ctx->loc;
+			ctx->count = 0;
+			return 0;
+		}
+	}
+
+	ctx->count++;
+
+	return 0;
+}
+
+static u32_t pending_in_sector(struct flash_sector *sector)
+{
+	struct sector_count_ctx ctx = {
+		.min_off = 0,
+		.count = 0,
+		.marker.fe_sector = NULL,
+	};
+
+	if (read_loc.fe_sector == sector) {
+		ctx.min_off = read_loc.fe_elem_off;
+	}
+
+	fcb_walk(&queue_fcb, sector, entry_count_cb, &ctx);
+
+	return ctx.count;
+}
+
+static int queue_rotate(void)
+{
+	int err = fcb_rotate(&queue_fcb);
+
+	if (err) {
+		LOG_ERR("Cannot rotate queue, err %d", err);
+		return err;
+	}
+
+	stats.erases++;
+
+	return 0;
+}
+
+/* Erase the sectors whose entries were all replayed. */
+static int consumed_sectors_release(void)
+{
+	int err;
+
+	while ((read_loc.fe_sector != NULL) &&
+	       (queue_fcb.f_oldest != read_loc.fe_sector)) {
+		err = queue_rotate();
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int oldest_sector_drop(void)
+{
+	u32_t dropped = pending_in_sector(queue_fcb.f_oldest);
+	int err;
+
+	if (queue_fcb.f_oldest == queue_fcb.f_active.fe_sector) {
+		/* Queue cannot make room without dropping everything. */
+		return -ENOSPC;
+	}
+
+	err = queue_rotate();
+	if (err) {
+		return err;
+	}
+
+	/* The replay position can only be in the dropped sector. */
+	read_loc.fe_sector = NULL;
+
+	stats.depth -= dropped;
+	stats.dropped += dropped;
+
+	LOG_WRN("Queue full, %u oldest messages dropped", dropped);
+
+	return 0;
+}
+
+static int entry_append(const struct cloud_queue_hdr *hdr,
+			const char *payload, size_t len,
+			struct fcb_entry *loc)
+{
+	int err;
+
+	err = fcb_append(&queue_fcb, sizeof(*hdr) + len, loc);
+	if (err) {
+		return err;
+	}
+
+	err = flash_area_write(queue_fcb.fap, FCB_ENTRY_FA_DATA_OFF(*loc),
+			       hdr, sizeof(*hdr));
+	if (err) {
+		return err;
+	}
+
+	if (len > 0) {
+		err = flash_area_write(queue_fcb.fap,
+				       FCB_ENTRY_FA_DATA_OFF(*loc) +
+				       sizeof(*hdr),
+				       payload, len);
+		if (err) {
+			return err;
+		}
+	}
+
+	return fcb_append_finish(&queue_fcb, loc);
+}
+
+/* Persist the replay position once the queue is drained, so that the
+ * replayed entries are not sent again after a reset. The sectors holding
+ * them are only erased when the replay moves past them.
+ */
+static int replay_marker_append(void)
+{
+	const struct cloud_queue_hdr hdr = {
+		.ep_type = CLOUD_QUEUE_MARKER,
+	};
+	struct fcb_entry loc;
+	int err;
+
+	err = entry_append(&hdr, NULL, 0, &loc);
+	if (err == -ENOSPC) {
+		/* Only replayed entries are left in the oldest sector. */
+		err = queue_rotate();
+		if (!err) {
+			err = entry_append(&hdr, NULL, 0, &loc);
+		}
+	}
+
+	if (err) {
+		LOG_ERR("Cannot store replay position, err %d", err);
+		return err;
+	}
+
+	read_loc = loc;
+
+	return 0;
+}
+
+int cloud_queue_put(const struct cloud_msg *msg)
+{
+	struct cloud_queue_hdr hdr;
+	struct fcb_entry loc;
+	int err;
+
+	if (msg == NULL) {
+		return -EINVAL;
+	}
+
+	if (msg->len > CONFIG_CLOUD_QUEUE_MSG_SIZE_MAX) {
+		return -EMSGSIZE;
+	}
+
+	if (!initialized) {
+		return -EPERM;
+	}
+
+	hdr.ep_type = msg->endpoint.type;
+	hdr.qos = msg->qos;
+	hdr.reserved = 0;
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+
+	err = entry_append(&hdr, msg->buf, msg->len, &loc);
+	if (err == -ENOSPC) {
+		if (IS_ENABLED(CONFIG_CLOUD_QUEUE_DROP_OLDEST)) {
+			err = oldest_sector_drop();
+			if (!err) {
+				err = entry_append(&hdr, msg->buf, msg->len,
+						   &loc);
+			}
+		}
+
+		if (err == -ENOSPC) {
+			stats.dropped++;
+		}
+	}
+
+	if (!err) {
+		stats.depth++;
+		stats.stored++;
+	}
+
+	k_mutex_unlock(&queue_lock);
+
+	if (err && (err != -ENOSPC)) {
+		LOG_ERR("Cannot store message, err %d", err);
+	}
+
+	return err;
+}
+
+int cloud_queue_send(const struct cloud_backend *const backend,
+		     const struct cloud_msg *msg)
+{
+	bool queued;
+	int err = 0;
+
+	if ((backend == NULL) || (msg == NULL)) {
+		return -EINVAL;
+	}
+
+	if (!initialized) {
+		return cloud_send(backend, msg);
+	}
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+
+	/* The message waits behind the older ones. The replay checks for
+	 * new entries under the same lock before it finishes.
+	 */
+	queued = (replay_backend != NULL) || (stats.depth > 0);
+	if (queued) {
+		err = cloud_queue_put(msg);
+	}
+
+	k_mutex_unlock(&queue_lock);
+
+	if (queued) {
+		return err;
+	}
+
+	err = cloud_send(backend, msg);
+	if (err) {
+		LOG_DBG("Send failed, err %d, queueing message", err);
+		err = cloud_queue_put(msg);
+	}
+
+	return err;
+}
+
+/* Read the oldest pending entry into the replay buffer, skipping replay
+ * markers and malformed entries. Returns -ENOENT if there is none.
+ */
+static int entry_read(struct fcb_entry *loc, struct cloud_msg *msg)
+{
+	struct cloud_queue_hdr hdr;
+	int err;
+
+	while (true) {
+		*loc = read_loc;
+
+		err = fcb_getnext(&queue_fcb, loc);
+		if (err) {
+			return -ENOENT;
+		}
+
+		if ((loc->fe_data_len < sizeof(hdr)) ||
+		    (loc->fe_data_len > sizeof(replay_buf))) {
+			LOG_WRN("Skipping malformed entry, len %u",
+				loc->fe_data_len);
+			read_loc = *loc;
+			stats.depth--;
+			continue;
+		}
+
+		err = flash_area_read(queue_fcb.fap,
+				      FCB_ENTRY_FA_DATA_OFF(*loc),
+				      replay_buf, loc->fe_data_len);
+		if (err) {
+			return err;
+		}
+
+		memcpy(&hdr, replay_buf, sizeof(hdr));
+		if (hdr.ep_type != CLOUD_QUEUE_MARKER) {
+			break;
+		}
+
+		read_loc = *loc;
+	}
+
+	msg->buf = (char *)&replay_buf[sizeof(hdr)];
+	msg->len = loc->fe_data_len - sizeof(hdr);
+	msg->qos = hdr.qos;
+	msg->endpoint.type = hdr.ep_type;
+	msg->endpoint.str = NULL;
+	msg->endpoint.len = 0;
+
+	return 0;
+}
+
+/* Move the replay position past a sent entry. The erase count taken when
+ * the entry was read tells whether its sector was dropped meanwhile.
+ */
+static int entry_consume(const struct fcb_entry *loc, u32_t erases)
+{
+	int err;
+
+	stats.replayed++;
+
+	if (stats.erases != erases) {
+		/* The replay restarts from the oldest sector left, the entry
+		 * may be sent again.
+		 */
+		return 0;
+	}
+
+	read_loc = *loc;
+	stats.depth--;
+
+	if (stats.depth == 0) {
+		err = replay_marker_append();
+		if (err) {
+			return err;
+		}
+	}
+
+	return consumed_sectors_release();
+}
+
+static void replay_work_fn(struct k_work *work)
+{
+	const struct cloud_backend *backend;
+	struct fcb_entry loc;
+	struct cloud_msg msg;
+	u32_t erases;
+	int err = 0;
+
+	for (size_t i = 0; i < CONFIG_CLOUD_QUEUE_REPLAY_BATCH_SIZE; i++) {
+		k_mutex_lock(&queue_lock, K_FOREVER);
+
+		backend = replay_backend;
+		if (backend == NULL) {
+			k_mutex_unlock(&queue_lock);
+			return;
+		}
+
+		err = entry_read(&loc, &msg);
+		if (err == -ENOENT) {
+			/* Under the same lock as the read, so that a message
+			 * queued right after it is not left behind.
+			 */
+			LOG_INF("Queue replayed");
+			replay_backend = NULL;
+		}
+
+		erases = stats.erases;
+
+		k_mutex_unlock(&queue_lock);
+
+		if (err) {
+			break;
+		}
+
+		/* Sent without the lock, so that a slow backend does not
+		 * block the producers.
+		 */
+		err = cloud_send(backend, &msg);
+
+		k_mutex_lock(&queue_lock, K_FOREVER);
+		if (!err) {
+			err = entry_consume(&loc, erases);
+		}
+		k_mutex_unlock(&queue_lock);
+
+		if (err) {
+			break;
+		}
+	}
+
+	if (err == -ENOENT) {
+		return;
+	}
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+
+	if (err) {
+		LOG_WRN("Replay stopped, err %d, %u messages pending",
+			err, stats.depth);
+		if (replay_backend == backend) {
+			replay_backend = NULL;
+		}
+	} else if (replay_backend != NULL) {
+		k_delayed_work_submit(&replay_work,
+				      K_MSEC(CONFIG_CLOUD_QUEUE_REPLAY_INTERVAL));
+	}
+
+	k_mutex_unlock(&queue_lock);
+}
+
+int cloud_queue_replay_start(const struct cloud_backend *const backend)
+{
+	if (backend == NULL) {
+		return -EINVAL;
+	}
+
+	if (!initialized) {
+		return -EPERM;
+	}
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+	replay_backend = backend;
+	k_mutex_unlock(&queue_lock);
+
+	LOG_DBG("Replaying %u messages", stats.depth);
+
+	return k_delayed_work_submit(&replay_work, K_NO_WAIT);
+}
+
+void cloud_queue_replay_stop(void)
+{
+	k_mutex_lock(&queue_lock, K_FOREVER);
+	replay_backend = NULL;
+	k_delayed_work_cancel(&replay_work);
+	k_mutex_unlock(&queue_lock);
+}
+
+void cloud_queue_stats_get(struct cloud_queue_stats *stats_out)
+{
+	__ASSERT_NO_MSG(stats_out != NULL);
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+	*stats_out = stats;
+	k_mutex_unlock(&queue_lock);
+}
+
+int cloud_queue_init(void)
+{
+	struct sector_count_ctx ctx = {
+		.min_off = 0,
+		.count = 0,
+		.marker.fe_sector = NULL,
+	};
+	u32_t sector_cnt = ARRAY_SIZE(queue_sectors);
+	int err;
+
+	if (initialized) {
+		return 0;
+	}
+
+	err = flash_area_get_sectors(CLOUD_QUEUE_FLASH_AREA_ID, &sector_cnt,
+				     queue_sectors);
+	if (err) {
+		LOG_ERR("Cannot get flash sectors, err %d", err);
+		return err;
+	}
+
+	queue_fcb.f_magic = CLOUD_QUEUE_FCB_MAGIC;
+	queue_fcb.f_version = CLOUD_QUEUE_FCB_VERSION;
+	queue_fcb.f_sectors = queue_sectors;
+	queue_fcb.f_sector_cnt = sector_cnt;
+	queue_fcb.f_scratch_cnt = 0;
+
+	err = fcb_init(CLOUD_QUEUE_FLASH_AREA_ID, &queue_fcb);
+	if (err) {
+		LOG_ERR("Cannot initialize FCB, err %d", err);
+		return err;
+	}
+
+	fcb_walk(&queue_fcb, NULL, entry_count_cb, &ctx);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.depth = ctx.count;
+	read_loc = ctx.marker;
+
+	/* Keep the replay position in the oldest sector. */
+	err = consumed_sectors_release();
+	if (err) {
+		return err;
+	}
+
+	k_delayed_work_init(&replay_work, replay_work_fn);
+	initialized = true;
+
+	LOG_INF("Cloud queue ready, %u messages pending", stats.depth);
+
+	return 0;
+}
+
+void cloud_queue_uninit(void)
+{
+	cloud_queue_replay_stop();
+
+	k_mutex_lock(&queue_lock, K_FOREVER);
+	initialized = false;
+	k_mutex_unlock(&queue_lock);
+}
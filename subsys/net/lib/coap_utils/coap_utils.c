@@ -8,13 +8,20 @@
 #include <net/coap.h>
 #include <net/coap_utils.h>
 #include <net/socket.h>
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+#include <modem/nrf91_socket.h>
+#endif
 
 LOG_MODULE_REGISTER(coap_utils, CONFIG_COAP_UTILS_LOG_LEVEL);
 
 #define MAX_COAP_MSG_LEN 256
 #define COAP_VER 1
 #define COAP_TOKEN_LEN 8
-#define COAP_MAX_REPLIES 1
+/* The first reply is used by single requests, the others by observers. */
+#define COAP_MAX_REPLIES (1 + CONFIG_COAP_UTILS_MAX_OBSERVERS)
+#define COAP_OBSERVE_REGISTER 0
+#define COAP_OBSERVE_DEREGISTER 1
+#define COAP_OBSERVE_NONE -1
 #define COAP_POOL_SLEEP 500
 #define COAP_OPEN_SOCKET_SLEEP 200
 #define COAP_RECEIVE_STACK_SIZE 500
@@ -22,10 +29,20 @@ LOG_MODULE_REGISTER(coap_utils, CONFIG_COAP_UTILS_LOG_LEVEL);
 const static int nfds = 1;
 static struct pollfd fds;
 static struct coap_reply replies[COAP_MAX_REPLIES];
+static K_MUTEX_DEFINE(replies_lock);
 static int proto_family;
 
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+/* Responses are received from the system work queue when the socket
+ * signals readiness, so no receive thread is needed.
+ */
+static struct k_poll_signal receive_signal;
+static struct k_poll_event receive_event;
+static struct k_work_poll receive_work;
+#else
 static K_THREAD_STACK_DEFINE(receive_stack_area, COAP_RECEIVE_STACK_SIZE);
 static struct k_thread receive_thread_data;
+#endif
 
 static int coap_open_socket(void)
 {
@@ -49,83 +66,189 @@ static void coap_close_socket(int socket)
 	(void)close(socket);
 }
 
-static void coap_receive(void)
+/* Returns -EAGAIN if there was no datagram to read. */
+static int coap_receive_response(void)
 {
 	static u8_t buf[MAX_COAP_MSG_LEN + 1];
 	struct coap_packet response;
 	struct coap_reply *reply = NULL;
 	static struct sockaddr from_addr;
-	socklen_t from_addr_len;
+	socklen_t from_addr_len = sizeof(from_addr);
 	int len;
 	int ret;
 
-	while (1) {
-		fds.revents = 0;
+	len = recvfrom(fds.fd, buf, sizeof(buf) - 1, MSG_DONTWAIT, &from_addr,
+		       &from_addr_len);
 
-		if (poll(&fds, nfds, -1) < 0) {
-			LOG_ERR("Error in poll:%d", errno);
-			errno = 0;
-			k_sleep(K_MSEC(COAP_POOL_SLEEP));
-			continue;
+	if (len < 0) {
+		ret = -errno;
+		if (errno != EAGAIN) {
+			LOG_ERR("Error reading response: %d", errno);
 		}
+		errno = 0;
+		return ret;
+	}
 
-		if (fds.revents & POLLERR) {
-			LOG_ERR("Error in poll.. waiting a moment.");
-			k_sleep(K_MSEC(COAP_POOL_SLEEP));
-			continue;
-		}
+	if (len == 0) {
+		LOG_ERR("Zero length recv");
+		return 0;
+	}
 
-		if (fds.revents & POLLHUP) {
-			LOG_ERR("Error in poll: POLLHUP");
-			continue;
-		}
+	ret = coap_packet_parse(&response, buf, len, NULL, 0);
+	if (ret < 0) {
+		LOG_ERR("Invalid data received");
+		return 0;
+	}
 
-		if (fds.revents & POLLNVAL) {
-			LOG_ERR("Error in poll: POLLNVAL - fd not open");
+	k_mutex_lock(&replies_lock, K_FOREVER);
 
-			coap_close_socket(fds.fd);
-			fds.fd = coap_open_socket();
+	reply = coap_response_received(&response, &from_addr, replies,
+				       COAP_MAX_REPLIES);
+	if (reply == &replies[0]) {
+		/* Notifications keep the observer reply registered. */
+		coap_reply_clear(reply);
+	}
 
-			LOG_INF("Socket has been re-open");
+	k_mutex_unlock(&replies_lock);
 
-			continue;
-		}
+	return 0;
+}
 
-		if (!(fds.revents & POLLIN)) {
-			LOG_ERR("Unknown poll error");
-			continue;
-		}
+/* Returns false if the caller should wait a moment before polling again. */
+static bool coap_handle_poll_events(short revents)
+{
+	if (revents & POLLERR) {
+		LOG_ERR("Error in poll.. waiting a moment.");
+		return false;
+	}
 
-		len = recvfrom(fds.fd, buf, sizeof(buf) - 1, 0, &from_addr,
-			       &from_addr_len);
+	if (revents & POLLHUP) {
+		LOG_ERR("Error in poll: POLLHUP");
+		return true;
+	}
 
-		if (len < 0) {
-			LOG_ERR("Error reading response: %d", errno);
-			errno = 0;
-			continue;
-		}
+	if (revents & POLLNVAL) {
+		LOG_ERR("Error in poll: POLLNVAL - fd not open");
 
-		if (len == 0) {
-			LOG_ERR("Zero length recv");
-			continue;
+		coap_close_socket(fds.fd);
+		fds.fd = coap_open_socket();
+
+		LOG_INF("Socket has been re-open");
+
+		return true;
+	}
+
+	if (!(revents & POLLIN)) {
+		LOG_ERR("Unknown poll error");
+		return true;
+	}
+
+	(void)coap_receive_response();
+
+	return true;
+}
+
+#if defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL)
+static void coap_receive_submit(k_timeout_t timeout)
+{
+	int ret;
+
+	ret = k_work_poll_submit(&receive_work, &receive_event, 1, timeout);
+	if (ret) {
+		LOG_ERR("Cannot wait for responses: %d", ret);
+	}
+}
+
+static void coap_receive_work_fn(struct k_work *work)
+{
+	unsigned int signaled;
+	int revents;
+	int fd = fds.fd;
+
+	ARG_UNUSED(work);
+
+	k_poll_signal_check(&receive_signal, &signaled, &revents);
+	k_poll_signal_reset(&receive_signal);
+	receive_event.state = K_POLL_STATE_NOT_READY;
+
+	if (!signaled) {
+		/* Retry after an error */
+		revents = POLLIN;
+	}
+
+	if (!coap_handle_poll_events(revents)) {
+		coap_receive_submit(K_MSEC(COAP_POOL_SLEEP));
+		return;
+	}
+
+	if (fds.fd != fd) {
+		/* Socket re-opened */
+		nrf91_socket_poll_signal_set(fds.fd, POLLIN, &receive_signal);
+	} else if (revents & POLLIN) {
+		/* Read all queued responses, the signal is raised again
+		 * only on the next modem event.
+		 */
+		while (coap_receive_response() == 0) {
 		}
+	}
 
-		ret = coap_packet_parse(&response, buf, len, NULL, 0);
-		if (ret < 0) {
-			LOG_ERR("Invalid data received");
+	coap_receive_submit(K_FOREVER);
+}
+
+static void coap_receive_start(void)
+{
+	int ret;
+
+	k_poll_signal_init(&receive_signal);
+	k_poll_event_init(&receive_event, K_POLL_TYPE_SIGNAL,
+			  K_POLL_MODE_NOTIFY_ONLY, &receive_signal);
+	k_work_poll_init(&receive_work, coap_receive_work_fn);
+
+	ret = nrf91_socket_poll_signal_set(fds.fd, POLLIN, &receive_signal);
+	if (ret) {
+		LOG_ERR("Cannot register socket signal: %d", ret);
+		return;
+	}
+
+	coap_receive_submit(K_FOREVER);
+	LOG_DBG("CoAP socket receive work started");
+}
+#else
+static void coap_receive(void)
+{
+	while (1) {
+		fds.revents = 0;
+
+		if (poll(&fds, nfds, -1) < 0) {
+			LOG_ERR("Error in poll:%d", errno);
+			errno = 0;
+			k_sleep(K_MSEC(COAP_POOL_SLEEP));
 			continue;
 		}
 
-		reply = coap_response_received(&response, &from_addr, replies,
-					       COAP_MAX_REPLIES);
-		if (reply) {
-			coap_reply_clear(reply);
+		if (!coap_handle_poll_events(fds.revents)) {
+			k_sleep(K_MSEC(COAP_POOL_SLEEP));
 		}
 	}
 }
 
+static void coap_receive_start(void)
+{
+	/* start sock receive thread */
+	k_thread_create(&receive_thread_data, receive_stack_area,
+			K_THREAD_STACK_SIZEOF(receive_stack_area),
+			(k_thread_entry_t)coap_receive, NULL, NULL, NULL,
+			/* Lowest priority cooperative thread */
+			K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1), 0,
+			K_NO_WAIT);
+	k_thread_name_set(&receive_thread_data, "CoAP-sock-recv");
+	LOG_DBG("CoAP socket receive thread started");
+}
+#endif /* defined(CONFIG_NRF91_SOCKET_POLL_SIGNAL) */
+
 static int coap_init_request(enum coap_method method,
-			     enum coap_msgtype msg_type,
+			     enum coap_msgtype msg_type, u8_t *token,
+			     int observe,
 			     const char *const *uri_path_options, u8_t *payload,
 			     u16_t payload_size, struct coap_packet *request,
 			     u8_t *buf)
@@ -134,13 +257,23 @@ static int coap_init_request(enum coap_method method,
 	int ret;
 
 	ret = coap_packet_init(request, buf, MAX_COAP_MSG_LEN, COAP_VER,
-			       msg_type, COAP_TOKEN_LEN, coap_next_token(),
+			       msg_type, COAP_TOKEN_LEN, token,
 			       method, coap_next_id());
 	if (ret < 0) {
 		LOG_ERR("Failed to init CoAP message");
 		goto end;
 	}
 
+	if (observe != COAP_OBSERVE_NONE) {
+		/* Observe precedes Uri-Path in the option order. */
+		ret = coap_append_option_int(request, COAP_OPTION_OBSERVE,
+					     observe);
+		if (ret < 0) {
+			LOG_ERR("Unable add option to request");
+			goto end;
+		}
+	}
+
 	for (opt = uri_path_options; opt && *opt; opt++) {
 		ret = coap_packet_append_option(request, COAP_OPTION_URI_PATH,
 						*opt, strlen(*opt));
@@ -181,11 +314,26 @@ static void coap_set_response_callback(struct coap_packet *request,
 {
 	struct coap_reply *reply;
 
+	k_mutex_lock(&replies_lock, K_FOREVER);
+
 	reply = &replies[0];
 
 	coap_reply_clear(reply);
 	coap_reply_init(reply, request);
 	reply->reply = reply_cb;
+
+	k_mutex_unlock(&replies_lock);
+}
+
+static struct coap_reply *coap_observer_find(coap_reply_t reply_cb)
+{
+	for (size_t i = 1; i < ARRAY_SIZE(replies); i++) {
+		if (replies[i].reply == reply_cb) {
+			return &replies[i];
+		}
+	}
+
+	return NULL;
 }
 
 void coap_init(int ip_family)
@@ -196,15 +344,7 @@ void coap_init(int ip_family)
 	fds.revents = 0;
 	fds.fd = coap_open_socket();
 
-	/* start sock receive thread */
-	k_thread_create(&receive_thread_data, receive_stack_area,
-			K_THREAD_STACK_SIZEOF(receive_stack_area),
-			(k_thread_entry_t)coap_receive, NULL, NULL, NULL,
-			/* Lowest priority cooperative thread */
-			K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1), 0,
-			K_NO_WAIT);
-	k_thread_name_set(&receive_thread_data, "CoAP-sock-recv");
-	LOG_DBG("CoAP socket receive thread started");
+	coap_receive_start();
 }
 
 int coap_send_request(enum coap_method method, const struct sockaddr *addr,
@@ -215,7 +355,8 @@ int coap_send_request(enum coap_method method, const struct sockaddr *addr,
 	struct coap_packet request;
 	u8_t buf[MAX_COAP_MSG_LEN];
 
-	ret = coap_init_request(method, COAP_TYPE_NON_CON, uri_path_options,
+	ret = coap_init_request(method, COAP_TYPE_NON_CON, coap_next_token(),
+				COAP_OBSERVE_NONE, uri_path_options,
 				payload, payload_size, &request, buf);
 	if (ret < 0) {
 		goto end;
@@ -234,3 +375,93 @@ int coap_send_request(enum coap_method method, const struct sockaddr *addr,
 end:
 	return ret;
 }
+
+int coap_observe_request(const struct sockaddr *addr,
+			 const char *const *uri_path_options,
+			 coap_reply_t reply_cb)
+{
+	int ret;
+	struct coap_packet request;
+	struct coap_reply *reply;
+	u8_t buf[MAX_COAP_MSG_LEN];
+
+	if (reply_cb == NULL) {
+		return -EINVAL;
+	}
+
+	ret = coap_init_request(COAP_METHOD_GET, COAP_TYPE_NON_CON,
+				coap_next_token(), COAP_OBSERVE_REGISTER,
+				uri_path_options, NULL, 0, &request, buf);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&replies_lock, K_FOREVER);
+
+	/* A free observer reply has no callback. */
+	reply = coap_observer_find(NULL);
+	if (reply == NULL) {
+		k_mutex_unlock(&replies_lock);
+		LOG_ERR("No free observer");
+		return -ENOMEM;
+	}
+
+	coap_reply_init(reply, &request);
+	reply->reply = reply_cb;
+
+	k_mutex_unlock(&replies_lock);
+
+	ret = coap_send_message(addr, &request);
+	if (ret < 0) {
+		LOG_ERR("Transmission failed: %d", errno);
+
+		k_mutex_lock(&replies_lock, K_FOREVER);
+		coap_reply_clear(reply);
+		k_mutex_unlock(&replies_lock);
+	}
+
+	return ret;
+}
+
+int coap_observe_cancel(const struct sockaddr *addr,
+			const char *const *uri_path_options,
+			coap_reply_t reply_cb)
+{
+	int ret;
+	struct coap_packet request;
+	struct coap_reply *reply;
+	u8_t token[COAP_TOKEN_LEN];
+	u8_t buf[MAX_COAP_MSG_LEN];
+
+	if (reply_cb == NULL) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&replies_lock, K_FOREVER);
+
+	reply = coap_observer_find(reply_cb);
+	if (reply == NULL) {
+		k_mutex_unlock(&replies_lock);
+		return -ENOENT;
+	}
+
+	/* Deregistration must use the token of the registration. */
+	memcpy(token, reply->token, sizeof(token));
+	coap_reply_clear(reply);
+
+	k_mutex_unlock(&replies_lock);
+
+	ret = coap_init_request(COAP_METHOD_GET, COAP_TYPE_NON_CON, token,
+				COAP_OBSERVE_DEREGISTER, uri_path_options,
+				NULL, 0, &request, buf);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = coap_send_message(addr, &request);
+	if (ret < 0) {
+		LOG_ERR("Transmission failed: %d", errno);
+	}
+
+	return ret;
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <string.h>
+#include <zephyr.h>
+#include <zephyr/types.h>
+#include <net/coap.h>
+#include <net/download_client.h>
+#include <logging/log.h>
+
+#include "coap.h"
+
+LOG_MODULE_DECLARE(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
+
+#define COAP_VER 1
+
+/* Block size exponent, SZX = log2(block size) - 4 */
+#define COAP_SZX (find_msb_set(CONFIG_DOWNLOAD_CLIENT_COAP_BLOCK_SIZE) - 5)
+#define BLOCK_SIZE(szx) BIT((szx) + 4)
+
+/* Room for the CoAP header and options in front of the payload */
+#define COAP_OVERHEAD 64
+
+BUILD_ASSERT((CONFIG_DOWNLOAD_CLIENT_COAP_BLOCK_SIZE &
+	      (CONFIG_DOWNLOAD_CLIENT_COAP_BLOCK_SIZE - 1)) == 0,
+	     "The CoAP block size must be a power of two");
+
+BUILD_ASSERT(CONFIG_DOWNLOAD_CLIENT_COAP_BLOCK_SIZE + COAP_OVERHEAD <=
+		 CONFIG_DOWNLOAD_CLIENT_MAX_RESPONSE_SIZE,
+	     "The response buffer must accommodate for a full CoAP block");
+
+/* Number of the first block that has not been received yet. */
+static u32_t first_missing_block(const struct download_client *dl)
+{
+	return dl->progress >> (dl->coap.szx + 4);
+}
+
+static int uri_path_append(struct coap_packet *pkt, const char *path)
+{
+	const char *end;
+	int err;
+
+	while (*path != '\0') {
+		end = strchr(path, '/');
+		if (end == NULL) {
+			end = path + strlen(path);
+		}
+
+		/* Skip empty segments, as in a leading '/' */
+		if (end != path) {
+			err = coap_packet_append_option(pkt,
+							COAP_OPTION_URI_PATH,
+							path, end - path);
+			if (err < 0) {
+				return err;
+			}
+		}
+
+		path = (*end == '/') ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+void dl_coap_block_init(struct download_client *dl, size_t from)
+{
+	dl->coap.szx = COAP_SZX;
+	dl->coap.retransmits = 0;
+	dl->coap.next_block = from >> (dl->coap.szx + 4);
+	dl->coap.resend_end = 0;
+	memcpy(dl->coap.token, coap_next_token(), sizeof(dl->coap.token));
+
+	dl->fragment_size = BLOCK_SIZE(dl->coap.szx);
+}
+
+int dl_coap_request_build(struct download_client *dl)
+{
+	struct coap_packet pkt;
+	u32_t first = first_missing_block(dl);
+	u32_t block = dl->coap.next_block;
+	int err;
+
+	if ((block - first) >= CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW) {
+		return 0;
+	}
+
+	if (dl->file_size == 0) {
+		/* Pipeline only once the size of the resource is known */
+		if (block != first) {
+			return 0;
+		}
+	} else if (((size_t)block << (dl->coap.szx + 4)) >= dl->file_size) {
+		/* Don't request blocks past the end of the resource */
+		return 0;
+	}
+
+	err = coap_packet_init(&pkt, dl->buf, sizeof(dl->buf), COAP_VER,
+			       COAP_TYPE_NON_CON, sizeof(dl->coap.token),
+			       dl->coap.token, COAP_METHOD_GET,
+			       coap_next_id());
+	if (err < 0) {
+		return err;
+	}
+
+	err = uri_path_append(&pkt, dl->file);
+	if (err < 0) {
+		return err;
+	}
+
+	err = coap_append_option_int(&pkt, COAP_OPTION_BLOCK2,
+				     (block << 4) | dl->coap.szx);
+	if (err < 0) {
+		return err;
+	}
+
+	if (dl->file_size == 0) {
+		/* Ask the server to indicate the size of the resource */
+		err = coap_append_option_int(&pkt, COAP_OPTION_SIZE2, 0);
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	LOG_DBG("Requesting block %u", block);
+
+	dl->coap.next_block++;
+
+	return pkt.offset;
+}
+
+int dl_coap_parse(struct download_client *dl, size_t len)
+{
+	struct coap_packet pkt;
+	u8_t token[8];
+	u8_t tkl;
+	u8_t code;
+	const u8_t *payload;
+	u16_t payload_len;
+	int block2;
+	int size2;
+	u8_t szx;
+	bool more;
+	size_t block_off;
+	size_t skip;
+	int err;
+
+	err = coap_packet_parse(&pkt, dl->buf, len, NULL, 0);
+	if (err < 0) {
+		LOG_WRN("Invalid CoAP response, err %d", err);
+		return 1;
+	}
+
+	tkl = coap_header_get_token(&pkt, token);
+	if ((tkl != sizeof(dl->coap.token)) ||
+	    (memcmp(token, dl->coap.token, tkl) != 0)) {
+		LOG_DBG("Response for another request");
+		return 1;
+	}
+
+	code = coap_header_get_code(&pkt);
+	if (code != COAP_RESPONSE_CODE_CONTENT) {
+		LOG_ERR("Unexpected response code %u.%02u",
+			code >> 5, code & 0x1f);
+		return -1;
+	}
+
+	block2 = coap_get_option_int(&pkt, COAP_OPTION_BLOCK2);
+	if (block2 < 0) {
+		/* The server sent the whole resource at once */
+		block2 = dl->coap.szx;
+	}
+
+	szx = block2 & 0x07;
+	more = (block2 & 0x08) != 0;
+	block_off = (size_t)(block2 >> 4) << (szx + 4);
+
+	payload = coap_packet_get_payload(&pkt, &payload_len);
+	if (payload == NULL) {
+		payload_len = 0;
+	}
+
+	if (payload_len > BLOCK_SIZE(dl->coap.szx)) {
+		LOG_ERR("Block larger than requested (%u)", payload_len);
+		return -1;
+	}
+
+	if (block_off > dl->progress) {
+		/* A later block arrived, so the first missing block was lost
+		 * or reordered. Request the missing blocks again right away,
+		 * unless they were requested again already.
+		 */
+		if (first_missing_block(dl) >= dl->coap.resend_end) {
+			dl->coap.resend_end = dl->coap.next_block;
+			dl->coap.next_block = first_missing_block(dl);
+			LOG_DBG("Block %u missing", dl->coap.next_block);
+		}
+
+		LOG_DBG("Ignoring block at offset %u", block_off);
+		return 1;
+	}
+
+	if ((block_off + payload_len < dl->progress) ||
+	    ((block_off + payload_len == dl->progress) && more)) {
+		LOG_DBG("Ignoring duplicate block at offset %u", block_off);
+		return 1;
+	}
+
+	if (szx < dl->coap.szx) {
+		/* The server prefers smaller blocks. The block numbers are
+		 * rescaled to keep the byte offsets they point to.
+		 */
+		LOG_INF("Block size reduced to %u", BLOCK_SIZE(szx));
+		dl->coap.next_block <<= (dl->coap.szx - szx);
+		dl->coap.resend_end <<= (dl->coap.szx - szx);
+		dl->coap.szx = szx;
+		dl->fragment_size = BLOCK_SIZE(szx);
+	}
+
+	size2 = coap_get_option_int(&pkt, COAP_OPTION_SIZE2);
+	if ((size2 > 0) && (dl->file_size == 0)) {
+		dl->file_size = size2;
+		LOG_DBG("File size = %d", dl->file_size);
+	}
+
+	/* Resuming in the middle of a block */
+	skip = dl->progress - block_off;
+
+	memmove(dl->buf, payload + skip, payload_len - skip);
+	dl->offset = payload_len - skip;
+	dl->progress += dl->offset;
+	dl->coap.retransmits = 0;
+
+	if (!more) {
+		dl->file_size = dl->progress;
+	}
+
+	if (dl->coap.next_block < first_missing_block(dl)) {
+		dl->coap.next_block = first_missing_block(dl);
+	}
+
+	return 0;
+}
+
+int dl_coap_retransmit(struct download_client *dl)
+{
+	if (dl->coap.retransmits >=
+	    CONFIG_DOWNLOAD_CLIENT_COAP_MAX_RETRANSMIT) {
+		LOG_ERR("No response from server");
+		return -ETIMEDOUT;
+	}
+
+	dl->coap.retransmits++;
+	dl->coap.resend_end = dl->coap.next_block;
+	dl->coap.next_block = first_missing_block(dl);
+
+	LOG_WRN("Block %u timed out, retransmitting", dl->coap.next_block);
+
+	return 0;
+}
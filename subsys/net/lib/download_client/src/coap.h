@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef DOWNLOAD_CLIENT_COAP_H__
+#define DOWNLOAD_CLIENT_COAP_H__
+
+#include <errno.h>
+#include <net/download_client.h>
+
+#if defined(CONFIG_DOWNLOAD_CLIENT_COAP)
+
+/* Start a block-wise transfer of dl->file from the given offset. */
+void dl_coap_block_init(struct download_client *dl, size_t from);
+
+/* Build the next Block2 request in dl->buf.
+ * Returns the request length, 0 if the request window is full,
+ * or a negative error code.
+ */
+int dl_coap_request_build(struct download_client *dl);
+
+/* Parse the response of len bytes received in dl->buf.
+ * On success, the payload is moved to the beginning of dl->buf and
+ * dl->offset is its length.
+ * Returns:
+ *  1 if the datagram is not the expected block and must be ignored,
+ *    blocks found missing are requested by the next dl_coap_request_build()
+ *  0 if the expected block was received
+ * -1 on error
+ */
+int dl_coap_parse(struct download_client *dl, size_t len);
+
+/* Request the missing blocks again after a timeout.
+ * Returns -ETIMEDOUT when the retransmissions are exhausted.
+ */
+int dl_coap_retransmit(struct download_client *dl);
+
+#else
+
+static inline void dl_coap_block_init(struct download_client *dl, size_t from)
+{
+}
+
+static inline int dl_coap_request_build(struct download_client *dl)
+{
+	return -ENOTSUP;
+}
+
+static inline int dl_coap_parse(struct download_client *dl, size_t len)
+{
+	return -1;
+}
+
+static inline int dl_coap_retransmit(struct download_client *dl)
+{
+	return -ENOTSUP;
+}
+
+#endif /* defined(CONFIG_DOWNLOAD_CLIENT_COAP) */
+
+#endif /* DOWNLOAD_CLIENT_COAP_H__ */
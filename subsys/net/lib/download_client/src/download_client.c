@@ -14,8 +14,19 @@
 #include <net/download_client.h>
 #include <logging/log.h>
 
+#include "coap.h"
+
 LOG_MODULE_REGISTER(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
 
+#define COAP_SCHEME "coap://"
+#define COAPS_SCHEME "coaps://"
+
+#if defined(CONFIG_DOWNLOAD_CLIENT_COAP)
+#define COAP_TIMEOUT_MS CONFIG_DOWNLOAD_CLIENT_COAP_TIMEOUT_MS
+#else
+#define COAP_TIMEOUT_MS K_FOREVER
+#endif
+
 #define GET_TEMPLATE                                                           \
 	"GET /%s HTTP/1.1\r\n"                                                 \
 	"Host: %s\r\n"                                                         \
@@ -37,15 +48,20 @@ BUILD_ASSERT(CONFIG_LOG_BUFFER_SIZE >= 2048,
 		 "Please increase log buffer sizer");
 #endif
 
-static int socket_timeout_set(int fd)
+static bool is_coap(const struct download_client *dl)
+{
+	return (dl->proto == IPPROTO_UDP) || (dl->proto == IPPROTO_DTLS_1_2);
+}
+
+static int socket_timeout_set(int fd, int timeout)
 {
 	int err;
 
-	if (CONFIG_DOWNLOAD_CLIENT_SOCK_TIMEOUT_MS == K_FOREVER) {
+	if (timeout == K_FOREVER) {
 		return 0;
 	}
 
-	const u32_t timeout_ms = CONFIG_DOWNLOAD_CLIENT_SOCK_TIMEOUT_MS;
+	const u32_t timeout_ms = timeout;
 
 	struct timeval timeo = {
 		.tv_sec = (timeout_ms / 1000),
@@ -117,12 +133,12 @@ static int socket_apn_set(int fd, const char *apn)
 	return 0;
 }
 
-static int resolve_and_connect(int family, const char *host,
+static int resolve_and_connect(int family, int proto, const char *host,
 			       const struct download_client_cfg *cfg)
 {
 	int fd;
 	int err;
-	int proto;
+	int type;
 	u16_t port;
 	struct addrinfo *addr;
 	struct addrinfo *info;
@@ -130,21 +146,36 @@ static int resolve_and_connect(int family, const char *host,
 	__ASSERT_NO_MSG(host);
 	__ASSERT_NO_MSG(cfg);
 
-	/* Set up port and protocol */
-	if (cfg->sec_tag == -1) {
-		proto = IPPROTO_TCP;
+	/* Set up port and socket type */
+	switch (proto) {
+	case IPPROTO_TCP:
+		type = SOCK_STREAM;
 		port = (cfg->port != 0) ? htons(cfg->port) :
 					  htons(80); /* HTTP, port 80 */
-	} else {
-		proto = IPPROTO_TLS_1_2;
+		break;
+	case IPPROTO_TLS_1_2:
+		type = SOCK_STREAM;
 		port = (cfg->port != 0) ? htons(cfg->port) :
 					  htons(443); /* HTTPS, port 443 */
+		break;
+	case IPPROTO_UDP:
+		type = SOCK_DGRAM;
+		port = (cfg->port != 0) ? htons(cfg->port) :
+					  htons(5683); /* CoAP, port 5683 */
+		break;
+	case IPPROTO_DTLS_1_2:
+		type = SOCK_DGRAM;
+		port = (cfg->port != 0) ? htons(cfg->port) :
+					  htons(5684); /* CoAPS, port 5684 */
+		break;
+	default:
+		return -1;
 	}
 
 	/* Lookup host */
 	struct addrinfo hints = {
 		.ai_family = family,
-		.ai_socktype = SOCK_STREAM,
+		.ai_socktype = type,
 		.ai_protocol = proto,
 		/* Either a valid, NULL-terminated access point name or NULL. */
 		.ai_next =  cfg->apn ?
@@ -166,7 +197,7 @@ static int resolve_and_connect(int family, const char *host,
 	LOG_INF("Attempting to connect over %s",
 		family == AF_INET ? log_strdup("IPv4") : log_strdup("IPv6"));
 
-	fd = socket(family, SOCK_STREAM, proto);
+	fd = socket(family, type, proto);
 	if (fd < 0) {
 		LOG_ERR("Failed to create socket, errno %d", errno);
 		goto cleanup;
@@ -180,7 +211,7 @@ static int resolve_and_connect(int family, const char *host,
 		}
 	}
 
-	if (proto == IPPROTO_TLS_1_2) {
+	if ((proto == IPPROTO_TLS_1_2) || (proto == IPPROTO_DTLS_1_2)) {
 		LOG_INF("Setting up TLS credentials");
 		err = socket_sectag_set(fd, cfg->sec_tag);
 		if (err) {
@@ -243,6 +274,28 @@ static int socket_send(const struct download_client *client, size_t len)
 	return 0;
 }
 
+static int coap_request_send(struct download_client *client)
+{
+	int err;
+	int len;
+
+	/* Fill the window of pipelined block requests */
+	while ((len = dl_coap_request_build(client)) > 0) {
+		err = socket_send(client, len);
+		if (err) {
+			LOG_ERR("Failed to send CoAP request, errno %d", errno);
+			return err;
+		}
+	}
+
+	if (len < 0) {
+		LOG_ERR("Cannot create CoAP request, err %d", len);
+		return len;
+	}
+
+	return 0;
+}
+
 static int get_request_send(struct download_client *client)
 {
 	int err;
@@ -253,6 +306,10 @@ static int get_request_send(struct download_client *client)
 	__ASSERT_NO_MSG(client->host);
 	__ASSERT_NO_MSG(client->file);
 
+	if (is_coap(client)) {
+		return coap_request_send(client);
+	}
+
 	/* Offset of last byte in range (Content-Range) */
 	off = client->progress + client->fragment_size - 1;
 
@@ -358,6 +415,53 @@ static int header_parse(struct download_client *client)
 	return 0;
 }
 
+/* Returns:
+ *  1 while the fragment is being received
+ *  0 if a whole fragment or the rest of the file has been received
+ * -1 on error
+ */
+static int http_parse(struct download_client *dl, size_t len)
+{
+	int rc;
+
+	/* Accumulate buffer offset */
+	dl->offset += len;
+
+	if (!dl->has_header) {
+		rc = header_parse(dl);
+		if (rc) {
+			/* Wait for payload, or something was wrong with
+			 * the header.
+			 */
+			return rc;
+		}
+
+		dl->has_header = true;
+	}
+
+	/* Accumulate overall file progress.
+	 *
+	 * If the last recv() call read an HTTP header,
+	 * the offset has been moved to the end of the header in
+	 * header_parse(). Thus, we accumulate the offset
+	 * to the progress.
+	 *
+	 * If the last recv() call received only a HTTP message body,
+	 * then we accumulate 'len'.
+	 *
+	 */
+	dl->progress += MIN(dl->offset, len);
+
+	/* Have we received a whole fragment or the whole file? */
+	if ((dl->offset < dl->fragment_size) &&
+	    (dl->progress != dl->file_size)) {
+		LOG_DBG("Awaiting full fragment (%u)", dl->offset);
+		return 1;
+	}
+
+	return 0;
+}
+
 static int fragment_evt_send(const struct download_client *client)
 {
 	__ASSERT(client->offset <= client->fragment_size,
@@ -390,21 +494,30 @@ static int error_evt_send(const struct download_client *dl, int error)
 	return dl->callback(&evt);
 }
 
+/* On failure, the error is reported to the application and the download
+ * stops, as it cannot go on without a connection.
+ */
 static int reconnect(struct download_client *dl)
 {
 	int err;
 
 	LOG_INF("Reconnecting..");
 	err = download_client_disconnect(dl);
-	if (err) {
-		return err;
+	if (!err) {
+		err = download_client_connect(dl, dl->host, &dl->config);
 	}
 
-	err = download_client_connect(dl, dl->host, &dl->config);
 	if (err) {
+		LOG_ERR("Reconnect failed, err %d", err);
+		error_evt_send(dl, EHOSTDOWN);
 		return err;
 	}
 
+	if (is_coap(dl)) {
+		/* Request the missing blocks on the new socket */
+		dl_coap_block_init(dl, dl->progress);
+	}
+
 	return 0;
 }
 
@@ -426,6 +539,22 @@ restart_and_suspend:
 		len = recv(dl->fd, dl->buf + dl->offset,
 			   sizeof(dl->buf) - dl->offset, 0);
 
+		if ((len == -1) && (errno == EAGAIN) && is_coap(dl)) {
+			/* Block requests or responses were lost */
+			if (dl_coap_retransmit(dl)) {
+				rc = error_evt_send(dl, ETIMEDOUT);
+				if (rc) {
+					/* Restart and suspend */
+					break;
+				}
+				if (reconnect(dl)) {
+					/* Restart and suspend */
+					break;
+				}
+			}
+			goto send_again;
+		}
+
 		if ((len == 0) || (len == -1)) {
 			/* We just had an unexpected socket error or closure */
 
@@ -457,54 +586,45 @@ restart_and_suspend:
 				/* Restart and suspend */
 				break;
 			}
-			reconnect(dl);
+			if (reconnect(dl)) {
+				/* Restart and suspend */
+				break;
+			}
 			goto send_again;
 		}
 
 		LOG_DBG("Read %d bytes from socket", len);
 
-		/* Accumulate buffer offset */
-		dl->offset += len;
-
-		if (!dl->has_header) {
-			rc = header_parse(dl);
-			if (rc > 0) {
-				/* Wait for payload */
-				continue;
-			}
-			if (rc < 0) {
-				/* Something was wrong with the header.
-				 * Restart and suspend, no point in retrying.
-				 */
-				error_evt_send(dl, EBADMSG);
-				break;
-			}
-
-			dl->has_header = true;
+		if (is_coap(dl)) {
+			rc = dl_coap_parse(dl, len);
+		} else {
+			rc = http_parse(dl, len);
 		}
 
-		/* Accumulate overall file progress.
-		 *
-		 * If the last recv() call read an HTTP header,
-		 * the offset has been moved to the end of the header in
-		 * header_parse(). Thus, we accumulate the offset
-		 * to the progress.
-		 *
-		 * If the last recv() call received only a HTTP message body,
-		 * then we accumulate 'len'.
-		 *
-		 */
-		dl->progress += MIN(dl->offset, len);
-
-		/* Have we received a whole fragment or the whole file? */
-		if ((dl->offset < dl->fragment_size) &&
-		    (dl->progress != dl->file_size)) {
-			LOG_DBG("Awaiting full fragment (%u)", dl->offset);
+		if (rc > 0) {
+			if (is_coap(dl)) {
+				/* Request the blocks found missing, if any */
+				goto send_again;
+			}
+			/* Wait for more data */
 			continue;
 		}
+		if (rc < 0) {
+			/* Something was wrong with the response.
+			 * Restart and suspend, no point in retrying.
+			 */
+			error_evt_send(dl, EBADMSG);
+			break;
+		}
 
-		LOG_INF("Downloaded %u/%u bytes (%d%%)", dl->progress,
-			dl->file_size, (dl->progress * 100) / dl->file_size);
+		if (dl->file_size) {
+			LOG_INF("Downloaded %u/%u bytes (%d%%)", dl->progress,
+				dl->file_size,
+				(dl->progress * 100) / dl->file_size);
+		} else {
+			/* CoAP servers may not tell the file size */
+			LOG_INF("Downloaded %u bytes", dl->progress);
+		}
 
 		/* Send fragment to application.
 		 * If the application callback returns non-zero, stop.
@@ -529,7 +649,10 @@ restart_and_suspend:
 		/* Attempt to reconnect if the connection was closed */
 		if (dl->connection_close) {
 			dl->connection_close = false;
-			reconnect(dl);
+			if (reconnect(dl)) {
+				/* Restart and suspend */
+				break;
+			}
 		}
 
 		/* Request next fragment */
@@ -545,7 +668,10 @@ send_again:
 				/* Restart and suspend */
 				break;
 			}
-			reconnect(dl);
+			if (reconnect(dl)) {
+				/* Restart and suspend */
+				break;
+			}
 			goto send_again;
 		}
 	}
@@ -580,6 +706,8 @@ int download_client_connect(struct download_client *client, const char *host,
 			    const struct download_client_cfg *config)
 {
 	int err;
+	int proto;
+	const char *hostname = host;
 
 	if (client == NULL || host == NULL || config == NULL) {
 		return -EINVAL;
@@ -591,6 +719,28 @@ int download_client_connect(struct download_client *client, const char *host,
 		}
 	}
 
+	if (strncmp(host, COAP_SCHEME, strlen(COAP_SCHEME)) == 0) {
+		proto = IPPROTO_UDP;
+		hostname = host + strlen(COAP_SCHEME);
+	} else if (strncmp(host, COAPS_SCHEME, strlen(COAPS_SCHEME)) == 0) {
+		proto = IPPROTO_DTLS_1_2;
+		hostname = host + strlen(COAPS_SCHEME);
+	} else if (config->sec_tag != -1) {
+		proto = IPPROTO_TLS_1_2;
+	} else {
+		proto = IPPROTO_TCP;
+	}
+
+	if (proto == IPPROTO_UDP || proto == IPPROTO_DTLS_1_2) {
+		if (!IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_COAP)) {
+			return -EPROTONOSUPPORT;
+		}
+		if ((proto == IPPROTO_DTLS_1_2) != (config->sec_tag != -1)) {
+			/* coaps:// requires a security tag, coap:// none */
+			return -EINVAL;
+		}
+	}
+
 	if (config->sec_tag != -1) {
 		client->fragment_size =
 			CONFIG_DOWNLOAD_CLIENT_MAX_TLS_FRAGMENT_SIZE;
@@ -607,11 +757,11 @@ int download_client_connect(struct download_client *client, const char *host,
 	/* Attempt IPv6 connection if configured, fallback to IPv4 */
 	if (IS_ENABLED(CONFIG_DOWNLOAD_CLIENT_IPV6)) {
 		client->fd =
-			resolve_and_connect(AF_INET6, host, config);
+			resolve_and_connect(AF_INET6, proto, hostname, config);
 	}
 	if (client->fd < 0) {
 		client->fd =
-			resolve_and_connect(AF_INET, host, config);
+			resolve_and_connect(AF_INET, proto, hostname, config);
 	}
 
 	if (client->fd < 0) {
@@ -619,12 +769,19 @@ int download_client_connect(struct download_client *client, const char *host,
 	}
 
 	client->host = host;
+	client->proto = proto;
 	client->config = *config;
 
 	LOG_INF("Connected to %s", log_strdup(host));
 
-	/* Set socket timeout, if configured */
-	err = socket_timeout_set(client->fd);
+	if (is_coap(client)) {
+		/* Lost blocks are detected with the receive timeout */
+		err = socket_timeout_set(client->fd, COAP_TIMEOUT_MS);
+	} else {
+		/* Set socket timeout, if configured */
+		err = socket_timeout_set(client->fd,
+					 CONFIG_DOWNLOAD_CLIENT_SOCK_TIMEOUT_MS);
+	}
 	if (err) {
 		return err;
 	}
@@ -667,6 +824,10 @@ int download_client_start(struct download_client *client, const char *file,
 	client->offset = 0;
 	client->has_header = false;
 
+	if (is_coap(client)) {
+		dl_coap_block_init(client, from);
+	}
+
 	LOG_INF("Downloading: %s [%u]", log_strdup(client->file),
 		client->progress);
 
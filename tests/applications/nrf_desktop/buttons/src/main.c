@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include "key_matrix.h"
+#include "key_id.h"
+#include "buttons_sim_def.h"
+
+#define MAX_COLS		32
+#define MAX_ROWS		32
+#define EVENT_LIMIT		4
+#define PRESS_SCANS		5
+#define RANDOM_STEPS		5000
+#define BENCH_SCANS		2000
+#define MAX_PRESSED		6
+
+struct key_event {
+	u16_t key_id;
+	bool pressed;
+};
+
+struct matrix {
+	size_t cols;
+	size_t rows;
+	u32_t settled_state[MAX_COLS];
+	u32_t prev_state[MAX_COLS];
+};
+
+struct scan_result {
+	struct key_event events[EVENT_LIMIT];
+	size_t event_cnt;
+	bool any_pressed;
+};
+
+static struct matrix ref_matrix;
+static struct matrix test_matrix;
+
+static u32_t pressed[MAX_COLS];
+static u32_t bench_input[BENCH_SCANS][MAX_COLS];
+
+static u32_t rand_next(u32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 16;
+}
+
+static void matrix_init(struct matrix *m, size_t cols, size_t rows)
+{
+	memset(m, 0, sizeof(*m));
+	m->cols = cols;
+	m->rows = rows;
+}
+
+/* Scan processing as done by the buttons module before the key matrix
+ * utilities were introduced, used as a reference.
+ */
+static void ref_scan(struct matrix *m, const u32_t *input,
+		     struct scan_result *res)
+{
+	u32_t raw_state[MAX_COLS];
+	u32_t cur_state[MAX_COLS];
+
+	memcpy(raw_state, input, m->cols * sizeof(raw_state[0]));
+
+	for (size_t i = 0; i < m->cols; i++) {
+		u32_t bounce_mask = m->prev_state[i] ^ raw_state[i];
+		m->prev_state[i] = raw_state[i];
+		raw_state[i] &= ~bounce_mask;
+		raw_state[i] |= m->settled_state[i] & bounce_mask;
+	}
+
+	for (size_t i = 0; i < m->cols; i++) {
+		u32_t blocking_mask = 0;
+		for (size_t j = 0; j < m->cols; j++) {
+			if (i == j) {
+				continue;
+			}
+			blocking_mask |= raw_state[j];
+		}
+		blocking_mask ^= raw_state[i];
+		cur_state[i] = raw_state[i];
+		if (!is_power_of_two(raw_state[i])) {
+			cur_state[i] &= blocking_mask;
+		}
+	}
+
+	res->event_cnt = 0;
+	res->any_pressed = false;
+
+	for (size_t i = 0; i < m->cols; i++) {
+		for (size_t j = 0; j < m->rows; j++) {
+			bool is_raw_pressed = raw_state[i] & BIT(j);
+			bool is_pressed = cur_state[i] & BIT(j);
+			bool was_pressed = m->settled_state[i] & BIT(j);
+
+			if ((is_pressed != was_pressed) &&
+			    (is_pressed == is_raw_pressed) &&
+			    (res->event_cnt < EVENT_LIMIT)) {
+				res->events[res->event_cnt].key_id =
+					KEY_ID(i, j);
+				res->events[res->event_cnt].pressed =
+					is_pressed;
+				res->event_cnt++;
+
+				WRITE_BIT(m->settled_state[i], j, is_pressed);
+			}
+		}
+
+		res->any_pressed = res->any_pressed ||
+				   (m->prev_state[i] != 0) ||
+				   (m->settled_state[i] != 0) ||
+				   (cur_state[i] != 0);
+	}
+}
+
+/* Scan processing of the buttons module. */
+static void scan(struct matrix *m, const u32_t *input,
+		 struct scan_result *res)
+{
+	u32_t raw_state[MAX_COLS];
+	u32_t cur_state[MAX_COLS];
+
+	memcpy(raw_state, input, m->cols * sizeof(raw_state[0]));
+
+	key_matrix_debounce(raw_state, m->prev_state, m->settled_state,
+			    m->cols);
+	key_matrix_ghost_filter(raw_state, cur_state, m->cols);
+
+	res->event_cnt = 0;
+	res->any_pressed = false;
+
+	for (size_t i = 0; i < m->cols; i++) {
+		u32_t changed = key_matrix_changed(raw_state[i], cur_state[i],
+						   m->settled_state[i]);
+
+		while (changed && (res->event_cnt < EVENT_LIMIT)) {
+			u32_t j = __builtin_ctz(changed);
+			bool is_pressed = (cur_state[i] & BIT(j)) != 0;
+
+			changed &= changed - 1;
+
+			res->events[res->event_cnt].key_id = KEY_ID(i, j);
+			res->events[res->event_cnt].pressed = is_pressed;
+			res->event_cnt++;
+
+			WRITE_BIT(m->settled_state[i], j, is_pressed);
+		}
+
+		res->any_pressed = res->any_pressed ||
+				   (m->prev_state[i] != 0) ||
+				   (m->settled_state[i] != 0) ||
+				   (cur_state[i] != 0);
+	}
+}
+
+/* Matrix without diodes: a pressed key connects its column with its row,
+ * so the driven column also reaches rows of the columns that share a row
+ * with it.
+ */
+static void matrix_read(size_t cols, u32_t *input)
+{
+	for (size_t i = 0; i < cols; i++) {
+		input[i] = pressed[i];
+
+		for (size_t j = 0; j < cols; j++) {
+			if ((j != i) && (pressed[i] & pressed[j])) {
+				input[i] |= pressed[j];
+			}
+		}
+	}
+}
+
+static void scan_compare(const u32_t *input)
+{
+	struct scan_result ref_res;
+	struct scan_result res;
+
+	ref_scan(&ref_matrix, input, &ref_res);
+	scan(&test_matrix, input, &res);
+
+	zassert_equal(res.event_cnt, ref_res.event_cnt,
+		      "Wrong number of events");
+	zassert_equal(res.any_pressed, ref_res.any_pressed,
+		      "Wrong scanning state");
+
+	for (size_t i = 0; i < res.event_cnt; i++) {
+		zassert_equal(res.events[i].key_id, ref_res.events[i].key_id,
+			      "Wrong key");
+		zassert_equal(res.events[i].pressed, ref_res.events[i].pressed,
+			      "Wrong key state");
+	}
+
+	zassert_mem_equal(test_matrix.settled_state, ref_matrix.settled_state,
+			  sizeof(ref_matrix.settled_state),
+			  "Wrong settled state");
+}
+
+static void test_setup(size_t cols, size_t rows)
+{
+	matrix_init(&ref_matrix, cols, rows);
+	matrix_init(&test_matrix, cols, rows);
+	memset(pressed, 0, sizeof(pressed));
+}
+
+static void test_ghost(void)
+{
+	u32_t input[MAX_COLS];
+	struct scan_result res;
+
+	test_setup(2, 2);
+
+	/* Two keys in one column */
+	pressed[0] = BIT(0) | BIT(1);
+	matrix_read(2, input);
+	scan(&test_matrix, input, &res);
+	scan(&test_matrix, input, &res);
+	zassert_equal(res.event_cnt, 2, "Keys not reported");
+
+	/* Third key makes the fourth one a ghost */
+	pressed[1] = BIT(0);
+	matrix_read(2, input);
+	zassert_equal(input[1], BIT(0) | BIT(1), "No ghost in the matrix");
+	scan(&test_matrix, input, &res);
+	scan(&test_matrix, input, &res);
+	zassert_equal(res.event_cnt, 0, "Ambiguous key reported");
+	zassert_equal(test_matrix.settled_state[1], 0, "Ghost key pressed");
+}
+
+static void test_sim_sequence(void)
+{
+	const size_t cols = 8;
+	const size_t rows = 18;
+	u32_t input[MAX_COLS];
+	u32_t seed = 1234;
+
+	test_setup(cols, rows);
+
+	/* Type the sequence of the simulated buttons module with bouncing
+	 * contacts.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(simulated_key_sequence); i++) {
+		u16_t key_id = simulated_key_sequence[i];
+		size_t col = KEY_COL(key_id) % cols;
+		size_t row = KEY_ROW(key_id) % rows;
+
+		for (size_t j = 0; j < 2 * PRESS_SCANS; j++) {
+			WRITE_BIT(pressed[col], row, j < PRESS_SCANS);
+			matrix_read(cols, input);
+
+			if ((rand_next(&seed) % 4) == 0) {
+				input[col] ^= BIT(row);
+			}
+
+			scan_compare(input);
+		}
+	}
+}
+
+static void random_input(size_t cols, size_t rows, u32_t *seed,
+			 u32_t *input)
+{
+	size_t col = rand_next(seed) % cols;
+	size_t row = rand_next(seed) % rows;
+	size_t pressed_cnt = 0;
+
+	for (size_t i = 0; i < cols; i++) {
+		pressed_cnt += __builtin_popcount(pressed[i]);
+	}
+
+	if ((pressed[col] & BIT(row)) || (pressed_cnt < MAX_PRESSED)) {
+		pressed[col] ^= BIT(row);
+	}
+
+	matrix_read(cols, input);
+}
+
+static void test_random(void)
+{
+	const size_t cols = 8;
+	const size_t rows = 18;
+	u32_t input[MAX_COLS];
+	u32_t seed = 5678;
+
+	test_setup(cols, rows);
+
+	for (size_t i = 0; i < RANDOM_STEPS; i++) {
+		random_input(cols, rows, &seed, input);
+
+		/* Repeat the scan to let the keys settle. */
+		scan_compare(input);
+		scan_compare(input);
+	}
+}
+
+static void bench(size_t cols, size_t rows)
+{
+	struct scan_result res;
+	u32_t seed = 9012;
+	u32_t start;
+	u32_t ref_cyc;
+	u32_t cyc;
+
+	test_setup(cols, rows);
+
+	for (size_t i = 0; i < BENCH_SCANS; i++) {
+		if ((i % 2) == 0) {
+			random_input(cols, rows, &seed, bench_input[i]);
+		} else {
+			memcpy(bench_input[i], bench_input[i - 1],
+			       sizeof(bench_input[i]));
+		}
+	}
+
+	start = k_cycle_get_32();
+	for (size_t i = 0; i < BENCH_SCANS; i++) {
+		ref_scan(&ref_matrix, bench_input[i], &res);
+	}
+	ref_cyc = k_cycle_get_32() - start;
+
+	start = k_cycle_get_32();
+	for (size_t i = 0; i < BENCH_SCANS; i++) {
+		scan(&test_matrix, bench_input[i], &res);
+	}
+	cyc = k_cycle_get_32() - start;
+
+	TC_PRINT("%ux%u matrix: %u ns per scan (reference %u ns)\n",
+		 (u32_t)cols, (u32_t)rows,
+		 (u32_t)(k_cyc_to_ns_floor64(cyc) / BENCH_SCANS),
+		 (u32_t)(k_cyc_to_ns_floor64(ref_cyc) / BENCH_SCANS));
+
+	zassert_mem_equal(test_matrix.settled_state, ref_matrix.settled_state,
+			  sizeof(ref_matrix.settled_state),
+			  "Wrong settled state");
+}
+
+static void test_bench(void)
+{
+	/* Full-size keyboard matrix and the largest supported matrix */
+	bench(8, 18);
+	bench(MAX_COLS, MAX_ROWS);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(buttons_test,
+			 ztest_unit_test(test_ghost),
+			 ztest_unit_test(test_sim_sequence),
+			 ztest_unit_test(test_random),
+			 ztest_unit_test(test_bench)
+			 );
+	ztest_run_test_suite(buttons_test);
+}
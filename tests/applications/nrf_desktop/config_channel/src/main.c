@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/util.h>
+#include <event_manager.h>
+
+#include "config_channel.h"
+#include "config_event.h"
+
+#define LOCAL_PID		0x52DE
+#define IMAGE_SIZE		4096
+#define REPORT_LEN		(REPORT_SIZE_USER_CONFIG + 1) /* with ID */
+#define HEADER_LEN		6
+#define EVENT_DATA_LEN_MAX	(REPORT_LEN - HEADER_LEN)
+#define WINDOW_SIZE		CONFIG_DESKTOP_CONFIG_CHANNEL_WINDOW_SIZE
+#define FLASH_WRITE_ALIGN	4
+#define SPEEDUP_MIN		3
+
+/* Chunk of the host tool before the windowed transfer was introduced */
+#define CLASSIC_CHUNK_LEN	24
+/* Windowed chunk that fits in the default report size */
+#define SHORT_CHUNK_LEN		20
+/* Windowed chunk that fills the report */
+#define LONG_CHUNK_LEN		ROUND_DOWN(EVENT_DATA_LEN_MAX - 1, FLASH_WRITE_ALIGN)
+
+/* Timing of the host tool */
+#define TRANSFER_TIME		1	/* ms, single USB control transfer */
+#define POLL_INTERVAL		20	/* ms */
+#define WINDOW_POLL_INTERVAL	2	/* ms */
+#define POLL_RETRY_COUNT	200
+
+static struct config_channel_state cfg_chan;
+
+static u8_t image[IMAGE_SIZE];
+static u8_t written[IMAGE_SIZE];
+static size_t written_len;
+
+static u8_t data_event_id;
+static u8_t host_seq;
+static u32_t transfer_cnt;
+static u32_t host_time;
+
+static const char *opt_descr[] = {
+	"data"
+};
+
+/* Write data as the DFU module does */
+static void set_config(const u8_t opt_id, const u8_t *data,
+		       const size_t size)
+{
+	zassert_equal(opt_id, 0, "Wrong option");
+	zassert_true(written_len + size <= sizeof(written), "Image too long");
+
+	memcpy(&written[written_len], data, size);
+	written_len += size;
+}
+
+static void fetch_config(const u8_t opt_id, u8_t *data, size_t *size)
+{
+	zassert_unreachable("Fetch is not supported");
+}
+
+static bool dfu_event_handler(const struct event_header *eh)
+{
+	GEN_CONFIG_EVENT_HANDLERS("dfu", opt_descr, set_config, fetch_config,
+				  true);
+
+	zassert_unreachable("Unhandled event");
+
+	return false;
+}
+
+EVENT_LISTENER(dfu, dfu_event_handler);
+EVENT_SUBSCRIBE(dfu, config_event);
+EVENT_SUBSCRIBE(dfu, config_fetch_request_event);
+
+/* Confirm processing of the config events as the USB state module does */
+static bool transport_event_handler(const struct event_header *eh)
+{
+	if (is_config_event(eh)) {
+		config_channel_event_done(&cfg_chan, cast_config_event(eh));
+
+		return false;
+	}
+
+	if (is_config_fetch_event(eh)) {
+		config_channel_fetch_receive(&cfg_chan,
+					     cast_config_fetch_event(eh));
+
+		return false;
+	}
+
+	zassert_unreachable("Unhandled event");
+
+	return false;
+}
+
+EVENT_LISTENER(transport, transport_event_handler);
+EVENT_SUBSCRIBE(transport, config_fetch_event);
+EVENT_SUBSCRIBE_FINAL(transport, config_event);
+
+/* Time of the host is modeled, so that the result does not depend on the
+ * system tick. The sleep lets the device process the events.
+ */
+static void host_sleep(u32_t time)
+{
+	host_time += time;
+	k_sleep(K_MSEC(time));
+}
+
+static void transfer_wait(void)
+{
+	/* Control transfers are scheduled in USB frames. */
+	transfer_cnt++;
+	host_sleep(TRANSFER_TIME);
+}
+
+static int report_set(u8_t event_id, u8_t status, const u8_t *data,
+		      size_t len)
+{
+	u8_t report[REPORT_LEN] = {0};
+	struct config_channel_frame frame = {
+		.report_id = REPORT_ID_USER_CONFIG,
+		.recipient = LOCAL_PID,
+		.event_id = event_id,
+		.status = status,
+		.event_data_len = len,
+		.event_data = (u8_t *)data,
+	};
+
+	zassert_true(config_channel_report_fill(report, sizeof(report), &frame,
+						true) >= 0,
+		     "Cannot fill report");
+
+	return config_channel_report_set(&cfg_chan, report, sizeof(report),
+					 true, LOCAL_PID);
+}
+
+static int window_frame_set(u8_t seq, const u8_t *data, size_t len)
+{
+	u8_t frame_data[EVENT_DATA_LEN_MAX];
+
+	zassert_true(len < sizeof(frame_data), "Chunk too long");
+
+	frame_data[0] = seq;
+	memcpy(&frame_data[1], data, len);
+
+	return report_set(data_event_id, CONFIG_STATUS_WINDOW_SET, frame_data,
+			  len + 1);
+}
+
+static void report_get(struct config_channel_frame *frame, u8_t *data)
+{
+	u8_t report[REPORT_LEN];
+
+	config_channel_report_get(&cfg_chan, report, sizeof(report), true,
+				  LOCAL_PID);
+
+	int pos = config_channel_report_parse(report, sizeof(report), frame,
+					      true);
+
+	zassert_true(pos >= 0, "Cannot parse report");
+	memcpy(data, &report[pos], frame->event_data_len);
+}
+
+static u8_t window_ack_get(u8_t expected_status)
+{
+	struct config_channel_frame frame;
+	u8_t data[EVENT_DATA_LEN_MAX];
+
+	report_get(&frame, data);
+
+	zassert_equal(frame.status, expected_status, "Wrong status");
+	zassert_equal(frame.event_data_len, 1, "No acknowledgment");
+
+	return data[0];
+}
+
+/* Set the option and wait until the device processes it. */
+static void host_set(u8_t event_id, const u8_t *data, size_t len)
+{
+	struct config_channel_frame frame;
+	u8_t rsp[EVENT_DATA_LEN_MAX];
+
+	zassert_equal(report_set(event_id, CONFIG_STATUS_PENDING, data, len),
+		      0, "Set rejected");
+	transfer_wait();
+
+	for (size_t i = 0; i < POLL_RETRY_COUNT; i++) {
+		host_sleep(POLL_INTERVAL);
+
+		report_get(&frame, rsp);
+		transfer_wait();
+
+		if (frame.status != CONFIG_STATUS_PENDING) {
+			break;
+		}
+	}
+
+	zassert_equal(frame.status, CONFIG_STATUS_SUCCESS, "Set failed");
+}
+
+/* Windowed transfer as done by the host tool. Frames that are not
+ * acknowledged once the device is idle are sent again.
+ */
+static void host_set_window(const u8_t *data, size_t len, size_t chunk_len)
+{
+	size_t chunk_cnt = DIV_ROUND_UP(len, chunk_len);
+	size_t retries = 0;
+	size_t base = 0;
+	size_t next = 0;
+
+	while (base < chunk_cnt) {
+		while ((next < chunk_cnt) && (next - base < WINDOW_SIZE)) {
+			size_t offset = next * chunk_len;
+
+			zassert_equal(window_frame_set(host_seq + next,
+						       &data[offset],
+						       MIN(chunk_len,
+							   len - offset)),
+				      0, "Frame rejected");
+			transfer_wait();
+			next++;
+		}
+
+		struct config_channel_frame frame;
+		u8_t rsp[EVENT_DATA_LEN_MAX];
+
+		report_get(&frame, rsp);
+		transfer_wait();
+
+		zassert_true((frame.status == CONFIG_STATUS_SUCCESS) ||
+			     (frame.status == CONFIG_STATUS_PENDING),
+			     "Transfer failed");
+
+		u8_t acked = rsp[0] - (u8_t)(host_seq + base - 1);
+
+		zassert_true(acked <= next - base, "Frame was not sent");
+		base += acked;
+
+		if (acked > 0) {
+			retries = 0;
+		} else {
+			retries++;
+			zassert_true(retries < POLL_RETRY_COUNT,
+				     "Transfer stalled");
+		}
+
+		if (frame.status == CONFIG_STATUS_SUCCESS) {
+			next = base;
+		} else if (acked == 0) {
+			host_sleep(WINDOW_POLL_INTERVAL);
+		}
+	}
+
+	host_seq += chunk_cnt;
+}
+
+static void transfer_start(void)
+{
+	memset(written, 0, sizeof(written));
+	written_len = 0;
+	transfer_cnt = 0;
+	host_time = 0;
+}
+
+static void image_check(void)
+{
+	zassert_equal(written_len, sizeof(image), "Wrong image length");
+	zassert_mem_equal(written, image, sizeof(image), "Wrong image");
+}
+
+static void test_init(void)
+{
+	u32_t seed = 1234;
+	u8_t mod_id = 0;
+
+	for (size_t i = 0; i < sizeof(image); i++) {
+		seed = seed * 1103515245 + 12345;
+		image[i] = seed >> 16;
+	}
+
+	zassert_false(event_manager_init(), "Error when initializing");
+	config_channel_init(&cfg_chan);
+
+	/* Module discovery, the test module gets the first ID. */
+	host_set(MOD_FIELD_SET(MODULE_BROADCAST) |
+		 OPT_FIELD_SET(BROADCAST_OPT_MAX_MOD_ID),
+		 &mod_id, sizeof(mod_id));
+
+	data_event_id = MOD_FIELD_SET(0) | OPT_FIELD_SET(1);
+}
+
+static u32_t classic_transfer(void)
+{
+	transfer_start();
+
+	for (size_t offset = 0; offset < sizeof(image);
+	     offset += CLASSIC_CHUNK_LEN) {
+		host_set(data_event_id, &image[offset],
+			 MIN(CLASSIC_CHUNK_LEN, sizeof(image) - offset));
+	}
+
+	image_check();
+
+	return host_time;
+}
+
+static u32_t window_transfer(size_t chunk_len)
+{
+	transfer_start();
+	host_set_window(image, sizeof(image), chunk_len);
+	image_check();
+
+	return host_time;
+}
+
+static void transfer_print(const char *name, u32_t time)
+{
+	TC_PRINT("%s: %u ms, %u B/s, %u control transfers\n", name, time,
+		 (u32_t)(sizeof(image) * MSEC_PER_SEC / time), transfer_cnt);
+}
+
+static void test_transfer(void)
+{
+	u32_t classic_time;
+	u32_t short_time;
+	u32_t long_time;
+
+	classic_time = classic_transfer();
+	transfer_print("Classic transfer", classic_time);
+
+	short_time = window_transfer(SHORT_CHUNK_LEN);
+	transfer_print("Windowed transfer, default report", short_time);
+
+	long_time = window_transfer(LONG_CHUNK_LEN);
+	transfer_print("Windowed transfer, large report", long_time);
+
+	zassert_true(short_time * SPEEDUP_MIN <= classic_time,
+		     "Windowed transfer too slow");
+	zassert_true(long_time < short_time, "Large report transfer too slow");
+}
+
+static void test_lost_frame(void)
+{
+	const u8_t *chunk[] = {&image[0], &image[4], &image[8]};
+	u8_t seq = host_seq;
+
+	transfer_start();
+
+	/* Frames following a lost one are dropped. */
+	zassert_equal(window_frame_set(seq, chunk[0], 4), 0, "Frame rejected");
+	zassert_equal(window_frame_set(seq + 2, chunk[2], 4), 0,
+		      "Frame rejected");
+	transfer_wait();
+	zassert_equal(window_ack_get(CONFIG_STATUS_SUCCESS), seq,
+		      "Wrong acknowledgment");
+	zassert_equal(written_len, 4, "Frame was not dropped");
+
+	/* Duplicated frame is dropped. */
+	zassert_equal(window_frame_set(seq, chunk[0], 4), 0, "Frame rejected");
+	transfer_wait();
+	zassert_equal(written_len, 4, "Duplicated frame processed");
+
+	/* Frames in flight block requests sent without the windowed mode. */
+	k_sched_lock();
+	zassert_equal(window_frame_set(seq + 1, chunk[1], 4), 0,
+		      "Frame rejected");
+	zassert_equal(report_set(data_event_id, CONFIG_STATUS_PENDING,
+				 chunk[2], 4),
+		      -EBUSY, "Set accepted during windowed transfer");
+	zassert_equal(window_ack_get(CONFIG_STATUS_PENDING), seq,
+		      "Wrong acknowledgment");
+	k_sched_unlock();
+	transfer_wait();
+
+	zassert_equal(window_frame_set(seq + 2, chunk[2], 4), 0,
+		      "Frame rejected");
+	transfer_wait();
+	zassert_equal(window_ack_get(CONFIG_STATUS_SUCCESS), (u8_t)(seq + 2),
+		      "Wrong acknowledgment");
+	zassert_mem_equal(written, image, 12, "Wrong data");
+
+	host_seq = seq + 3;
+
+	/* Request sent without the windowed mode ends the windowed transfer,
+	 * next windowed transfer can use any sequence number.
+	 */
+	transfer_start();
+	host_set(data_event_id, &image[0], 4);
+	host_seq += WINDOW_SIZE + 1;
+	host_set_window(&image[4], 8, 4);
+	zassert_mem_equal(written, image, 12, "Wrong data");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(config_channel_test,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test(test_transfer),
+			 ztest_unit_test(test_lost_frame)
+			 );
+	ztest_run_test_suite(config_channel_test);
+}
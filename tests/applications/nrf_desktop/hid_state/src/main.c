@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include "hid_eventq.h"
+
+#define QUEUE_SIZE		12
+#define EXPIRATION		500
+#define KEY_CNT			8
+#define FLOOD_STEPS		20000
+#define SUBSCRIBER_PERIOD	7	/* ms */
+#define DISCONNECTED_STEPS	2000
+
+/* Start close to the timestamp wrap */
+#define TIME_START		(UINT32_MAX - 1000)
+
+struct ref_event {
+	u16_t usage_id;
+	s16_t value;
+};
+
+static struct hid_eventq_event buf[QUEUE_SIZE];
+static struct hid_eventq eventq;
+
+/* Reference model of the queue, unbounded for the test duration */
+static struct ref_event ref[FLOOD_STEPS];
+static size_t ref_head;
+static size_t ref_tail;
+
+static bool key_pressed[KEY_CNT];
+
+static u32_t worst_enqueue_cyc;
+static u32_t worst_get_cyc;
+static u32_t max_len;
+static u32_t purged_cnt;
+static u32_t dropped_cnt;
+
+static u32_t rand_next(u32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 16;
+}
+
+static void ref_reset(void)
+{
+	ref_head = 0;
+	ref_tail = 0;
+}
+
+static void ref_purge(size_t cnt)
+{
+	s32_t sum[KEY_CNT] = {0};
+
+	zassert_true(ref_head + cnt <= ref_tail, "Too many events purged");
+
+	for (size_t i = ref_head; i < ref_head + cnt; i++) {
+		sum[ref[i].usage_id] += ref[i].value;
+	}
+
+	/* A key press must not be purged without its release */
+	for (size_t i = 0; i < ARRAY_SIZE(sum); i++) {
+		zassert_true(sum[i] <= 0, "Unpaired key press purged");
+	}
+
+	ref_head += cnt;
+	purged_cnt += cnt;
+}
+
+/* Enqueue the same way as the HID state module does */
+static void enqueue(u16_t usage_id, s16_t value, u32_t now, bool connected)
+{
+	u32_t start = k_cycle_get_32();
+	size_t len = eventq.len;
+	bool room = hid_eventq_make_room(&eventq, now, EXPIRATION,
+					 !connected);
+	u32_t cyc;
+
+	ref_purge(len - eventq.len);
+
+	if (!room) {
+		hid_eventq_reset(&eventq);
+		dropped_cnt += ref_tail - ref_head;
+		ref_reset();
+	}
+
+	zassert_equal(hid_eventq_append(&eventq, usage_id, value, now), 0,
+		      "Append failed");
+
+	cyc = k_cycle_get_32() - start;
+	worst_enqueue_cyc = MAX(worst_enqueue_cyc, cyc);
+
+	ref[ref_tail].usage_id = usage_id;
+	ref[ref_tail].value = value;
+	ref_tail++;
+
+	zassert_true(eventq.len <= QUEUE_SIZE, "Queue overflow");
+	zassert_equal(eventq.len, ref_tail - ref_head, "Wrong queue length");
+	max_len = MAX(max_len, eventq.len);
+}
+
+/* Subscriber that handles one event at a time */
+static void subscriber_handle(void)
+{
+	struct hid_eventq_event event;
+	u32_t start = k_cycle_get_32();
+	bool found = hid_eventq_get(&eventq, &event);
+	u32_t cyc = k_cycle_get_32() - start;
+
+	worst_get_cyc = MAX(worst_get_cyc, cyc);
+
+	if (!found) {
+		zassert_equal(ref_head, ref_tail, "Event lost");
+		return;
+	}
+
+	zassert_true(ref_head < ref_tail, "Unexpected event");
+	zassert_equal(event.usage_id, ref[ref_head].usage_id,
+		      "Wrong event order");
+	zassert_equal(event.value, ref[ref_head].value, "Wrong event order");
+	ref_head++;
+}
+
+static void flood(u32_t *seed, size_t steps, bool connected)
+{
+	u32_t now = TIME_START;
+	u32_t next_handle = now + SUBSCRIBER_PERIOD;
+
+	for (size_t i = 0; i < steps; i++) {
+		u16_t key = rand_next(seed) % KEY_CNT;
+
+		key_pressed[key] = !key_pressed[key];
+		enqueue(key, key_pressed[key] ? 1 : -1, now, connected);
+
+		/* Button events come faster than reports are sent */
+		now += rand_next(seed) % 4;
+
+		while (connected && ((s32_t)(now - next_handle) >= 0)) {
+			subscriber_handle();
+			next_handle += SUBSCRIBER_PERIOD;
+		}
+	}
+}
+
+static void test_setup(void)
+{
+	hid_eventq_init(&eventq, buf, ARRAY_SIZE(buf));
+	ref_reset();
+	memset(key_pressed, 0, sizeof(key_pressed));
+	worst_enqueue_cyc = 0;
+	worst_get_cyc = 0;
+	max_len = 0;
+	purged_cnt = 0;
+	dropped_cnt = 0;
+}
+
+static void test_fifo(void)
+{
+	struct hid_eventq_event event;
+
+	test_setup();
+
+	/* Move the head so that the queue wraps */
+	for (size_t i = 0; i < QUEUE_SIZE / 2; i++) {
+		zassert_equal(hid_eventq_append(&eventq, 0, 0, 0), 0, NULL);
+		zassert_true(hid_eventq_get(&eventq, &event), NULL);
+	}
+
+	for (size_t i = 0; i < QUEUE_SIZE; i++) {
+		zassert_equal(hid_eventq_append(&eventq, i, 1, i), 0,
+			      "Append failed");
+	}
+
+	zassert_true(hid_eventq_is_full(&eventq), "Queue not full");
+	zassert_equal(hid_eventq_append(&eventq, 0, 1, 0), -ENOBUFS,
+		      "Append to a full queue");
+	zassert_equal(hid_eventq_peek(&eventq, QUEUE_SIZE - 1)->usage_id,
+		      QUEUE_SIZE - 1, "Wrong event");
+
+	for (size_t i = 0; i < QUEUE_SIZE; i++) {
+		zassert_true(hid_eventq_get(&eventq, &event), "Queue empty");
+		zassert_equal(event.usage_id, i, "Wrong event order");
+		zassert_equal(event.timestamp, i, "Wrong timestamp");
+	}
+
+	zassert_true(hid_eventq_is_empty(&eventq), "Queue not empty");
+	zassert_false(hid_eventq_get(&eventq, &event), "Event in empty queue");
+}
+
+static void test_cleanup_pairs(void)
+{
+	const u32_t t = TIME_START;
+
+	test_setup();
+
+	/* Orphan key release is removed once expired */
+	hid_eventq_append(&eventq, 3, -1, t);
+	zassert_equal(hid_eventq_cleanup(&eventq, t + EXPIRATION - 1,
+					 EXPIRATION), 0, "Valid event removed");
+	zassert_equal(hid_eventq_cleanup(&eventq, t + EXPIRATION, EXPIRATION),
+		      1, "Expired event not removed");
+
+	/* Press A, press B, release A */
+	hid_eventq_append(&eventq, 1, 1, t);
+	hid_eventq_append(&eventq, 2, 1, t + 1);
+	hid_eventq_append(&eventq, 1, -1, t + 2);
+
+	/* B is still pressed, nothing can be removed */
+	zassert_equal(hid_eventq_cleanup(&eventq, t + 2 * EXPIRATION,
+					 EXPIRATION), 0,
+		      "Unpaired key press removed");
+
+	/* Release B, all expired events are paired */
+	hid_eventq_append(&eventq, 2, -1, t + 3);
+	hid_eventq_append(&eventq, 1, 1, t + 3 * EXPIRATION);
+	zassert_equal(hid_eventq_cleanup(&eventq, t + 3 * EXPIRATION,
+					 EXPIRATION), 4,
+		      "Paired events not removed");
+	zassert_equal(eventq.len, 1, "Valid event removed");
+	zassert_equal(hid_eventq_peek(&eventq, 0)->timestamp,
+		      t + 3 * EXPIRATION, "Wrong event left");
+}
+
+static void test_make_room(void)
+{
+	const u32_t t = TIME_START;
+
+	test_setup();
+
+	/* Fill the queue with paired events that did not expire yet */
+	for (size_t i = 0; i < QUEUE_SIZE; i++) {
+		hid_eventq_append(&eventq, i / 2, (i % 2) ? -1 : 1, t + i);
+	}
+
+	zassert_false(hid_eventq_make_room(&eventq, t + QUEUE_SIZE,
+					   EXPIRATION, false),
+		      "Valid events removed");
+	zassert_equal(eventq.len, QUEUE_SIZE, "Valid events removed");
+
+	/* Only the oldest pair is removed */
+	zassert_true(hid_eventq_make_room(&eventq, t + QUEUE_SIZE,
+					  EXPIRATION, true),
+		     "No room made");
+	zassert_equal(eventq.len, QUEUE_SIZE - 2, "Wrong events removed");
+	zassert_equal(hid_eventq_peek(&eventq, 0)->usage_id, 1,
+		      "Wrong events removed");
+}
+
+static void test_flood_slow_subscriber(void)
+{
+	u32_t seed = 1234;
+
+	test_setup();
+	flood(&seed, FLOOD_STEPS, true);
+
+	TC_PRINT("Connected: peak queue length %u, purged %u, dropped %u\n",
+		 max_len, purged_cnt, dropped_cnt);
+	TC_PRINT("Worst-case enqueue %u us, get %u us\n",
+		 k_cyc_to_us_ceil32(worst_enqueue_cyc),
+		 k_cyc_to_us_ceil32(worst_get_cyc));
+}
+
+static void test_flood_disconnected(void)
+{
+	u32_t seed = 5678;
+
+	test_setup();
+	flood(&seed, DISCONNECTED_STEPS, false);
+
+	TC_PRINT("Disconnected: peak queue length %u, purged %u, "
+		 "dropped %u\n", max_len, purged_cnt, dropped_cnt);
+	TC_PRINT("Worst-case enqueue %u us\n",
+		 k_cyc_to_us_ceil32(worst_enqueue_cyc));
+
+	zassert_equal(max_len, QUEUE_SIZE, "Queue never filled up");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(hid_state_test,
+			 ztest_unit_test(test_fifo),
+			 ztest_unit_test(test_cleanup_pairs),
+			 ztest_unit_test(test_make_room),
+			 ztest_unit_test(test_flood_slow_subscriber),
+			 ztest_unit_test(test_flood_disconnected)
+			 );
+	ztest_run_test_suite(hid_state_test);
+}
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <kernel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include "led_seq.h"
+
+#define SEQUENCE_SIZE		64	/* Default buffer size of leds module */
+#define LONG_SEQUENCE_SIZE	512
+#define SIM_TIME		10000	/* ms */
+#define COLOR_TOLERANCE		1
+
+/* Single color update of the substep playback */
+struct ref_update {
+	u16_t delay;
+	struct led_color color;
+};
+
+static const struct led_effect breath =
+	LED_EFFECT_LED_BREATH(500, LED_COLOR(100, 50, 0));
+
+static const struct led_effect blink =
+	LED_EFFECT_LED_BLINK(50, LED_COLOR(100, 100, 100));
+
+static const struct led_effect on_go_off =
+	LED_EFFECT_LED_ON_GO_OFF(LED_COLOR(255, 255, 255), 1000, 500);
+
+/* LED clock effect with two ticks, substep times are not equal */
+static const struct led_effect clock = {
+	.steps = ((const struct led_effect_step[]) {
+		{
+			.color = LED_NOCOLOR(),
+			.substep_count = 1,
+			.substep_time = LED_CLOCK_SLEEP_PERIOD,
+		},
+		LED_CLOCK_TIK(0, LED_COLOR(0, 0, 255))
+		LED_CLOCK_TIK(1, LED_COLOR(0, 0, 255))
+	}),
+	.step_count = 5,
+	.loop_forever = true,
+};
+
+/* Single step received by the LED stream module */
+static const struct led_effect stream_step = {
+	.steps = ((const struct led_effect_step[]) {
+		{
+			.color = LED_COLOR(255, 0, 128),
+			.substep_count = 100,
+			.substep_time = 10,
+		},
+	}),
+	.step_count = 1,
+	.loop_forever = false,
+};
+
+/* Blink with substep times that are not multiples of each other */
+static const struct led_effect uneven_blink = {
+	.steps = ((const struct led_effect_step[]) {
+		{
+			.color = LED_COLOR(255, 0, 0),
+			.substep_count = 1,
+			.substep_time = 15,
+		},
+		{
+			.color = LED_NOCOLOR(),
+			.substep_count = 1,
+			.substep_time = 10,
+		},
+	}),
+	.step_count = 2,
+	.loop_forever = true,
+};
+
+static struct led_seq seq;
+static struct led_seq_entry buf[SEQUENCE_SIZE];
+static struct led_seq_entry long_buf[LONG_SEQUENCE_SIZE];
+static struct led_seq_entry loop_buf[LONG_SEQUENCE_SIZE];
+
+/* Substep playback as done by the leds module before the PWM sequences were
+ * introduced, used as a reference. The color is updated in a work after
+ * every substep. The reference color is the exact linear interpolation
+ * between the color at the beginning of the step and the step color.
+ * Returns false when the effect ends.
+ */
+static bool ref_next(const struct led_effect *effect,
+		     struct led_color *step_color, u16_t *step,
+		     u16_t *substep, struct ref_update *update)
+{
+	if (*step >= effect->step_count) {
+		return false;
+	}
+
+	const struct led_effect_step *effect_step = &effect->steps[*step];
+	int count = effect_step->substep_count;
+
+	(*substep)++;
+
+	update->delay = effect_step->substep_time;
+
+	for (size_t i = 0; i < ARRAY_SIZE(step_color->c); i++) {
+		int diff = effect_step->color.c[i] - step_color->c[i];
+
+		update->color.c[i] = step_color->c[i] +
+				     (diff * *substep + count / 2) / count;
+	}
+
+	if (*substep == effect_step->substep_count) {
+		*step_color = effect_step->color;
+		*substep = 0;
+		(*step)++;
+
+		if ((*step == effect->step_count) && effect->loop_forever) {
+			*step = 0;
+		}
+	}
+
+	return true;
+}
+
+/* Number of CPU wakeups of the substep playback within simulation time */
+static u32_t ref_wakeups(const struct led_effect *effect)
+{
+	struct led_color color = LED_NOCOLOR();
+	struct ref_update update;
+	u16_t step = 0;
+	u16_t substep = 0;
+	u32_t time = 0;
+	u32_t cnt = 0;
+
+	while (ref_next(effect, &color, &step, &substep, &update)) {
+		time += update.delay;
+		if (time > SIM_TIME) {
+			break;
+		}
+		cnt++;
+	}
+
+	return cnt;
+}
+
+/* Number of CPU wakeups of the sequence playback within simulation time,
+ * the policy follows the leds module.
+ */
+static u32_t seq_wakeups(const struct led_effect *effect,
+			 const struct led_color *start_color, size_t buf_size)
+{
+	u32_t time = 0;
+	u32_t cnt = 0;
+	size_t len;
+
+	led_seq_init(&seq, effect, start_color);
+
+	while ((len = led_seq_fill(&seq, buf, buf_size)) > 0) {
+		if (led_seq_is_pass_loop(&seq)) {
+			/* Played by the PWM peripheral in a loop. */
+			break;
+		}
+
+		/* Wake up at the end of the played buffer. */
+		time += len * led_seq_tick_get(&seq);
+		if (time > SIM_TIME) {
+			break;
+		}
+		cnt++;
+	}
+
+	return cnt;
+}
+
+static void color_check(const struct led_seq_entry *entry,
+			const struct led_color *color)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(color->c); i++) {
+		zassert_true(abs(entry->c[i] - color->c[i]) <= COLOR_TOLERANCE,
+			     "Wrong color");
+	}
+
+	for (size_t i = ARRAY_SIZE(color->c); i < ARRAY_SIZE(entry->c); i++) {
+		zassert_equal(entry->c[i], 0, "Unused channel set");
+	}
+}
+
+/* Check the sequence against the substep playback. Every color update is
+ * represented by the number of entries that matches its delay. The looped
+ * pass must be played in the same way as the following passes.
+ */
+static void timeline_check(const struct led_effect *effect,
+			   const struct led_color *start_color, size_t passes)
+{
+	struct led_color color = *start_color;
+	struct led_color step_color = *start_color;
+	struct ref_update update;
+	size_t loop_len = 0;
+	u16_t step = 0;
+	u16_t substep = 0;
+	size_t pos = 0;
+	size_t len;
+	u16_t tick;
+
+	led_seq_init(&seq, effect, &color);
+	tick = led_seq_tick_get(&seq);
+
+	for (size_t pass = 0; pass < passes; pass++) {
+		len = led_seq_fill(&seq, long_buf, ARRAY_SIZE(long_buf));
+		zassert_true(led_seq_is_pass_end(&seq), "Pass does not fit");
+
+		if (loop_len > 0) {
+			/* Looped pass is repeated by the PWM peripheral. */
+			zassert_equal(len, loop_len, "Wrong looped pass");
+			zassert_mem_equal(long_buf, loop_buf,
+					  len * sizeof(long_buf[0]),
+					  "Wrong looped pass");
+		} else if (led_seq_is_pass_loop(&seq)) {
+			memcpy(loop_buf, long_buf, len * sizeof(long_buf[0]));
+			loop_len = len;
+		}
+
+		pos = 0;
+		do {
+			zassert_true(ref_next(effect, &step_color, &step,
+					      &substep, &update),
+				     "Effect ended early");
+
+			size_t entries = update.delay / tick;
+
+			zassert_equal(update.delay % tick, 0,
+				      "Substep time not a multiple of tick");
+			zassert_true(pos + entries <= len,
+				     "Sequence too short");
+
+			/* Color of the previous update is kept for the
+			 * delay.
+			 */
+			for (size_t i = 0; i < entries; i++) {
+				color_check(&long_buf[pos + i], &color);
+			}
+			pos += entries;
+			color = update.color;
+		} while ((step != 0) || (substep != 0));
+
+		zassert_equal(pos, len, "Sequence too long");
+	}
+
+	zassert_true(loop_len > 0, "Effect not looped");
+}
+
+static void test_breath(void)
+{
+	u32_t wakeups;
+	u32_t ref;
+
+	const struct led_color off = LED_NOCOLOR();
+
+	/* Colors of two passes of the looped effect */
+	timeline_check(&breath, &off, 2);
+
+	wakeups = seq_wakeups(&breath, &off, SEQUENCE_SIZE);
+	ref = ref_wakeups(&breath);
+
+	TC_PRINT("Breathing effect: %u wakeups/s "
+		 "(substep playback %u wakeups/s)\n",
+		 wakeups * MSEC_PER_SEC / SIM_TIME,
+		 ref * MSEC_PER_SEC / SIM_TIME);
+
+	zassert_equal(wakeups, 0, "Breathing effect needs the CPU");
+}
+
+static void test_clock(void)
+{
+	const struct led_color off = LED_NOCOLOR();
+
+	timeline_check(&clock, &off, 2);
+	zassert_equal(seq_wakeups(&clock, &off, SEQUENCE_SIZE), 0,
+		      "Clock effect needs the CPU");
+}
+
+static void test_start_color(void)
+{
+	const struct led_color lit = LED_COLOR(100, 100, 100);
+	const struct led_color half = LED_COLOR(50, 20, 0);
+	struct led_color color = lit;
+	bool on = false;
+	bool off = false;
+	size_t len;
+
+	/* First pass starts from the previous color and cannot be looped. */
+	led_seq_init(&seq, &blink, &color);
+	led_seq_fill(&seq, buf, ARRAY_SIZE(buf));
+	zassert_true(led_seq_is_pass_end(&seq), "Pass does not fit");
+	zassert_false(led_seq_is_pass_loop(&seq), "First pass looped");
+
+	len = led_seq_fill(&seq, buf, ARRAY_SIZE(buf));
+	zassert_true(led_seq_is_pass_loop(&seq), "Second pass not looped");
+
+	for (size_t i = 0; i < len; i++) {
+		on = on || (buf[i].c[0] == blink.steps[0].color.c[0]);
+		off = off || (buf[i].c[0] == 0);
+	}
+	zassert_true(on && off, "LED does not blink in the loop");
+
+	/* Looped pass starts from the color at the end of the effect. */
+	timeline_check(&blink, &lit, 3);
+	timeline_check(&breath, &half, 3);
+
+	zassert_equal(seq_wakeups(&blink, &lit, SEQUENCE_SIZE), 1,
+		      "Blink effect needs the CPU");
+	zassert_equal(seq_wakeups(&breath, &half, SEQUENCE_SIZE), 1,
+		      "Breathing effect needs the CPU");
+}
+
+static void test_chunks(void)
+{
+	struct led_color color = LED_NOCOLOR();
+	size_t long_len;
+	size_t pos = 0;
+	size_t len;
+
+	led_seq_init(&seq, &on_go_off, &color);
+	long_len = led_seq_fill(&seq, long_buf, ARRAY_SIZE(long_buf));
+	zassert_true(long_len > SEQUENCE_SIZE, "Sequence fits in buffer");
+	zassert_equal(led_seq_fill(&seq, long_buf, ARRAY_SIZE(long_buf)), 0,
+		      "Effect did not end");
+
+	/* Sequence played in multiple buffers is the same */
+	led_seq_init(&seq, &on_go_off, &color);
+	while ((len = led_seq_fill(&seq, buf, ARRAY_SIZE(buf))) > 0) {
+		zassert_true(pos + len <= long_len, "Sequence too long");
+		zassert_mem_equal(buf, &long_buf[pos], len * sizeof(buf[0]),
+				  "Wrong sequence");
+		pos += len;
+	}
+	zassert_equal(pos, long_len, "Sequence too short");
+
+	led_seq_color_get(&seq, &color);
+	zassert_equal(color.c[0], 0, "LED not turned off");
+
+	TC_PRINT("LED on, go off effect: %u wakeups "
+		 "(substep playback %u wakeups)\n",
+		 seq_wakeups(&on_go_off, &color, SEQUENCE_SIZE),
+		 ref_wakeups(&on_go_off));
+	TC_PRINT("Streamed step: %u wakeups (substep playback %u wakeups)\n",
+		 seq_wakeups(&stream_step, &color, SEQUENCE_SIZE),
+		 ref_wakeups(&stream_step));
+}
+
+static void test_uneven_times(void)
+{
+	const struct led_color off = LED_NOCOLOR();
+
+	led_seq_init(&seq, &uneven_blink, &off);
+	zassert_equal(led_seq_tick_get(&seq), 5, "Wrong tick");
+
+	/* Substeps are not rounded to the tick. */
+	timeline_check(&uneven_blink, &off, 2);
+}
+
+static void test_no_time(void)
+{
+	const struct led_effect led_on =
+		LED_EFFECT_LED_ON(LED_COLOR(10, 20, 30));
+	struct led_color color = LED_NOCOLOR();
+
+	led_seq_init(&seq, &led_on, &color);
+	zassert_equal(led_seq_tick_get(&seq), 0, "Wrong tick");
+	zassert_equal(led_seq_fill(&seq, buf, ARRAY_SIZE(buf)), 1,
+		      "Color not set");
+	zassert_true(led_seq_is_pass_end(&seq), "Effect did not end");
+	color_check(&buf[0], &led_on.steps[0].color);
+	zassert_equal(led_seq_fill(&seq, buf, ARRAY_SIZE(buf)), 0,
+		      "Effect did not end");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(leds_test,
+			 ztest_unit_test(test_breath),
+			 ztest_unit_test(test_clock),
+			 ztest_unit_test(test_start_color),
+			 ztest_unit_test(test_chunks),
+			 ztest_unit_test(test_uneven_times),
+			 ztest_unit_test(test_no_time)
+			 );
+	ztest_run_test_suite(leds_test);
+}
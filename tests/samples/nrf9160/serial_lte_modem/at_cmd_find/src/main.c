@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include "slm_util.h"
+#include "slm_at_host.h"
+
+#define BENCH_ROUNDS	200
+
+#define CMD(_name) { .string = "AT#" #_name }
+
+/* Command table as sorted by the linker */
+static const struct slm_at_cmd cmd_list[] = {
+	CMD(XACCEPT), CMD(XBIND), CMD(XCLAC), CMD(XCONNECT), CMD(XDATAMODE),
+	CMD(XFTP), CMD(XGETADDRINFO), CMD(XGPS), CMD(XLISTEN), CMD(XMQTTCON),
+	CMD(XMQTTPUB), CMD(XMQTTSUB), CMD(XMQTTUNSUB), CMD(XPING), CMD(XRECV),
+	CMD(XRECVFROM), CMD(XSEND), CMD(XSENDTO), CMD(XSLEEP), CMD(XSLMVER),
+	CMD(XSOCKET), CMD(XSOCKETOPT), CMD(XSOCKETSELECT), CMD(XTCPCLI),
+	CMD(XTCPSEND), CMD(XTCPSVR), CMD(XUDPCLI), CMD(XUDPSEND),
+	CMD(XUDPSVR),
+};
+
+/* Commands in the order the module parsers were chained before */
+static const char * const chain_list[] = {
+	"AT#XSOCKET", "AT#XSOCKETOPT", "AT#XBIND", "AT#XCONNECT",
+	"AT#XLISTEN", "AT#XACCEPT", "AT#XSEND", "AT#XRECV", "AT#XSENDTO",
+	"AT#XRECVFROM", "AT#XGETADDRINFO", "AT#XSOCKETSELECT", "AT#XDATAMODE",
+	"AT#XPING", "AT#XGPS", "AT#XMQTTCON", "AT#XMQTTPUB", "AT#XMQTTSUB",
+	"AT#XMQTTUNSUB", "AT#XFTP", "AT#XTCPSVR", "AT#XTCPCLI", "AT#XTCPSEND",
+	"AT#XUDPSVR", "AT#XUDPCLI", "AT#XUDPSEND", "AT#XSLEEP", "AT#XSLMVER",
+	"AT#XCLAC",
+};
+
+/* Modem commands were offered to every module parser */
+static const char * const modem_cmds[] = {
+	"AT+CFUN=1", "AT+CEREG?", "AT%XSYSTEMMODE=1,0,1,0", "AT+CGSN=1",
+	"AT%XMONITOR", "AT+COPS?",
+};
+
+/* Lookup before the sorted table: compare against every command in turn */
+static const char *chain_find(const char *at_cmd)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(chain_list); i++) {
+		if (slm_util_cmd_casecmp(at_cmd, chain_list[i])) {
+			return chain_list[i];
+		}
+	}
+
+	return NULL;
+}
+
+static const char *table_find(const char *at_cmd)
+{
+	const struct slm_at_cmd *cmd =
+		slm_util_at_cmd_find(cmd_list, ARRAY_SIZE(cmd_list), at_cmd);
+
+	return cmd ? cmd->string : NULL;
+}
+
+static void test_sorted(void)
+{
+	zassert_equal(ARRAY_SIZE(cmd_list), ARRAY_SIZE(chain_list),
+		      "Command lists differ");
+
+	for (size_t i = 1; i < ARRAY_SIZE(cmd_list); i++) {
+		zassert_true(strcmp(cmd_list[i - 1].string,
+				    cmd_list[i].string) < 0,
+			     "Table not sorted");
+	}
+}
+
+static void test_find(void)
+{
+	static const char * const suffix[] = { "", "=1", "?", "=?" };
+	char buf[64];
+
+	for (size_t i = 0; i < ARRAY_SIZE(chain_list); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(suffix); j++) {
+			snprintf(buf, sizeof(buf), "%s%s", chain_list[i],
+				 suffix[j]);
+			zassert_not_null(table_find(buf), "Command not found");
+			zassert_not_null(chain_find(buf), "Command not found");
+			zassert_true(!strcmp(table_find(buf), chain_find(buf)),
+				     "Lookups differ");
+			zassert_true(!strcmp(table_find(buf), chain_list[i]),
+				     "Wrong command found");
+
+			/* Names are compared ignoring case */
+			for (char *c = buf; *c; c++) {
+				*c = tolower((int)*c);
+			}
+			zassert_not_null(table_find(buf),
+					 "Lower case command not found");
+			zassert_true(!strcmp(table_find(buf), chain_list[i]),
+				     "Lower case command not found");
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(modem_cmds); i++) {
+		zassert_is_null(table_find(modem_cmds[i]),
+				"Modem command found");
+		zassert_is_null(chain_find(modem_cmds[i]),
+				"Modem command found");
+	}
+
+	zassert_is_null(table_find("AT#XSOCK=1"), "Prefix found");
+	zassert_is_null(table_find("AT#XSOCKETS=1"), "Longer name found");
+	zassert_is_null(table_find("AT#XUNKNOWN"), "Unknown command found");
+	zassert_not_null(table_find("AT#XSLMVER\r\n"),
+			 "Terminated command not found");
+	zassert_true(!strcmp(table_find("AT#XSLMVER\r\n"), "AT#XSLMVER"),
+		     "Terminated command not found");
+}
+
+static u32_t bench(const char *(*find)(const char *), const char * const *cmds,
+		   size_t cnt)
+{
+	u32_t start = k_cycle_get_32();
+
+	for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (size_t i = 0; i < cnt; i++) {
+			(void)find(cmds[i]);
+		}
+	}
+
+	return k_cycle_get_32() - start;
+}
+
+static void bench_print(const char *name, const char * const *cmds,
+			size_t cnt)
+{
+	u32_t chain_cyc = bench(chain_find, cmds, cnt);
+	u32_t table_cyc = bench(table_find, cmds, cnt);
+	u32_t lookups = BENCH_ROUNDS * cnt;
+
+	TC_PRINT("%s: chain %u ns, sorted table %u ns per lookup\n", name,
+		 (u32_t)(k_cyc_to_ns_floor64(chain_cyc) / lookups),
+		 (u32_t)(k_cyc_to_ns_floor64(table_cyc) / lookups));
+}
+
+static void test_benchmark(void)
+{
+	const char *slm_cmds[ARRAY_SIZE(chain_list)];
+
+	/* SLM commands with parameters, as typically sent by a host */
+	static char cmd_buf[ARRAY_SIZE(chain_list)][32];
+
+	for (size_t i = 0; i < ARRAY_SIZE(chain_list); i++) {
+		snprintf(cmd_buf[i], sizeof(cmd_buf[i]), "%s=1",
+			 chain_list[i]);
+		slm_cmds[i] = cmd_buf[i];
+	}
+
+	bench_print("SLM commands", slm_cmds, ARRAY_SIZE(slm_cmds));
+	bench_print("Modem commands", modem_cmds, ARRAY_SIZE(modem_cmds));
+}
+
+void test_main(void)
+{
+	ztest_test_suite(at_cmd_find_test,
+			 ztest_unit_test(test_sorted),
+			 ztest_unit_test(test_find),
+			 ztest_unit_test(test_benchmark)
+			 );
+	ztest_run_test_suite(at_cmd_find_test);
+}
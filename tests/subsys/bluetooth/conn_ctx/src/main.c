@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <ztest.h>
+#include <kernel.h>
+#include <sys/util.h>
+#include <bluetooth/conn_ctx.h>
+
+#define CONN_CNT	CONFIG_BT_MAX_CONN
+#define DATA_MAGIC	0xC0FFEE00
+#define READER_CNT	3
+#define READER_ITERATIONS	2000
+#define CHURN_ITERATIONS	500
+#define STACK_SIZE	1024
+#define THREAD_PRIO	K_PRIO_PREEMPT(1)
+#define TEST_TIMEOUT	K_SECONDS(60)
+
+struct bt_conn {
+	u8_t index;
+};
+
+struct ctx_data {
+	u32_t magic;
+	u8_t conn_index;
+	u32_t generation;
+};
+
+static struct bt_conn conns[CONN_CNT];
+
+BT_CONN_CTX_DEF(test, CONN_CNT, sizeof(struct ctx_data));
+static struct bt_conn_ctx_lib *ctx_lib = &test_ctx_lib;
+
+static K_THREAD_STACK_ARRAY_DEFINE(stacks, READER_CNT + 1, STACK_SIZE);
+static struct k_thread threads[READER_CNT + 1];
+static K_SEM_DEFINE(threads_done, 0, READER_CNT + 1);
+
+static atomic_t reader_hits;
+static atomic_t reader_misses;
+static atomic_t churn_cycles;
+static bool stress_failed;
+
+/* Replaces the Bluetooth host */
+u8_t bt_conn_index(struct bt_conn *conn)
+{
+	return conn->index;
+}
+
+static void ctx_data_init(struct ctx_data *data, u8_t conn_index,
+			  u32_t generation)
+{
+	data->magic = DATA_MAGIC;
+	data->conn_index = conn_index;
+	data->generation = generation;
+}
+
+static void test_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(conns); i++) {
+		conns[i].index = i;
+	}
+}
+
+static void test_alloc_get_free(void)
+{
+	struct ctx_data *data;
+	struct ctx_data *found;
+
+	data = bt_conn_ctx_alloc(ctx_lib, &conns[1]);
+	zassert_not_null(data, "Allocation failed");
+	ctx_data_init(data, 1, 0);
+
+	/* Not visible before the allocating user releases it */
+	zassert_is_null(bt_conn_ctx_get_by_id(ctx_lib, 1),
+			"Context visible during initialization");
+	bt_conn_ctx_release(ctx_lib, data);
+
+	zassert_is_null(bt_conn_ctx_alloc(ctx_lib, &conns[1]),
+			"Second context allocated for the connection");
+	zassert_is_null(bt_conn_ctx_get(ctx_lib, &conns[0]),
+			"Context found for another connection");
+
+	found = bt_conn_ctx_get(ctx_lib, &conns[1]);
+	zassert_equal_ptr(found, data, "Wrong context");
+	zassert_equal(found->conn_index, 1, "Wrong context data");
+	bt_conn_ctx_release(ctx_lib, found);
+
+	zassert_equal(bt_conn_ctx_free(ctx_lib, &conns[1]), 0, "Free failed");
+	zassert_is_null(bt_conn_ctx_get(ctx_lib, &conns[1]),
+			"Context found after free");
+	zassert_equal(bt_conn_ctx_free(ctx_lib, &conns[1]), -EINVAL,
+		      "Context freed twice");
+	zassert_equal(k_mem_slab_num_used_get(&test_mem_slab), 0,
+		      "Memory not released");
+}
+
+static void test_free_while_used(void)
+{
+	const struct bt_conn_ctx *ctx;
+	struct ctx_data *data;
+
+	data = bt_conn_ctx_alloc(ctx_lib, &conns[2]);
+	zassert_not_null(data, "Allocation failed");
+	ctx_data_init(data, 2, 0);
+	bt_conn_ctx_release(ctx_lib, data);
+
+	ctx = bt_conn_ctx_get_by_id(ctx_lib, 2);
+	zassert_not_null(ctx, "Context not found");
+	zassert_equal_ptr(ctx->conn, &conns[2], "Wrong connection");
+
+	zassert_equal(bt_conn_ctx_free(ctx_lib, &conns[2]), 0, "Free failed");
+	zassert_is_null(bt_conn_ctx_get(ctx_lib, &conns[2]),
+			"Context found after free");
+	zassert_is_null(bt_conn_ctx_alloc(ctx_lib, &conns[2]),
+			"Context reallocated while in use");
+
+	/* The user keeps the data until it releases the context */
+	zassert_equal(k_mem_slab_num_used_get(&test_mem_slab), 1,
+		      "Memory released while in use");
+	zassert_equal(data->magic, DATA_MAGIC, "Data changed while in use");
+	bt_conn_ctx_release(ctx_lib, ctx->data);
+	zassert_equal(k_mem_slab_num_used_get(&test_mem_slab), 0,
+		      "Memory not released by the last user");
+
+	data = bt_conn_ctx_alloc(ctx_lib, &conns[2]);
+	zassert_not_null(data, "Allocation after release failed");
+	bt_conn_ctx_release(ctx_lib, data);
+	bt_conn_ctx_free_all(ctx_lib);
+	zassert_equal(k_mem_slab_num_used_get(&test_mem_slab), 0,
+		      "Memory not released");
+}
+
+static u32_t rand_next(u32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 16;
+}
+
+static void stress_check(const struct ctx_data *data, u8_t index,
+			 u32_t generation)
+{
+	if ((data->magic != DATA_MAGIC) || (data->conn_index != index) ||
+	    (data->generation != generation)) {
+		stress_failed = true;
+	}
+}
+
+/* Sends "reports" to random connections, as the HIDS does */
+static void reader_thread(void *p1, void *p2, void *p3)
+{
+	u32_t seed = POINTER_TO_UINT(p1);
+
+	for (int i = 0; i < READER_ITERATIONS; i++) {
+		u8_t index = rand_next(&seed) % CONN_CNT;
+		struct ctx_data *data;
+		u32_t generation;
+
+		if (i % 2) {
+			data = bt_conn_ctx_get(ctx_lib, &conns[index]);
+		} else {
+			const struct bt_conn_ctx *ctx =
+				bt_conn_ctx_get_by_id(ctx_lib, index);
+
+			data = ctx ? ctx->data : NULL;
+		}
+
+		if (!data) {
+			atomic_inc(&reader_misses);
+			k_yield();
+			continue;
+		}
+
+		/* The data must not be freed or reused while it is held */
+		generation = data->generation;
+		stress_check(data, index, generation);
+		k_yield();
+		stress_check(data, index, generation);
+
+		bt_conn_ctx_release(ctx_lib, data);
+		atomic_inc(&reader_hits);
+	}
+
+	k_sem_give(&threads_done);
+}
+
+/* Connects and disconnects the peers */
+static void churn_thread(void *p1, void *p2, void *p3)
+{
+	u32_t seed = POINTER_TO_UINT(p1);
+	u32_t generation = 0;
+
+	for (int i = 0; i < CHURN_ITERATIONS; i++) {
+		u8_t index = rand_next(&seed) % CONN_CNT;
+		struct ctx_data *data;
+
+		if (bt_conn_ctx_free(ctx_lib, &conns[index]) == 0) {
+			k_yield();
+		}
+
+		data = bt_conn_ctx_alloc(ctx_lib, &conns[index]);
+		if (data) {
+			ctx_data_init(data, index, ++generation);
+			k_yield();
+			bt_conn_ctx_release(ctx_lib, data);
+			atomic_inc(&churn_cycles);
+		}
+
+		k_yield();
+	}
+
+	k_sem_give(&threads_done);
+}
+
+static void test_stress(void)
+{
+	stress_failed = false;
+	atomic_set(&reader_hits, 0);
+	atomic_set(&reader_misses, 0);
+	atomic_set(&churn_cycles, 0);
+
+	for (size_t i = 0; i < READER_CNT; i++) {
+		k_thread_create(&threads[i], stacks[i], STACK_SIZE,
+				reader_thread, UINT_TO_POINTER(i + 1), NULL,
+				NULL, THREAD_PRIO, 0, K_NO_WAIT);
+	}
+
+	k_thread_create(&threads[READER_CNT], stacks[READER_CNT], STACK_SIZE,
+			churn_thread, UINT_TO_POINTER(1234), NULL, NULL,
+			THREAD_PRIO, 0, K_NO_WAIT);
+
+	for (size_t i = 0; i < ARRAY_SIZE(threads); i++) {
+		zassert_equal(k_sem_take(&threads_done, TEST_TIMEOUT), 0,
+			      "Stress test timed out");
+	}
+
+	zassert_false(stress_failed, "Context changed while in use");
+	zassert_true(atomic_get(&reader_hits) > 0, "No context found");
+	zassert_true(atomic_get(&churn_cycles) > 0, "No context allocated");
+
+	bt_conn_ctx_free_all(ctx_lib);
+	zassert_equal(k_mem_slab_num_used_get(&test_mem_slab), 0,
+		      "Memory leaked");
+
+	for (size_t i = 0; i < CONN_CNT; i++) {
+		zassert_is_null(bt_conn_ctx_get_by_id(ctx_lib, i),
+				"Context left after free");
+	}
+}
+
+void test_main(void)
+{
+	ztest_test_suite(bt_conn_ctx_test,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test(test_alloc_get_free),
+			 ztest_unit_test(test_free_while_used),
+			 ztest_unit_test(test_stress)
+			 );
+	ztest_run_test_suite(bt_conn_ctx_test);
+}
@@ -12,14 +12,21 @@
 #include <sys/util.h>
 
 
+/* Maximum number of discoveries running at the same time */
+#define DISCOVER_MOCK_REQ_CNT 4
+
 /* Settings of the discover mock */
-static struct bt_discover_mock {
+static struct {
 	const struct bt_gatt_attr *attr;
 	size_t len;
+} discover_mock_data;
+
+/* Discovery requests of the discover mock */
+static struct bt_discover_mock {
 	struct bt_conn *conn;
 	struct bt_gatt_discover_params *params;
 	struct k_delayed_work work;
-} discover_mock_data;
+} discover_mock_req[DISCOVER_MOCK_REQ_CNT];
 
 
 void bt_gatt_discover_mock_setup(const struct bt_gatt_attr *attr, size_t len)
@@ -122,11 +129,28 @@ static void bt_gatt_discover_work(struct k_work *work)
 int bt_gatt_discover(struct bt_conn *conn,
 		     struct bt_gatt_discover_params *params)
 {
+	struct bt_discover_mock *mock_data = NULL;
+
 	printk("Running %s mock\n", __func__);
-	discover_mock_data.conn = conn;
-	discover_mock_data.params = params;
 
-	k_delayed_work_init(&(discover_mock_data.work), bt_gatt_discover_work);
-	k_delayed_work_submit(&(discover_mock_data.work), K_MSEC(5));
+	/* The parameters of a discovery procedure are reused for its
+	 * subsequent requests.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(discover_mock_req); i++) {
+		if (discover_mock_req[i].params == params) {
+			mock_data = &discover_mock_req[i];
+			break;
+		}
+		if (!mock_data && !discover_mock_req[i].params) {
+			mock_data = &discover_mock_req[i];
+		}
+	}
+	zassert_not_null(mock_data, "Too many discovery procedures");
+
+	mock_data->conn = conn;
+	mock_data->params = params;
+
+	k_delayed_work_init(&(mock_data->work), bt_gatt_discover_work);
+	k_delayed_work_submit(&(mock_data->work), K_MSEC(5));
 	return 0;
 }
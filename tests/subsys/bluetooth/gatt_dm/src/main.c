@@ -15,7 +15,8 @@
 #define SERVICE_DISCOVERY_TIMEOUT 2000
 
 static char dummy_conn;
-K_SEM_DEFINE(discovery_finished, 0, 1);
+static char dummy_conn_other[2];
+K_SEM_DEFINE(discovery_finished, 0, CONFIG_BT_GATT_DM_MAX_INSTANCES);
 
 
 const struct bt_gatt_attr discover_sim[] = {
@@ -376,6 +377,52 @@ void test_gatt_generic_serv(void)
 	/* No cleanup here - cleanup is done in run_dm_next */
 }
 
+void test_gatt_concurrent(void)
+{
+	struct bt_conn *conn_hids = (struct bt_conn *)&dummy_conn;
+	struct bt_conn *conn_dis = (struct bt_conn *)&dummy_conn_other[0];
+	struct bt_conn *conn_busy = (struct bt_conn *)&dummy_conn_other[1];
+	struct bt_gatt_dm *dm_hids = NULL;
+	struct bt_gatt_dm *dm_dis = NULL;
+	struct bt_gatt_dm *dm_busy = NULL;
+	const struct bt_gatt_service_val *serv_val;
+	int err;
+
+	err = bt_gatt_dm_start(conn_hids, BT_UUID_HIDS, &test_hids_cb, &dm_hids);
+	zassert_equal(0, err, "bt_gatt_dm_start finished with error: %d", err);
+	err = bt_gatt_dm_start(conn_hids, BT_UUID_DIS, &test_hids_cb, &dm_busy);
+	zassert_equal(-EALREADY, err, "Second discovery on the same connection: %d", err);
+	err = bt_gatt_dm_start(conn_dis, BT_UUID_DIS, &test_hids_cb, &dm_dis);
+	zassert_equal(0, err, "bt_gatt_dm_start finished with error: %d", err);
+	err = bt_gatt_dm_start(conn_busy, BT_UUID_DIS, &test_hids_cb, &dm_busy);
+	zassert_equal(-EALREADY, err, "Discovery started without a free instance: %d", err);
+
+	for (int i = 0; i < 2; ++i) {
+		err = k_sem_take(&discovery_finished, K_MSEC(SERVICE_DISCOVERY_TIMEOUT));
+		zassert_equal(0, err, "It seems that no callback function was called: %d", err);
+	}
+
+	zassert_not_null(dm_hids, "Device Manager pointer not set");
+	zassert_not_null(dm_dis, "Device Manager pointer not set");
+	zassert_is_null(dm_busy, "Device Manager pointer set");
+	zassert_not_equal(dm_hids, dm_dis, "Discoveries share an instance");
+	zassert_equal(conn_hids, bt_gatt_dm_conn_get(dm_hids), "Unexpected connection");
+	zassert_equal(conn_dis, bt_gatt_dm_conn_get(dm_dis), "Unexpected connection");
+
+	serv_val = bt_gatt_dm_attr_service_val(bt_gatt_dm_service_get(dm_hids));
+	zassert_true(!bt_uuid_cmp(BT_UUID_HIDS, serv_val->uuid), "Invalid service detected");
+	zassert_equal(11, bt_gatt_dm_attr_cnt(dm_hids), "Unexpected number of attributes detected: %d",
+		      bt_gatt_dm_attr_cnt(dm_hids));
+
+	serv_val = bt_gatt_dm_attr_service_val(bt_gatt_dm_service_get(dm_dis));
+	zassert_true(!bt_uuid_cmp(BT_UUID_DIS, serv_val->uuid), "Invalid service detected");
+	zassert_equal(5, bt_gatt_dm_attr_cnt(dm_dis), "Unexpected number of attributes detected: %d",
+		      bt_gatt_dm_attr_cnt(dm_dis));
+
+	bt_gatt_dm_data_release(dm_hids);
+	bt_gatt_dm_data_release(dm_dis);
+}
+
 void test_main(void)
 {
 	ztest_test_suite(
@@ -387,7 +434,8 @@ void test_main(void)
 		ztest_unit_test_setup_teardown(test_gatt_HIDS_attr_by_handle, test_setup, unit_test_noop),
 		ztest_unit_test_setup_teardown(test_gatt_HIDS_next_chrc_access, test_setup, unit_test_noop),
 		ztest_unit_test_setup_teardown(test_gatt_HIDS_chrc_by_uuid, test_setup, unit_test_noop),
-		ztest_unit_test_setup_teardown(test_gatt_generic_serv, test_setup, unit_test_noop)
+		ztest_unit_test_setup_teardown(test_gatt_generic_serv, test_setup, unit_test_noop),
+		ztest_unit_test_setup_teardown(test_gatt_concurrent, test_setup, unit_test_noop)
 	);
 
 	ztest_run_test_suite(test_gatt);
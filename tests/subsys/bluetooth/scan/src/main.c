@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <string.h>
+#include <stdio.h>
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <ztest.h>
+#include <sys/byteorder.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/scan.h>
+
+#define ADV_DATA_MAX_LEN	31
+#define TAG_CNT			256
+#define REPORT_CNT		(2 * TAG_CNT)
+#define REPLAY_ROUNDS		8
+#define UUID_FILTER_CNT		32
+#define NAME_FILTER_CNT		32
+#define TAG_UUID_BASE		0x1800
+#define OTHER_UUID_BASE		0x2a00
+
+/* Bluetooth host stand-in */
+static bt_le_scan_cb_t *scan_cb;
+
+int bt_le_scan_start(const struct bt_le_scan_param *param,
+		     bt_le_scan_cb_t cb)
+{
+	scan_cb = cb;
+	return 0;
+}
+
+int bt_le_scan_stop(void)
+{
+	scan_cb = NULL;
+	return 0;
+}
+
+int bt_conn_le_create(const bt_addr_le_t *peer,
+		      const struct bt_conn_le_create_param *create_param,
+		      const struct bt_le_conn_param *conn_param,
+		      struct bt_conn **conn)
+{
+	return -ENOTSUP;
+}
+
+void bt_conn_unref(struct bt_conn *conn)
+{
+}
+
+void bt_data_parse(struct net_buf_simple *ad,
+		   bool (*func)(struct bt_data *data, void *user_data),
+		   void *user_data)
+{
+	while (ad->len > 1) {
+		struct bt_data data;
+		u8_t len;
+
+		len = net_buf_simple_pull_u8(ad);
+		if ((len == 0) || (len > ad->len)) {
+			return;
+		}
+
+		data.type = net_buf_simple_pull_u8(ad);
+		data.data_len = len - 1;
+		data.data = ad->data;
+
+		if (!func(&data, user_data)) {
+			return;
+		}
+
+		net_buf_simple_pull(ad, len - 1);
+	}
+}
+
+/* Recorded advertising reports */
+struct adv_report {
+	bt_addr_le_t addr;
+	u8_t data[ADV_DATA_MAX_LEN];
+	u8_t len;
+};
+
+static struct adv_report reports[REPORT_CNT];
+
+static size_t match_cnt;
+static size_t no_match_cnt;
+static struct bt_scan_filter_match last_match;
+
+static void scan_filter_match(struct bt_scan_device_info *device_info,
+			      struct bt_scan_filter_match *filter_match,
+			      bool connectable)
+{
+	match_cnt++;
+	last_match = *filter_match;
+}
+
+static void scan_filter_no_match(struct bt_scan_device_info *device_info,
+				 bool connectable)
+{
+	no_match_cnt++;
+}
+
+BT_SCAN_CB_INIT(scan_cb_data, scan_filter_match, scan_filter_no_match,
+		NULL, NULL);
+
+static void tag_addr_get(bt_addr_le_t *addr, u32_t id)
+{
+	addr->type = BT_ADDR_LE_RANDOM;
+	addr->a.val[0] = id;
+	addr->a.val[1] = id >> 8;
+	addr->a.val[2] = 0x5a;
+	addr->a.val[3] = 0xa5;
+	addr->a.val[4] = 0x12;
+	addr->a.val[5] = 0xc0;
+}
+
+static void tag_name_get(char *name, size_t len, u32_t id)
+{
+	snprintf(name, len, "Tag-%03u", id);
+}
+
+static void ad_append(struct adv_report *report, u8_t type,
+		      const void *data, u8_t len)
+{
+	zassert_true(report->len + len + 2 <= sizeof(report->data),
+		     "Advertising data too long");
+
+	report->data[report->len++] = len + 1;
+	report->data[report->len++] = type;
+	memcpy(&report->data[report->len], data, len);
+	report->len += len;
+}
+
+/* Report i comes from a tag filtered by the address, name and UUID
+ * filters when i < TAG_CNT, from another device otherwise.
+ */
+static void reports_build(void)
+{
+	for (u32_t i = 0; i < REPORT_CNT; i++) {
+		struct adv_report *report = &reports[i];
+		u8_t flags = BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR;
+		char name[16];
+		u8_t uuids[3 * sizeof(u16_t)];
+		u16_t uuid_base = (i < TAG_CNT) ? TAG_UUID_BASE :
+						  OTHER_UUID_BASE;
+
+		memset(report, 0, sizeof(*report));
+		tag_addr_get(&report->addr, i);
+
+		ad_append(report, BT_DATA_FLAGS, &flags, sizeof(flags));
+
+		tag_name_get(name, sizeof(name),
+			     (i < TAG_CNT) ? i : (1000 - TAG_CNT + i));
+		ad_append(report, BT_DATA_NAME_COMPLETE, name, strlen(name));
+
+		/* The filtered UUID is the last in the list. */
+		sys_put_le16(OTHER_UUID_BASE + UUID_FILTER_CNT, &uuids[0]);
+		sys_put_le16(OTHER_UUID_BASE + UUID_FILTER_CNT + 1, &uuids[2]);
+		sys_put_le16(uuid_base + (i % UUID_FILTER_CNT), &uuids[4]);
+		ad_append(report, BT_DATA_UUID16_SOME, uuids, sizeof(uuids));
+	}
+}
+
+static void ad_init(struct net_buf_simple *ad, const u8_t *data, u8_t len)
+{
+	ad->__buf = (u8_t *)data;
+	ad->data = ad->__buf;
+	ad->len = len;
+	ad->size = len;
+}
+
+static void report_replay(const bt_addr_le_t *addr, const u8_t *data,
+			  u8_t len)
+{
+	struct net_buf_simple ad;
+
+	ad_init(&ad, data, len);
+
+	zassert_not_null(scan_cb, "Scanning not started");
+	scan_cb(addr, -50, BT_GAP_ADV_TYPE_ADV_IND, &ad);
+}
+
+static void test_reset(void)
+{
+	bt_scan_init(NULL);
+	zassert_equal(bt_scan_start(BT_SCAN_TYPE_SCAN_PASSIVE), 0,
+		      "Scanning not started");
+
+	match_cnt = 0;
+	no_match_cnt = 0;
+	memset(&last_match, 0, sizeof(last_match));
+}
+
+static void test_init(void)
+{
+	bt_scan_cb_register(&scan_cb_data);
+	reports_build();
+}
+
+static void test_addr_filter(void)
+{
+	struct bt_filter_status status;
+	bt_addr_le_t addr;
+
+	test_reset();
+
+	for (u32_t i = 0; i < TAG_CNT; i++) {
+		tag_addr_get(&addr, i);
+		zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_ADDR,
+						 &addr), 0,
+			      "Address filter not added");
+	}
+
+	/* Duplicates are not added again. */
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_ADDR, &addr), 0,
+		      "Duplicate address filter rejected");
+	zassert_equal(bt_scan_filter_get(&status), 0, "No filter status");
+	zassert_equal(status.addr.cnt, TAG_CNT, "Wrong address filter count");
+
+	zassert_equal(bt_scan_filter_enable(BT_SCAN_ADDR_FILTER, false), 0,
+		      "Filter not enabled");
+
+	for (u32_t i = 0; i < REPORT_CNT; i++) {
+		report_replay(&reports[i].addr, reports[i].data,
+			      reports[i].len);
+	}
+
+	zassert_equal(match_cnt, TAG_CNT, "Wrong number of matches");
+	zassert_equal(no_match_cnt, REPORT_CNT - TAG_CNT,
+		      "Wrong number of mismatches");
+	zassert_true(last_match.addr.match, "Address match not reported");
+	zassert_equal(bt_addr_le_cmp(last_match.addr.addr,
+				     &reports[TAG_CNT - 1].addr), 0,
+		      "Wrong address reported");
+}
+
+static void test_name_filter(void)
+{
+	const struct bt_scan_short_name short_name = {
+		.name = "Nordic_HIDS",
+		.min_len = 6,
+	};
+	const u8_t *name;
+
+	test_reset();
+
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_NAME,
+					 "Nordic_Mouse"), 0,
+		      "Name filter not added");
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_NAME,
+					 "Nordic_Keyboard"), 0,
+		      "Name filter not added");
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_NAME,
+					 "Nordic"), 0,
+		      "Name filter not added");
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_SHORT_NAME,
+					 &short_name), 0,
+		      "Short name filter not added");
+	zassert_equal(bt_scan_filter_enable(BT_SCAN_NAME_FILTER |
+					    BT_SCAN_SHORT_NAME_FILTER, false),
+		      0, "Filter not enabled");
+
+	/* The advertised name must be the beginning of a filter name. */
+	name = (const u8_t *)"\x0c\x09Nordic_Keyb";
+	report_replay(&reports[0].addr, name, 13);
+	zassert_equal(match_cnt, 1, "Name prefix not matched");
+	zassert_true(last_match.name.match, "Name match not reported");
+	zassert_true(strcmp(last_match.name.name, "Nordic_Keyboard") == 0,
+		     "Wrong name reported");
+
+	name = (const u8_t *)"\x0c\x09Nordic_Keyz";
+	report_replay(&reports[0].addr, name, 13);
+	zassert_equal(match_cnt, 1, "Different name matched");
+
+	name = (const u8_t *)"\x07\x09Nordic";
+	report_replay(&reports[0].addr, name, 8);
+	zassert_equal(match_cnt, 2, "Full name not matched");
+
+	/* Short names must be at least min_len long. */
+	name = (const u8_t *)"\x06\x08Nordi";
+	report_replay(&reports[0].addr, name, 7);
+	zassert_equal(match_cnt, 2, "Too short name matched");
+
+	name = (const u8_t *)"\x07\x08Nordic";
+	report_replay(&reports[0].addr, name, 8);
+	zassert_equal(match_cnt, 3, "Short name not matched");
+	zassert_true(last_match.short_name.match,
+		     "Short name match not reported");
+}
+
+static void test_uuid_filter_all_mode(void)
+{
+	struct adv_report report = { 0 };
+	u8_t uuid[sizeof(u16_t)];
+
+	test_reset();
+
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID,
+					 BT_UUID_HIDS), 0,
+		      "UUID filter not added");
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID,
+					 BT_UUID_BAS), 0,
+		      "UUID filter not added");
+	zassert_equal(bt_scan_filter_enable(BT_SCAN_UUID_FILTER, true), 0,
+		      "Filter not enabled");
+
+	/* All UUIDs must be found, possibly in different fields. */
+	sys_put_le16(BT_UUID_HIDS_VAL, uuid);
+	ad_append(&report, BT_DATA_UUID16_SOME, uuid, sizeof(uuid));
+	ad_append(&report, BT_DATA_UUID16_SOME, uuid, sizeof(uuid));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 0, "Matched without all UUIDs");
+
+	sys_put_le16(BT_UUID_BAS_VAL, uuid);
+	ad_append(&report, BT_DATA_UUID16_ALL, uuid, sizeof(uuid));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 1, "Not matched with all UUIDs");
+	zassert_equal(last_match.uuid.count, 2, "Wrong UUID count");
+}
+
+static void test_uuid_128_filter(void)
+{
+	struct adv_report report = { 0 };
+	struct bt_uuid_128 uuid = BT_UUID_INIT_128(
+		0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
+		0x93, 0xf3, 0xa3, 0xb5, 0x01, 0x00, 0x40, 0x6e);
+	u8_t hids_128[16] = {
+		0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+		0x00, 0x10, 0x00, 0x00, 0x12, 0x18, 0x00, 0x00,
+	};
+
+	test_reset();
+
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID,
+					 &uuid.uuid), 0,
+		      "UUID filter not added");
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID,
+					 BT_UUID_HIDS), 0,
+		      "UUID filter not added");
+	zassert_equal(bt_scan_filter_enable(BT_SCAN_UUID_FILTER, false), 0,
+		      "Filter not enabled");
+
+	ad_append(&report, BT_DATA_UUID128_ALL, uuid.val, sizeof(uuid.val));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 1, "128-bit UUID not matched");
+	zassert_equal(last_match.uuid.uuid[0]->type, BT_UUID_TYPE_128,
+		      "Wrong UUID type reported");
+	zassert_mem_equal(BT_UUID_128(last_match.uuid.uuid[0])->val,
+			  uuid.val, sizeof(uuid.val), "Wrong UUID reported");
+
+	/* A 16-bit UUID advertised in the 128-bit form. */
+	memset(&report, 0, sizeof(report));
+	ad_append(&report, BT_DATA_UUID128_SOME, hids_128, sizeof(hids_128));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 2, "Base UUID form not matched");
+}
+
+static void test_manufacturer_data_filter(void)
+{
+	u8_t data[] = { 0x59, 0x00, 0x10, 0x20 };
+	u8_t mask[] = { 0xff, 0xff, 0xf0, 0xff };
+	u8_t any_company[] = { 0x00, 0x00, 0x42 };
+	u8_t any_company_mask[] = { 0x00, 0x00, 0xff };
+	const struct bt_scan_manufacturer_data filter = {
+		.data = data,
+		.data_len = sizeof(data),
+		.mask = mask,
+	};
+	const struct bt_scan_manufacturer_data filter_any = {
+		.data = any_company,
+		.data_len = sizeof(any_company),
+		.mask = any_company_mask,
+	};
+	struct adv_report report = { 0 };
+	u8_t adv[] = { 0x59, 0x00, 0x1f, 0x20, 0x99 };
+
+	test_reset();
+
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_MANUFACTURER_DATA,
+					 &filter), 0,
+		      "Manufacturer data filter not added");
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_MANUFACTURER_DATA,
+					 &filter_any), 0,
+		      "Manufacturer data filter not added");
+	zassert_equal(bt_scan_filter_enable(BT_SCAN_MANUFACTURER_DATA_FILTER,
+					    false), 0,
+		      "Filter not enabled");
+
+	/* Masked bits are ignored. */
+	ad_append(&report, BT_DATA_MANUFACTURER_DATA, adv, sizeof(adv));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 1, "Masked data not matched");
+	zassert_equal(last_match.manufacturer_data.len, sizeof(data),
+		      "Wrong manufacturer data reported");
+
+	adv[3] = 0x21;
+	memset(&report, 0, sizeof(report));
+	ad_append(&report, BT_DATA_MANUFACTURER_DATA, adv, sizeof(adv));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 1, "Different data matched");
+
+	/* The filter without the Company Identifier. */
+	adv[0] = 0x34;
+	adv[2] = 0x42;
+	memset(&report, 0, sizeof(report));
+	ad_append(&report, BT_DATA_MANUFACTURER_DATA, adv, sizeof(adv));
+	report_replay(&reports[0].addr, report.data, report.len);
+	zassert_equal(match_cnt, 2, "Data of any company not matched");
+}
+
+static void test_pool_exhausted(void)
+{
+	bt_addr_le_t addr;
+	int err = 0;
+	u32_t added;
+
+	test_reset();
+
+	for (added = 0; added < CONFIG_BT_SCAN_FILTER_POOL_SIZE; added++) {
+		tag_addr_get(&addr, added);
+		err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_ADDR, &addr);
+		if (err) {
+			break;
+		}
+	}
+
+	zassert_equal(err, -ENOMEM, "Pool not exhausted");
+	zassert_true(added > TAG_CNT, "Pool too small");
+
+	/* Removing the filters releases the memory. */
+	bt_scan_filter_remove_all();
+	tag_addr_get(&addr, 0);
+	zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_ADDR, &addr), 0,
+		      "Memory not released");
+}
+
+/* Reference implementation comparing every filter with the report. */
+static bt_addr_le_t ref_addr[TAG_CNT];
+static char ref_name[NAME_FILTER_CNT][16];
+static u16_t ref_uuid[UUID_FILTER_CNT];
+
+static bool ref_data_check(struct bt_data *data, void *user_data)
+{
+	bool *match = user_data;
+
+	if (data->type == BT_DATA_NAME_COMPLETE) {
+		for (size_t i = 0; i < NAME_FILTER_CNT; i++) {
+			if (strncmp(ref_name[i], (const char *)data->data,
+				    data->data_len) == 0) {
+				*match = true;
+			}
+		}
+	} else if (data->type == BT_DATA_UUID16_SOME) {
+		for (size_t i = 0; i < UUID_FILTER_CNT; i++) {
+			for (size_t j = 0; j < data->data_len; j += 2) {
+				if (sys_get_le16(&data->data[j]) ==
+				    ref_uuid[i]) {
+					*match = true;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool ref_match(const struct adv_report *report)
+{
+	struct net_buf_simple ad;
+	bool match = false;
+
+	for (size_t i = 0; i < TAG_CNT; i++) {
+		if (bt_addr_le_cmp(&report->addr, &ref_addr[i]) == 0) {
+			match = true;
+		}
+	}
+
+	ad_init(&ad, report->data, report->len);
+	bt_data_parse(&ad, ref_data_check, &match);
+
+	return match;
+}
+
+static void test_replay_benchmark(void)
+{
+	size_t ref_match_cnt = 0;
+	u32_t start;
+	u32_t scan_cycles;
+	u32_t ref_cycles;
+
+	test_reset();
+
+	for (u32_t i = 0; i < TAG_CNT; i++) {
+		tag_addr_get(&ref_addr[i], i);
+		zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_ADDR,
+						 &ref_addr[i]), 0,
+			      "Address filter not added");
+	}
+
+	for (u32_t i = 0; i < NAME_FILTER_CNT; i++) {
+		tag_name_get(ref_name[i], sizeof(ref_name[i]), i);
+		zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_NAME,
+						 ref_name[i]), 0,
+			      "Name filter not added");
+	}
+
+	for (u32_t i = 0; i < UUID_FILTER_CNT; i++) {
+		struct bt_uuid_16 uuid = BT_UUID_INIT_16(TAG_UUID_BASE + i);
+
+		ref_uuid[i] = uuid.val;
+		zassert_equal(bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID,
+						 &uuid.uuid), 0,
+			      "UUID filter not added");
+	}
+
+	zassert_equal(bt_scan_filter_enable(BT_SCAN_ADDR_FILTER |
+					    BT_SCAN_NAME_FILTER |
+					    BT_SCAN_UUID_FILTER, false),
+		      0, "Filter not enabled");
+
+	start = k_cycle_get_32();
+	for (u32_t round = 0; round < REPLAY_ROUNDS; round++) {
+		for (u32_t i = 0; i < REPORT_CNT; i++) {
+			report_replay(&reports[i].addr, reports[i].data,
+				      reports[i].len);
+		}
+	}
+	scan_cycles = k_cycle_get_32() - start;
+
+	start = k_cycle_get_32();
+	for (u32_t round = 0; round < REPLAY_ROUNDS; round++) {
+		for (u32_t i = 0; i < REPORT_CNT; i++) {
+			ref_match_cnt += ref_match(&reports[i]);
+		}
+	}
+	ref_cycles = k_cycle_get_32() - start;
+
+	zassert_equal(match_cnt, ref_match_cnt,
+		      "Result differs from the reference");
+	zassert_equal(match_cnt, REPLAY_ROUNDS * TAG_CNT,
+		      "Wrong number of matches");
+
+	TC_PRINT("%u reports, %u filters\n", REPLAY_ROUNDS * REPORT_CNT,
+		 TAG_CNT + NAME_FILTER_CNT + UUID_FILTER_CNT);
+	TC_PRINT("Scan module: %u cycles per report\n",
+		 scan_cycles / (REPLAY_ROUNDS * REPORT_CNT));
+	TC_PRINT("Linear reference: %u cycles per report\n",
+		 ref_cycles / (REPLAY_ROUNDS * REPORT_CNT));
+}
+
+void test_main(void)
+{
+	ztest_test_suite(scan_test,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test(test_addr_filter),
+			 ztest_unit_test(test_name_filter),
+			 ztest_unit_test(test_uuid_filter_all_mode),
+			 ztest_unit_test(test_uuid_128_filter),
+			 ztest_unit_test(test_manufacturer_data_filter),
+			 ztest_unit_test(test_pool_exhausted),
+			 ztest_unit_test(test_replay_benchmark)
+			 );
+	ztest_run_test_suite(scan_test);
+}
@@ -0,0 +1,6 @@
+/* generated file copied to simplify building the test */
+#ifndef PM_CONFIG_H__
+#define PM_CONFIG_H__
+#define PM_CLOUD_QUEUE_STORAGE_ID 1
+#define PM_CLOUD_QUEUE_STORAGE_SIZE 0x400
+#endif /* PM_CONFIG_H__ */
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <string.h>
+#include <stdio.h>
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <ztest.h>
+#include <pm_config.h>
+#include <storage/flash_map.h>
+#include <net/cloud.h>
+#include <net/cloud_queue.h>
+
+#define SECTOR_SIZE	256
+#define SECTOR_COUNT	(PM_CLOUD_QUEUE_STORAGE_SIZE / SECTOR_SIZE)
+#define ERASED_VAL	0xff
+#define MSG_MAX_LEN	32
+#define MSG_LOG_LEN	64
+/* Long enough to replay the whole queue in batches. */
+#define REPLAY_WAIT	K_MSEC(50 * CONFIG_CLOUD_QUEUE_REPLAY_INTERVAL)
+
+/* Simulated flash */
+static u8_t flash_mem[PM_CLOUD_QUEUE_STORAGE_SIZE];
+static const struct flash_area flash_fa = {
+	.fa_id = PM_CLOUD_QUEUE_STORAGE_ID,
+	.fa_off = 0,
+	.fa_size = PM_CLOUD_QUEUE_STORAGE_SIZE,
+};
+
+int flash_area_open(u8_t id, const struct flash_area **fa)
+{
+	if (id != PM_CLOUD_QUEUE_STORAGE_ID) {
+		return -ENOENT;
+	}
+
+	*fa = &flash_fa;
+	return 0;
+}
+
+void flash_area_close(const struct flash_area *fa)
+{
+}
+
+int flash_area_read(const struct flash_area *fa, off_t off, void *dst,
+		    size_t len)
+{
+	zassert_true(off + len <= sizeof(flash_mem), "Read out of bounds");
+	memcpy(dst, &flash_mem[off], len);
+	return 0;
+}
+
+int flash_area_write(const struct flash_area *fa, off_t off, const void *src,
+		     size_t len)
+{
+	const u8_t *data = src;
+
+	zassert_true(off + len <= sizeof(flash_mem), "Write out of bounds");
+	for (size_t i = 0; i < len; i++) {
+		/* Flash bits can only be cleared by a write. */
+		zassert_equal(flash_mem[off + i] & data[i], data[i],
+			      "Write to non-erased flash");
+		flash_mem[off + i] = data[i];
+	}
+
+	return 0;
+}
+
+int flash_area_erase(const struct flash_area *fa, off_t off, size_t len)
+{
+	zassert_true(off + len <= sizeof(flash_mem), "Erase out of bounds");
+	zassert_equal(off % SECTOR_SIZE, 0, "Unaligned erase");
+	memset(&flash_mem[off], ERASED_VAL, len);
+	return 0;
+}
+
+u8_t flash_area_align(const struct flash_area *fa)
+{
+	return 1;
+}
+
+u8_t flash_area_erased_val(const struct flash_area *fa)
+{
+	return ERASED_VAL;
+}
+
+int flash_area_get_sectors(int fa_id, u32_t *count,
+			   struct flash_sector *sectors)
+{
+	zassert_true(*count >= SECTOR_COUNT, "Sector array too small");
+
+	for (size_t i = 0; i < SECTOR_COUNT; i++) {
+		sectors[i].fs_off = i * SECTOR_SIZE;
+		sectors[i].fs_size = SECTOR_SIZE;
+	}
+
+	*count = SECTOR_COUNT;
+	return 0;
+}
+
+/* Fake backend standing in for the MQTT broker */
+static char sent_log[MSG_LOG_LEN][MSG_MAX_LEN + 1];
+static size_t sent_count;
+static int fail_after = -1;
+
+static int fake_send(const struct cloud_backend *const backend,
+		     const struct cloud_msg *const msg)
+{
+	zassert_true(msg->len <= MSG_MAX_LEN, "Unexpected message length");
+	zassert_equal(msg->endpoint.type, CLOUD_EP_TOPIC_MSG,
+		      "Endpoint type not preserved");
+
+	if ((fail_after >= 0) && (sent_count >= fail_after)) {
+		return -ENOTCONN;
+	}
+
+	zassert_true(sent_count < MSG_LOG_LEN, "Too many messages sent");
+	memcpy(sent_log[sent_count], msg->buf, msg->len);
+	sent_log[sent_count][msg->len] = '\0';
+	sent_count++;
+
+	return 0;
+}
+
+static const struct cloud_api fake_api = {
+	.send = fake_send,
+};
+
+static struct cloud_backend_config fake_config = {
+	.name = "FAKE",
+};
+
+static const struct cloud_backend fake_backend = {
+	.api = &fake_api,
+	.config = &fake_config,
+};
+
+static void msg_put(int id)
+{
+	char buf[MSG_MAX_LEN];
+	struct cloud_msg msg = {
+		.buf = buf,
+		.qos = CLOUD_QOS_AT_MOST_ONCE,
+		.endpoint.type = CLOUD_EP_TOPIC_MSG,
+	};
+
+	msg.len = snprintf(buf, sizeof(buf), "{\"msg\":%d}", id);
+
+	zassert_equal(cloud_queue_put(&msg), 0, "Message not queued");
+}
+
+static void msg_check(size_t idx, int id)
+{
+	char expected[MSG_MAX_LEN];
+
+	snprintf(expected, sizeof(expected), "{\"msg\":%d}", id);
+	zassert_true(strcmp(sent_log[idx], expected) == 0,
+		     "Message %d replayed out of order", id);
+}
+
+static void test_reset(void)
+{
+	sent_count = 0;
+	fail_after = -1;
+}
+
+static void test_cloud_queue_init(void)
+{
+	struct cloud_queue_stats stats;
+
+	memset(flash_mem, ERASED_VAL, sizeof(flash_mem));
+
+	zassert_equal(cloud_queue_init(), 0, "Init failed");
+
+	cloud_queue_stats_get(&stats);
+	zassert_equal(stats.depth, 0, "Queue not empty");
+}
+
+static void test_cloud_queue_replay_in_order(void)
+{
+	struct cloud_queue_stats stats;
+	struct cloud_queue_stats before;
+	const int msg_cnt = 10;
+
+	test_reset();
+	cloud_queue_stats_get(&before);
+
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_put(i);
+	}
+
+	cloud_queue_stats_get(&stats);
+	zassert_equal(stats.depth, msg_cnt, "Wrong queue depth");
+	zassert_equal(sent_count, 0, "Message sent while offline");
+
+	zassert_equal(cloud_queue_replay_start(&fake_backend), 0,
+		      "Replay start failed");
+	k_sleep(REPLAY_WAIT);
+
+	zassert_equal(sent_count, msg_cnt, "Not all messages replayed");
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_check(i, i);
+	}
+
+	cloud_queue_stats_get(&stats);
+	zassert_equal(stats.depth, 0, "Queue not drained");
+	zassert_equal(stats.erases, before.erases,
+		      "Sector with free space erased on drain");
+}
+
+static void test_cloud_queue_send_failure(void)
+{
+	struct cloud_queue_stats stats;
+	const int msg_cnt = 5;
+
+	test_reset();
+
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_put(i);
+	}
+
+	/* Connection drops after the second message. */
+	fail_after = 2;
+	cloud_queue_replay_start(&fake_backend);
+	k_sleep(REPLAY_WAIT);
+
+	cloud_queue_stats_get(&stats);
+	zassert_equal(sent_count, 2, "Replay did not stop on failure");
+	zassert_equal(stats.depth, msg_cnt - 2, "Failed message lost");
+
+	/* Reconnect */
+	fail_after = -1;
+	cloud_queue_replay_start(&fake_backend);
+	k_sleep(REPLAY_WAIT);
+
+	zassert_equal(sent_count, msg_cnt, "Not all messages replayed");
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_check(i, i);
+	}
+}
+
+static void test_cloud_queue_send_during_replay(void)
+{
+	char buf[MSG_MAX_LEN];
+	struct cloud_msg msg = {
+		.buf = buf,
+		.qos = CLOUD_QOS_AT_MOST_ONCE,
+		.endpoint.type = CLOUD_EP_TOPIC_MSG,
+	};
+	const int msg_cnt = 6;
+
+	test_reset();
+
+	for (int i = 0; i < msg_cnt - 1; i++) {
+		msg_put(i);
+	}
+
+	cloud_queue_replay_start(&fake_backend);
+
+	/* The new message must not overtake the queued ones. */
+	msg.len = snprintf(buf, sizeof(buf), "{\"msg\":%d}", msg_cnt - 1);
+	zassert_equal(cloud_queue_send(&fake_backend, &msg), 0,
+		      "Send failed");
+	k_sleep(REPLAY_WAIT);
+
+	zassert_equal(sent_count, msg_cnt, "Not all messages sent");
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_check(i, i);
+	}
+
+	/* Sent directly once the queue is empty. */
+	zassert_equal(cloud_queue_send(&fake_backend, &msg), 0,
+		      "Send failed");
+	zassert_equal(sent_count, msg_cnt + 1, "Message not sent directly");
+}
+
+static void test_cloud_queue_replay_after_reset(void)
+{
+	struct cloud_queue_stats stats;
+	const int msg_cnt = 8;
+
+	test_reset();
+
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_put(i);
+	}
+
+	/* Only what is in flash survives the reset. */
+	cloud_queue_uninit();
+	zassert_equal(cloud_queue_init(), 0, "Init failed");
+
+	cloud_queue_stats_get(&stats);
+	zassert_equal(stats.depth, msg_cnt, "Queued messages lost on reset");
+
+	cloud_queue_replay_start(&fake_backend);
+	k_sleep(REPLAY_WAIT);
+
+	zassert_equal(sent_count, msg_cnt, "Not all messages replayed");
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_check(i, i);
+	}
+
+	/* The drained queue stays empty after the next reset. */
+	cloud_queue_uninit();
+	zassert_equal(cloud_queue_init(), 0, "Init failed");
+
+	cloud_queue_stats_get(&stats);
+	zassert_equal(stats.depth, 0, "Replayed messages recovered");
+
+	cloud_queue_replay_start(&fake_backend);
+	k_sleep(REPLAY_WAIT);
+
+	zassert_equal(sent_count, msg_cnt, "Replayed messages sent again");
+}
+
+static void test_cloud_queue_drop_oldest(void)
+{
+	struct cloud_queue_stats stats;
+	struct cloud_queue_stats before;
+	const int msg_cnt = 80;
+	u32_t dropped;
+
+	test_reset();
+	cloud_queue_stats_get(&before);
+
+	for (int i = 0; i < msg_cnt; i++) {
+		msg_put(i);
+	}
+
+	cloud_queue_stats_get(&stats);
+	dropped = stats.dropped - before.dropped;
+	zassert_true(dropped > 0, "Queue did not overflow");
+	zassert_equal(stats.depth + dropped, msg_cnt, "Messages unaccounted");
+
+	cloud_queue_replay_start(&fake_backend);
+	k_sleep(REPLAY_WAIT);
+
+	zassert_equal(sent_count, msg_cnt - dropped, "Wrong replay count");
+	for (int i = 0; i < sent_count; i++) {
+		msg_check(i, dropped + i);
+	}
+}
+
+static void test_cloud_queue_msg_too_large(void)
+{
+	static char buf[CONFIG_CLOUD_QUEUE_MSG_SIZE_MAX + 1];
+	struct cloud_msg msg = {
+		.buf = buf,
+		.len = sizeof(buf),
+		.endpoint.type = CLOUD_EP_TOPIC_MSG,
+	};
+
+	zassert_equal(cloud_queue_put(&msg), -EMSGSIZE,
+		      "Oversized message accepted");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(cloud_queue_test,
+			 ztest_unit_test(test_cloud_queue_init),
+			 ztest_unit_test(test_cloud_queue_replay_in_order),
+			 ztest_unit_test(test_cloud_queue_send_failure),
+			 ztest_unit_test(test_cloud_queue_send_during_replay),
+			 ztest_unit_test(test_cloud_queue_replay_after_reset),
+			 ztest_unit_test(test_cloud_queue_drop_oldest),
+			 ztest_unit_test(test_cloud_queue_msg_too_large)
+			 );
+	ztest_run_test_suite(cloud_queue_test);
+}
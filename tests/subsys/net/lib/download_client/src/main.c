@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <string.h>
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <ztest.h>
+#include <net/socket.h>
+#include <net/coap.h>
+#include <net/download_client.h>
+
+#define SERVER_HOST	"coap://127.0.0.1"
+#define SERVER_PORT	5683
+#define FILE_PATH	"fw/app.bin"
+#define FILE_SIZE	1000
+#define BLOCK_SIZE	CONFIG_DOWNLOAD_CLIENT_COAP_BLOCK_SIZE
+#define BLOCK_COUNT	((FILE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define DGRAM_MAX	256
+#define TIMEOUT_MS	CONFIG_DOWNLOAD_CLIENT_COAP_TIMEOUT_MS
+#define NO_BLOCK	UINT32_MAX
+
+#define SERVER_STACK_SIZE	2048
+#define SERVER_PRIORITY		K_PRIO_PREEMPT(5)
+
+static struct download_client dl;
+static u8_t file[FILE_SIZE];
+static u8_t received[FILE_SIZE];
+static size_t received_len;
+static int download_err;
+static K_SEM_DEFINE(download_sem, 0, 1);
+
+/* Behavior of the CoAP server */
+static u32_t server_lost_block;
+static u32_t server_late_block;
+static u8_t server_late_rsp[DGRAM_MAX];
+static size_t server_late_len;
+static u8_t server_requests[BLOCK_COUNT];
+static bool server_error;
+static int server_fd;
+
+static K_THREAD_STACK_DEFINE(server_stack, SERVER_STACK_SIZE);
+static struct k_thread server_thread;
+
+/* Build the response to a block request, returns its length or 0. */
+static size_t server_respond(u8_t *req, size_t req_len, u8_t *rsp,
+			     u32_t *block)
+{
+	struct coap_packet request;
+	struct coap_packet response;
+	u8_t token[8];
+	u8_t tkl;
+	int block2;
+	u32_t num;
+	size_t off;
+	size_t len;
+	bool more;
+	int err;
+
+	err = coap_packet_parse(&request, req, req_len, NULL, 0);
+	if (err) {
+		return 0;
+	}
+
+	block2 = coap_get_option_int(&request, COAP_OPTION_BLOCK2);
+	if (block2 < 0) {
+		return 0;
+	}
+
+	/* The requested block size is always accepted */
+	num = block2 >> 4;
+	off = num * BLOCK_SIZE;
+	if (off >= FILE_SIZE) {
+		return 0;
+	}
+
+	len = MIN(BLOCK_SIZE, FILE_SIZE - off);
+	more = (off + len) < FILE_SIZE;
+
+	tkl = coap_header_get_token(&request, token);
+
+	err = coap_packet_init(&response, rsp, DGRAM_MAX, 1, COAP_TYPE_NON_CON,
+			       tkl, token, COAP_RESPONSE_CODE_CONTENT,
+			       coap_next_id());
+	if (err) {
+		return 0;
+	}
+
+	err = coap_append_option_int(&response, COAP_OPTION_BLOCK2,
+				     block2 | (more << 3));
+	if (err) {
+		return 0;
+	}
+
+	if (coap_get_option_int(&request, COAP_OPTION_SIZE2) >= 0) {
+		err = coap_append_option_int(&response, COAP_OPTION_SIZE2,
+					     FILE_SIZE);
+		if (err) {
+			return 0;
+		}
+	}
+
+	err = coap_packet_append_payload_marker(&response);
+	if (err) {
+		return 0;
+	}
+
+	err = coap_packet_append_payload(&response, &file[off], len);
+	if (err) {
+		return 0;
+	}
+
+	*block = num;
+
+	return response.offset;
+}
+
+/* CoAP server on the loopback interface, which can lose the response to
+ * one block and delay the response to another one past the next response.
+ */
+static void server_run(void *a, void *b, void *c)
+{
+	static u8_t req[DGRAM_MAX];
+	static u8_t rsp[DGRAM_MAX];
+	struct sockaddr from;
+	socklen_t from_len;
+	ssize_t req_len;
+	size_t rsp_len;
+	u32_t block;
+
+	while (true) {
+		from_len = sizeof(from);
+		req_len = recvfrom(server_fd, req, sizeof(req), 0, &from,
+				   &from_len);
+		if (req_len <= 0) {
+			server_error = true;
+			continue;
+		}
+
+		rsp_len = server_respond(req, req_len, rsp, &block);
+		if (rsp_len == 0) {
+			server_error = true;
+			continue;
+		}
+
+		server_requests[block]++;
+
+		if (block == server_lost_block) {
+			server_lost_block = NO_BLOCK;
+			continue;
+		}
+
+		if (block == server_late_block) {
+			server_late_block = NO_BLOCK;
+			memcpy(server_late_rsp, rsp, rsp_len);
+			server_late_len = rsp_len;
+			continue;
+		}
+
+		(void)sendto(server_fd, rsp, rsp_len, 0, &from, from_len);
+
+		if (server_late_len > 0) {
+			(void)sendto(server_fd, server_late_rsp,
+				     server_late_len, 0, &from, from_len);
+			server_late_len = 0;
+		}
+	}
+}
+
+static int download_client_callback(const struct download_client_evt *evt)
+{
+	switch (evt->id) {
+	case DOWNLOAD_CLIENT_EVT_FRAGMENT:
+		if (received_len + evt->fragment.len > sizeof(received)) {
+			download_err = -EFBIG;
+			k_sem_give(&download_sem);
+			return -1;
+		}
+		memcpy(&received[received_len], evt->fragment.buf,
+		       evt->fragment.len);
+		received_len += evt->fragment.len;
+		return 0;
+	case DOWNLOAD_CLIENT_EVT_DONE:
+		k_sem_give(&download_sem);
+		return 0;
+	case DOWNLOAD_CLIENT_EVT_ERROR:
+		download_err = evt->error;
+		k_sem_give(&download_sem);
+		return -1;
+	default:
+		return 0;
+	}
+}
+
+/* Download the file from the loopback server, returns the duration. */
+static s64_t download_run(size_t from)
+{
+	const struct download_client_cfg cfg = {
+		.port = SERVER_PORT,
+		.sec_tag = -1,
+	};
+	s64_t start;
+	int err;
+
+	received_len = 0;
+	download_err = 0;
+	k_sem_reset(&download_sem);
+
+	err = download_client_connect(&dl, SERVER_HOST, &cfg);
+	zassert_equal(err, 0, "Cannot connect");
+
+	start = k_uptime_get();
+
+	err = download_client_start(&dl, FILE_PATH, from);
+	zassert_equal(err, 0, "Cannot start download");
+
+	err = k_sem_take(&download_sem, K_MSEC(3 * TIMEOUT_MS));
+	zassert_equal(err, 0, "Download did not finish");
+
+	start = k_uptime_delta(&start);
+
+	err = download_client_disconnect(&dl);
+	zassert_equal(err, 0, "Cannot disconnect");
+
+	zassert_equal(download_err, 0, "Download failed");
+	zassert_false(server_error, "Invalid request");
+	zassert_equal(received_len, FILE_SIZE - from, "Wrong length");
+	zassert_mem_equal(received, &file[from], received_len,
+			  "Wrong content");
+
+	return start;
+}
+
+static void test_setup(void)
+{
+	server_lost_block = NO_BLOCK;
+	server_late_block = NO_BLOCK;
+	server_late_len = 0;
+	server_error = false;
+	memset(server_requests, 0, sizeof(server_requests));
+}
+
+static void test_init(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(SERVER_PORT),
+		.sin_addr = INADDR_LOOPBACK_INIT,
+	};
+	int err;
+
+	for (size_t i = 0; i < sizeof(file); i++) {
+		file[i] = (u8_t)(i * 7 + (i >> 8));
+	}
+
+	server_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	zassert_true(server_fd >= 0, "Cannot create server socket");
+
+	err = bind(server_fd, (struct sockaddr *)&addr, sizeof(addr));
+	zassert_equal(err, 0, "Cannot bind server socket");
+
+	test_setup();
+	k_thread_create(&server_thread, server_stack,
+			K_THREAD_STACK_SIZEOF(server_stack), server_run,
+			NULL, NULL, NULL, SERVER_PRIORITY, 0, K_NO_WAIT);
+
+	err = download_client_init(&dl, download_client_callback);
+	zassert_equal(err, 0, "Cannot init download client");
+}
+
+static void test_download(void)
+{
+	test_setup();
+
+	download_run(0);
+
+	for (size_t i = 0; i < BLOCK_COUNT; i++) {
+		zassert_equal(server_requests[i], 1, "Block requested twice");
+	}
+}
+
+static void test_download_resume(void)
+{
+	test_setup();
+
+	/* Resume in the middle of the second block */
+	download_run(100);
+
+	zassert_equal(server_requests[0], 0, "Downloaded blocks requested");
+}
+
+static void test_download_lost_response(void)
+{
+	s64_t duration;
+
+	test_setup();
+	server_lost_block = 2;
+
+	duration = download_run(0);
+
+	/* The next block reveals the loss, without waiting for a timeout */
+	zassert_true(server_requests[2] >= 2, "Lost block not requested");
+	zassert_true(duration < TIMEOUT_MS, "Lost block found by timeout");
+}
+
+static void test_download_reordered(void)
+{
+	s64_t duration;
+
+	test_setup();
+	server_late_block = 2;
+
+	duration = download_run(0);
+
+	zassert_true(duration < TIMEOUT_MS, "Late block found by timeout");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(download_client_test,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test(test_download),
+			 ztest_unit_test(test_download_resume),
+			 ztest_unit_test(test_download_lost_response),
+			 ztest_unit_test(test_download_reordered)
+			 );
+	ztest_run_test_suite(download_client_test);
+}
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2020 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#include <string.h>
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <ztest.h>
+#include <net/coap.h>
+#include <net/download_client.h>
+#include <logging/log.h>
+
+#include "coap.h"
+
+LOG_MODULE_REGISTER(download_client, CONFIG_DOWNLOAD_CLIENT_LOG_LEVEL);
+
+#define FILE_PATH	"fw/app.bin"
+#define FILE_SIZE	1000
+#define BLOCK_SIZE	CONFIG_DOWNLOAD_CLIENT_COAP_BLOCK_SIZE
+#define BLOCK_SZX	2 /* 64 bytes */
+#define BLOCK_COUNT	((FILE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define DGRAM_MAX	CONFIG_DOWNLOAD_CLIENT_MAX_RESPONSE_SIZE
+#define INFLIGHT_MAX	8
+#define TOKEN_OFFSET	4 /* Token follows the fixed CoAP header */
+
+struct dgram {
+	u8_t data[DGRAM_MAX];
+	size_t len;
+};
+
+static struct download_client dl;
+static u8_t file[FILE_SIZE];
+static u8_t received[FILE_SIZE];
+static size_t received_len;
+
+/* Requests sent by the client and not answered yet */
+static struct dgram inflight[INFLIGHT_MAX];
+static size_t inflight_cnt;
+static size_t inflight_max;
+static size_t requests_total;
+
+/* Behavior of the server stand-in */
+static u8_t server_szx_max;
+static bool server_size2;
+static bool server_not_found;
+
+static void requests_send(void)
+{
+	int len;
+
+	while ((len = dl_coap_request_build(&dl)) > 0) {
+		zassert_true(inflight_cnt < INFLIGHT_MAX, "Too many requests");
+		memcpy(inflight[inflight_cnt].data, dl.buf, len);
+		inflight[inflight_cnt].len = len;
+		inflight_cnt++;
+		requests_total++;
+	}
+
+	zassert_equal(len, 0, "Cannot build request");
+	inflight_max = MAX(inflight_max, inflight_cnt);
+}
+
+static void request_drop(size_t idx)
+{
+	zassert_true(idx < inflight_cnt, "No such request");
+
+	inflight_cnt--;
+	memmove(&inflight[idx], &inflight[idx + 1],
+		(inflight_cnt - idx) * sizeof(inflight[0]));
+}
+
+static bool uri_path_check(const struct coap_option *opt, const char *str)
+{
+	return (opt->len == strlen(str)) &&
+	       (memcmp(opt->value, str, opt->len) == 0);
+}
+
+/* CoAP server stand-in, serving the test file block by block. */
+static size_t server_respond(struct dgram *req, u8_t *rsp)
+{
+	struct coap_packet request;
+	struct coap_packet response;
+	struct coap_option path[4];
+	u8_t token[8];
+	u8_t tkl;
+	int block2;
+	u32_t num;
+	u8_t szx;
+	size_t off;
+	size_t len;
+	bool more;
+	int err;
+
+	err = coap_packet_parse(&request, req->data, req->len, NULL, 0);
+	zassert_equal(err, 0, "Invalid request");
+	zassert_equal(coap_header_get_type(&request), COAP_TYPE_NON_CON,
+		      "Request not non-confirmable");
+	zassert_equal(coap_header_get_code(&request), COAP_METHOD_GET,
+		      "Request not a GET");
+
+	err = coap_find_options(&request, COAP_OPTION_URI_PATH, path,
+				ARRAY_SIZE(path));
+	zassert_equal(err, 2, "Wrong number of Uri-Path options");
+	zassert_true(uri_path_check(&path[0], "fw"), "Wrong Uri-Path");
+	zassert_true(uri_path_check(&path[1], "app.bin"), "Wrong Uri-Path");
+
+	block2 = coap_get_option_int(&request, COAP_OPTION_BLOCK2);
+	zassert_true(block2 >= 0, "No Block2 option");
+	zassert_equal(block2 & 0x08, 0, "More flag set in request");
+
+	num = block2 >> 4;
+	szx = block2 & 0x07;
+	if (szx > server_szx_max) {
+		/* Late negotiation, RFC 7959 section 2.4 */
+		num <<= (szx - server_szx_max);
+		szx = server_szx_max;
+	}
+
+	off = num << (szx + 4);
+	zassert_true(off < FILE_SIZE, "Block past the end of the file");
+
+	len = MIN(BIT(szx + 4), FILE_SIZE - off);
+	more = (off + len) < FILE_SIZE;
+
+	tkl = coap_header_get_token(&request, token);
+
+	err = coap_packet_init(&response, rsp, DGRAM_MAX, 1, COAP_TYPE_NON_CON,
+			       tkl, token,
+			       server_not_found ? COAP_RESPONSE_CODE_NOT_FOUND :
+						  COAP_RESPONSE_CODE_CONTENT,
+			       coap_next_id());
+	zassert_equal(err, 0, "Cannot init response");
+
+	if (server_not_found) {
+		return response.offset;
+	}
+
+	err = coap_append_option_int(&response, COAP_OPTION_BLOCK2,
+				     (num << 4) | (more << 3) | szx);
+	zassert_equal(err, 0, "Cannot add Block2");
+
+	if (server_size2 &&
+	    (coap_get_option_int(&request, COAP_OPTION_SIZE2) >= 0)) {
+		err = coap_append_option_int(&response, COAP_OPTION_SIZE2,
+					     FILE_SIZE);
+		zassert_equal(err, 0, "Cannot add Size2");
+	}
+
+	err = coap_packet_append_payload_marker(&response);
+	zassert_equal(err, 0, "Cannot add payload marker");
+	err = coap_packet_append_payload(&response, &file[off], len);
+	zassert_equal(err, 0, "Cannot add payload");
+
+	return response.offset;
+}
+
+/* Answer the request at idx, returns the result of dl_coap_parse(). */
+static int response_deliver(size_t idx)
+{
+	size_t len;
+	int rc;
+
+	len = server_respond(&inflight[idx], dl.buf);
+	request_drop(idx);
+
+	rc = dl_coap_parse(&dl, len);
+	if (rc == 0) {
+		zassert_true(received_len + dl.offset <= sizeof(received),
+			     "Received too much");
+		zassert_true(dl.offset <= dl.fragment_size,
+			     "Fragment too large");
+		memcpy(&received[received_len], dl.buf, dl.offset);
+		received_len += dl.offset;
+	}
+
+	return rc;
+}
+
+static bool download_done(void)
+{
+	return (dl.file_size != 0) && (dl.progress == dl.file_size);
+}
+
+static void transfer_run(void)
+{
+	requests_send();
+
+	while (!download_done()) {
+		zassert_true(inflight_cnt > 0, "Transfer stalled");
+		zassert_true(response_deliver(0) >= 0, "Response rejected");
+		requests_send();
+	}
+}
+
+static void transfer_check(size_t from)
+{
+	zassert_equal(dl.file_size, FILE_SIZE, "Wrong file size");
+	zassert_equal(received_len, FILE_SIZE - from, "Wrong length");
+	zassert_mem_equal(received, &file[from], received_len,
+			  "Wrong content");
+}
+
+static void test_setup(size_t from)
+{
+	memset(&dl, 0, sizeof(dl));
+	dl.file = FILE_PATH;
+	dl.progress = from;
+	dl_coap_block_init(&dl, from);
+
+	received_len = 0;
+	inflight_cnt = 0;
+	inflight_max = 0;
+	requests_total = 0;
+
+	server_szx_max = 6;
+	server_size2 = true;
+	server_not_found = false;
+}
+
+static void test_init(void)
+{
+	for (size_t i = 0; i < sizeof(file); i++) {
+		file[i] = (u8_t)(i * 7 + (i >> 8));
+	}
+}
+
+static void test_download_pipelined(void)
+{
+	test_setup(0);
+	zassert_equal(dl.fragment_size, BLOCK_SIZE, "Wrong fragment size");
+
+	transfer_run();
+
+	transfer_check(0);
+	zassert_equal(requests_total, BLOCK_COUNT, "Blocks requested twice");
+	zassert_equal(inflight_max, CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW,
+		      "Requests not pipelined");
+}
+
+static void test_download_resume(void)
+{
+	/* Resume in the middle of the second block */
+	test_setup(100);
+
+	transfer_run();
+
+	transfer_check(100);
+}
+
+static void test_download_no_size(void)
+{
+	test_setup(0);
+	server_size2 = false;
+
+	transfer_run();
+
+	transfer_check(0);
+	zassert_equal(inflight_max, 1, "Pipelined without the file size");
+}
+
+static void test_download_smaller_blocks(void)
+{
+	size_t next_off;
+
+	test_setup(0);
+	server_szx_max = BLOCK_SZX - 1;
+
+	requests_send();
+	next_off = dl.coap.next_block * BLOCK_SIZE;
+
+	zassert_equal(response_deliver(0), 0, "Response rejected");
+
+	/* The pipelined requests are not requested again */
+	zassert_equal((size_t)dl.coap.next_block << (dl.coap.szx + 4),
+		      next_off, "Next block not rescaled");
+
+	transfer_run();
+
+	transfer_check(0);
+	zassert_equal(dl.fragment_size, BLOCK_SIZE / 2, "Block size kept");
+}
+
+static void test_download_lost_response(void)
+{
+	test_setup(0);
+
+	requests_send();
+	zassert_equal(response_deliver(0), 0, "First block rejected");
+	requests_send();
+	zassert_equal(inflight_cnt, CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW,
+		      "Window not filled");
+
+	/* The response to the second block is lost */
+	request_drop(0);
+
+	/* The next block reveals the loss, no timeout needed */
+	zassert_equal(response_deliver(0), 1, "Out of order block accepted");
+	requests_send();
+	zassert_equal(inflight_cnt, 1 + CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW,
+		      "Missing blocks not requested again");
+
+	/* The blocks in flight are not requested a third time */
+	zassert_equal(response_deliver(0), 1, "Out of order block accepted");
+	requests_send();
+	zassert_equal(inflight_cnt, CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW,
+		      "Missing blocks requested twice");
+
+	transfer_run();
+
+	transfer_check(0);
+	zassert_equal(requests_total,
+		      BLOCK_COUNT + CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW,
+		      "Wrong number of requests");
+	zassert_equal(dl.coap.retransmits, 0, "Timeout needed");
+}
+
+static void test_download_reordered(void)
+{
+	test_setup(0);
+
+	requests_send();
+	zassert_equal(response_deliver(0), 0, "First block rejected");
+	requests_send();
+
+	/* The third block overtakes the second one */
+	zassert_equal(response_deliver(1), 1, "Out of order block accepted");
+	requests_send();
+
+	transfer_run();
+
+	transfer_check(0);
+	zassert_equal(requests_total,
+		      BLOCK_COUNT + CONFIG_DOWNLOAD_CLIENT_COAP_WINDOW,
+		      "Wrong number of requests");
+	zassert_equal(dl.coap.retransmits, 0, "Timeout needed");
+}
+
+static void test_download_timeout(void)
+{
+	test_setup(0);
+
+	for (int i = 0; i < CONFIG_DOWNLOAD_CLIENT_COAP_MAX_RETRANSMIT; i++) {
+		zassert_equal(dl_coap_retransmit(&dl), 0,
+			      "Retransmission failed");
+	}
+
+	zassert_equal(dl_coap_retransmit(&dl), -ETIMEDOUT,
+		      "Retransmissions not limited");
+}
+
+static void test_download_wrong_token(void)
+{
+	size_t len;
+
+	test_setup(0);
+
+	requests_send();
+	len = server_respond(&inflight[0], dl.buf);
+	dl.buf[TOKEN_OFFSET] ^= 0xff;
+
+	zassert_equal(dl_coap_parse(&dl, len), 1, "Foreign response accepted");
+	zassert_equal(dl.progress, 0, "Progress changed");
+}
+
+static void test_download_not_found(void)
+{
+	test_setup(0);
+	server_not_found = true;
+
+	requests_send();
+
+	zassert_equal(response_deliver(0), -1, "Error response accepted");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(download_client_coap_test,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test(test_download_pipelined),
+			 ztest_unit_test(test_download_resume),
+			 ztest_unit_test(test_download_no_size),
+			 ztest_unit_test(test_download_smaller_blocks),
+			 ztest_unit_test(test_download_lost_response),
+			 ztest_unit_test(test_download_reordered),
+			 ztest_unit_test(test_download_timeout),
+			 ztest_unit_test(test_download_wrong_token),
+			 ztest_unit_test(test_download_not_found)
+			 );
+	ztest_run_test_suite(download_client_coap_test);
+}